@@ -3,18 +3,36 @@
 #include "AliasInstrumentation.h"
 #include "RegionCloneUtil.h"
 
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/AliasSetTracker.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 
 using namespace llvm;
 using namespace lge;
+using namespace lge::pra;
+
+#define DEBUG_TYPE "alias-instrumentation"
+
+STATISTIC(NumPairChecks, "Number of pointer pairs that may alias");
+STATISTIC(NumReadOnlyPairs, "Number of read-only pointer pairs not checked");
+STATISTIC(NumFastChecks, "Number of range checks always evaluated");
+STATISTIC(NumSlowChecks, "Number of range checks evaluated if hulls overlap");
+STATISTIC(NumReusedChecks, "Number of range checks reused from other regions");
+STATISTIC(NumClonedInstructions, "Number of instructions in cloned regions");
+STATISTIC(NumOverBudgetRegions, "Number of regions not cloned due to the "
+                                "growth budget");
+STATISTIC(NumHoistedRegions, "Number of regions with checks hoisted out of "
+                             "enclosing loops");
 
 // Scope selection flags to be used from both Clang and Opt.
 static cl::opt<bool>
@@ -30,6 +48,18 @@ static cl::opt<bool> AliasInstrumentationStats(
     "alias-checks-stats", cl::desc("Show DBG stats for alias instrumentation"),
     cl::init(false), cl::ZeroOrMore);
 
+static cl::opt<bool> HoistAliasChecks(
+    "hoist-alias-checks",
+    cl::desc("Hoist alias checks out of loops where their bounds are "
+             "invariant"),
+    cl::init(true), cl::ZeroOrMore);
+
+static cl::opt<unsigned> AliasChecksGrowth(
+    "alias-checks-growth",
+    cl::desc("Maximum growth of a function by cloned regions, in percent of "
+             "its instructions"),
+    cl::init(100), cl::ZeroOrMore);
+
 template <typename T>
 std::pair<T, T> makeOrderedPair(const T &t1, const T &t2) {
   return (t1 < t2) ? std::make_pair(t1, t2) : std::make_pair(t2, t1);
@@ -61,6 +91,53 @@ static bool regionHasLoop(Region *R, LoopInfo *LI) {
   return false;
 }
 
+namespace {
+// Checks if the bounds of an access function have the same value out of loop
+// L as in the region: L doesn't appear in its recurrences, the trip counts of
+// the loops nested in L are invariant in L and no operand is defined in L.
+// Divisions by non-constant values are rejected, since the hoisted check may
+// run even if the region doesn't.
+struct HoistableBoundsChecker {
+  ScalarEvolution *SE;
+  const Loop *L;
+  bool Hoistable;
+
+  HoistableBoundsChecker(ScalarEvolution *SE, const Loop *L)
+      : SE(SE), L(L), Hoistable(true) {}
+
+  bool follow(const SCEV *S) {
+    if (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(S)) {
+      const Loop *AddRecLoop = AddRec->getLoop();
+
+      if (AddRecLoop == L)
+        Hoistable = false;
+      else if (L->contains(AddRecLoop)) {
+        if (!SE->hasLoopInvariantBackedgeTakenCount(AddRecLoop))
+          Hoistable = false;
+        else {
+          const SCEV *BECount = SE->getBackedgeTakenCount(AddRecLoop);
+          if (!SE->isLoopInvariant(BECount, L))
+            Hoistable = false;
+          else
+            visitAll(BECount, *this);
+        }
+      }
+    } else if (const SCEVUnknown *Unknown = dyn_cast<SCEVUnknown>(S)) {
+      if (Instruction *Inst = dyn_cast<Instruction>(Unknown->getValue()))
+        if (L->contains(Inst))
+          Hoistable = false;
+    } else if (const SCEVUDivExpr *Div = dyn_cast<SCEVUDivExpr>(S)) {
+      if (!isa<SCEVConstant>(Div->getRHS()))
+        Hoistable = false;
+    }
+
+    return Hoistable;
+  }
+
+  bool isDone() const { return !Hoistable; }
+};
+} // end anonymous namespace
+
 void AliasInstrumentation::fixAliasInfo(Region *R) {
   MDBuilder MDB(CurrentFn->getContext());
   if (!MDDomain)
@@ -126,13 +203,23 @@ void AliasInstrumentation::buildNoAliasClone(Region *R, Value *CheckResult) {
   if (!CheckResult)
     return;
 
+  unsigned CloneSize = getCloneSize(R);
+  ClonedInstructions += CloneSize;
+  NumClonedInstructions += CloneSize;
+
   // Collect stats before cloning the region. The number of loops guarded by the
   // checks is the same as the number of loop headers within the region.
   if (AliasInstrumentationStats)
-    for (const BasicBlock *BB : R->blocks())
+    for (const BasicBlock *BB : R->blocks()) {
       if (LI->getLoopFor(BB) && LI->getLoopFor(BB)->getHeader() == BB)
         ClonedLoops++;
 
+      std::string IR;
+      raw_string_ostream OS(IR);
+      BB->print(OS);
+      ClonedIRBytes += OS.str().size();
+    }
+
   Region *ClonedRegion = cloneRegion(R, nullptr, RI, DT, DF);
   registerClonedBlocks(R);
   registerClonedBlocks(ClonedRegion);
@@ -163,38 +250,53 @@ Value *AliasInstrumentation::chainChecks(std::vector<Value *> Checks,
 }
 
 Value *AliasInstrumentation::buildRangeCheck(
-    Value *BasePtrA, Value *BasePtrB, std::pair<Value *, Value *> BoundsA,
-    std::pair<Value *, Value *> BoundsB, BuilderType *Builder,
-    SCEVRangeBuilder *RangeBuilder) {
-  Value *LowerA = BoundsA.first;
-  Value *UpperA = BoundsA.second;
-  Value *LowerB = BoundsB.first;
-  Value *UpperB = BoundsB.second;
-
-  // Stretch both upper bounds past the last addressable byte.
-  UpperA = RangeBuilder->stretchPtrUpperBound(BasePtrA, UpperA);
-  UpperB = RangeBuilder->stretchPtrUpperBound(BasePtrB, UpperB);
-
-  // Cast all bounds to i8* (equivalent to void*, according to the LLVM manual).
-  Type *I8PtrTy = Builder->getInt8PtrTy();
-  LowerA = RangeBuilder->InsertNoopCastOfTo(LowerA, I8PtrTy);
-  LowerB = RangeBuilder->InsertNoopCastOfTo(LowerB, I8PtrTy);
-  UpperA = RangeBuilder->InsertNoopCastOfTo(UpperA, I8PtrTy);
-  UpperB = RangeBuilder->InsertNoopCastOfTo(UpperB, I8PtrTy);
-
+    std::pair<Value *, Value *> BoundsA, std::pair<Value *, Value *> BoundsB,
+    BuilderType *Builder, const Twine &Name) {
   // Build actual interval comparisons.
-  Value *AIsBeforeB = Builder->CreateICmpULE(UpperA, LowerB);
-  Value *BIsBeforeA = Builder->CreateICmpULE(UpperB, LowerA);
+  Value *AIsBeforeB = Builder->CreateICmpULE(BoundsA.second, BoundsB.first);
+  Value *BIsBeforeA = Builder->CreateICmpULE(BoundsB.second, BoundsA.first);
 
-  Value *Check = Builder->CreateOr(AIsBeforeB, BIsBeforeA, "pair-no-alias");
+  Value *Check = Builder->CreateOr(AIsBeforeB, BIsBeforeA, Name);
 
   return Check;
 }
 
+std::pair<Value *, Value *>
+AliasInstrumentation::buildHull(const std::set<Value *> &Ptrs,
+                                BoundMap &PointerBounds,
+                                BuilderType *Builder) {
+  std::pair<Value *, Value *> Hull = PointerBounds[*Ptrs.begin()];
+
+  for (auto I = std::next(Ptrs.begin()), E = Ptrs.end(); I != E; ++I) {
+    std::pair<Value *, Value *> Bounds = PointerBounds[*I];
+    Value *IsLower = Builder->CreateICmpULT(Bounds.first, Hull.first);
+    Value *IsUpper = Builder->CreateICmpUGT(Bounds.second, Hull.second);
+    Hull.first = Builder->CreateSelect(IsLower, Bounds.first, Hull.first);
+    Hull.second = Builder->CreateSelect(IsUpper, Bounds.second, Hull.second);
+  }
+
+  return Hull;
+}
+
+std::set<Value *> AliasInstrumentation::getWrittenPointers(Region *R) {
+  std::set<Value *> Written;
+
+  for (auto &Pair : PtrRA->RegionsRangeData[R].BasePtrsData)
+    for (Instruction *Inst : Pair.second.AccessInstructions)
+      if (Inst->mayWriteToMemory()) {
+        Written.insert(Pair.first);
+        break;
+      }
+
+  return Written;
+}
+
 bool
 AliasInstrumentation::computePtrsDependence(Region *R,
                                             ValuePairSet *PtrPairsToCheck) {
+  ValuePairSet ReadOnlyPairs;
   AliasSetTracker AST(*AA);
+  std::set<Value *> Written = getWrittenPointers(R);
 
   // We only consider dependencies within the region.
   for (BasicBlock *BB : R->blocks())
@@ -221,24 +323,178 @@ AliasInstrumentation::computePtrsDependence(Region *R,
 
         // Guarantees ordered pairs (avoids repetition).
         auto Dep = makeOrderedPair(BasePtr, AliasingPtr);
+
+        // Read-only pointers can't create dependencies between themselves.
+        if (!Written.count(BasePtr) && !Written.count(AliasingPtr)) {
+          if (ReadOnlyPairs.insert(Dep).second)
+            NumReadOnlyPairs++;
+          continue;
+        }
+
         PtrPairsToCheck->insert(Dep);
       }
     }
   }
+
+  return !PtrPairsToCheck->empty();
 }
 
 void AliasInstrumentation::buildSCEVBounds(Region *R,
+                                           const std::set<Value *> &Ptrs,
                                            SCEVRangeBuilder *RangeBuilder,
                                            BoundMap *PointerBounds) {
-  // Compute access bounds for each base pointer analysed in the region.
-  for (auto &Pair : PtrRA->RegionsRangeData[R].BasePtrsData) {
-    Value *Low = RangeBuilder->getULowerBound(Pair.second.AccessFunctions);
-    Value *Up = RangeBuilder->getUUpperBound(Pair.second.AccessFunctions);
+  Instruction *InsertPt = RangeBuilder->getInsertPoint();
+
+  // Compute access bounds for each base pointer checked in the region.
+  for (Value *Ptr : Ptrs) {
+    BoundKey Key = getBoundKey(R, Ptr);
+
+    // Reuse the bounds computed for another region, if available.
+    auto Inserted = InsertedBounds.find(Key);
+    if ((Inserted != InsertedBounds.end()) &&
+        isAvailableAt(Inserted->second.first, InsertPt) &&
+        isAvailableAt(Inserted->second.second, InsertPt)) {
+      PointerBounds->insert(std::make_pair(Ptr, Inserted->second));
+      continue;
+    }
+
+    auto &AccessFunctions =
+        PtrRA->RegionsRangeData[R].BasePtrsData[Ptr].AccessFunctions;
+    Value *Low = RangeBuilder->getULowerBound(AccessFunctions);
+    Value *Up = RangeBuilder->getUUpperBound(AccessFunctions);
 
     assert((Low && Up) &&
            "All access expressions should have computable SCEV bounds by now");
 
-    PointerBounds->insert(std::make_pair(Pair.first, std::make_pair(Low, Up)));
+    // Stretch the upper bound past the last addressable byte.
+    Up = RangeBuilder->stretchPtrUpperBound(Ptr, Up);
+
+    // Cast both bounds to i8* (equivalent to void*, according to the LLVM
+    // manual).
+    Type *I8PtrTy = Type::getInt8PtrTy(CurrentFn->getContext());
+    Low = RangeBuilder->InsertNoopCastOfTo(Low, I8PtrTy);
+    Up = RangeBuilder->InsertNoopCastOfTo(Up, I8PtrTy);
+
+    PointerBounds->insert(std::make_pair(Ptr, std::make_pair(Low, Up)));
+    InsertedBounds[Key] = std::make_pair(Low, Up);
+  }
+}
+
+bool AliasInstrumentation::isAvailableAt(Value *V, Instruction *InsertPt) {
+  Instruction *Inst = dyn_cast<Instruction>(V);
+  return !Inst || (Inst->getParent() && DT->dominates(Inst, InsertPt));
+}
+
+AliasInstrumentation::BoundKey AliasInstrumentation::getBoundKey(Region *R,
+                                                                 Value *Ptr) {
+  std::vector<const SCEV *> AccessFunctions =
+      PtrRA->RegionsRangeData[R].BasePtrsData[Ptr].AccessFunctions;
+
+  std::sort(AccessFunctions.begin(), AccessFunctions.end());
+  AccessFunctions.erase(
+      std::unique(AccessFunctions.begin(), AccessFunctions.end()),
+      AccessFunctions.end());
+
+  return std::make_pair(Ptr, AccessFunctions);
+}
+
+AliasInstrumentation::CheckKey
+AliasInstrumentation::getCheckKey(Region *R, std::pair<Value *, Value *> Pair) {
+  return std::make_pair(getBoundKey(R, Pair.first),
+                        getBoundKey(R, Pair.second));
+}
+
+Instruction *
+AliasInstrumentation::getCheckInsertPoint(Region *R,
+                                          const std::set<Value *> &Ptrs) {
+  Instruction *InsertPt = R->getEnteringBlock()->getTerminator();
+
+  if (!HoistAliasChecks)
+    return InsertPt;
+
+  std::set<const SCEV *> AccessFunctions;
+  for (Value *Ptr : Ptrs) {
+    auto &PtrData = PtrRA->RegionsRangeData[R].BasePtrsData[Ptr];
+    AccessFunctions.insert(PtrData.AccessFunctions.begin(),
+                           PtrData.AccessFunctions.end());
+  }
+
+  // Find the innermost loop that encloses the region.
+  Loop *L = LI->getLoopFor(R->getEntry());
+  while (L && R->contains(L))
+    L = L->getParentLoop();
+
+  // Move the checks out of each enclosing loop, while they don't depend on its
+  // iterations.
+  for (; L; L = L->getParentLoop()) {
+    BasicBlock *Preheader = L->getLoopPreheader();
+
+    if (!Preheader || R->contains(Preheader) || ClonedBlocks.count(Preheader) ||
+        !DT->dominates(Preheader, R->getEnteringBlock()))
+      break;
+
+    bool Hoistable = true;
+    for (const SCEV *Expr : AccessFunctions) {
+      HoistableBoundsChecker Checker(SE, L);
+      visitAll(Expr, Checker);
+
+      if (!Checker.Hoistable) {
+        Hoistable = false;
+        break;
+      }
+    }
+
+    if (!Hoistable)
+      break;
+
+    // The operands of the bounds must also be available in the pre-header.
+    SCEVRangeBuilder RangeBuilder(SE, CurrentFn->getParent()->getDataLayout(),
+        AA, LI, DT, R, Preheader->getTerminator());
+    if (!RangeBuilder.canComputeBoundsFor(AccessFunctions))
+      break;
+
+    InsertPt = Preheader->getTerminator();
+  }
+
+  return InsertPt;
+}
+
+Value *AliasInstrumentation::getPairCheck(Region *R,
+                                          std::pair<Value *, Value *> Pair,
+                                          BoundMap &PointerBounds,
+                                          BuilderType *Builder) {
+  CheckKey Key = getCheckKey(R, Pair);
+
+  auto Inserted = InsertedPairChecks.find(Key);
+  if ((Inserted != InsertedPairChecks.end()) &&
+      isAvailableAt(Inserted->second, &*Builder->GetInsertPoint())) {
+    NumReusedChecks++;
+    return Inserted->second;
+  }
+
+  Value *Check = buildRangeCheck(PointerBounds[Pair.first],
+                                 PointerBounds[Pair.second], Builder,
+                                 "pair-no-alias");
+  InsertedPairChecks[Key] = Check;
+  NumFastChecks++;
+
+  return Check;
+}
+
+void AliasInstrumentation::registerCheckBlocks(BasicBlock *From,
+                                               BasicBlock *To) {
+  std::vector<BasicBlock *> Worklist(1, From);
+
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.back();
+    Worklist.pop_back();
+
+    if (!ClonedBlocks.insert(BB).second || (BB == To))
+      continue;
+
+    TerminatorInst *TI = BB->getTerminator();
+    for (unsigned i = 0; i < TI->getNumSuccessors(); i++)
+      Worklist.push_back(TI->getSuccessor(i));
   }
 }
 
@@ -350,20 +606,92 @@ void AliasInstrumentation::simplifyRegion(Region *R) {
         [&](BasicBlock *BB){ R->replaceExitRecursive(BB); });
 }
 
+Value *AliasInstrumentation::insertSlowPath(Value *HullCheck,
+                                            const ValuePairSet &Pairs,
+                                            BoundMap &PointerBounds,
+                                            BuilderType *Builder) {
+  // Split the checks block: the pairwise checks are placed in a new block
+  // between the fast path and the block that branches to the region.
+  //          fast path
+  //     T .------'------. F
+  //       |          slow path
+  //       '------.------'
+  //         \|/ (phi)
+  BasicBlock *Fast = Builder->GetInsertBlock();
+  BasicBlock *Merge = SplitBlock(Fast, &*Builder->GetInsertPoint(), DT, LI);
+  BasicBlock *Slow = BasicBlock::Create(CurrentFn->getContext(),
+                                        Fast->getName() + ".slow-checks",
+                                        CurrentFn, Merge);
+  DT->addNewBlock(Slow, Fast);
+  if (Loop *L = LI->getLoopFor(Fast))
+    L->addBasicBlockToLoop(Slow, *LI);
+  if (Region *Parent = RI->getRegionFor(Fast)) {
+    RI->setRegionFor(Merge, Parent);
+    RI->setRegionFor(Slow, Parent);
+  }
+
+  Fast->getTerminator()->eraseFromParent();
+  Builder->SetInsertPoint(Fast);
+  Builder->CreateCondBr(HullCheck, Merge, Slow);
+
+  Builder->SetInsertPoint(Slow);
+  std::vector<Value *> PairwiseChecks;
+  for (auto &Pair : Pairs)
+    PairwiseChecks.push_back(buildRangeCheck(PointerBounds[Pair.first],
+                                             PointerBounds[Pair.second],
+                                             Builder, "pair-no-alias"));
+  Value *SlowResult = chainChecks(PairwiseChecks, Builder);
+  Builder->CreateBr(Merge);
+  NumSlowChecks += Pairs.size();
+
+  Builder->SetInsertPoint(Merge->getFirstNonPHI());
+  PHINode *Result = Builder->CreatePHI(Builder->getInt1Ty(), 2,
+                                       "hull-no-alias");
+  Result->addIncoming(Builder->getTrue(), Fast);
+  Result->addIncoming(SlowResult, Slow);
+
+  Builder->SetInsertPoint(Merge->getTerminator());
+  return Result;
+}
+
 Value *AliasInstrumentation::insertDynamicChecks(Region *R) {
   ValuePairSet PtrPairsToCheck;
-  computePtrsDependence(R, &PtrPairsToCheck);
 
   // If there are no conflicting pointers, don't instrument anything.
-  if (PtrPairsToCheck.size() == 0)
+  if (!computePtrsDependence(R, &PtrPairsToCheck))
     return nullptr;
 
+  NumPairChecks += PtrPairsToCheck.size();
+
   // Create an entering block to receive the checks.
   simplifyRegion(R);
 
+  // A region that compares the same pointers, with the same bounds, of a
+  // region instrumented before shares its result.
+  std::set<CheckKey> RegionKey;
+  std::set<Value *> Ptrs;
+  for (auto &Pair : PtrPairsToCheck) {
+    RegionKey.insert(getCheckKey(R, Pair));
+    Ptrs.insert(Pair.first);
+    Ptrs.insert(Pair.second);
+  }
+
+  auto Inserted = InsertedRegionChecks.find(RegionKey);
+  if ((Inserted != InsertedRegionChecks.end()) &&
+      isAvailableAt(Inserted->second,
+                    R->getEnteringBlock()->getTerminator())) {
+    NumReusedChecks += PtrPairsToCheck.size();
+    return Inserted->second;
+  }
+
   // Set instruction insertion context. We'll insert the run-time tests in the
-  // region entering block.
-  Instruction *InsertPt = R->getEnteringBlock()->getTerminator();
+  // region entering block, or in the pre-header of an enclosing loop.
+  Instruction *InsertPt = getCheckInsertPoint(R, Ptrs);
+  BasicBlock *CheckBlock = InsertPt->getParent();
+  bool Hoisted = (CheckBlock != R->getEnteringBlock());
+  if (Hoisted)
+    NumHoistedRegions++;
+
   SCEVRangeBuilder RangeBuilder(SE, CurrentFn->getParent()->getDataLayout(), AA,
       LI, DT, R, InsertPt);
   BuilderType Builder(CurrentFn->getContext(),
@@ -371,21 +699,61 @@ Value *AliasInstrumentation::insertDynamicChecks(Region *R) {
   Builder.SetInsertPoint(InsertPt);
 
   BoundMap PointerBounds;
-  buildSCEVBounds(R, &RangeBuilder, &PointerBounds);
+  buildSCEVBounds(R, Ptrs, &RangeBuilder, &PointerBounds);
 
-  std::vector<Value *> PairwiseChecks;
+  // Pairs of written pointers are always checked. Pairs of a written and a
+  // read-only pointer are grouped under the hull check.
+  std::set<Value *> Written = getWrittenPointers(R);
+  std::set<Value *> WrittenSide, ReadOnlySide;
+  ValuePairSet MixedPairs;
+  std::vector<Value *> FastChecks;
 
-  // Insert comparison expressions for every pair of pointers that need to be
-  // checked in the region.
   for (auto &Pair : PtrPairsToCheck) {
-    auto Check =
-        buildRangeCheck(Pair.first, Pair.second, PointerBounds[Pair.first],
-                        PointerBounds[Pair.second], &Builder, &RangeBuilder);
-    PairwiseChecks.push_back(Check);
+    bool FirstWritten = Written.count(Pair.first);
+    bool SecondWritten = Written.count(Pair.second);
+
+    if (FirstWritten && SecondWritten) {
+      FastChecks.push_back(getPairCheck(R, Pair, PointerBounds, &Builder));
+      continue;
+    }
+
+    MixedPairs.insert(Pair);
+    WrittenSide.insert(FirstWritten ? Pair.first : Pair.second);
+    ReadOnlySide.insert(FirstWritten ? Pair.second : Pair.first);
+  }
+
+  Value *Result;
+
+  // A hull check only pays off if it replaces more than one pairwise check.
+  if (MixedPairs.size() < 2) {
+    for (auto &Pair : MixedPairs)
+      FastChecks.push_back(getPairCheck(R, Pair, PointerBounds, &Builder));
+
+    // Combine all checks into a single boolean result using AND.
+    Result = chainChecks(FastChecks, &Builder);
+  } else {
+    Value *HullCheck = buildRangeCheck(
+        buildHull(WrittenSide, PointerBounds, &Builder),
+        buildHull(ReadOnlySide, PointerBounds, &Builder), &Builder,
+        "hull-no-alias");
+    Value *FastResult = chainChecks(FastChecks, &Builder);
+    NumFastChecks++;
+
+    Value *HullResult =
+        insertSlowPath(HullCheck, MixedPairs, PointerBounds, &Builder);
+
+    Result = FastResult
+                 ? Builder.CreateAnd(FastResult, HullResult, "region-no-alias")
+                 : HullResult;
   }
 
-  // Combine all checks into a single boolean result using AND.
-  return chainChecks(PairwiseChecks, &Builder);
+  // Cloning an enclosing region would leave the checks defined in only one of
+  // its versions.
+  if (Hoisted)
+    registerCheckBlocks(CheckBlock, Builder.GetInsertBlock());
+
+  InsertedRegionChecks[RegionKey] = Result;
+  return Result;
 }
 
 BasicBlock *AliasInstrumentation::getFnExitingBlock() {
@@ -429,6 +797,71 @@ bool AliasInstrumentation::canInstrument(Region *R) {
   return true;
 }
 
+std::set<Loop *> AliasInstrumentation::getAccessLoops(Region *R) {
+  std::set<Loop *> Loops;
+
+  for (auto &Pair : PtrRA->RegionsRangeData[R].BasePtrsData)
+    for (Instruction *Inst : Pair.second.AccessInstructions) {
+      Loop *L = LI->getLoopFor(Inst->getParent());
+
+      if (!L || !R->contains(L))
+        continue;
+
+      while (L->getParentLoop() && R->contains(L->getParentLoop()))
+        L = L->getParentLoop();
+
+      Loops.insert(L);
+    }
+
+  return Loops;
+}
+
+Region *AliasInstrumentation::getSmallestVersionedRegion(Region *R) {
+  std::set<Loop *> Loops = getAccessLoops(R);
+  Region *Smallest = R;
+  bool Shrunk = !Loops.empty();
+
+  // Descend into the single child that contains all loops, while it can be
+  // instrumented by itself.
+  while (Shrunk) {
+    Shrunk = false;
+
+    for (auto SubRegion = Smallest->begin(), E = Smallest->end();
+         SubRegion != E; ++SubRegion) {
+      Region *Candidate = &(**SubRegion);
+      bool HasAllLoops = std::all_of(Loops.begin(), Loops.end(),
+          [&](Loop *L) { return Candidate->contains(L); });
+
+      if (!HasAllLoops)
+        continue;
+
+      if (canInstrument(Candidate) &&
+          (!RunRegionAliasInstrumentation ||
+           PtrRA->RegionsRangeData[Candidate].HasFullSideEffectInfo)) {
+        Smallest = Candidate;
+        Shrunk = true;
+      }
+
+      break;
+    }
+  }
+
+  return Smallest;
+}
+
+bool AliasInstrumentation::fitsGrowthBudget(Region *R) {
+  uint64_t Budget = (uint64_t)FunctionSize * AliasChecksGrowth / 100;
+
+  return ClonedInstructions + getCloneSize(R) <= Budget;
+}
+
+void AliasInstrumentation::instrumentSubRegions(Region *R) {
+  for (auto SubRegion = R->end(); SubRegion != R->begin();) {
+    --SubRegion;
+    instrumentRegion(&(**SubRegion));
+  }
+}
+
 void AliasInstrumentation::instrumentRegion(Region *R) {
   if (RunFunctionAliasInstrumentation && !canInstrument(R))
     return;
@@ -437,18 +870,24 @@ void AliasInstrumentation::instrumentRegion(Region *R) {
   // children (only instrument regions for which full range info is available).
   if (RunRegionAliasInstrumentation &&
      (!canInstrument(R) || !PtrRA->RegionsRangeData[R].HasFullSideEffectInfo)) {
+    instrumentSubRegions(R);
+    return;
+  }
 
-    // Traverse children in reverse order, so we reach dominated regions first.
-    for (auto SubRegion = R->end(); SubRegion != R->begin();) {
-      --SubRegion;
-      instrumentRegion(&(**SubRegion));
-    }
+  // Only clone the code around the loops if it can't be avoided. If even the
+  // smallest region doesn't fit the growth budget, its children might.
+  Region *Target = getSmallestVersionedRegion(R);
+  if (!fitsGrowthBudget(Target)) {
+    NumOverBudgetRegions++;
+
+    if (RunRegionAliasInstrumentation)
+      instrumentSubRegions(Target);
 
     return;
   }
 
-  Value *CheckResult = insertDynamicChecks(R);
-  buildNoAliasClone(R, CheckResult);
+  Value *CheckResult = insertDynamicChecks(Target);
+  buildNoAliasClone(Target, CheckResult);
 }
 
 bool AliasInstrumentation::runOnFunction(llvm::Function &F) {
@@ -464,6 +903,10 @@ bool AliasInstrumentation::runOnFunction(llvm::Function &F) {
   CurrentFn = &F;
 
   releaseMemory();
+
+  for (Function::iterator BBIt = F.begin(), BE = F.end(); BBIt != BE; ++BBIt)
+    FunctionSize += BBIt->size();
+
   instrumentRegion(RI->getTopLevelRegion());
 
   // Print final stats.
@@ -481,7 +924,8 @@ bool AliasInstrumentation::runOnFunction(llvm::Function &F) {
     if (TotalLoops > 0)
       std::cerr << "[RESTRICTIFICATION] function: " << std::string(F.getName()) <<
         ", total-loops: " << TotalLoops << ", restrictified-loops: " <<
-        ClonedLoops << std::endl;
+        ClonedLoops << ", cloned-instructions: " << ClonedInstructions <<
+        ", cloned-ir-bytes: " << ClonedIRBytes << std::endl;
   }
 
   return true;
@@ -522,6 +966,6 @@ INITIALIZE_PASS_DEPENDENCY(DominanceFrontier);
 INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass);
 INITIALIZE_PASS_DEPENDENCY(RegionInfoPass);
 INITIALIZE_PASS_DEPENDENCY(ScalarEvolution);
-INITIALIZE_PASS_DEPENDENCY(PtrRangeAnalysis);
+INITIALIZE_PASS_DEPENDENCY(PraPtrRangeAnalysis);
 INITIALIZE_PASS_END(AliasInstrumentation, "alias-instrumentation",
                     "Insert alias checks and clone regions", false, false)
@@ -41,6 +41,7 @@
 #include <functional>
 #include <map>
 #include <set>
+#include <vector>
 
 using namespace llvm;
 
@@ -51,6 +52,11 @@ class AliasInstrumentation : public FunctionPass {
   typedef std::map<Value *, std::pair<Value *, Value *>> BoundMap;
   typedef std::set<std::pair<Value *, Value *>> ValuePairSet;
 
+  // The bounds of a base pointer are identified by the pointer and the sorted
+  // list of its access functions, and a check by the bounds it compares.
+  typedef std::pair<Value *, std::vector<const SCEV *>> BoundKey;
+  typedef std::pair<BoundKey, BoundKey> CheckKey;
+
   // Analyses used.
   ScalarEvolution *SE;
   AliasAnalysis *AA;
@@ -58,7 +64,7 @@ class AliasInstrumentation : public FunctionPass {
   RegionInfo *RI;
   DominatorTree *DT;
   DominanceFrontier *DF;
-  PtrRangeAnalysis *PtrRA;
+  pra::PtrRangeAnalysis *PtrRA;
 
   // Function being analysed.
   Function *CurrentFn;
@@ -68,12 +74,42 @@ class AliasInstrumentation : public FunctionPass {
 
   std::set<BasicBlock*> ClonedBlocks;
 
+  // Bounds and checks already inserted in the current function. They are
+  // reused by every region instrumented later whose checks they dominate.
+  std::map<BoundKey, std::pair<Value *, Value *>> InsertedBounds;
+  std::map<CheckKey, Value *> InsertedPairChecks;
+  std::map<std::set<CheckKey>, Value *> InsertedRegionChecks;
+
+  // Number of instructions in the function before instrumentation, and number
+  // of instructions cloned so far. Used by the growth budget.
+  size_t FunctionSize;
+  size_t ClonedInstructions;
+
   // [DBG]
   size_t ClonedLoops;
+  size_t ClonedIRBytes;
 
-  // Walks the region tree, instrumenting the greatest possible regions.
+  // Walks the region tree, instrumenting the greatest possible regions. Each
+  // one is narrowed to its smallest descendant containing all its loops, and
+  // must fit the growth budget.
   void instrumentRegion(Region *R);
 
+  // Instruments the children of R. They are traversed in reverse order, so we
+  // reach dominated regions first.
+  void instrumentSubRegions(Region *R);
+
+  // Returns the outermost loops of R that contain accesses to the pointers
+  // analysed in R. These are the loops that benefit from the no-alias version.
+  std::set<Loop *> getAccessLoops(Region *R);
+
+  // Returns the smallest region, R or one of its descendants, that contains
+  // all access loops of R and can be instrumented. Code around the loops is
+  // not worth cloning.
+  Region *getSmallestVersionedRegion(Region *R);
+
+  // Checks if cloning R keeps the function within its growth budget.
+  bool fitsGrowthBudget(Region *R);
+
   // Checks if there are basic properties that prevent us from instrumenting
   // this region, e.g., no exit block or absence of loops.
   bool canInstrument(Region *R);
@@ -84,15 +120,54 @@ class AliasInstrumentation : public FunctionPass {
 
   // Generates dynamic checks that compare the access range of every pair of
   // pointers in the region at run-time, thus finding if there is true aliasing.
-  // For every pair (A,B) of pointers in the region that may alias, we generate:
+  // For every pair (A,B) of pointers in the region that may alias, and such
+  // that at least one of them is written, we generate:
   // - check(A, B) -> upperAddrA + sizeOfA <= lowerAddrB ||
   //                  upperAddrB + sizeOfB <= lowerAddrA
+  // Pairs of a written and a read-only pointer are first tested at once, by
+  // comparing the hull of the written pointers with the hull of the read-only
+  // ones. Their pairwise checks are only evaluated if the hulls overlap:
+  //
+  //   region-no-alias = check(W1, W2) && ... &&
+  //                     (check(hull(W), hull(R)) ||
+  //                      (check(W1, R1) && check(W1, R2) && ...))
+  //
   // The instructions needed for the checks compuation are inserted in the
-  // entering block of the target region, which works as a pre-header. The
-  // returned Instruction produces a boolean value that, at run-time, indicates
-  // if the region is free of dependencies.
+  // entering block of the target region, which works as a pre-header, or in
+  // the pre-header of the outermost enclosing loop in which the bounds are
+  // invariant. Checks already inserted for the same pointers and bounds are
+  // reused. The returned Instruction produces a boolean value that, at
+  // run-time, indicates if the region is free of dependencies.
   Value *insertDynamicChecks(Region *R);
 
+  // Returns the highest point, dominating the entering block of R, where the
+  // bounds of PTRS are available and have the same values they have in R.
+  Instruction *getCheckInsertPoint(Region *R, const std::set<Value *> &Ptrs);
+
+  // Returns true if V can be used at INSERT_PT.
+  bool isAvailableAt(Value *V, Instruction *InsertPt);
+
+  BoundKey getBoundKey(Region *R, Value *Ptr);
+  CheckKey getCheckKey(Region *R, std::pair<Value *, Value *> Pair);
+
+  // Returns the check of PAIR, reusing a previous one if it is available at
+  // the insertion point of BUILDER.
+  Value *getPairCheck(Region *R, std::pair<Value *, Value *> Pair,
+                      BoundMap &PointerBounds, BuilderType *Builder);
+
+  // Keeps the blocks between FROM and TO, which hold checks hoisted out of
+  // the regions they guard, from being cloned.
+  void registerCheckBlocks(BasicBlock *From, BasicBlock *To);
+
+  // Returns the base pointers written in the region.
+  std::set<Value *> getWrittenPointers(Region *R);
+
+  // Inserts the pairwise checks of PAIRS in a new block, executed only if
+  // HULL_CHECK fails. Returns the result of the checks, which is true if the
+  // hull check passes.
+  Value *insertSlowPath(Value *HullCheck, const ValuePairSet &Pairs,
+                        BoundMap &PointerBounds, BuilderType *Builder);
+
   // Create single entry and exit EDGES in a region (thus creating entering and
   // exiting blocks).
   void simplifyRegion(Region *R);
@@ -108,19 +183,28 @@ class AliasInstrumentation : public FunctionPass {
   // taken from LLVM's "SplitCriticalEdge()". Updates dominator info.
   BasicBlock *splitEdge(BasicBlock *Src, BasicBlock *Dst);
 
-  // Requests the insertion of the actual symbolic bounds expressions.
-  void buildSCEVBounds(Region *R, SCEVRangeBuilder *RangeBuilder,
+  // Requests the insertion of the actual symbolic bounds expressions of PTRS.
+  // The bounds are i8* values, and the upper bound is the address of the first
+  // byte after the memory accessed.
+  void buildSCEVBounds(Region *R, const std::set<Value *> &Ptrs,
+                       pra::SCEVRangeBuilder *RangeBuilder,
                        BoundMap *PointerBounds);
 
   // Determines which base pointers in the region need to be checked against
-  // eachother. We only checks pointers for which we have range info.
+  // eachother. We only checks pointers for which we have range info, and at
+  // least one of the pointers in a pair must be written. Returns false if no
+  // pair needs to be checked.
   bool computePtrsDependence(Region *R, ValuePairSet *PtrPairsToCheck);
 
   // Inserts the actual interval comparison.
-  Value *buildRangeCheck(Value *BasePtrA, Value *BasePtrB,
-                         std::pair<Value *, Value *> BoundsA,
+  Value *buildRangeCheck(std::pair<Value *, Value *> BoundsA,
                          std::pair<Value *, Value *> BoundsB,
-                         BuilderType *Builder, SCEVRangeBuilder *RangeBuilder);
+                         BuilderType *Builder, const Twine &Name);
+
+  // Computes the interval that contains the bounds of all pointers in PTRS.
+  std::pair<Value *, Value *> buildHull(const std::set<Value *> &Ptrs,
+                                        BoundMap &PointerBounds,
+                                        BuilderType *Builder);
 
   // Chain the checks that compare different pairs of pointers to a single
   // result value using "and" operations.
@@ -165,7 +249,13 @@ public:
   void releaseMemory()
   {
     ClonedBlocks.clear();
+    InsertedBounds.clear();
+    InsertedPairChecks.clear();
+    InsertedRegionChecks.clear();
+    FunctionSize = 0;
+    ClonedInstructions = 0;
     ClonedLoops = 0;
+    ClonedIRBytes = 0;
   }
 };
 
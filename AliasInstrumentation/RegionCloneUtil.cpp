@@ -69,6 +69,17 @@ static void cloneDominatorInfo(BasicBlock *BB,
   }
 }
 
+unsigned lge::getCloneSize(Region *R) {
+  unsigned Size = 0;
+
+  // Every instruction of the region is cloned. The phis added to the exit
+  // block for values used outside the region are not counted.
+  for (auto BB : R->blocks())
+    Size += BB->size();
+
+  return Size;
+}
+
 Region *lge::cloneRegion(Region *R, RGPassManager *RGM, RegionInfo *RI,
                          DominatorTree *DT, DominanceFrontier *DF) {
   ValueMap<const Value*, WeakVH> VMap;
@@ -21,6 +21,9 @@ namespace lge {
 // do our best to update both the region info tree and dominance info.
 Region *cloneRegion(Region *R, RGPassManager *RGM, RegionInfo *RI,
                           DominatorTree *DT, DominanceFrontier *DF);
+
+// Estimates the number of instructions cloneRegion adds to the function.
+unsigned getCloneSize(Region *R);
 }
 
 #endif
@@ -1,8 +1,13 @@
 // Author: Pericles Alves [periclesrafael@dcc.ufmg.br]
 
 #include "PtrRangeAnalysis.h"
+#include "commentsCache.h"
 
 #include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/Support/CommandLine.h>
@@ -16,11 +21,16 @@ using namespace lge;
 #define LOAD 1
 #define STORE 2
 #define LOADSTORE 3
+#define ALLOC 4
 
 STATISTIC(numMA , "Number of memory access"); 
 STATISTIC(numAMA , "Number of memory analyzed access");
 STATISTIC(numAA , "Number of arrays"); 
 STATISTIC(numAAA , "Number of analyzed arrays");
+STATISTIC(numMW , "Number of arrays written before read");
+STATISTIC(numSA , "Number of scratch arrays");
+STATISTIC(numRA , "Number of regions of the input analyzed");
+STATISTIC(numRS , "Number of regions of the input skipped");
 
 static cl::opt<bool> Cllicm("Ptr-licm",                      
     cl::desc("Use loop invariant code motion in Pointer Range Analysis.")); 
@@ -31,6 +41,15 @@ static cl::opt<bool> Clptru("Ptr-Unsafe",
 static cl::opt<bool> Clregion("Ptr-region",                      
     cl::desc("Rebuild regions in Pointer Range Analysis")); 
 
+static cl::opt<bool> ClMustWrite("Ptr-must-write",
+    cl::desc("Don't copy in the data of pointers written before read."));
+
+// Flags that change the comments, for the keys of the comments cache.
+static CacheFlag LicmFlag(Cllicm);
+static CacheFlag UnsafeFlag(Clptru);
+static CacheFlag RegionFlag(Clregion);
+static CacheFlag MustWriteFlag(ClMustWrite);
+
 Value *lge::getPointerOperand(Instruction *Inst) {
   if (LoadInst *Load = dyn_cast<LoadInst>(Inst))
     return Load->getPointerOperand();
@@ -134,12 +153,274 @@ char PtrRangeAnalysis::getPointerAcessType (Loop *L, Value *V) {
 }
 
 char PtrRangeAnalysis::getPointerAcessType (Region *R, Value *V) {
+  // Regions are analyzed on demand, so R may not be analyzed yet.
+  if (!PointerAccessRegion.count(R))
+    analyzeRegionPointers(R);
   if (PointerAccessRegion.count(R) &&
       PointerAccessRegion[R].count(V))
     return PointerAccessRegion[R][V];
   return LOADSTORE;
 }
 
+char PtrRangeAnalysis::getPointerAcessType (Loop *L, Region *R, Value *V) {
+  if (!ClMustWrite)
+    return L ? getPointerAcessType(L, V) : getPointerAcessType(R, V);
+
+  // Without "-Ptr-licm", the loops are not analyzed before.
+  if (L && !PointerAccess.count(L))
+    analyzeLoopPointers(L);
+  char Access = L ? getPointerAcessType(L, V) : getPointerAcessType(R, V);
+  if (!(Access & STORE) || !isWrittenBeforeRead(V, L, R))
+    return Access;
+
+  numMW++;
+  if (isScratchPointer(V, L, R)) {
+    numSA++;
+    return ALLOC;
+  }
+  return STORE;
+}
+
+BasicBlock *PtrRangeAnalysis::getZeroTripGuard (Loop *Lp) {
+  BasicBlock *Preheader = Lp->getLoopPreheader();
+  BasicBlock *Latch = Lp->getLoopLatch();
+  if (!Preheader || !Latch || (Lp->getExitingBlock() != Latch))
+    return nullptr;
+  BasicBlock *Guard = Preheader->getSinglePredecessor();
+  if (!Guard)
+    return nullptr;
+
+  BranchInst *GuardBr = dyn_cast<BranchInst>(Guard->getTerminator());
+  BranchInst *LatchBr = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!GuardBr || !LatchBr || !GuardBr->isConditional() ||
+      !LatchBr->isConditional())
+    return nullptr;
+  ICmpInst *GuardCmp = dyn_cast<ICmpInst>(GuardBr->getCondition());
+  ICmpInst *LatchCmp = dyn_cast<ICmpInst>(LatchBr->getCondition());
+  if (!GuardCmp || !LatchCmp)
+    return nullptr;
+
+  // Conditions to enter the loop, and to run one more iteration.
+  CmpInst::Predicate Enter = (GuardBr->getSuccessor(0) == Preheader) ?
+      GuardCmp->getPredicate() : GuardCmp->getInversePredicate();
+  CmpInst::Predicate Continue = (LatchBr->getSuccessor(0) == Lp->getHeader()) ?
+      LatchCmp->getPredicate() : LatchCmp->getInversePredicate();
+  if ((Enter != Continue) || (SE->getSCEV(GuardCmp->getOperand(1)) !=
+                              SE->getSCEV(LatchCmp->getOperand(1))))
+    return nullptr;
+
+  // The guard tests the first value of the induction variable, as the latch
+  // would do before the first iteration.
+  const SCEVAddRecExpr *IV =
+      dyn_cast<SCEVAddRecExpr>(SE->getSCEV(LatchCmp->getOperand(0)));
+  if (!IV || (IV->getLoop() != Lp) || !IV->isAffine())
+    return nullptr;
+  const SCEV *First = SE->getMinusSCEV(IV->getStart(),
+                                       IV->getStepRecurrence(*SE));
+  return (SE->getSCEV(GuardCmp->getOperand(0)) == First) ? Guard : nullptr;
+}
+
+bool PtrRangeAnalysis::runsInEveryIteration (BasicBlock *BB, Loop *L,
+                                             Region *R) {
+  BasicBlock *Current = BB;
+  Loop *Lp = LI->getLoopFor(BB);
+  while (Lp && (L ? L->contains(Lp) : R->contains(Lp))) {
+    SmallVector<BasicBlock*, 4> Exiting;
+    Lp->getExitingBlocks(Exiting);
+    for (unsigned i = 0, ie = Exiting.size(); i != ie; i++)
+      if (!DT->dominates(Current, Exiting[i]))
+        return false;
+    if (Lp == L)
+      return true;
+
+    // A loop skipped only when it has no iterations writes nothing, and its
+    // range is empty.
+    Current = Lp->getHeader();
+    if (BasicBlock *Guard = getZeroTripGuard(Lp))
+      Current = Guard;
+    Lp = Lp->getParentLoop();
+  }
+  if (L)
+    return Current == L->getHeader();
+
+  BasicBlock *Exit = R->getExit();
+  for (auto BB = R->block_begin(), BE = R->block_end(); BB != BE; BB++) {
+    TerminatorInst *TI = (*BB)->getTerminator();
+    bool Exiting = (TI->getNumSuccessors() == 0);
+    for (unsigned i = 0, ie = TI->getNumSuccessors(); i != ie; i++)
+      if (TI->getSuccessor(i) == Exit)
+        Exiting = true;
+    if (Exiting && !DT->dominates(Current, *BB))
+      return false;
+  }
+  return true;
+}
+
+bool PtrRangeAnalysis::isDenseAccess (const SCEV *AccessFunction,
+                                      const SCEV *BasePtr, uint64_t ElemSize,
+                                      Loop *L, Region *R) {
+  // Steps of the access in the loops of the computation.
+  std::vector<std::pair<const Loop*, const SCEV*> > Steps;
+  const SCEV *Offset = SE->getMinusSCEV(AccessFunction, BasePtr);
+  while (const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(Offset)) {
+    const Loop *Lp = AR->getLoop();
+    if (!(L ? L->contains(Lp) : R->contains(Lp)))
+      break;
+    if (!AR->isAffine())
+      return false;
+    Steps.push_back(std::make_pair(Lp, AR->getStepRecurrence(*SE)));
+    Offset = AR->getStart();
+  }
+
+  // The smallest step goes to the next element, and each other step goes
+  // over all the iterations of the previous one.
+  Type *Ty = SE->getEffectiveSCEVType(AccessFunction->getType());
+  std::vector<const SCEV*> Expected(1, SE->getConstant(Ty, ElemSize));
+  while (!Steps.empty()) {
+    unsigned k = 0, ke = Steps.size();
+    const SCEV *Step = nullptr;
+    for (; (k != ke) && !Step; k++)
+      for (unsigned e = 0, ee = Expected.size(); e != ee; e++)
+        if ((Steps[k].second == Expected[e]) ||
+            (Steps[k].second == SE->getNegativeSCEV(Expected[e])))
+          Step = Expected[e];
+    if (!Step)
+      return false;
+    const Loop *Lp = Steps[k - 1].first;
+    Steps.erase(Steps.begin() + (k - 1));
+
+    const SCEV *BTC = SE->getBackedgeTakenCount(Lp);
+    if (isa<SCEVCouldNotCompute>(BTC))
+      return false;
+    const SCEV *One = SE->getConstant(BTC->getType(), 1);
+    const SCEV *OneTy = SE->getConstant(Ty, 1);
+    const SCEV *TripCounts[] = {
+      SE->getAddExpr(SE->getTruncateOrZeroExtend(BTC, Ty), OneTy),
+      SE->getAddExpr(SE->getTruncateOrSignExtend(BTC, Ty), OneTy),
+      SE->getTruncateOrZeroExtend(SE->getAddExpr(BTC, One), Ty),
+      SE->getTruncateOrSignExtend(SE->getAddExpr(BTC, One), Ty)
+    };
+    Expected.clear();
+    for (const SCEV *TripCount : TripCounts)
+      Expected.push_back(SE->getMulExpr(Step, TripCount));
+  }
+  return true;
+}
+
+bool PtrRangeAnalysis::isWrittenBeforeRead (Value *BasePtr, Loop *L,
+                                            Region *R) {
+  RegionRangeInfo &Info = RegionsRangeData[R];
+  if (!Info.HasFullSideEffectInfo || !Info.BasePtrsData.count(BasePtr))
+    return false;
+  RegionRangeInfo::PtrRangeInfo &Data = Info.BasePtrsData[BasePtr];
+  const DataLayout &DL = CurrentFn->getParent()->getDataLayout();
+  const SCEV *Base = SE->getSCEV(BasePtr);
+
+  // Every access of the range must be in the computation, and go to the same
+  // element in each iteration.
+  std::vector<Instruction*> Stores, Loads;
+  const SCEV *AccessFunction = nullptr;
+  uint64_t ElemSize = 0;
+  for (unsigned i = 0, ie = Data.AccessInstructions.size(); i != ie; i++) {
+    Instruction *Inst = Data.AccessInstructions[i];
+    const SCEV *AF = Data.AccessFunctions[i];
+    if (!(L ? L->contains(Inst) : R->contains(Inst)) ||
+        (SE->getPointerBase(AF) != Base) ||
+        (AccessFunction && (AF != AccessFunction)))
+      return false;
+    AccessFunction = AF;
+
+    Type *Ty = Inst->getType();
+    if (StoreInst *SI = dyn_cast<StoreInst>(Inst)) {
+      Ty = SI->getValueOperand()->getType();
+      Stores.push_back(Inst);
+    }
+    else
+      Loads.push_back(Inst);
+    if (ElemSize && (ElemSize != DL.getTypeAllocSize(Ty)))
+      return false;
+    ElemSize = DL.getTypeAllocSize(Ty);
+  }
+  if (Stores.empty())
+    return false;
+
+  // Calls may access the data out of the ranges.
+  std::vector<BasicBlock*> Blocks;
+  if (L)
+    Blocks.assign(L->block_begin(), L->block_end());
+  else
+    for (auto BB = R->block_begin(), BE = R->block_end(); BB != BE; BB++)
+      Blocks.push_back(*BB);
+  for (unsigned i = 0, ie = Blocks.size(); i != ie; i++)
+    for (auto I = Blocks[i]->begin(), IE = Blocks[i]->end(); I != IE; I++) {
+      CallInst *CI = dyn_cast<CallInst>(I);
+      if (!CI || isa<DbgInfoIntrinsic>(CI))
+        continue;
+      if (isa<GlobalValue>(BasePtr) && !CI->doesNotAccessMemory())
+        return false;
+      for (unsigned j = 0, je = CI->getNumArgOperands(); j != je; j++)
+        if (GetUnderlyingObject(CI->getArgOperand(j), DL, 0) == BasePtr)
+          return false;
+    }
+
+  // Some store writes the whole range.
+  if (!isDenseAccess(AccessFunction, Base, ElemSize, L, R))
+    return false;
+  bool Covered = false;
+  for (unsigned i = 0, ie = Stores.size(); (i != ie) && !Covered; i++)
+    Covered = runsInEveryIteration(Stores[i]->getParent(), L, R);
+  if (!Covered)
+    return false;
+
+  // Each iteration reads the element after writing it.
+  for (unsigned i = 0, ie = Loads.size(); i != ie; i++) {
+    bool Written = false;
+    for (unsigned j = 0, je = Stores.size(); (j != je) && !Written; j++)
+      Written = DT->dominates(Stores[j], Loads[i]);
+    if (!Written)
+      return false;
+  }
+  return true;
+}
+
+bool PtrRangeAnalysis::isScratchPointer (Value *BasePtr, Loop *L, Region *R) {
+  if (!isa<AllocaInst>(BasePtr))
+    return false;
+
+  // Follow the addresses computed from the array to the instructions that
+  // access it.
+  std::vector<Value*> Worklist(1, BasePtr);
+  std::set<Value*> Visited;
+  while (!Worklist.empty()) {
+    Value *V = Worklist.back();
+    Worklist.pop_back();
+    for (User *U : V->users()) {
+      Instruction *I = dyn_cast<Instruction>(U);
+      if (!I)
+        return false;
+      if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) ||
+          isa<PHINode>(I) || isa<SelectInst>(I)) {
+        if (Visited.insert(I).second)
+          Worklist.push_back(I);
+        continue;
+      }
+      // Bounds of the ranges, and markers of the array.
+      if (isa<PtrToIntInst>(I) || isa<ICmpInst>(I) || isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(I))
+        if ((II->getIntrinsicID() == Intrinsic::lifetime_start) ||
+            (II->getIntrinsicID() == Intrinsic::lifetime_end))
+          continue;
+      if (!(L ? L->contains(I) : R->contains(I)))
+        return false;
+      if (StoreInst *SI = dyn_cast<StoreInst>(I))
+        if (SI->getValueOperand() == V)
+          return false;
+    }
+  }
+  return true;
+}
+
 void PtrRangeAnalysis::analyzeLoopPointers (Loop *L) {
   for (auto BB = L->block_begin(), BE = L->block_end(); BB != BE; BB++) {
     for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
@@ -670,7 +951,7 @@ void PtrRangeAnalysis::analyzeReducedRegion (Region *R) {
         }
       }
   }
-  RegionsRangeData[Rr] = RegionData;
+  RegionsRangeData.set(Rr, RegionData);
 }
 
 void PtrRangeAnalysis::collectRangeInfo(Region *R) {
@@ -690,14 +971,33 @@ void PtrRangeAnalysis::collectRangeInfo(Region *R) {
         RegionData.HasFullSideEffectInfo = false;
       }
     }
-  RegionsRangeData[R] = RegionData;
+  RegionsRangeData.set(R, RegionData);
   
   if (!RegionData.HasFullSideEffectInfo && Clregion)
     analyzeReducedRegion(R);
- 
-  // Collect range info for child regions.
+}
+
+PtrRangeAnalysis::RegionRangeInfo &
+PtrRangeAnalysis::RegionRangeMap::operator[](Region *R) {
+  auto It = Data.find(R);
+  if (It != Data.end())
+    return It->second;
+
+  // The placeholder is only seen if the analysis of R looks R up again.
+  Data[R] = RegionRangeInfo(R);
+  PtrRA->collectRangeInfo(R);
+  // Regions built by the clients (e.g. the reduced regions) aren't counted.
+  if (PtrRA->OriginalRegions.count(R)) {
+    PtrRA->NumAnalyzedRegions++;
+    numRA++;
+  }
+  return Data[R];
+}
+
+static void collectRegions(Region *R, SmallPtrSetImpl<Region *> &Regions) {
+  Regions.insert(R);
   for (auto &SubRegion : *R)
-    collectRangeInfo(&(*SubRegion));
+    collectRegions(&(*SubRegion), Regions);
 }
 
 bool PtrRangeAnalysis::runOnFunction(llvm::Function &F) {
@@ -709,25 +1009,37 @@ bool PtrRangeAnalysis::runOnFunction(llvm::Function &F) {
   RR = &getAnalysis<RegionReconstructor>();
 
   CurrentFn = &F;
+  releaseMemory();
 
   if (Cllicm)
     tryOptimizeFunction(&F, LI);
 
-  releaseMemory();
-  collectRangeInfo(RI->getTopLevelRegion());
+  // The range data of each region is collected when a client looks it up.
+  collectRegions(RI->getTopLevelRegion(), OriginalRegions);
 
   return false;
 }
 
+void PtrRangeAnalysis::releaseMemory() {
+  numRS += OriginalRegions.size() - NumAnalyzedRegions;
+  OriginalRegions.clear();
+  NumAnalyzedRegions = 0;
+  RegionsRangeData.clear();
+  PointerAccess.clear();
+  PointerAccessRegion.clear();
+}
+
 void PtrRangeAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequiredID(LoopSimplifyID);
   AU.addRequiredID(LCSSAID);
-  AU.addRequired<DominatorTreeWrapperPass>();
+  // The range data is collected after runOnFunction, when the clients ask for
+  // it, so every analysis it uses must stay alive as long as this pass.
+  AU.addRequiredTransitive<DominatorTreeWrapperPass>();
   AU.addRequiredTransitive<LoopInfoWrapperPass>();
   AU.addRequiredTransitive<ScalarEvolution>();
-  AU.addRequired<AliasAnalysis>();
+  AU.addRequiredTransitive<AliasAnalysis>();
   AU.addRequiredTransitive<RegionInfoPass>();
-  AU.addRequired<RegionReconstructor>();
+  AU.addRequiredTransitive<RegionReconstructor>();
 
   AU.setPreservesAll();
 }
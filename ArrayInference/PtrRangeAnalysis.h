@@ -11,6 +11,10 @@
 // determined ("HasFullSideEffectInfo" flag). For each base pointer, it also
 // stores the list of access expresions for which bounds can be computed.
 //
+// The data of a region is collected the first time the region is looked up in
+// the map, and kept until the pass runs on the next function. Most regions are
+// never annotated, so most of them are never analyzed.
+//
 // After this analysis runs, the user can pass the extracted data to the
 // SCEVRangeBuilder utility, to insert instructions to compute the actual
 // symbolic bounds at the region entry. A small example of how this can be
@@ -47,6 +51,7 @@
 #include "SCEVRangeBuilder.h"
 #include "regionReconstructor.h"
 
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/Analysis/RegionInfo.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
@@ -96,6 +101,26 @@ class PtrRangeAnalysis : public FunctionPass {
     RegionRangeInfo(Region *R) : R(R), HasFullSideEffectInfo(false) {}
   };
 
+  /**
+   * Range data of the regions of the current function, collected on demand.
+   */
+  class RegionRangeMap {
+    PtrRangeAnalysis *PtrRA;
+    std::map<Region *, RegionRangeInfo> Data;
+
+  public:
+    explicit RegionRangeMap(PtrRangeAnalysis *PtrRA) : PtrRA(PtrRA) {}
+
+    // Returns the data of R, collecting it if R wasn't analyzed yet.
+    RegionRangeInfo &operator[](Region *R);
+
+    // Set the data of R without analyzing it.
+    void set(Region *R, const RegionRangeInfo &Info) { Data[R] = Info; }
+
+    bool isAnalyzed(Region *R) const { return Data.count(R) != 0; }
+    void clear() { Data.clear(); }
+  };
+
   // Map with Analyzed Functions
   std::map<Function*, bool> ValidFunctions;
 
@@ -116,6 +141,11 @@ class PtrRangeAnalysis : public FunctionPass {
   // Function being analysed.
   Function *CurrentFn;
 
+  // Regions of the function when the pass ran, and how many of them were
+  // analyzed. The regions built later by the clients are not in the set.
+  SmallPtrSet<Region *, 16> OriginalRegions;
+  unsigned NumAnalyzedRegions;
+
   // For loop L, find the pointers and the access memory model.
   void analyzeLoopPointers (Loop *L);
 
@@ -138,7 +168,7 @@ class PtrRangeAnalysis : public FunctionPass {
   bool collectRangeInfo(Instruction *Inst, RegionRangeInfo *RegionData,
                         SCEVRangeBuilder *RangeBuilder);
 
-  // Collects range data for a whole region.
+  // Collects range data for a whole region, but not for its subregions.
   void collectRangeInfo(Region *R);
 
   // Return if the CallInst is safe to try do the analysis.
@@ -169,10 +199,36 @@ class PtrRangeAnalysis : public FunctionPass {
   // Provides an abstraction of the graph of functions called in CallInst
   // instructions in the IR, searching and matching dependences.
   void analyzeRegionPointers (Region *R, std::map<Function*,Region*> & funcs);
+
+  // Must-write analysis. The computation is the loop L or, if L is null, the
+  // region R, and the range of a pointer is the hull of the accesses
+  // collected for it in RegionsRangeData[R].
+
+  // Returns the block that skips L when it has no iterations, if L is entered
+  // through such a guard, or null.
+  BasicBlock *getZeroTripGuard (Loop *Lp);
+
+  // Returns true if BB runs in every iteration of the loops of the
+  // computation around it, and whenever the computation runs.
+  bool runsInEveryIteration (BasicBlock *BB, Loop *L, Region *R);
+
+  // Returns true if the loops of the computation make AccessFunction go
+  // through every element of its range, without gaps.
+  bool isDenseAccess (const SCEV *AccessFunction, const SCEV *BasePtr,
+                      uint64_t ElemSize, Loop *L, Region *R);
+
+  // Returns true if the computation writes every element of the range of
+  // BasePtr, and only reads the elements that it has written before.
+  bool isWrittenBeforeRead (Value *BasePtr, Loop *L, Region *R);
+
+  // Returns true if BasePtr is an array of the function that is only used by
+  // the computation.
+  bool isScratchPointer (Value *BasePtr, Loop *L, Region *R);
   
 public:
   static char ID;
-  explicit PtrRangeAnalysis() : FunctionPass(ID) {}
+  explicit PtrRangeAnalysis()
+      : FunctionPass(ID), NumAnalyzedRegions(0), RegionsRangeData(this) {}
 
   // Return the type of memory acess in a char.
   // 1 - Just Loads
@@ -181,17 +237,25 @@ public:
   char getPointerAcessType (Loop *L, Value *V);
   char getPointerAcessType (Region *R, Value *V);
 
+  // Same as above, for the loop L (or the region R, if L is null) whose
+  // ranges are computed in region R. With "-Ptr-must-write", pointers whose
+  // whole range is written before being read are refined to:
+  // 2 - Just Stores, so their data isn't copied to the device.
+  // 4 - Scratch, if they are also local arrays not used out of the
+  //     computation, so their data isn't copied at all.
+  char getPointerAcessType (Loop *L, Region *R, Value *V);
+
   // Insert a RegionRangeInfo object to the reduced region of R, case R cannot
   // be analyzed.
   void analyzeReducedRegion (Region *R);
 
   // Set of regions in the function and their respective range data.
-  std::map<Region *, RegionRangeInfo> RegionsRangeData;
+  RegionRangeMap RegionsRangeData;
 
   // FunctionPass interface.
   virtual bool runOnFunction(Function &F);
   virtual void getAnalysisUsage(AnalysisUsage &AU) const;
-  void releaseMemory() { RegionsRangeData.clear(); }
+  void releaseMemory();
 };
 
 // Get the value that represents the base pointer of the given memory
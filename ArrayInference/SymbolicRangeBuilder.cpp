@@ -0,0 +1,348 @@
+#include "SymbolicRangeBuilder.h"
+#include "PtrRangeAnalysis.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+using namespace lge;
+
+// Constants are only folded while the result can't overflow.
+#define FOLD_ADD_LIMIT (1LL << 62)
+#define FOLD_MUL_LIMIT (1LL << 31)
+
+const BoundExpr *SymbolicRangeBuilder::newNode(BoundExpr::ExprKind Kind,
+                                               long long int Constant,
+                                               Value *Val,
+                                               const BoundExpr *LHS,
+                                               const BoundExpr *RHS) {
+  BoundExpr *Node = new BoundExpr();
+  Node->Kind = Kind;
+  Node->Constant = Constant;
+  Node->Val = Val;
+  Node->LHS = LHS;
+  Node->RHS = RHS;
+  Nodes.push_back(std::unique_ptr<BoundExpr>(Node));
+  return Node;
+}
+
+const BoundExpr *SymbolicRangeBuilder::getConstant(long long int C) {
+  return newNode(BoundExpr::BE_Constant, C, nullptr, nullptr, nullptr);
+}
+
+const BoundExpr *SymbolicRangeBuilder::getValue(Value *V) {
+  if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+    if (CI->getValue().getMinSignedBits() <= 64)
+      return getConstant(CI->getSExtValue());
+
+  return newNode(BoundExpr::BE_Value, 0, V, nullptr, nullptr);
+}
+
+const BoundExpr *SymbolicRangeBuilder::getOperation(BoundExpr::ExprKind Kind,
+                                                    const BoundExpr *LHS,
+                                                    const BoundExpr *RHS) {
+  if (!LHS || !RHS)
+    return nullptr;
+
+  if ((LHS->Kind == BoundExpr::BE_Constant) &&
+      (RHS->Kind == BoundExpr::BE_Constant)) {
+    long long int A = LHS->Constant, B = RHS->Constant;
+    switch (Kind) {
+    case BoundExpr::BE_Add:
+      if ((std::llabs(A) < FOLD_ADD_LIMIT) && (std::llabs(B) < FOLD_ADD_LIMIT))
+        return getConstant(A + B);
+      break;
+    case BoundExpr::BE_Mul:
+      if ((std::llabs(A) < FOLD_MUL_LIMIT) && (std::llabs(B) < FOLD_MUL_LIMIT))
+        return getConstant(A * B);
+      break;
+    case BoundExpr::BE_UDiv:
+      if ((A >= 0) && (B > 0))
+        return getConstant(A / B);
+      break;
+    case BoundExpr::BE_Max:
+      return (A > B) ? LHS : RHS;
+    case BoundExpr::BE_Min:
+      return (A < B) ? LHS : RHS;
+    default:
+      break;
+    }
+  }
+
+  // Identities of the arithmetic operations.
+  switch (Kind) {
+  case BoundExpr::BE_Add:
+    if (LHS->isConstant(0))
+      return RHS;
+    if (RHS->isConstant(0))
+      return LHS;
+    break;
+  case BoundExpr::BE_Mul:
+    if (LHS->isConstant(0) || RHS->isConstant(1))
+      return LHS;
+    if (RHS->isConstant(0) || LHS->isConstant(1))
+      return RHS;
+    break;
+  case BoundExpr::BE_UDiv:
+    if (RHS->isConstant(1))
+      return LHS;
+    break;
+  default:
+    if (LHS == RHS)
+      return LHS;
+    break;
+  }
+
+  return newNode(Kind, 0, nullptr, LHS, RHS);
+}
+
+const BoundExpr *SymbolicRangeBuilder::visit(const SCEV *S, bool Upper) {
+  auto It = Bounds.find(std::make_pair(S, Upper));
+  if (It != Bounds.end())
+    return It->second;
+
+  const BoundExpr *Bound = nullptr;
+  switch (S->getSCEVType()) {
+  case scConstant:
+    Bound = visitConstant(cast<SCEVConstant>(S), Upper);
+    break;
+  case scTruncate:
+    Bound = visitTruncateExpr(cast<SCEVTruncateExpr>(S), Upper);
+    break;
+  case scZeroExtend:
+  case scSignExtend:
+    Bound = visitCastExpr(cast<SCEVCastExpr>(S), Upper);
+    break;
+  case scAddExpr:
+    Bound = visitAddExpr(cast<SCEVAddExpr>(S), Upper);
+    break;
+  case scMulExpr:
+    Bound = visitMulExpr(cast<SCEVMulExpr>(S), Upper);
+    break;
+  case scUDivExpr:
+    Bound = visitUDivExpr(cast<SCEVUDivExpr>(S), Upper);
+    break;
+  case scAddRecExpr:
+    Bound = visitAddRecExpr(cast<SCEVAddRecExpr>(S), Upper);
+    break;
+  case scSMaxExpr:
+  case scUMaxExpr:
+    Bound = visitMaxExpr(cast<SCEVNAryExpr>(S), Upper);
+    break;
+  case scUnknown:
+    Bound = visitUnknown(cast<SCEVUnknown>(S), Upper);
+    break;
+  case scCouldNotCompute:
+    break;
+  default:
+    llvm_unreachable("Unknown SCEV type!");
+  }
+
+  Bounds[std::make_pair(S, Upper)] = Bound;
+  return Bound;
+}
+
+// Constants wider than 64 bits can't be written in C.
+const BoundExpr *SymbolicRangeBuilder::visitConstant(
+    const SCEVConstant *Constant, bool Upper) {
+  const APInt &Val = Constant->getValue()->getValue();
+  if (Val.getMinSignedBits() > 64)
+    return nullptr;
+  return getConstant(Val.getSExtValue());
+}
+
+// Same clamping of SCEVRangeBuilder::visitTruncateExpr. If the bound of the
+// operand is out of the overflow-free range of the destination type, the bound
+// is the maximum/minimum value the destination type can assume:
+// - upper_bound: upper_bound(op) > SMAX(dst) ? UMAX(dst) : upper_bound(op)
+// - lower_bound: lower_bound(op) < 0 ? SMIN(dst) : lower_bound(op)
+// Bounds are computed as "long long int" in C, so truncations to 64 bits or
+// more are not clamped.
+const BoundExpr *SymbolicRangeBuilder::visitTruncateExpr(
+    const SCEVTruncateExpr *Expr, bool Upper) {
+  const BoundExpr *Bound = visit(Expr->getOperand(), Upper);
+  unsigned DstBW =
+      SE->getEffectiveSCEVType(Expr->getType())->getIntegerBitWidth();
+  if (!Bound || (DstBW >= 64))
+    return Bound;
+
+  long long int NoOFLimit = Upper ? (1LL << (DstBW - 1)) - 1 : 0;
+  long long int TyLimit = Upper ? (1LL << DstBW) - 1 : -(1LL << (DstBW - 1));
+  if (Bound->Kind == BoundExpr::BE_Constant) {
+    bool Overflow = Upper ? (Bound->Constant > NoOFLimit)
+                          : (Bound->Constant < NoOFLimit);
+    return Overflow ? getConstant(TyLimit) : Bound;
+  }
+
+  return newNode(Upper ? BoundExpr::BE_ClampUpper : BoundExpr::BE_ClampLower,
+                 TyLimit, nullptr, Bound, getConstant(NoOFLimit));
+}
+
+// The bound of an extension is the bound of its operand.
+// - upper_bound: upper_bound(op)
+// - lower_bound: lower_bound(op)
+const BoundExpr *SymbolicRangeBuilder::visitCastExpr(const SCEVCastExpr *Expr,
+                                                     bool Upper) {
+  return visit(Expr->getOperand(), Upper);
+}
+
+// Negative operands are multiplications by a negative constant, whose bounds
+// are already inverted by visitMulExpr.
+// - upper_bound: upper_bound(op_1) + ... + upper_bound(op_N)
+// - lower_bound: lower_bound(op_1) + ... + lower_bound(op_N)
+const BoundExpr *SymbolicRangeBuilder::visitAddExpr(const SCEVAddExpr *Expr,
+                                                    bool Upper) {
+  const BoundExpr *Bound = visit(Expr->getOperand(0), Upper);
+  for (unsigned I = 1, E = Expr->getNumOperands(); I < E; ++I)
+    Bound = getOperation(BoundExpr::BE_Add, Bound,
+                         visit(Expr->getOperand(I), Upper));
+  return Bound;
+}
+
+// Same cases of SCEVRangeBuilder::visitMulExpr.
+// - if C >= 0: C * bound(op2)
+// - if C < 0: C * inverse_bound(op2)
+// - otherwise: max/min of the products of the bounds of both operands.
+const BoundExpr *SymbolicRangeBuilder::visitMulExpr(const SCEVMulExpr *Expr,
+                                                    bool Upper) {
+  if (Expr->getNumOperands() != 2)
+    return nullptr;
+
+  // If there is a constant, it will be the first operand.
+  const SCEV *Op1 = Expr->getOperand(0);
+  const SCEV *Op2 = Expr->getOperand(1);
+  if (const SCEVConstant *SC = dyn_cast<SCEVConstant>(Op1)) {
+    bool Invert = SC->getValue()->getValue().isNegative();
+    return getOperation(BoundExpr::BE_Mul, visit(Op1, Upper),
+                        visit(Op2, Invert ? !Upper : Upper));
+  }
+
+  const BoundExpr *Lhs = visit(Op1, Upper);
+  const BoundExpr *Rhs = visit(Op2, Upper);
+  const BoundExpr *Lhs2 = visit(Op1, !Upper);
+  const BoundExpr *Rhs2 = visit(Op2, !Upper);
+  if (!Lhs || !Rhs || !Lhs2 || !Rhs2)
+    return nullptr;
+
+  BoundExpr::ExprKind Select = Upper ? BoundExpr::BE_Max : BoundExpr::BE_Min;
+  const BoundExpr *Ref1 = getOperation(BoundExpr::BE_Mul, Lhs, Rhs);
+  const BoundExpr *Ref2 = getOperation(BoundExpr::BE_Mul, Lhs2, Rhs);
+  const BoundExpr *Ref3 = getOperation(BoundExpr::BE_Mul, Lhs, Rhs2);
+  const BoundExpr *Ref4 = getOperation(BoundExpr::BE_Mul, Lhs2, Rhs2);
+  return getOperation(Select, getOperation(Select, Ref1, Ref2),
+                      getOperation(Select, Ref3, Ref4));
+}
+
+// - upper_bound: upper_bound(lhs) / lower_bound(rhs)
+// - lower_bound: lower_bound(lhs) / upper_bound(rhs)
+const BoundExpr *SymbolicRangeBuilder::visitUDivExpr(const SCEVUDivExpr *Expr,
+                                                     bool Upper) {
+  return getOperation(BoundExpr::BE_UDiv, visit(Expr->getLHS(), Upper),
+                      visit(Expr->getRHS(), !Upper));
+}
+
+// Compute bounds for an expression of the type {%start, +, %step}<%loop>.
+// - upper: upper(%start) + upper(%step) * upper(backedge_taken(%loop))
+// - lower_bound: lower_bound(%start)
+const BoundExpr *SymbolicRangeBuilder::visitAddRecExpr(
+    const SCEVAddRecExpr *Expr, bool Upper) {
+  // Quadratic recurrences are not bounded by the formula above. See
+  // SCEVRangeBuilder::visitAddRecExpr.
+  if (Expr->isQuadratic())
+    return nullptr;
+
+  if (!Upper)
+    return visit(Expr->getStart(), /*Upper*/ false);
+
+  const Loop *L = Expr->getLoop();
+  if (!SE->hasLoopInvariantBackedgeTakenCount(L))
+    return nullptr;
+
+  const BoundExpr *Start = visit(Expr->getStart(), Upper);
+  const BoundExpr *Step = visit(Expr->getStepRecurrence(*SE), Upper);
+  const BoundExpr *BEdgeCount = visit(SE->getBackedgeTakenCount(L), Upper);
+  return getOperation(BoundExpr::BE_Add, Start,
+                      getOperation(BoundExpr::BE_Mul, Step, BEdgeCount));
+}
+
+// Both smax and umax are written as a max of the bounds of the operands.
+// - upper_bound: max(upper_bound(op_1), ... upper_bound(op_N))
+// - lower_bound: max(lower_bound(op_1), ... lower_bound(op_N))
+const BoundExpr *SymbolicRangeBuilder::visitMaxExpr(const SCEVNAryExpr *Expr,
+                                                    bool Upper) {
+  const BoundExpr *Bound = visit(Expr->getOperand(0), Upper);
+  for (unsigned I = 1, E = Expr->getNumOperands(); I < E; ++I)
+    Bound = getOperation(BoundExpr::BE_Max, Bound,
+                         visit(Expr->getOperand(I), Upper));
+  return Bound;
+}
+
+// The bounds of a generic value are the value itself, if it is a region
+// parameter available at the insertion point.
+const BoundExpr *SymbolicRangeBuilder::visitUnknown(const SCEVUnknown *Expr,
+                                                    bool Upper) {
+  Value *Val = Expr->getValue();
+  Instruction *Inst = dyn_cast<Instruction>(Val);
+
+  if (!isInvariant(Val, R, LI, AA))
+    return visitSRemInst(Expr, Upper);
+
+  if (Inst && !DT->dominates(Inst, InsertPt))
+    return visitSRemInst(Expr, Upper);
+
+  return getValue(Val);
+}
+
+// Bounds of "i % v", with v invariant: v to upper bound, and 0 to lower bound.
+const BoundExpr *SymbolicRangeBuilder::visitSRemInst(const SCEVUnknown *Expr,
+                                                     bool Upper) {
+  Instruction *Inst = dyn_cast<Instruction>(Expr->getValue());
+  if (!Inst || (Inst->getOpcode() != Instruction::SRem))
+    return nullptr;
+
+  Value *V = Inst->getOperand(1);
+  if (!isInvariant(V, R, LI, AA))
+    return nullptr;
+
+  if (!isa<Constant>(V) && !isa<GlobalValue>(V) && !isa<Argument>(V) &&
+      !isa<AllocaInst>(V) && !isa<LoadInst>(V) && !isa<GetElementPtrInst>(V))
+    return nullptr;
+
+  return Upper ? getValue(V) : getConstant(0);
+}
+
+// - lower_bound: min(exprN, min(exprN-1, ... min(expr2, expr1)))
+// - upper_bound: max(exprN, max(exprN-1, ... max(expr2, expr1)))
+const BoundExpr *SymbolicRangeBuilder::getULowerOrUpperBound(
+    const std::vector<const SCEV *> &ExprList, bool Upper) {
+  if (ExprList.empty())
+    return nullptr;
+
+  BoundExpr::ExprKind Select = Upper ? BoundExpr::BE_Max : BoundExpr::BE_Min;
+  const BoundExpr *BestBound = visit(ExprList[0], Upper);
+  for (unsigned I = 1, E = ExprList.size(); I < E; ++I)
+    BestBound = getOperation(Select, visit(ExprList[I], Upper), BestBound);
+  return BestBound;
+}
+
+const BoundExpr *SymbolicRangeBuilder::getULowerBound(
+    const std::vector<const SCEV *> &ExprList) {
+  return getULowerOrUpperBound(ExprList, /*Upper*/ false);
+}
+
+const BoundExpr *SymbolicRangeBuilder::getUUpperBound(
+    const std::vector<const SCEV *> &ExprList) {
+  return getULowerOrUpperBound(ExprList, /*Upper*/ true);
+}
+
+const BoundExpr *SymbolicRangeBuilder::stretchPtrUpperBound(
+    Value *BasePtr, const BoundExpr *UpperBound) {
+  // As the base pointer might be multi-dimensional, we extract its innermost
+  // element type.
+  Type *ElemTy = BasePtr->getType();
+
+  while (isa<SequentialType>(ElemTy))
+    ElemTy = cast<SequentialType>(ElemTy)->getElementType();
+
+  return getOperation(BoundExpr::BE_Add, UpperBound,
+                      getConstant(DL.getTypeAllocSize(ElemTy)));
+}
@@ -0,0 +1,113 @@
+// Symbolic counterpart of SCEVRangeBuilder. It computes the same bounds for
+// Scalar Evolution expressions, but, instead of inserting instructions in the
+// CFG to evaluate them, it builds a small expression tree whose leaves are
+// constants and values available at the given program point. For the loop:
+//
+//   for (int i = 0; i < n; i++)
+//     a[i] = i;
+//
+// The upper bound of "a[i]" is the tree (a + 4 * (n - 1)) + 4, which
+// RecoverCode writes in C by resolving "a" and "n" to their names in the
+// source file. The module is never changed.
+
+#ifndef SYMBOLIC_RANGE_BUILDER_H
+#define SYMBOLIC_RANGE_BUILDER_H 1
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+
+namespace llvm {
+class AliasAnalysis;
+class Region;
+}
+
+namespace lge {
+
+// Node of a bound. Constants and values are leaves, the other kinds are binary
+// operations on LHS and RHS. The clamps of truncations are written as
+// "(LHS > RHS ? Constant : LHS)" and "(LHS < RHS ? Constant : LHS)".
+struct BoundExpr {
+  enum ExprKind { BE_Constant, BE_Value, BE_Add, BE_Mul, BE_UDiv, BE_Max,
+                  BE_Min, BE_ClampUpper, BE_ClampLower };
+
+  ExprKind Kind;
+  long long int Constant;
+  Value *Val;
+  const BoundExpr *LHS;
+  const BoundExpr *RHS;
+
+  bool isConstant(long long int C) const {
+    return (Kind == BE_Constant) && (Constant == C);
+  }
+};
+
+class SymbolicRangeBuilder {
+  ScalarEvolution *SE;
+  AliasAnalysis *AA;
+  LoopInfo *LI;
+  DominatorTree *DT;
+  Region *R;
+  Instruction *InsertPt; // Point where the leaves must be available.
+  const DataLayout &DL;
+  std::vector<std::unique_ptr<BoundExpr>> Nodes; // Every node built.
+  std::map<std::pair<const SCEV *, bool>, const BoundExpr *>
+      Bounds; // Saved bounds for reuse.
+
+  const BoundExpr *newNode(BoundExpr::ExprKind Kind, long long int Constant,
+                           Value *Val, const BoundExpr *LHS,
+                           const BoundExpr *RHS);
+  const BoundExpr *getConstant(long long int C);
+  const BoundExpr *getValue(Value *V);
+
+  // Build "LHS Kind RHS", folding constant operands. Returns null if any
+  // operand is null.
+  const BoundExpr *getOperation(BoundExpr::ExprKind Kind, const BoundExpr *LHS,
+                                const BoundExpr *RHS);
+
+  // Main entry point, with the bounds cache.
+  const BoundExpr *visit(const SCEV *S, bool Upper);
+
+  // Find detailed description for each method at their implementation headers.
+  const BoundExpr *visitConstant(const SCEVConstant *Constant, bool Upper);
+  const BoundExpr *visitTruncateExpr(const SCEVTruncateExpr *Expr, bool Upper);
+  const BoundExpr *visitCastExpr(const SCEVCastExpr *Expr, bool Upper);
+  const BoundExpr *visitAddExpr(const SCEVAddExpr *Expr, bool Upper);
+  const BoundExpr *visitMulExpr(const SCEVMulExpr *Expr, bool Upper);
+  const BoundExpr *visitUDivExpr(const SCEVUDivExpr *Expr, bool Upper);
+  const BoundExpr *visitAddRecExpr(const SCEVAddRecExpr *Expr, bool Upper);
+  const BoundExpr *visitMaxExpr(const SCEVNAryExpr *Expr, bool Upper);
+  const BoundExpr *visitUnknown(const SCEVUnknown *Expr, bool Upper);
+  const BoundExpr *visitSRemInst(const SCEVUnknown *Expr, bool Upper);
+
+  const BoundExpr *getULowerOrUpperBound(
+      const std::vector<const SCEV *> &ExprList, bool Upper);
+
+public:
+  SymbolicRangeBuilder(ScalarEvolution *SE, const DataLayout &DL,
+                       AliasAnalysis *AA, LoopInfo *LI, DominatorTree *DT,
+                       Region *R, Instruction *InsertPt)
+      : SE(SE), AA(AA), LI(LI), DT(DT), R(R), InsertPt(InsertPt), DL(DL) {}
+
+  // Returns the minimum value an SCEV can assume, or null if it is unknown.
+  const BoundExpr *getLowerBound(const SCEV *S) { return visit(S, false); }
+
+  // Returns the maximum value an SCEV can assume, or null if it is unknown.
+  const BoundExpr *getUpperBound(const SCEV *S) { return visit(S, true); }
+
+  // Smallest lower bound and greatest upper bound of a set of expressions.
+  const BoundExpr *getULowerBound(const std::vector<const SCEV *> &ExprList);
+  const BoundExpr *getUUpperBound(const std::vector<const SCEV *> &ExprList);
+
+  // Add the element size to the upper bound of a base pointer, so the new upper
+  // bound will be the first byte after the pointed memory region.
+  const BoundExpr *stretchPtrUpperBound(Value *BasePtr,
+                                        const BoundExpr *UpperBound);
+};
+} // end lge namespace
+
+#endif // SYMBOLIC_RANGE_BUILDER_H
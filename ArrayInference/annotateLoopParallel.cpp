@@ -7,17 +7,21 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// Find a file named "out_pl.log" and try to insert metadata in all loop,
-// when the file identify loops as parallel.
+// Insert metadata in all loops that CanParallelize identifies as parallel.
+// The parallel loops are shared in memory when both passes run in the same
+// process (see the dawncc driver), or read from the sidecar file given by
+// "-parallel-loops-in".
 //
 // To use this pass please use the flag "-annotateParallel", see the example
 // available below:
 //
-// opt -load ${LIBR}/libLLVMArrayInference.so -annotateParallel ${BENCH}/$2.bc 
+// opt -load ${LIBR}/libLLVMArrayInference.so -annotateParallel \
+//   -parallel-loops-in=${LOOPS} ${BENCH}/$2.bc
 //
 // The ambient variables and your signification:
 //   -- LIBR => Set the location of ArrayInference tool location.
 //   -- BENCH => Set the benchmark's paste.
+//   -- LOOPS => Set the file written by "-can-parallelize -parallel-loops-out".
 // 
 //===----------------------------------------------------------------------===//
 
@@ -50,7 +54,9 @@ using namespace std;
 
 #define DEBUG_TYPE "annotateParallel"
 
-void AnnotateParallel::setMetadataParallelLoop (Loop *L) {
+void AnnotateParallel::setMetadataParallelLoop (Loop *L,
+    bool NeedsAliasCheck, const lge::LoopReductions &Reductions,
+    const lge::LoopPrivates &Privates) {
   // Mark loop 'L' as parallel using metadata.
   BasicBlock *BB = L->getHeader();
   if (BB == nullptr)
@@ -58,36 +64,40 @@ void AnnotateParallel::setMetadataParallelLoop (Loop *L) {
   LLVMContext& C = BB->getTerminator()->getContext();
   MDNode* N = MDNode::get(C, MDString::get(C, "Parallel Loop Metadata"));
   BB->getTerminator()->setMetadata("isParallel", N);
-}
-
-void AnnotateParallel::readFile() {   
-  // Read file "out_pl" and try to infer parallel loops.
-  std::ifstream InFile;
-  InFile.open("out_pl.log", std::ios_base::in);
-  if (!InFile.is_open())
-    return;
-  
-  std::string Line = std::string(), name = std::string();
-  while (std::getline(InFile, Line)) {
-    name = std::string();
-    unsigned int i = 0, ie = Line.length();
-    for (;(i != ie) && (Line[i] != ';'); i++) 
-      name += Line[i];
-    i++;
-    if (Line[i] == '-' && Line[(i+1)] == '1') {
-      continue;
+  if (NeedsAliasCheck) {
+    N = MDNode::get(C, MDString::get(C, "Parallel If No Alias Metadata"));
+    BB->getTerminator()->setMetadata("isParallelIfNoAlias", N);
+  }
+  if (!Reductions.empty()) {
+    std::vector<Metadata*> Ops;
+    for (auto &R : Reductions) {
+      Ops.push_back(MDString::get(C, R.first));
+      Ops.push_back(MDString::get(C, R.second));
     }
-    while (i != ie) {
-      int tmp  = 0;
-      for (;(i!=ie) && (Line[i] != ';'); i++) {
-        tmp = (tmp * 10);
-        tmp += (Line[i] - '0');
-      }
-      Functions[name].push_back(tmp);
-      i++;
+    BB->getTerminator()->setMetadata("reductions", MDNode::get(C, Ops));
+  }
+  if (!Privates.empty()) {
+    std::vector<Metadata*> Ops;
+    for (auto &P : Privates) {
+      Ops.push_back(MDString::get(C, P.first));
+      Ops.push_back(MDString::get(C, P.second));
     }
+    BB->getTerminator()->setMetadata("privates", MDNode::get(C, Ops));
   }
-  InFile.close();
+}
+
+static cl::opt<std::string> ParallelLoopsIn(
+    "parallel-loops-in",
+    cl::desc("Sidecar file with the parallel loops found by CanParallelize."),
+    cl::init(""));
+
+void AnnotateParallel::readFile() {
+  // Loops detected in this process don't need the sidecar file.
+  if (DetectedLoops != &LoopsFromFile || ParallelLoopsIn.empty())
+    return;
+
+  if (!LoopsFromFile.readFromFile(ParallelLoopsIn))
+    errs() << "Could not read parallel loops from " << ParallelLoopsIn << "\n";
 }
 
 static cl::opt<std::string> ParallelLoopAnnotations(
@@ -145,18 +155,16 @@ StringRef FileNameFromPath(StringRef FileName) {
 
 void AnnotateParallel::functionIdentify (Function *F) {
   // Write annotations from the output of CanParallelize.
-  if (Functions.count(F->getName())) {
-    std::map<Loop*, bool> Loops;
+  if (DetectedLoops->hasFunction(F->getName())) {
+    std::set<Loop*> Loops;
     // Identify and insert metadata on each loop available, case parallel.
     for (auto B = F->begin(), BE = F->end(); B != BE; B++) {  
       Loop *l = li->getLoopFor(B);
-      if (l && Loops.count(l) == 0) {
-        // Set loop as parallel.
-        for (int i = 0, ie = Functions[F->getName()].size(); i != ie; i++)
-          if (Functions[F->getName()][i] == l->getStartLoc()->getLine())
-            setMetadataParallelLoop(l);
-        Loops[l] = true;
-      }
+      if (!l || !Loops.insert(l).second)
+        continue;
+      if (const lge::ParallelLoop *PL = DetectedLoops->lookup(l, *li))
+        setMetadataParallelLoop(l, PL->Flags & lge::PL_NeedsAliasCheck,
+                                PL->Reductions, PL->Privates);
     }
   }
 
@@ -232,7 +240,7 @@ bool AnnotateParallel::runOnModule(Module &M) {
     functionIdentify(F);
   }
   // Clear used functions.
-  Functions.erase(Functions.begin(), Functions.end());
+  LoopsFromFile.clear();
   return true;
 }
 
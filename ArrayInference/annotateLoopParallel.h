@@ -7,22 +7,28 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// Find a file named "out_pl.log" and try to insert metadata in all loop,
-// when the file identify loops as parallel.
+// Insert metadata in all loops that CanParallelize identifies as parallel.
+// The parallel loops are shared in memory when both passes run in the same
+// process (see the dawncc driver), or read from the sidecar file given by
+// "-parallel-loops-in".
 //
 // To use this pass please use the flag "-annotateParallel", see the example
 // available below:
 //
-// opt -load ${LIBR}/libLLVMArrayInference.so -annotateParallel ${BENCH}/$2.bc 
+// opt -load ${LIBR}/libLLVMArrayInference.so -annotateParallel \
+//   -parallel-loops-in=${LOOPS} ${BENCH}/$2.bc
 //
 // The ambient variables and your signification:
 //   -- LIBR => Set the location of ArrayInference tool location.
 //   -- BENCH => Set the benchmark's paste.
+//   -- LOOPS => Set the file written by "-can-parallelize -parallel-loops-out".
 // 
 //===----------------------------------------------------------------------===//
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/DebugInfo.h"
 
+#include "../DepBasedParallelLoopAnalysis/ParallelLoopSet.h"
+
 namespace llvm {
 
 class Value;
@@ -36,9 +42,11 @@ class AnnotateParallel : public ModulePass {
   //===---------------------------------------------------------------------===
   //                              Data Structures
   //===---------------------------------------------------------------------===
-  // Maps a function name to a list of lines in the source code that contain
-  // parallel loops.
-  std::map<std::string, std::vector<int> > Functions;
+  // Lines in the source code that contain parallel loops, for each function.
+  // Points to LoopsFromFile, unless the set is provided by the user of the
+  // pass.
+  lge::ParallelLoopSet LoopsFromFile;
+  const lge::ParallelLoopSet *DetectedLoops;
 
   // Maps a file name to a mapping between a function name suffix to a set
   // of indexes of loops in functions with that suffix which are parallel.
@@ -68,7 +76,8 @@ class AnnotateParallel : public ModulePass {
 
   //===---------------------------------------------------------------------===
 
-  // Find the lines to parallelize in standard input file.
+  // Read the parallel loops from the sidecar file, if they were not provided
+  // in memory.
   void readFile();
 
   // Read parallel loop annotations from a file passed by a command-line
@@ -78,8 +87,14 @@ class AnnotateParallel : public ModulePass {
   // Populate FunctionDebugInfo.
   void readFunctionDebugInfo(Module &M);
 
-  // Set Loop 'L' as parallel in the bytecode.
-  void setMetadataParallelLoop(Loop *L);
+  // Set Loop 'L' as parallel in the bytecode. Loops that are only parallel if
+  // their pointers don't overlap are also marked with "isParallelIfNoAlias",
+  // and the reductions of the loop are listed in "reductions", as pairs of
+  // operator and variable name. Its private variables are listed in
+  // "privates", as pairs of clause and variable name.
+  void setMetadataParallelLoop(Loop *L, bool NeedsAliasCheck = false,
+      const lge::LoopReductions &Reductions = lge::LoopReductions(),
+      const lge::LoopPrivates &Privates = lge::LoopPrivates());
 
   // This void calls regionIdentify for the top level region in function F.
   void functionIdentify(Function *F);
@@ -88,7 +103,8 @@ class AnnotateParallel : public ModulePass {
 
   static char ID;
 
-  AnnotateParallel() : ModulePass(ID) {};
+  AnnotateParallel(const lge::ParallelLoopSet *Loops = nullptr)
+    : ModulePass(ID), DetectedLoops(Loops ? Loops : &LoopsFromFile) {};
   
   // We need to insert the Instructions for each source file.
   virtual bool runOnModule(Module &M) override;
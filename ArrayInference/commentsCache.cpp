@@ -0,0 +1,378 @@
+//===------------------------ commentsCache.cpp --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Persistent cache of the comments collected by WriteInFile. See
+// commentsCache.h for the key and the layout of the entries.
+//
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "writeInFile.h"
+#include "commentsCache.h"
+
+#include <set>
+
+using namespace llvm;
+
+#define CACHE_MAGIC "DAWNCC-COMMENTS 2\n"
+
+namespace {
+struct RegisteredFlag {
+  std::function<std::string()> Value;
+  bool IsFile;
+};
+}
+
+// Flags registered with CacheFlag, by name, so that the order of the hash
+// doesn't depend on the order the files are linked.
+static std::map<std::string, RegisteredFlag> &getCacheFlags() {
+  static std::map<std::string, RegisteredFlag> Flags;
+  return Flags;
+}
+
+static void registerFlag(StringRef Name, std::function<std::string()> Value,
+                         bool IsFile) {
+  RegisteredFlag &Flag = getCacheFlags()[Name];
+  Flag.Value = Value;
+  Flag.IsFile = IsFile;
+}
+
+CacheFlag::CacheFlag(cl::opt<bool> &Opt) {
+  registerFlag(Opt.ArgStr,
+               [&Opt]() { return std::string(Opt.getValue() ? "1" : "0"); },
+               false);
+}
+
+CacheFlag::CacheFlag(cl::opt<char> &Opt) {
+  registerFlag(Opt.ArgStr,
+               [&Opt]() { return std::string(1, Opt.getValue()); }, false);
+}
+
+CacheFlag::CacheFlag(cl::opt<unsigned> &Opt) {
+  registerFlag(Opt.ArgStr,
+               [&Opt]() { return std::to_string(Opt.getValue()); }, false);
+}
+
+CacheFlag::CacheFlag(cl::opt<std::string> &Opt, bool IsFile) {
+  registerFlag(Opt.ArgStr, [&Opt]() { return Opt.getValue(); }, IsFile);
+}
+
+CacheFlag::CacheFlag(StringRef Name, std::function<std::string()> Value,
+                     bool IsFile) {
+  registerFlag(Name, Value, IsFile);
+}
+
+static std::string getDigest(MD5 &Hash) {
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Str;
+  MD5::stringifyResult(Result, Str);
+  return Str.str();
+}
+
+// Add S to Hash. Every field is terminated, so that two sequences of fields
+// never produce the same stream.
+static void addField(MD5 &Hash, StringRef S) {
+  Hash.update(S);
+  Hash.update(StringRef("\0", 1));
+}
+
+// Remove the numbers of metadata nodes ("!dbg !42" becomes "!dbg !"). They
+// change whenever debug information is added anywhere before the function in
+// the module.
+static std::string stripMetadataNumbers(StringRef IR) {
+  std::string Str;
+  Str.reserve(IR.size());
+  for (unsigned i = 0, ie = IR.size(); i != ie; ++i) {
+    Str += IR[i];
+    if (IR[i] == '!')
+      while ((i + 1 != ie) && isdigit(IR[i + 1]))
+        ++i;
+  }
+  return Str;
+}
+
+static std::string hashFunctionIR(const Function &F) {
+  MD5 Hash;
+
+  std::string IR;
+  raw_string_ostream OS(IR);
+  F.print(OS);
+  addField(Hash, stripMetadataNumbers(OS.str()));
+
+  // The metadata references were stripped, so add the debug information that
+  // the analysis reads back: source locations and names of variables.
+  for (const_inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+    std::string Info;
+    raw_string_ostream InfoOS(Info);
+    if (const DebugLoc &Loc = I->getDebugLoc())
+      InfoOS << Loc.getLine() << ":" << Loc.getCol();
+
+    const DILocalVariable *Var = nullptr;
+    if (const DbgDeclareInst *DD = dyn_cast<DbgDeclareInst>(&*I))
+      Var = DD->getVariable();
+    else if (const DbgValueInst *DV = dyn_cast<DbgValueInst>(&*I))
+      Var = DV->getVariable();
+    if (Var)
+      InfoOS << " " << Var->getName() << ":" << Var->getLine();
+
+    addField(Hash, InfoOS.str());
+  }
+
+  return getDigest(Hash);
+}
+
+std::string CommentsCache::getFileHash(const std::string &Path) {
+  auto It = FileHashes.find(Path);
+  if (It != FileHashes.end())
+    return It->second;
+
+  MD5 Hash;
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (Buffer)
+    addField(Hash, (*Buffer)->getBuffer());
+  else
+    addField(Hash, "<missing>");
+
+  return FileHashes[Path] = getDigest(Hash);
+}
+
+std::string CommentsCache::getEntryPath(StringRef Key) const {
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, Key + ".comments");
+  return Path.str();
+}
+
+void CommentsCache::prepare(Module &M) {
+  ContentHashes.clear();
+  FileHashes.clear();
+  if (!isEnabled())
+    return;
+
+  for (auto F = M.begin(), FE = M.end(); F != FE; ++F)
+    if (!F->isDeclaration())
+      ContentHashes[&*F] = hashFunctionIR(*F);
+
+  MD5 Hash;
+  for (auto &Flag : getCacheFlags()) {
+    addField(Hash, Flag.first);
+    std::string Value = Flag.second.Value();
+    addField(Hash, Value);
+    if (Flag.second.IsFile && !Value.empty())
+      addField(Hash, getFileHash(Value));
+  }
+  FlagsHash = getDigest(Hash);
+}
+
+std::string CommentsCache::getKey(const Function &F, const std::string &File) {
+  MD5 Hash;
+  addField(Hash, CACHE_MAGIC);
+  addField(Hash, FlagsHash);
+  addField(Hash, File);
+  addField(Hash, getFileHash(File + "_scope.bin"));
+  addField(Hash, getFileHash(File + "_scope.dot"));
+  addField(Hash, ContentHashes[&F]);
+
+  // Functions reachable through calls, sorted by name so that the key doesn't
+  // depend on the order they are found.
+  std::map<std::string, const Function *> Callees;
+  std::set<const Function *> Visited;
+  std::vector<const Function *> Worklist(1, &F);
+  Visited.insert(&F);
+  while (!Worklist.empty()) {
+    const Function *Fn = Worklist.back();
+    Worklist.pop_back();
+    for (const_inst_iterator I = inst_begin(Fn), IE = inst_end(Fn); I != IE;
+         ++I) {
+      const CallInst *CI = dyn_cast<CallInst>(&*I);
+      if (!CI)
+        continue;
+      const Function *Callee = CI->getCalledFunction();
+      if (!Callee || !Visited.insert(Callee).second)
+        continue;
+      Callees[Callee->getName()] = Callee;
+      if (!Callee->isDeclaration())
+        Worklist.push_back(Callee);
+    }
+  }
+
+  for (auto C = Callees.begin(), CE = Callees.end(); C != CE; ++C) {
+    addField(Hash, C->first);
+    auto It = ContentHashes.find(C->second);
+    addField(Hash, It != ContentHashes.end() ? It->second : "<declaration>");
+  }
+
+  return getDigest(Hash);
+}
+
+bool CommentsCache::load(StringRef Key, FunctionComments &FC) {
+  auto Buffer = MemoryBuffer::getFile(getEntryPath(Key));
+  if (!Buffer)
+    return false;
+
+  StringRef Data = (*Buffer)->getBuffer();
+  if (!Data.startswith(CACHE_MAGIC))
+    return false;
+  Data = Data.substr(strlen(CACHE_MAGIC));
+
+  // Read a number terminated by Delim.
+  auto readNumber = [&](unsigned &N, char Delim) {
+    size_t Pos = Data.find(Delim);
+    if (Pos == StringRef::npos || Data.substr(0, Pos).getAsInteger(10, N))
+      return false;
+    Data = Data.substr(Pos + 1);
+    return true;
+  };
+
+  // Read a string of Size bytes followed by a new line.
+  auto readString = [&](unsigned Size, std::string &Str) {
+    if ((Data.size() <= Size) || (Data[Size] != '\n'))
+      return false;
+    Str = Data.substr(0, Size);
+    Data = Data.substr(Size + 1);
+    return true;
+  };
+
+  // Read a string preceded by its size.
+  auto readSizedString = [&](std::string &Str) {
+    unsigned Size;
+    return readNumber(Size, '\n') && readString(Size, Str);
+  };
+
+  std::map<unsigned int, std::string> Comments;
+  std::vector<std::string> Routines;
+  std::vector<MappedArgument> Mapped;
+  std::set<unsigned int> HostArguments;
+  std::vector<CallSummary> Calls;
+  unsigned NumComments, NumRoutines, Line, Size;
+
+  if (!readNumber(NumComments, '\n'))
+    return false;
+  for (unsigned i = 0; i != NumComments; ++i)
+    if (!readNumber(Line, ' ') || !readNumber(Size, '\n') ||
+        !readString(Size, Comments[Line]))
+      return false;
+
+  if (!readNumber(NumRoutines, '\n'))
+    return false;
+  Routines.resize(NumRoutines);
+  for (unsigned i = 0; i != NumRoutines; ++i)
+    if (!readNumber(Size, '\n') || !readString(Size, Routines[i]))
+      return false;
+
+  unsigned NumMapped, NumHost, NumCalls, Access, Parameter;
+  if (!readNumber(NumMapped, '\n'))
+    return false;
+  Mapped.resize(NumMapped);
+  for (unsigned i = 0; i != NumMapped; ++i) {
+    MappedArgument &MA = Mapped[i];
+    if (!readNumber(MA.ArgNo, ' ') || !readNumber(Access, ' ') ||
+        !readNumber(MA.Line, '\n') || !readSizedString(MA.Lower) ||
+        !readSizedString(MA.Size) || !readSizedString(MA.Item))
+      return false;
+    MA.Access = Access;
+  }
+
+  if (!readNumber(NumHost, '\n'))
+    return false;
+  for (unsigned i = 0; i != NumHost; ++i) {
+    if (!readNumber(Line, '\n'))
+      return false;
+    HostArguments.insert(Line);
+  }
+
+  if (!readNumber(NumCalls, '\n'))
+    return false;
+  Calls.resize(NumCalls);
+  for (unsigned i = 0; i != NumCalls; ++i) {
+    CallSummary &CS = Calls[i];
+    if (!readNumber(CS.Line, ' ') || !readNumber(CS.HoistStart, ' ') ||
+        !readNumber(CS.HoistEnd, ' ') || !readNumber(Size, '\n') ||
+        !readSizedString(CS.Callee))
+      return false;
+    CS.Arguments.resize(Size);
+    CS.Parameters.resize(Size);
+    for (unsigned j = 0; j != Size; ++j) {
+      if (!readNumber(Parameter, ' ') || !readSizedString(CS.Arguments[j]))
+        return false;
+      CS.Parameters[j] = (int)Parameter - 1;
+    }
+  }
+
+  FC.Comments.swap(Comments);
+  FC.Routines.swap(Routines);
+  FC.Mapped.swap(Mapped);
+  FC.HostArguments.swap(HostArguments);
+  FC.Calls.swap(Calls);
+  return true;
+}
+
+void CommentsCache::store(StringRef Key, const FunctionComments &FC) {
+  if (sys::fs::create_directories(Dir))
+    return;
+
+  // Write to a temporary file and rename it, so that concurrent runs never
+  // see a partial entry.
+  int FD;
+  SmallString<128> TmpPath;
+  if (sys::fs::createUniqueFile(getEntryPath(Key) + "-%%%%%%.tmp", FD,
+                                TmpPath))
+    return;
+
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << CACHE_MAGIC << FC.Comments.size() << "\n";
+    for (auto I = FC.Comments.begin(), IE = FC.Comments.end(); I != IE; ++I)
+      OS << I->first << " " << I->second.size() << "\n" << I->second << "\n";
+    OS << FC.Routines.size() << "\n";
+    for (auto I = FC.Routines.begin(), IE = FC.Routines.end(); I != IE; ++I)
+      OS << I->size() << "\n" << *I << "\n";
+    OS << FC.Mapped.size() << "\n";
+    for (auto I = FC.Mapped.begin(), IE = FC.Mapped.end(); I != IE; ++I)
+      OS << I->ArgNo << " " << (unsigned)I->Access << " " << I->Line << "\n"
+         << I->Lower.size() << "\n" << I->Lower << "\n"
+         << I->Size.size() << "\n" << I->Size << "\n"
+         << I->Item.size() << "\n" << I->Item << "\n";
+    OS << FC.HostArguments.size() << "\n";
+    for (auto I = FC.HostArguments.begin(), IE = FC.HostArguments.end();
+         I != IE; ++I)
+      OS << *I << "\n";
+    OS << FC.Calls.size() << "\n";
+    for (auto I = FC.Calls.begin(), IE = FC.Calls.end(); I != IE; ++I) {
+      OS << I->Line << " " << I->HoistStart << " " << I->HoistEnd << " "
+         << I->Arguments.size() << "\n" << I->Callee.size() << "\n"
+         << I->Callee << "\n";
+      for (unsigned j = 0, je = I->Arguments.size(); j != je; ++j)
+        OS << (I->Parameters[j] + 1) << " " << I->Arguments[j].size() << "\n"
+           << I->Arguments[j] << "\n";
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TmpPath);
+      return;
+    }
+  }
+
+  if (sys::fs::rename(TmpPath, getEntryPath(Key)))
+    sys::fs::remove(TmpPath);
+}
+
+//===------------------------ commentsCache.cpp --------------------------===//
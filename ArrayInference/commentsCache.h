@@ -0,0 +1,123 @@
+//===------------------------ commentsCache.h --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// CommentsCache keeps, in a directory, the comments that WriteInFile collects
+// for each function, so that a function that did not change since the last
+// run is not analyzed again.
+//
+// Entries are content addressed. The key of a function is a MD5 hash of
+// everything its comments depend on:
+//   -- The IR of the function, without the numbering of metadata nodes, plus
+//      the source locations and the names of the variables in its debug
+//      information.
+//   -- The IR of every function it may call, since the routines and the
+//      side-effects of the calls are part of the analysis.
+//   -- The flags that change the annotations (Emit-OMP, Restrictifier,
+//      Memory-Coalescing, Ptr-licm, Ptr-region, ...). Each one is registered
+//      with a CacheFlag next to its definition.
+//   -- The source file name, and the contents of its scope tree (binary and
+//      DOT files) and of the "Parallel-File" and "private-file" inputs.
+//
+// The hashes are computed by prepare, before any function of the module is
+// analyzed, because the analyses modify the IR.
+//
+// Each entry is a file named after its key, with the following layout:
+//
+//   "DAWNCC-COMMENTS 2\n" NumComments "\n"
+//   { Line " " Size "\n" Comment "\n" }*
+//   NumRoutines "\n"
+//   { Size "\n" Routine "\n" }*
+//   NumMapped "\n"
+//   { ArgNo " " Access " " Line "\n" Size "\n" Lower "\n" Size "\n" Size "\n"
+//     Size "\n" Item "\n" }*
+//   NumHostArguments "\n" { ArgNo "\n" }*
+//   NumCalls "\n"
+//   { Line " " HoistStart " " HoistEnd " " NumArgs "\n" Size "\n" Callee "\n"
+//     { Parameter+1 " " Size "\n" Argument "\n" }* }*
+//
+// The last three sections are the data summary used by "-Data-Hoisting".
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COMMENTS_CACHE_H
+#define COMMENTS_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+namespace llvm {
+
+struct FunctionComments;
+
+// Registers a flag that changes the comments of a function, so that its value
+// is part of the keys of the cache. It is declared after the flag:
+//
+//   static cl::opt<bool> ClFoo("Foo", cl::desc("..."));
+//   static CacheFlag FooFlag(ClFoo);
+//
+// The type of the flag is checked by the compiler. For a path, IsFile adds
+// the contents of the file to the keys too.
+class CacheFlag {
+public:
+  explicit CacheFlag(cl::opt<bool> &Opt);
+  explicit CacheFlag(cl::opt<char> &Opt);
+  explicit CacheFlag(cl::opt<unsigned> &Opt);
+  CacheFlag(cl::opt<std::string> &Opt, bool IsFile);
+
+  // For a flag defined out of ArrayInference, read through Value.
+  CacheFlag(StringRef Name, std::function<std::string()> Value, bool IsFile);
+};
+
+class CommentsCache {
+  // Directory of the entries. The cache is disabled if it is empty.
+  std::string Dir;
+
+  // Hash of the flags that change the annotations.
+  std::string FlagsHash;
+
+  // Hash of the IR of each function defined in the module.
+  std::map<const Function *, std::string> ContentHashes;
+
+  // Hash of the contents of each file read by the analysis.
+  std::map<std::string, std::string> FileHashes;
+
+  std::string getFileHash(const std::string &Path);
+
+  std::string getEntryPath(StringRef Key) const;
+
+public:
+  explicit CommentsCache(StringRef Dir) : Dir(Dir) {}
+
+  bool isEnabled() const { return !Dir.empty(); }
+
+  // Hash the functions of M. It must be called before any of them is
+  // analyzed.
+  void prepare(Module &M);
+
+  // Key of the comments of F, whose source is File.
+  std::string getKey(const Function &F, const std::string &File);
+
+  // Fill FC with the entry of Key. Returns false if there is no valid entry.
+  bool load(StringRef Key, FunctionComments &FC);
+
+  // Store the comments of a function. Failures are silently ignored, the
+  // entry is just recomputed in the next run.
+  void store(StringRef Key, const FunctionComments &FC);
+};
+
+}
+
+#endif
+
+//===------------------------ commentsCache.h --------------------------===//
@@ -0,0 +1,186 @@
+//===------------------------ offloadCostModel.cpp -----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Cost model of offloading. See offloadCostModel.h for the formula and the
+// keys of the configuration file.
+//
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "offloadCostModel.h"
+#include "commentsCache.h"
+
+#include <cstdlib>
+
+using namespace llvm;
+
+static cl::opt<bool> ClOffloadCost("Offload-Cost",
+    cl::desc("Guard offloaded computations with a run-time profitability "
+             "test."));
+
+static cl::opt<std::string> ClOffloadConfig("Offload-Config",
+    cl::desc("File with the weights of the offloading cost model."));
+
+// Flags that change the comments, for the keys of the comments cache.
+static CacheFlag OffloadCostFlag(ClOffloadCost);
+static CacheFlag OffloadConfigFlag(ClOffloadConfig, true);
+
+static const char *ClassNames[] = { "int", "fp", "div", "mem", "call" };
+
+OffloadCostModel::OffloadCostModel() {
+  // Defaults for a discrete GPU, in cycles of the host. The device runs many
+  // iterations at the same time, so its cost per instruction is small, but
+  // starting a kernel and copying data are expensive.
+  HostCost[IC_Int] = 1;
+  HostCost[IC_FP] = 1;
+  HostCost[IC_Div] = 20;
+  HostCost[IC_Mem] = 2;
+  HostCost[IC_Call] = 20;
+  DeviceCost[IC_Int] = 0.02;
+  DeviceCost[IC_FP] = 0.01;
+  DeviceCost[IC_Div] = 0.2;
+  DeviceCost[IC_Mem] = 0.1;
+  DeviceCost[IC_Call] = 1;
+  Launch = 30000;
+  Transfer = 0.5;
+  CPUThreads = 8;
+  CPULaunch = 5000;
+  UnknownTripCount = 100;
+}
+
+bool OffloadCostModel::readFromFile(StringRef Path, std::string &Error) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    Error = "can't read " + Path.str();
+    return false;
+  }
+
+  SmallVector<StringRef, 32> Lines;
+  (*Buffer)->getBuffer().split(Lines, "\n", -1, false);
+  for (unsigned i = 0, ie = Lines.size(); i != ie; ++i) {
+    StringRef Line = Lines[i].split('#').first.trim();
+    if (Line.empty())
+      continue;
+
+    std::pair<StringRef, StringRef> KV = Line.split('=');
+    StringRef Key = KV.first.trim();
+    std::string Text = KV.second.trim().str();
+    char *End = nullptr;
+    double Value = strtod(Text.c_str(), &End);
+    if (Text.empty() || *End || (Value < 0)) {
+      Error = Path.str() + ":" + std::to_string(i + 1) + ": bad value";
+      return false;
+    }
+
+    double *Field = nullptr;
+    for (unsigned c = 0; c != NumInstClasses; ++c) {
+      if (Key == (std::string("host-") + ClassNames[c]))
+        Field = &HostCost[c];
+      if (Key == (std::string("device-") + ClassNames[c]))
+        Field = &DeviceCost[c];
+    }
+    if (Key == "launch")
+      Field = &Launch;
+    else if (Key == "transfer")
+      Field = &Transfer;
+    else if (Key == "cpu-threads")
+      Field = &CPUThreads;
+    else if (Key == "cpu-launch")
+      Field = &CPULaunch;
+    else if (Key == "unknown-trip-count")
+      Field = &UnknownTripCount;
+
+    if (!Field) {
+      Error = Path.str() + ":" + std::to_string(i + 1) + ": unknown key " +
+              Key.str();
+      return false;
+    }
+    *Field = Value;
+  }
+
+  if (CPUThreads < 1)
+    CPUThreads = 1;
+  return true;
+}
+
+OffloadCostModel::InstClass OffloadCostModel::classify(const Instruction &I) {
+  if (isa<PHINode>(I) || isa<DbgInfoIntrinsic>(I) || isa<TerminatorInst>(I) ||
+      isa<AllocaInst>(I))
+    return IC_None;
+  if (isa<LoadInst>(I) || isa<StoreInst>(I))
+    return IC_Mem;
+  if (isa<CallInst>(I) || isa<InvokeInst>(I))
+    return IC_Call;
+
+  switch (I.getOpcode()) {
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+    return IC_Div;
+  default:
+    break;
+  }
+
+  if (I.getType()->isFPOrFPVectorTy() || isa<FCmpInst>(I))
+    return IC_FP;
+  return IC_Int;
+}
+
+double OffloadCostModel::getGain(const BasicBlock &BB, bool OnHost) const {
+  double Host = 0, Device = 0;
+  for (auto I = BB.begin(), IE = BB.end(); I != IE; ++I) {
+    InstClass C = classify(*I);
+    if (C == IC_None)
+      continue;
+    Host += HostCost[C];
+    Device += DeviceCost[C];
+  }
+  if (OnHost)
+    Device = Host / CPUThreads;
+  return Host - Device;
+}
+
+double OffloadCostModel::getLaunchCost(bool OnHost) const {
+  return OnHost ? CPULaunch : Launch;
+}
+
+double OffloadCostModel::getTransferCost(bool OnHost) const {
+  return OnHost ? 0 : Transfer;
+}
+
+bool OffloadCostModel::isEnabled() {
+  return ClOffloadCost;
+}
+
+OffloadCostModel OffloadCostModel::load() {
+  OffloadCostModel Model;
+  std::string Error;
+  if (!ClOffloadConfig.empty() && !Model.readFromFile(ClOffloadConfig, Error)) {
+    errs() << "Offload-Config: " << Error << ", using the default weights\n";
+    Model = OffloadCostModel();
+  }
+  return Model;
+}
+
+const OffloadCostModel &OffloadCostModel::get() {
+  // The initialization of a local static runs once, even when the workers of
+  // "-Jobs" reach it at the same time.
+  static const OffloadCostModel Model = load();
+  return Model;
+}
+
+//===------------------------ offloadCostModel.cpp -----------------------===//
@@ -0,0 +1,105 @@
+//===------------------------ offloadCostModel.h -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// OffloadCostModel estimates if running a computation on the accelerator (or,
+// with "-Emit-OMP=2", on several threads) pays off. It is enabled with
+// "-Offload-Cost", and RecoverCode uses it to guard the data and compute
+// pragmas with an "if(...)" clause that is evaluated at run time.
+//
+// A computation is offloaded when the time it saves is greater than the
+// fixed cost of starting it plus the cost of moving its data:
+//
+//   sum(Trips(B) * (HostCost(B) - DeviceCost(B))) >
+//       Launch + Transfer * sum(Bytes(P))
+//
+// where B are the basic blocks of the computation, Trips(B) is the product of
+// the trip counts of the loops around B, and P are the pointers copied between
+// the host and the device (twice, if they are copied in and out). The cost of
+// a block is the sum of the costs of its instructions, by class.
+//
+// On threads of the host, there is no transfer, and the device cost is the
+// host cost divided by the number of threads.
+//
+// The weights can be calibrated for each machine with a file given by
+// "-Offload-Config", with one "key = value" per line ('#' starts a comment):
+//
+//   host-int, host-fp, host-div, host-mem, host-call        Host costs.
+//   device-int, device-fp, device-div, device-mem, device-call
+//                                                           Device costs.
+//   launch              Cost of starting a computation on the device.
+//   transfer            Cost of moving one byte to or from the device.
+//   cpu-threads         Number of threads of the host.
+//   cpu-launch          Cost of starting the threads of the host.
+//   unknown-trip-count  Trips of a loop whose trip count is unknown.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OFFLOAD_COST_MODEL_H
+#define OFFLOAD_COST_MODEL_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include <string>
+
+namespace llvm {
+
+class OffloadCostModel {
+public:
+  // Classes of instructions with different costs.
+  enum InstClass { IC_Int, IC_FP, IC_Div, IC_Mem, IC_Call, IC_None,
+                   NumInstClasses = IC_None };
+
+private:
+  double HostCost[NumInstClasses];
+  double DeviceCost[NumInstClasses];
+  double Launch;
+  double Transfer;
+  double CPUThreads;
+  double CPULaunch;
+  double UnknownTripCount;
+
+  static InstClass classify(const Instruction &I);
+
+  // Build the model, with the weights of "-Offload-Config" if it is given.
+  static OffloadCostModel load();
+
+public:
+  OffloadCostModel();
+
+  // Read the weights of a configuration file. Keys not in the file keep their
+  // values. Returns false, with a message in Error, if it can't be read.
+  bool readFromFile(StringRef Path, std::string &Error);
+
+  // Time saved by running one execution of BB on the device, or on the
+  // threads of the host if OnHost is true.
+  double getGain(const BasicBlock &BB, bool OnHost) const;
+
+  // Fixed cost of starting the computation.
+  double getLaunchCost(bool OnHost) const;
+
+  // Cost of moving one byte between the host and the device.
+  double getTransferCost(bool OnHost) const;
+
+  // Trips assumed for a loop whose trip count can't be computed.
+  double getUnknownTripCount() const { return UnknownTripCount; }
+
+  // Returns true if "-Offload-Cost" is set.
+  static bool isEnabled();
+
+  // Model shared by every computation, read from "-Offload-Config" the first
+  // time it is used.
+  static const OffloadCostModel &get();
+};
+
+}
+
+#endif
+
+//===------------------------ offloadCostModel.h -------------------------===//
@@ -30,7 +30,12 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <queue>
 
 #include "llvm/IR/DIBuilder.h" 
@@ -45,6 +50,7 @@
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
 #include "recoverCode.h" 
+#include "commentsCache.h"
 #include "PtrRangeAnalysis.h"
 #include "restrictifier.h"
 
@@ -56,6 +62,16 @@ using namespace llvm;
 using namespace std;
 using namespace lge;
 
+// Experimental, and off by default: hidden until benchmarks/symbolic-bounds.sh
+// -check 1 shows that both modes write the same bounds on benchmarks/inputs
+// and ArrayInference/tests.
+static cl::opt<bool> ClSymbolicBounds("Symbolic-Bounds", cl::Hidden,
+    cl::desc("Write the bounds of pointers straight from their scalar "
+             "evolution expressions, without inserting instructions."));
+
+// Flag that changes the comments, for the keys of the comments cache.
+static CacheFlag SymbolicBoundsFlag(ClSymbolicBounds);
+
 void RecoverCode::setOMP (char omp) {
   OMPF = omp;
 }
@@ -66,7 +82,61 @@ char RecoverCode::OMPType() {
 
 void RecoverCode::clearCommands() {
   this->NewVars = 0;
-  commands.erase(commands.begin(), commands.end());
+  commands.clear();
+  CommandList.clear();
+}
+
+// Return true if "token" is a use of a command, NAME[index].
+static bool getCommandIndex (const std::string &token, const std::string &NAME,
+                             int *index) {
+  std::string prefix = NAME + "[";
+  if ((token.size() <= prefix.size() + 1) ||
+      (token.compare(0, prefix.size(), prefix) != 0) ||
+      (token[token.size() - 1] != ']'))
+    return false;
+  std::string digits = token.substr(prefix.size(),
+                                    token.size() - prefix.size() - 1);
+  if (digits.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  *index = atoi(digits.c_str());
+  return true;
+}
+
+// Replace each use of a command (NAME[i]) in "text" by NAME[rename(i)].
+static std::string renameCommandUses (const std::string &text,
+                                      const std::string &NAME,
+                                      const std::function<int(int)> &rename) {
+  std::string prefix = NAME + "[";
+  std::string result = std::string();
+  size_t begin = 0;
+  for (size_t pos = text.find(prefix); pos != std::string::npos;
+       pos = text.find(prefix, pos + 1)) {
+    // Skip longer names ending in NAME, like RST_NAME.
+    if ((pos > 0) && (isalnum(text[pos - 1]) || (text[pos - 1] == '_')))
+      continue;
+    size_t close = text.find(']', pos);
+    int index = -1;
+    if ((close == std::string::npos) ||
+        !getCommandIndex(text.substr(pos, close - pos + 1), NAME, &index))
+      continue;
+    result += text.substr(begin, pos - begin);
+    result += prefix + std::to_string(rename(index)) + "]";
+    begin = close + 1;
+  }
+  return result + text.substr(begin);
+}
+
+// Operands that simplifyCommand can reorder: names, numbers and commands.
+static bool isSimpleOperand (const std::string &token) {
+  if (token.empty() || (token == "-"))
+    return false;
+  for (unsigned int i = 0, ie = token.size(); i != ie; i++) {
+    char c = token[i];
+    if (!isalnum(c) && (c != '_') && (c != '[') && (c != ']') && (c != '.') &&
+        ((c != '-') || (i != 0)))
+      return false;
+  }
+  return true;
 }
 
 void RecoverCode::insertComputedValue (Value *V, int *id, std::string str) {
@@ -127,17 +197,9 @@ int RecoverCode::getIndex () {
 // Return a unique string to insert in the source file.
 std::string RecoverCode::getUniqueString () {
   std::string result = std::string();
-  std::vector <std::string> Exp(getIndex());
-  std::string value = std::string();
-  
-  for (std::map<std::string, int>::iterator I = this->commands.begin(),
-       IE = this->commands.end(); I != IE; I++) {
-    Exp[I->second] = I->first;
-  }
-  
-  for (unsigned int i = 0, ie = (Exp.size()-1); i < ie; i++) {
+  for (unsigned int i = 0, ie = CommandList.size(); i < ie; i++) {
     result +=  NAME + "[" + std::to_string(i) + "] = ";
-    result += Exp[i];
+    result += CommandList[i];
   }
   
   return result;
@@ -145,25 +207,161 @@ std::string RecoverCode::getUniqueString () {
 
 // This method insert or re-use some expression available:
 void RecoverCode::insertCommand (int* var, std::string expression) {
-  if (this->commands.count(expression) > 0) {
-    *var = this->commands[expression];
+  expression = simplifyCommand(expression);
+
+  // A command that only copies another one is the other one.
+  int index = -1;
+  if (getCommandIndex(expression.substr(0, expression.size() - 2), NAME,
+                      &index) && ((unsigned int) index < CommandList.size())) {
+    *var = index;
+    return;
+  }
+
+  auto It = this->commands.find(expression);
+  if (It != this->commands.end()) {
+    *var = It->second;
     return;
   }
   
   *var = getNewIndex();
   this->commands[expression] = *var; 
+  if (CommandList.size() <= (unsigned int) *var)
+    CommandList.resize(*var + 1);
+  CommandList[*var] = expression;
+}
+
+std::string RecoverCode::simplifyCommand (std::string expression) {
+  if ((expression.size() < 2) ||
+      (expression.compare(expression.size() - 2, 2, ";\n") != 0))
+    return expression;
+
+  std::vector<std::string> tokens;
+  std::string body = expression.substr(0, expression.size() - 2);
+  for (size_t begin = 0, end = 0; end != std::string::npos; begin = end + 1) {
+    end = body.find(' ', begin);
+    tokens.push_back(body.substr(begin, (end == std::string::npos) ?
+                                        std::string::npos : end - begin));
+  }
+
+  // Commands holding a constant are replaced by it.
+  for (unsigned int i = 0, ie = tokens.size(); i < ie; i += 2) {
+    int index = -1;
+    long long int num = 0;
+    if (!isSimpleOperand(tokens[i]))
+      return expression;
+    if (getCommandIndex(tokens[i], NAME, &index) &&
+        ((unsigned int) index < CommandList.size())) {
+      std::string value = CommandList[index];
+      value = value.substr(0, value.size() - 2);
+      if (isSimpleOperand(value) && TryConvertToInteger(value, &num))
+        tokens[i] = value;
+    }
+  }
+
+  if (tokens.size() == 1)
+    return tokens[0] + ";\n";
+
+  std::string signal = tokens[1];
+  if ((tokens.size() != 3) || ((signal != "+") && (signal != "-") &&
+      (signal != "*") && (signal != "/")))
+    return expression;
+
+  std::string value1 = tokens[0], value2 = tokens[2];
+  long long int num1 = 0, num2 = 0;
+  long long int maskSum = 1, maskMul = 1;
+  maskSum <<= 62;
+  maskMul <<= 31;
+  bool isNum1 = TryConvertToInteger(value1, &num1);
+  bool isNum2 = TryConvertToInteger(value2, &num2);
+
+  if (isNum1 && isNum2) {
+    if ((signal == "+") && (llabs(num1) < maskSum) && (llabs(num2) < maskSum))
+      return std::to_string(num1 + num2) + ";\n";
+    if ((signal == "-") && (llabs(num1) < maskSum) && (llabs(num2) < maskSum))
+      return std::to_string(num1 - num2) + ";\n";
+    if ((signal == "*") && (llabs(num1) < maskMul) && (llabs(num2) < maskMul))
+      return std::to_string(num1 * num2) + ";\n";
+    if ((signal == "/") && (num2 != 0))
+      return std::to_string(num1 / num2) + ";\n";
+  }
+
+  if (isNum2 && (num2 == 0) && ((signal == "+") || (signal == "-")))
+    return value1 + ";\n";
+  if (isNum1 && (num1 == 0) && (signal == "+"))
+    return value2 + ";\n";
+  if (isNum2 && (num2 == 1) && ((signal == "*") || (signal == "/")))
+    return value1 + ";\n";
+  if (isNum1 && (num1 == 1) && (signal == "*"))
+    return value2 + ";\n";
+  if (((isNum1 && (num1 == 0)) || (isNum2 && (num2 == 0))) && (signal == "*"))
+    return "0;\n";
+
+  if (((signal == "+") || (signal == "*")) && (value2 < value1))
+    std::swap(value1, value2);
+  return value1 + " " + signal + " " + value2 + ";\n";
+}
+
+std::string RecoverCode::compactCommands (std::string code) {
+  std::vector<int> newIndex(CommandList.size(), -1);
+  std::vector<int> worklist;
+  auto markUse = [&](int index) {
+    if (((unsigned int) index < newIndex.size()) && (newIndex[index] == -1)) {
+      newIndex[index] = 0;
+      worklist.push_back(index);
+    }
+    return index;
+  };
+
+  renameCommandUses(code, NAME, markUse);
+  renameCommandUses(offloadTest, NAME, markUse);
+  for (auto I = DataRanges.begin(), IE = DataRanges.end(); I != IE; I++) {
+    renameCommandUses(I->second.Lower, NAME, markUse);
+    renameCommandUses(I->second.Size, NAME, markUse);
+  }
+  while (!worklist.empty()) {
+    int index = worklist.back();
+    worklist.pop_back();
+    renameCommandUses(CommandList[index], NAME, markUse);
+  }
+
+  // Commands only use the ones before them, so numbering the live ones in
+  // their order keeps the list topological.
+  int live = 0;
+  for (unsigned int i = 0, ie = newIndex.size(); i != ie; i++)
+    if (newIndex[i] != -1)
+      newIndex[i] = live++;
+  auto rename = [&](int index) {
+    if ((unsigned int) index < newIndex.size() && (newIndex[index] != -1))
+      return newIndex[index];
+    return index;
+  };
+
+  std::vector<std::string> oldList;
+  oldList.swap(CommandList);
+  commands.clear();
+  for (unsigned int i = 0, ie = oldList.size(); i != ie; i++) {
+    if (newIndex[i] == -1)
+      continue;
+    std::string command = renameCommandUses(oldList[i], NAME, rename);
+    commands[command] = newIndex[i];
+    CommandList.push_back(command);
+  }
+  NewVars = live;
+
+  // The computed values keep the old numbers.
+  ComputedValues.clear();
+  offloadTest = renameCommandUses(offloadTest, NAME, rename);
+  for (auto I = DataRanges.begin(), IE = DataRanges.end(); I != IE; I++) {
+    I->second.Lower = renameCommandUses(I->second.Lower, NAME, rename);
+    I->second.Size = renameCommandUses(I->second.Size, NAME, rename);
+  }
+  return renameCommandUses(code, NAME, rename);
 }
 
 std::string RecoverCode::selectCommand (int var) {
-  if (var == -1)
+  if ((var < 0) || ((unsigned int) var >= CommandList.size()))
     return std::string();
-  
-  for (std::map<std::string, int>::iterator I = this->commands.begin(),
-       IE = this->commands.end(); I != IE; I++)
-    if (I->second == var)
-       return I->first;
-
-   return std::string();
+  return CommandList[var];
 }
 
 // Return the correct string to PtrToInt Instruction
@@ -818,6 +1016,83 @@ std::string RecoverCode::getAccessString (Value *V, std::string ptrName,
   return result;
 }
 
+// Write a bound built by SymbolicRangeBuilder. The leaves are written by
+// getAccessString and each operation is a new command.
+std::string RecoverCode::getBoundString (const BoundExpr *E,
+                                         std::string ptrName, int *var,
+                                         const DataLayout *DT) {
+  if (!E) {
+    setValidFalse();
+    return std::string();
+  }
+
+  switch (E->Kind) {
+    case BoundExpr::BE_Constant:
+      return std::to_string(E->Constant);
+    case BoundExpr::BE_Value:
+      return getAccessString(E->Val, ptrName, var, DT);
+    default:
+    break;
+  }
+
+  int op1 = -1, op2 = -1;
+  std::string value1 = getBoundString(E->LHS, ptrName, &op1, DT);
+  std::string value2 = getBoundString(E->RHS, ptrName, &op2, DT);
+  if (!isValid())
+    return std::string();
+
+  // The base pointer is written as "0", so the sums with it are simplified
+  // here.
+  if (E->Kind == BoundExpr::BE_Add && op1 == -1 && value1 == "0") {
+    *var = op2;
+    return value2;
+  }
+
+  if (E->Kind == BoundExpr::BE_Add && op2 == -1 && value2 == "0") {
+    *var = op1;
+    return value1;
+  }
+
+  if (op1 != -1)
+    value1 += NAME + "[" + std::to_string(op1) + "]";
+  if (op2 != -1)
+    value2 += NAME + "[" + std::to_string(op2) + "]";
+
+  std::string expression = std::string();
+  switch (E->Kind) {
+    case BoundExpr::BE_Add:
+      expression = value1 + " + " + value2;
+    break;
+    case BoundExpr::BE_Mul:
+      expression = value1 + " * " + value2;
+    break;
+    case BoundExpr::BE_UDiv:
+      expression = value1 + " / " + value2;
+    break;
+    case BoundExpr::BE_Max:
+      expression = "(" + value1 + " > " + value2 + " ? " + value1 + " : " +
+                   value2 + ")";
+    break;
+    case BoundExpr::BE_Min:
+      expression = "(" + value1 + " < " + value2 + " ? " + value1 + " : " +
+                   value2 + ")";
+    break;
+    case BoundExpr::BE_ClampUpper:
+      expression = "(" + value1 + " > " + value2 + " ? " +
+                   std::to_string(E->Constant) + " : " + value1 + ")";
+    break;
+    case BoundExpr::BE_ClampLower:
+      expression = "(" + value1 + " < " + value2 + " ? " +
+                   std::to_string(E->Constant) + " : " + value1 + ")";
+    break;
+    default:
+    break;
+  }
+
+  insertCommand(var, expression + ";\n");
+  return std::string();
+}
+
 Region* RecoverCode::regionofBasicBlock (BasicBlock *bb,
                                                   RegionInfoPass *rp) {
   Region *r = rp->getRegionInfo().getRegionFor(bb);
@@ -1113,7 +1388,8 @@ bool RecoverCode::isValidPointer (Value *Pointer, const DataLayout* DT) {
 
 // Return a string with the access Expression to the pointer.
 std::string RecoverCode::getAccessExpression (Value* Pointer, Value* Expression,
-                                             const DataLayout* DT, bool upper) {
+                                             const DataLayout* DT, bool upper,
+                                             const BoundExpr *Bound) {
   int var = -1, number = 0;
   RecoverNames::VarNames nameF = rn->getNameofValue(Pointer);
 
@@ -1151,7 +1427,10 @@ std::string RecoverCode::getAccessExpression (Value* Pointer, Value* Expression,
   subExp1 = std::to_string(size) + " * ";
   subExp2 = " * " +  std::to_string(size) + ";\n";
   
-  expression = getAccessString(Expression, nameF.nameInFile, &var, DT);
+  if (ClSymbolicBounds)
+    expression = getBoundString(Bound, nameF.nameInFile, &var, DT);
+  else
+    expression = getAccessString(Expression, nameF.nameInFile, &var, DT);
   
   if (var == -1) {
     long long int num = -1;
@@ -1180,7 +1459,10 @@ std::string RecoverCode::getDataPragma (
   std::vector<std::string> loads;
   std::vector<std::string> stores;
   std::vector<std::string> ldnsts; 
+  std::vector<std::string> allocs;
   for (auto I = vctPtMA.begin(), IE = vctPtMA.end(); I != IE; I++) {
+    if (I->second == 4)
+      allocs.push_back(I->first);
     if (I->second == 2)
       stores.push_back(I->first);
     if (I->second == 1)
@@ -1222,7 +1504,7 @@ std::string RecoverCode::getDataPragma (
       result += ",";
   }
   if (stores.size() != 0)
-    result += ")";
+    result += ") ";
   if ((OMPF == OMP_CPU) || (OMPF == OMP_GPU)) {
     if (ldnsts.size() != 0)
       result += "map(tofrom: ";
@@ -1238,6 +1520,23 @@ std::string RecoverCode::getDataPragma (
       result += ",";
   }
   if (ldnsts.size() != 0)
+    result += ") ";
+  // Create data only on the device
+  if ((OMPF == OMP_CPU) || (OMPF == OMP_GPU)) {
+    if (allocs.size() != 0)
+      result += "map(alloc: ";
+  }
+  else {
+    if (allocs.size() != 0)
+      result += "pcreate(";
+  }
+  for (unsigned int i = 0, ie = allocs.size(); i != ie; i++) {
+    result += allocs[i] + "[" + vctLower[allocs[i]];
+    result += ":" + vctUpper[allocs[i]] + "]";
+    if (i != (ie-1))
+      result += ",";
+  }
+  if (allocs.size() != 0)
     result += ")";
   result += "\n";
   if (OMPF == ACC)
@@ -1253,7 +1552,10 @@ std::string RecoverCode::getDataPragmaRegion (
   std::vector<std::string> loads;
   std::vector<std::string> stores;
   std::vector<std::string> ldnsts; 
+  std::vector<std::string> allocs;
   for (auto I = vctPtMA.begin(), IE = vctPtMA.end(); I != IE; I++) {
+    if (I->second == 4)
+      allocs.push_back(I->first);
     if (I->second == 2)
       stores.push_back(I->first);
     if (I->second == 1) {
@@ -1296,7 +1598,7 @@ std::string RecoverCode::getDataPragmaRegion (
       result += ",";
   }
   if (stores.size() != 0)
-    result += ")";
+    result += ") ";
   if ((OMPF == OMP_CPU) || (OMPF == OMP_GPU)) {
     if (ldnsts.size() != 0)
       result += "map(tofrom: ";
@@ -1312,6 +1614,23 @@ std::string RecoverCode::getDataPragmaRegion (
       result += ",";
   }
   if (ldnsts.size() != 0)
+    result += ") ";
+  // Create data only on the device
+  if ((OMPF == OMP_CPU) || (OMPF == OMP_GPU)) {
+    if (allocs.size() != 0)
+      result += "map(alloc: ";
+  }
+  else {
+    if (allocs.size() != 0)
+      result += "pcreate(";
+  }
+  for (unsigned int i = 0, ie = allocs.size(); i != ie; i++) {
+    result += allocs[i] + "[" + vctLower[allocs[i]];
+    result += ":" + vctUpper[allocs[i]] + "]";
+    if (i != (ie-1))
+      result += ",";
+  }
+  if (allocs.size() != 0)
     result += ")";
   result += "\n";
   return result;
@@ -1515,6 +1834,250 @@ std::string RecoverCode::getPointerMD (Value *V, std::string name, int *var,
   return std::string();
 }
 
+// Write a cost as a C constant.
+static std::string costToString (double cost) {
+  if (cost == std::floor(cost) && std::fabs(cost) < 1e15)
+    return std::to_string((long long int) cost);
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.6g", cost);
+  return std::string(buffer);
+}
+
+std::string RecoverCode::getTripCount (Loop *L, SCEVRangeBuilder &rangeBuilder,
+                                       SymbolicRangeBuilder &symbolicBuilder,
+                                       ScalarEvolution *se,
+                                       const DataLayout *DT, double &trips) {
+  trips = OffloadCostModel::get().getUnknownTripCount();
+  const SCEV *BECount = se->getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BECount))
+    return std::string();
+
+  if (const SCEVConstant *C = dyn_cast<SCEVConstant>(BECount)) {
+    trips = (double) C->getValue()->getValue().getZExtValue() + 1;
+    return std::string();
+  }
+
+  // The check inserts no instruction, so it is done in both modes: a trip
+  // count is only written if SCEVRangeBuilder would write it too.
+  if (!rangeBuilder.canComputeBoundsFor(BECount))
+    return std::string();
+
+  // The bounds of the other loops don't depend on this one, so undo the
+  // commands of a trip count we fail to write.
+  std::unordered_map<std::string, int> oldCommands = commands;
+  std::vector<std::string> oldList = CommandList;
+  std::map<Value*, std::pair<int,std::string> > oldValues = ComputedValues;
+  unsigned int oldNewVars = NewVars;
+  Value *oldPointer = getPointer();
+
+  int var = -1;
+  std::string expression = std::string();
+  if (ClSymbolicBounds) {
+    if (const BoundExpr *upper = symbolicBuilder.getUpperBound(BECount))
+      expression = getBoundString(upper, std::string(), &var, DT);
+  }
+  else if (Value *upper = rangeBuilder.getUpperBound(BECount))
+    expression = getAccessString(upper, std::string(), &var, DT);
+  if (var != -1)
+    expression = NAME + "[" + std::to_string(var) + "]";
+
+  setPointer(oldPointer);
+  if (!isValid() || expression.empty()) {
+    commands = oldCommands;
+    CommandList = oldList;
+    ComputedValues = oldValues;
+    NewVars = oldNewVars;
+    setValidTrue();
+    return std::string();
+  }
+
+  long long int num = 0;
+  if (TryConvertToInteger(expression, &num)) {
+    trips = (double) num + 1;
+    return std::string();
+  }
+  return "(" + expression + " + 1)";
+}
+
+std::string RecoverCode::getOffloadCondition (Loop *L, Region *R,
+                               SCEVRangeBuilder &rangeBuilder,
+                               SymbolicRangeBuilder &symbolicBuilder,
+                               ScalarEvolution *se, LoopInfo *li,
+                               std::map<std::string, std::string> & vctUpper,
+                               std::map<std::string, char> & vctPtMA,
+                               std::map<std::string, Value*> & vctPtr,
+                               const DataLayout *DT) {
+  const OffloadCostModel &CM = OffloadCostModel::get();
+  bool onHost = (OMPF == OMP_CPU);
+
+  // Gain of the blocks of each loop (null for blocks out of any loop of the
+  // computation), as each of them runs as many times as its loop nest.
+  std::map<Loop*, double> gains;
+  std::vector<BasicBlock*> blocks;
+  if (L)
+    blocks.assign(L->block_begin(), L->block_end());
+  else
+    for (auto BB = R->block_begin(), BE = R->block_end(); BB != BE; BB++)
+      blocks.push_back(*BB);
+
+  for (unsigned int i = 0, ie = blocks.size(); i != ie; i++) {
+    Loop *Lp = li->getLoopFor(blocks[i]);
+    if (Lp && !(L ? L->contains(Lp) : R->contains(Lp)))
+      Lp = nullptr;
+    gains[Lp] += CM.getGain(*blocks[i], onHost);
+  }
+
+  // Work saved by offloading, as a constant plus a sum of symbolic terms.
+  std::map<Loop*, std::pair<double, std::string> > tripCounts;
+  double work = 0;
+  std::string symbolicWork = std::string();
+  for (auto I = gains.begin(), IE = gains.end(); I != IE; I++) {
+    double coefficient = I->second;
+    std::string factors = std::string();
+    for (Loop *Lp = I->first; Lp && (L ? L->contains(Lp) : R->contains(Lp));
+         Lp = Lp->getParentLoop()) {
+      if (tripCounts.count(Lp) == 0) {
+        double trips = 0;
+        std::string expression = getTripCount(Lp, rangeBuilder,
+                                              symbolicBuilder, se, DT, trips);
+        tripCounts[Lp] = std::make_pair(trips, expression);
+      }
+      if (tripCounts[Lp].second.empty())
+        coefficient *= tripCounts[Lp].first;
+      else
+        factors += " * " + tripCounts[Lp].second;
+    }
+    if (factors.empty()) {
+      work += coefficient;
+      continue;
+    }
+    if (!symbolicWork.empty())
+      symbolicWork += " + ";
+    symbolicWork += costToString(coefficient) + factors;
+  }
+
+  // Bytes moved between the host and the device.
+  double bytes = 0;
+  std::string symbolicBytes = std::string();
+  if (!onHost) {
+    for (auto I = vctUpper.begin(), IE = vctUpper.end(); I != IE; I++) {
+      if (vctPtMA[I->first] == 4)
+        continue;
+      unsigned int size = getSizeInBytes(getSizeToValue(vctPtr[I->first], DT));
+      if (vctPtMA[I->first] == 3)
+        size *= 2;
+      long long int num = 0;
+      if (TryConvertToInteger(I->second, &num)) {
+        bytes += (double) size * num;
+        continue;
+      }
+      if (!symbolicBytes.empty())
+        symbolicBytes += " + ";
+      symbolicBytes += std::to_string(size) + " * (" + I->second + ")";
+    }
+  }
+
+  double fixed = CM.getLaunchCost(onHost) +
+                 CM.getTransferCost(onHost) * bytes;
+  if (symbolicWork.empty() && symbolicBytes.empty())
+    return (work > fixed) ? std::string() : std::string("0");
+
+  std::string expression = "(";
+  if (!symbolicWork.empty())
+    expression += symbolicWork + " + ";
+  expression += costToString(work) + " > " + costToString(fixed);
+  if (!symbolicBytes.empty())
+    expression += " + " + costToString(CM.getTransferCost(onHost)) + " * (" +
+                  symbolicBytes + ")";
+  expression += ");\n";
+
+  int var = -1;
+  insertCommand(&var, expression);
+  return NAME + "[" + std::to_string(var) + "]";
+}
+
+void RecoverCode::setDataRanges (std::map<std::string, std::string> & vctLower,
+                                 std::map<std::string, std::string> & vctUpper,
+                                 std::map<std::string, char> & vctPtMA,
+                                 std::map<std::string, Value*> & vctPtr) {
+  DataRanges.clear();
+  for (auto I = vctPtr.begin(), IE = vctPtr.end(); I != IE; I++) {
+    DataRange &DR = DataRanges[I->second];
+    DR.Name = I->first;
+    DR.Lower = vctLower[I->first];
+    DR.Size = vctUpper[I->first];
+    DR.Access = vctPtMA[I->first];
+  }
+}
+
+std::string RecoverCode::expandCommands (std::string expression) {
+  std::map<int, std::string> byIndex;
+  for (unsigned int i = 0, ie = CommandList.size(); i != ie; i++) {
+    std::string command = CommandList[i];
+    if ((command.size() >= 2) &&
+        (command.compare(command.size() - 2, 2, ";\n") == 0))
+      command.erase(command.size() - 2);
+    byIndex[i] = command;
+  }
+
+  // Commands only use the ones created before them, so each round removes a
+  // level of them.
+  std::string prefix = NAME + "[";
+  for (unsigned int round = 0; round <= byIndex.size(); round++) {
+    size_t pos = expression.find(prefix);
+    if (pos == std::string::npos)
+      return expression;
+
+    std::string result = std::string();
+    size_t begin = 0;
+    while (pos != std::string::npos) {
+      size_t close = expression.find(']', pos);
+      long long int index = -1;
+      if ((close == std::string::npos) ||
+          !TryConvertToInteger(expression.substr(pos + prefix.size(),
+                                          close - pos - prefix.size()), &index)
+          || !byIndex.count(index))
+        return std::string();
+      result += expression.substr(begin, pos - begin);
+      result += "(" + byIndex[index] + ")";
+      begin = close + 1;
+      pos = expression.find(prefix, begin);
+    }
+    result += expression.substr(begin);
+    expression = result;
+  }
+  return std::string();
+}
+
+std::string RecoverCode::addOffloadCondition (std::string pragmas,
+                                              std::string cond) {
+  if (cond.empty())
+    return pragmas;
+
+  std::string result = std::string();
+  std::string rstTest = " if(!RST_" + NAME + ")";
+  size_t begin = 0;
+  while (begin < pragmas.size()) {
+    size_t end = pragmas.find('\n', begin);
+    if (end == std::string::npos)
+      end = pragmas.size();
+    std::string line = pragmas.substr(begin, end - begin);
+    if (line.compare(0, 7, "#pragma") == 0) {
+      if ((line.size() >= rstTest.size()) &&
+          (line.compare(line.size() - rstTest.size(), rstTest.size(),
+                        rstTest) == 0))
+        line.insert(line.size() - 1, " && " + cond);
+      else
+        line += " if(" + cond + ")";
+    }
+    result += line;
+    if (end != pragmas.size())
+      result += "\n";
+    begin = end + 1;
+  }
+  return result;
+}
+
 bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
                                         PtrRangeAnalysis *ptrRA, 
                                         RegionInfoPass *rp, AliasAnalysis *aa,
@@ -1523,10 +2086,13 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
   
   // Initilize The Analisys with Default Values.
   initializeNewVars(); 
+  offloadTest = std::string();
 
   Module *M = L->getLoopPredecessor()->getParent()->getParent();
   const DataLayout DT = DataLayout(M);
   std::map<Value*, std::pair<Value*, Value*> > pointerBounds;
+  std::map<Value*, std::pair<const BoundExpr*, const BoundExpr*> >
+    symbolicBounds;
   std::string expression = std::string();
   std::string expressionEnd = std::string();
 
@@ -1542,6 +2108,7 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
     
   Instruction *insertPt = r->getEntry()->getTerminator();
   SCEVRangeBuilder rangeBuilder(se, DT, aa, li, dt, r, insertPt);
+  SymbolicRangeBuilder symbolicBuilder(se, DT, aa, li, dt, r, insertPt);
 
   // Generate and store both bounds for each base pointer in the region.
   for (auto& pair : ptrRA->RegionsRangeData[r].BasePtrsData) {
@@ -1549,6 +2116,16 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
       continue;
     // Adds "sizeof(element)" to the upper bound of a pointer, so it gives us
     // the address of the first byte after the memory region.
+    if (ClSymbolicBounds) {
+      const BoundExpr *low =
+        symbolicBuilder.getULowerBound(pair.second.AccessFunctions);
+      const BoundExpr *up =
+        symbolicBuilder.getUUpperBound(pair.second.AccessFunctions);
+      up = symbolicBuilder.stretchPtrUpperBound(pair.first, up);
+      symbolicBounds[pair.first] = std::make_pair(low, up);
+      pointerBounds[pair.first] = std::pair<Value*, Value*>(nullptr, nullptr);
+      continue;
+    }
     Value *low = rangeBuilder.getULowerBound(pair.second.AccessFunctions);
     Value *up = rangeBuilder.getUUpperBound(pair.second.AccessFunctions);
     up = rangeBuilder.stretchPtrUpperBound(pair.first, up);
@@ -1567,9 +2144,9 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
     RecoverNames::VarNames nameF = rn->getNameofValue(It->first);
     Rst.setNameToValue(nameF.nameInFile, It->first);
     std::string lLimit = getAccessExpression(It->first, It->second.first,
-        &DT, false);
+        &DT, false, symbolicBounds[It->first].first);
     std::string uLimit = getAccessExpression(It->first, It->second.second,
-        &DT, true);
+        &DT, true, symbolicBounds[It->first].second);
    
     std::string olLimit = std::string();
     std::string oSize = std::string();
@@ -1578,7 +2155,7 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
       continue;
     vctLower[nameF.nameInFile] = olLimit;
     vctUpper[nameF.nameInFile] = oSize;
-    vctPtMA[nameF.nameInFile] = ptrRA->getPointerAcessType(L, It->first);
+    vctPtMA[nameF.nameInFile] = ptrRA->getPointerAcessType(L, r, It->first);
     vctPtr[nameF.nameInFile] = It->first;
     needR[nameF.nameInFile] = needPointerAddrToRestrict(It->first);
     if (!isValid() || nameF.nameInFile.empty()) {
@@ -1591,28 +2168,36 @@ bool RecoverCode::analyzeLoop (Loop* L, int Line, int LastLine,
 
   }
   
+  if (OffloadCostModel::isEnabled())
+    offloadTest = getOffloadCondition(L, nullptr, rangeBuilder,
+                                      symbolicBuilder, se, li, vctUpper,
+                                      vctPtMA, vctPtr, &DT);
+
+  setDataRanges(vctLower, vctUpper, vctPtMA, vctPtr);
   expression += getDataPragma(vctLower, vctUpper, vctPtMA);
 
   if (isValid()) {
-    std::string result = std::string(); 
-    if (getIndex() > 0) {
-      result += "long long int " + NAME + "[";
-      result += std::to_string(getNewIndex()) + "];\n";
-      result += getUniqueString();
-    }
-    result += expression;
-
     if (OMPF == OMP_GPU)
       Rst.setTrueOMP();
 
     Rst.setName("RST_"+NAME);
     Rst.getBounds(vctLower, vctUpper, vctPtr, needR);
-    result = Rst.generateTests(result);
+    std::string result = Rst.generateTests(expression);
+    result = addOffloadCondition(result, offloadTest);
+
+    // Write only the commands used by the pragmas, the tests and the data
+    // ranges, before them.
+    result = compactCommands(result);
+    if (getIndex() > 0) {
+      std::string prologue = "long long int " + NAME + "[";
+      prologue += std::to_string(getNewIndex()) + "];\n";
+      result = prologue + getUniqueString() + result;
+    }
 
     restric = Rst.isValid();
     // Use to insert test on parallel pragmas
-    //if (Rst.isValid())
-    //  test = "if(!RST_" + NAME + ")"; 
+    if (Rst.isValid())
+      test = "if(!RST_" + NAME + ")";
     Comments[Line] = result;
   }
   return isValid();
@@ -1626,9 +2211,12 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
 
   // Initilize The Analisys with Default Values.
   initializeNewVars(); 
+  offloadTest = std::string();
   Module *M = r->block_begin()->getParent()->getParent();
   const DataLayout DT = DataLayout(M);
   std::map<Value*, std::pair<Value*, Value*> > pointerBounds;
+  std::map<Value*, std::pair<const BoundExpr*, const BoundExpr*> >
+    symbolicBounds;
   std::string expression = std::string();
   std::string expressionEnd = std::string();
 
@@ -1656,6 +2244,7 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
     return false;
 
   SCEVRangeBuilder rangeBuilder(se, DT, aa, li, dt, r, insertPt);
+  SymbolicRangeBuilder symbolicBuilder(se, DT, aa, li, dt, r, insertPt);
   // Generate and store both bounds for each base pointer in the region.
   for (auto& pair : ptrRA->RegionsRangeData[r].BasePtrsData) {
     if (pointerDclInsideRegion(r,pair.first)) {
@@ -1663,6 +2252,16 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
     }
     // Adds "sizeof(element)" to the upper bound of a pointer, so it gives us
     // the address of the first byte after the memory region.
+    if (ClSymbolicBounds) {
+      const BoundExpr *low =
+        symbolicBuilder.getULowerBound(pair.second.AccessFunctions);
+      const BoundExpr *up =
+        symbolicBuilder.getUUpperBound(pair.second.AccessFunctions);
+      up = symbolicBuilder.stretchPtrUpperBound(pair.first, up);
+      symbolicBounds[pair.first] = std::make_pair(low, up);
+      pointerBounds[pair.first] = std::pair<Value*, Value*>(nullptr, nullptr);
+      continue;
+    }
     Value *low = rangeBuilder.getULowerBound(pair.second.AccessFunctions);
     Value *up = rangeBuilder.getUUpperBound(pair.second.AccessFunctions);
     up = rangeBuilder.stretchPtrUpperBound(pair.first, up);
@@ -1681,9 +2280,9 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
     RecoverNames::VarNames nameF = rn->getNameofValue(It->first);
     Rst.setNameToValue(nameF.nameInFile, It->first);
     std::string lLimit = getAccessExpression(It->first, It->second.first,
-        &DT, false);
+        &DT, false, symbolicBounds[It->first].first);
     std::string uLimit = getAccessExpression(It->first, It->second.second,
-        &DT, true);
+        &DT, true, symbolicBounds[It->first].second);
     std::string olLimit = std::string();
     std::string oSize = std::string();
     generateCorrectUB(lLimit, uLimit, olLimit, oSize);
@@ -1691,7 +2290,8 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
       continue; 
     vctLower[nameF.nameInFile] = olLimit;
     vctUpper[nameF.nameInFile] = oSize;
-    vctPtMA[nameF.nameInFile] = ptrRA->getPointerAcessType(r, It->first);
+    vctPtMA[nameF.nameInFile] = ptrRA->getPointerAcessType(nullptr, r,
+                                                           It->first);
     vctPtr[nameF.nameInFile] = It->first;
     needR[nameF.nameInFile] = needPointerAddrToRestrict(It->first);
     //errs() << nameF.nameInFile << "\n" << lLimit << "\n" << uLimit << "\n\n" ;
@@ -1706,27 +2306,35 @@ bool RecoverCode::analyzeRegion (Region *r, int Line, int LastLine,
 
   }
   
+  if (OffloadCostModel::isEnabled())
+    offloadTest = getOffloadCondition(nullptr, r, rangeBuilder,
+                                      symbolicBuilder, se, li, vctUpper,
+                                      vctPtMA, vctPtr, &DT);
+
+  setDataRanges(vctLower, vctUpper, vctPtMA, vctPtr);
   expression += getDataPragmaRegion(vctLower, vctUpper, vctPtMA);
   if (isValid()) {
-    std::string result = std::string(); 
-    if (getIndex() > 0) {
-      result += "long long int " + NAME + "[";
-      result += std::to_string(getNewIndex()) + "];\n";
-      result += getUniqueString();
-    }
-    result += expression;
-
     if (OMPF == OMP_GPU)
       Rst.setTrueOMP();
 
     Rst.setName("RST_"+NAME);
     Rst.getBounds(vctLower, vctUpper, vctPtr, needR);
-    result = Rst.generateTests(result);
+    std::string result = Rst.generateTests(expression);
+    result = addOffloadCondition(result, offloadTest);
+
+    // Write only the commands used by the pragmas, the tests and the data
+    // ranges, before them.
+    result = compactCommands(result);
+    if (getIndex() > 0) {
+      std::string prologue = "long long int " + NAME + "[";
+      prologue += std::to_string(getNewIndex()) + "];\n";
+      result = prologue + getUniqueString() + result;
+    }
 
     restric = Rst.isValid();
     // Use to insert test on parallel pragmas
-    //if (Rst.isValid())
-    //  test = "if(!RST_" + NAME + ")";
+    if (Rst.isValid())
+      test = "if(!RST_" + NAME + ")";
     result += "{\n";
     Comments[Line] = result;
   }
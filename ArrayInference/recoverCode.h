@@ -26,10 +26,14 @@
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 
 #include "PtrRangeAnalysis.h"
+#include "SymbolicRangeBuilder.h"
 
 #include "constantsSimplify.h"
+#include "offloadCostModel.h"
 #include "recoverNames.h"
 
+#include <unordered_map>
+
 using namespace lge;
 
 namespace llvm {
@@ -53,8 +57,13 @@ class RecoverCode {
   //===---------------------------------------------------------------------===
   //                              Data Structs
   //===---------------------------------------------------------------------===
-  // Data structs to identify a instruction with the command with C/C++ sintaxy:
-  std::map<std::string, int> commands;
+  // Data structs to identify a instruction with the command with C/C++ sintaxy.
+  // Commands are the nodes of a DAG: each one only uses the ones created
+  // before it, so CommandList, indexed by command, is in topological order,
+  // and "commands" finds a command by its text after simplifyCommand.
+  std::unordered_map<std::string, int> commands;
+
+  std::vector<std::string> CommandList;
   
   std::vector<std::string> Expression;
   
@@ -171,9 +180,11 @@ class RecoverCode {
   std::string getValidBounds (std::string Expression, int *Index);
 
   // Return the Expression value converted to the position of the array of
-  // "Pointer"
+  // "Pointer". With "-Symbolic-Bounds", the value is written from Bound
+  // instead of Expression.
   std::string getAccessExpression (Value* Pointer, Value* Expression,
-                                  const DataLayout* DT, bool upper);
+                                  const DataLayout* DT, bool upper,
+                                  const BoundExpr *Bound = nullptr);
 
   // Generate pragmas to data transference between devices, using loop context.
   std::string getDataPragma (std::map<std::string, std::string> & vctLower,
@@ -198,6 +209,35 @@ class RecoverCode {
   // we cannot annotate it).
   bool pointerDclInsideLoop(Loop *L, Value *V); 
 
+  // Return the trip count of loop "L" as a C expression, or as a number in
+  // "trips" if it is a constant (or unknown, in which case the cost model
+  // gives the number of trips).
+  std::string getTripCount (Loop *L, SCEVRangeBuilder &rangeBuilder,
+                            SymbolicRangeBuilder &symbolicBuilder,
+                            ScalarEvolution *se, const DataLayout *DT,
+                            double &trips);
+
+  // Return the condition, as a C expression, that says if offloading the
+  // blocks of "L" (or of "R", if "L" is null) pays off, following the
+  // OffloadCostModel. Return an empty string if it always pays off.
+  std::string getOffloadCondition (Loop *L, Region *R,
+                               SCEVRangeBuilder &rangeBuilder,
+                               SymbolicRangeBuilder &symbolicBuilder,
+                               ScalarEvolution *se, LoopInfo *li,
+                               std::map<std::string, std::string> & vctUpper,
+                               std::map<std::string, char> & vctPtMA,
+                               std::map<std::string, Value*> & vctPtr,
+                               const DataLayout *DT);
+
+  // Fill DataRanges with the bounds of each pointer.
+  void setDataRanges (std::map<std::string, std::string> & vctLower,
+                      std::map<std::string, std::string> & vctUpper,
+                      std::map<std::string, char> & vctPtMA,
+                      std::map<std::string, Value*> & vctPtr);
+
+  // Add the condition "cond" to the "if" clause of each pragma in "pragmas".
+  std::string addOffloadCondition (std::string pragmas, std::string cond);
+
   public:
 
   RecoverCode () {
@@ -213,6 +253,25 @@ class RecoverCode {
   std::map<unsigned int, std::string> Comments;
 
   bool restric;  
+
+  // Condition of the offloading cost model for the last analyzed loop or
+  // region, to insert in its parallel pragmas. Empty if there is none.
+  std::string offloadTest;
+
+  // Data copied to the device for each base pointer of the last analyzed
+  // loop or region: its name, bounds and access (1 to, 2 from, 3 tofrom).
+  struct DataRange {
+    std::string Name;
+    std::string Lower;
+    std::string Size;
+    char Access;
+
+    // The range as written in data pragmas, "name[lower:size]".
+    std::string getItem() const {
+      return Name + "[" + Lower + ":" + Size + "]";
+    }
+  };
+  std::map<Value*, DataRange> DataRanges;
   //===---------------------------------------------------------------------===
 
   // Set true to emit omp pragmas
@@ -245,6 +304,16 @@ class RecoverCode {
   // Insert the command in the list of expressions named commands.
   void insertCommand (int* var, std::string expression);
 
+  // Put a command in canonical form: the operands that are commands holding a
+  // constant are replaced by it, binary operations on constants are folded,
+  // and the operands of "+" and "*" are sorted.
+  std::string simplifyCommand (std::string expression);
+
+  // Drop the commands that are not used by "code", by DataRanges or by
+  // offloadTest, and renumber the others keeping their order. Returns "code"
+  // with the new numbers.
+  std::string compactCommands (std::string code);
+
   // Validate the pointer to write the pragmas.
   bool isValidPointer (Value *Pointer, const DataLayout* DT);
 
@@ -270,10 +339,20 @@ class RecoverCode {
   // Return the vector Expression in one simple string.
   std::string getUniqueString ();
 
+  // Replace, in "expression", the uses of the commands (NAME[i]) by their
+  // expressions, so it can be written out of the computation. Returns an
+  // empty string if a command is unknown.
+  std::string expandCommands (std::string expression);
+
   // Return the access expression in a string form, to write in source file.
   std::string getAccessString (Value *V, std::string ptrName, int *var,
                               const DataLayout *DT);
 
+  // Translate a bound built by SymbolicRangeBuilder to C, like
+  // getAccessString does for the instructions of SCEVRangeBuilder.
+  std::string getBoundString (const BoundExpr *E, std::string ptrName,
+                              int *var, const DataLayout *DT);
+
   // Define if we need to dereference the pointer.
   bool needPointerAddrToRestrict(Value *V);
 
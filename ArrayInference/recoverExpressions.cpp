@@ -27,6 +27,7 @@
 #include "llvm/ADT/Statistic.h"
 
 #include "recoverExpressions.h"
+#include "commentsCache.h"
 
 using namespace llvm;
 using namespace std;
@@ -38,6 +39,9 @@ using namespace lge;
 static cl::opt<bool> ClRegionTask("Region-Task",
 cl::Hidden, cl::desc("Annotate regions in the source file."));
 
+// Flag that changes the comments, for the keys of the comments cache.
+static CacheFlag RegionTaskFlag(ClRegionTask);
+
 int RecoverExpressions::getIndex() {
   return this->index;
 }
@@ -97,19 +97,38 @@ const Function *RecoverNames::findEnclosingFunc(const Value *V) {
   return NULL;
 }
 
-const DILocalVariable *RecoverNames::findVar(const Value *V, const Function *F) {
+const DenseMap<const Value*, const DILocalVariable*> &
+RecoverNames::getDebugVars(const Function *F) {
+  auto It = debugVars.find(F);
+  if (It != debugVars.end())
+    return It->second;
+
+  // The first intrinsic of each value gives its variable.
+  DenseMap<const Value*, const DILocalVariable*> &vars = debugVars[F];
   for (auto Iter = inst_begin(F), End = inst_end(F); Iter != End; ++Iter) {
     const Instruction *I = &*Iter;
+    const Value *V = nullptr;
+    const DILocalVariable *Var = nullptr;
     if (const DbgDeclareInst *DbgDeclare = dyn_cast<DbgDeclareInst>(I)) {
-      if (DbgDeclare->getAddress() == V)
-        return DbgDeclare->getVariable();
-
+      V = DbgDeclare->getAddress();
+      Var = DbgDeclare->getVariable();
+    }
+    else if (const DbgValueInst *DbgValue = dyn_cast<DbgValueInst>(I)) {
+      V = DbgValue->getValue();
+      Var = DbgValue->getVariable();
     }
-    else if (const DbgValueInst *DbgValue = dyn_cast<DbgValueInst>(I))
-      if (DbgValue->getValue() == V)
-        return DbgValue->getVariable();
+    if (V && !vars.count(V))
+      vars[V] = Var;
   }
-  return NULL;
+  return vars;
+}
+
+const DILocalVariable *RecoverNames::findVar(const Value *V, const Function *F) {
+  const DenseMap<const Value*, const DILocalVariable*> &vars = getDebugVars(F);
+  auto It = vars.find(V);
+  if (It == vars.end())
+    return NULL;
+  return It->second;
 }
 
 StringRef RecoverNames::getOriginalName(const Value *V) {
@@ -149,78 +168,38 @@ void RecoverNames::typeVarNames(VarNames *var, Instruction *I) {
     var->isLoad = true;
 }
 
-bool RecoverNames::addVarName(RegionVars *list, VarNames var) {
-  unsigned int i = 0;
-  for (unsigned int e = list->variables.size(); i < e; i++)
-    if (list->variables[i].name == var.name &&
-        list->variables[i].nameInFile == var.nameInFile)
-      return false;
-
-  if (i == list->variables.size())
-    list->variables.push_back(var);
-
+bool RecoverNames::addVarName(RegionVars *list, const VarNames &var,
+                              StringSet<> &names) {
+  // The variables of a list are identified by their names.
+  std::string key = var.name + '\0' + var.nameInFile;
+  if (names.count(key))
+    return false;
+  names.insert(key);
+  list->variables.push_back(var);
   return true;
 }
 
 bool RecoverNames::haveListLocation(Region *region) {
-  unsigned int loc = 0;
-  if (varsList.empty())
-    return false;
-
-  while (varsList[loc].region != region) {
-    loc++;
-    if (loc == varsList.size())
-      return false;
-  }
-  return true;
+  return regionIndex.count(region) != 0;
 }
 
 unsigned int RecoverNames::getListLocation(Region *region) {
-  if (varsList.empty())
-    return INT_MAX;
-  unsigned int loc = 0;
-  while (varsList[loc].region != region) {
-    loc++;
-    if (loc == varsList.size())
-      break;
-  }
-  return loc;
+  auto It = regionIndex.find(region);
+  if (It == regionIndex.end())
+    return varsList.empty() ? INT_MAX : varsList.size();
+  return It->second;
 }
 
-// This void copy one list of Variables of Analyzed region
-// to one new list menber, example:
-//
-//               ---------------    -----------
-//               || a , b , c || => || d , e ||
-//               ---------------    -----------
-//
-//   The result is a new region, with all variable to the last set
-//   ,the  (d,e) set.
-//
-//             -----------------------
-//             || a , b , c , d , e ||
-//             -----------------------
-//
-void RecoverNames::copyList(RegionVars *list, int regionLocation) {
-  for (unsigned int j = 0, k = 0,
-                    je = varsList[regionLocation].variables.size();
-       j < je; j++) {
-    VarNames var;
-    var = varsList[regionLocation].variables[j];
-    // For each variable, if set not contains
-    // insert in the set.
-    for (; k < list->variables.size(); k++)
-      if (list->variables[k].name == var.name &&
-          list->variables[k].nameInFile == var.nameInFile)
-        break;
-
-    if (k == list->variables.size())
-      list->variables.push_back(varsList[regionLocation].variables[j]);
-  }
+void RecoverNames::addToIndex(const VarNames &var) {
+  // The top region is analyzed first, and holds every block of the function,
+  // so the first access of each value in the function gives its names.
+  if (var.value && !varIndex.count(var.value))
+    varIndex[var.value] = var;
 }
 
 void RecoverNames::getPtrMetadata(RegionVars *list, Instruction *J,
-                                  Instruction *I, Region *r) {
+                                  Instruction *I, Region *r,
+                                  StringSet<> &names) {
   std::string nameInFile = getOriginalName(I);
 
   if (nameInFile != std::string()) {
@@ -238,23 +217,23 @@ void RecoverNames::getPtrMetadata(RegionVars *list, Instruction *J,
     else if (AllocaInst *AL = dyn_cast<AllocaInst>(&(*I)))
       initializeVarNames(&var, AL, r);
 
-    addVarName(list, var);
+    addVarName(list, var, names);
+    addToIndex(var);
   }
 
   // If a global variable is found, insert in the list.
   if (LoadInst *LI = dyn_cast<LoadInst>(&(*J)))
     if (isa<GetElementPtrInst>(&(*I)))
-      for (unsigned int i = 0, e = listGlobalVars.size(); i < e; i++)
-        if (J->getOperand(0)->getName() == listGlobalVars[i].name) {
-          VarNames var;
-          initializeVarNames(&var, LI, r);
-          var.nameInFile = listGlobalVars[i].name;
-          var.globalValue = listGlobalVars[i].value;
-          var.isLocal = false;
-          var.isGlobal = true;
-          addVarName(list, var);
-          break;
-        }
+      if (const GlobVars *GV = findGlobalVar(J->getOperand(0)->getName())) {
+        VarNames var;
+        initializeVarNames(&var, LI, r);
+        var.nameInFile = GV->name;
+        var.globalValue = GV->value;
+        var.isLocal = false;
+        var.isGlobal = true;
+        addVarName(list, var, names);
+        addToIndex(var);
+      }
 }
 
 void RecoverNames::initializeRegionVars(RegionVars *list, Region *region,
@@ -278,35 +257,46 @@ void RecoverNames::findRegionAdress(Region *region, Region *regionParent,
     initializeRegionVars(&list, region, regionParent, true, false, *id);
 
   // Try find a name of variables for each instruction in a basic block.
+  StringSet<> names;
   for (Region::block_iterator B = region->block_begin(),
                               BE = region->block_end();
        B != BE; ++B)
     for (auto I = B->begin(), J = B->begin(), IEnd = B->end(); I != IEnd; ++I) {
-      getPtrMetadata(&list, J, I, region);
+      getPtrMetadata(&list, J, I, region, names);
       J = I;
-      VarNames var;
-      var = getNameofValue(I);
     }
 
-  // Copy the parant variables
-  if (haveListLocation(region))
-    copyList(&list, getListLocation(region));
-
-  // Insert this region, now analized, in the set of regions
+  // Insert this region, now analized, in the set of regions. The parent
+  // variables are not copied, findRegionVariables finds them through
+  // "regionParent".
+  regionIndex[region] = varsList.size();
   varsList.push_back(list);
 
   // For each sub region, try find your variable names
   for (auto SR = region->begin(), SRE = region->end(); SR != SRE; ++SR) {
     Region *r = &(**SR);
-    *id++;
+    (*id)++;
     findRegionAdress(r, region, id);
   }
 }
 
 RecoverNames::RegionVars RecoverNames::findRegionVariables(Region *R) {
-  for (unsigned int i = 0, e = varsList.size(); i < e; i++)
-    if (varsList[i].region == R)
-      return varsList[i];
+  if (haveListLocation(R)) {
+    RegionVars list = varsList[getListLocation(R)];
+    StringSet<> names;
+    for (unsigned int i = 0, e = list.variables.size(); i < e; i++)
+      names.insert(list.variables[i].name + '\0' +
+                   list.variables[i].nameInFile);
+
+    // Copy the parent variables.
+    const RegionVars *rv = &varsList[getListLocation(R)];
+    while (rv->hasParent && haveListLocation(rv->regionParent)) {
+      rv = &varsList[getListLocation(rv->regionParent)];
+      for (unsigned int i = 0, e = rv->variables.size(); i < e; i++)
+        addVarName(&list, rv->variables[i], names);
+    }
+    return list;
+  }
 
   RegionVars list;
   initializeRegionVars(&list, R, R, false, false, -1);
@@ -317,17 +307,23 @@ RecoverNames::RegionVars RecoverNames::findRegionVariables(Region *R) {
 RecoverNames::VarNames RecoverNames::getName(Instruction *I) {
   BasicBlock *bb = I->getParent();
   Region *r = rp->getRegionInfo().getRegionFor(bb);
-  RegionVars rv = findRegionVariables(r);
   Value *v = getBasePtrValue(I, r);
 
-  for (unsigned int i = 0, e = rv.variables.size(); i < e; i++)
-    if (rv.variables[i].value == v)
-      return rv.variables[i];
+  auto It = varIndex.find(v);
+  if (It != varIndex.end())
+    return It->second;
 
   VarNames vn;
   return vn;
 }
 
+const RecoverNames::GlobVars *RecoverNames::findGlobalVar(StringRef name) {
+  auto It = globalVarIndex.find(name);
+  if (It == globalVarIndex.end())
+    return nullptr;
+  return &listGlobalVars[It->second];
+}
+
 void RecoverNames::searchGlobalVariables(Module *M) {
   if (listGlobalVars.empty()) {
     // If don't know the global Variables, do the search on module metadata.
@@ -344,6 +340,9 @@ void RecoverNames::searchGlobalVariables(Module *M) {
             GlobVars tempvar;
             tempvar.name = DGV->getName();
             tempvar.value = DGV;
+            // The first variable with a name is the one found by name.
+            if (!globalVarIndex.count(DGV->getName()))
+              globalVarIndex[DGV->getName()] = listGlobalVars.size();
             listGlobalVars.push_back(tempvar);
           }
         }
@@ -353,6 +352,25 @@ void RecoverNames::searchGlobalVariables(Module *M) {
 }
 
 RecoverNames::VarNames RecoverNames::getNameofValue(Value *V) {
+  // The names of an instruction depend on the region of its block, so they
+  // are found again if it was moved to another block, as done by Ptr-licm and
+  // by the split of the entry block in RecoverCode.
+  const BasicBlock *block = nullptr;
+  if (Instruction *I = dyn_cast<Instruction>(V))
+    block = I->getParent();
+
+  auto It = nameCache.find(V);
+  if (It != nameCache.end() && It->second.block == block)
+    return It->second.var;
+
+  VarNames var = findNameofValue(V);
+  CachedName &entry = nameCache[V];
+  entry.var = var;
+  entry.block = block;
+  return var;
+}
+
+RecoverNames::VarNames RecoverNames::findNameofValue(Value *V) {
   VarNames var;
   var.nameInFile = "";
   if (isa<Argument>(V) || isa<PHINode>(V)) {
@@ -364,14 +382,12 @@ RecoverNames::VarNames RecoverNames::getNameofValue(Value *V) {
   if (GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
     Module *M = GV->getParent();
     searchGlobalVariables(M);
-    for (unsigned int i = 0, e = listGlobalVars.size(); i < e; i++)
-      if (V->getName() == listGlobalVars[i].name) {
-          var.nameInFile = listGlobalVars[i].name;
-          var.globalValue = listGlobalVars[i].value;
-          var.isLocal = false;
-          var.isGlobal = true;
-          break;
-        }
+    if (const GlobVars *GVar = findGlobalVar(V->getName())) {
+      var.nameInFile = GVar->name;
+      var.globalValue = GVar->value;
+      var.isLocal = false;
+      var.isGlobal = true;
+    }
   }
 
 
@@ -398,7 +414,6 @@ RecoverNames::VarNames RecoverNames::getNameofValue(Value *V) {
     BasicBlock *bb = I->getParent();
     Function *F = bb->getParent();
     Region *r = rp->getRegionInfo().getRegionFor(bb);
-    RegionVars rv = findRegionVariables(r);
     Value *v = getBasePtrValue(I, r);
     Module *M = F->getParent();
 
@@ -430,14 +445,12 @@ RecoverNames::VarNames RecoverNames::getNameofValue(Value *V) {
 
     // Return if the based pointer of instruction is a global variable.
     if (isa<LoadInst>(I) || isa<StoreInst>(I)) {
-      for (unsigned int i = 0, e = listGlobalVars.size(); i < e; i++)
-        if (I->getOperand(0)->getName() == listGlobalVars[i].name) {
-          var.nameInFile = listGlobalVars[i].name;
-          var.globalValue = listGlobalVars[i].value;
-          var.isLocal = false;
-          var.isGlobal = true;
-          break;
-        }
+      if (const GlobVars *GVar = findGlobalVar(I->getOperand(0)->getName())) {
+        var.nameInFile = GVar->name;
+        var.globalValue = GVar->value;
+        var.isLocal = false;
+        var.isGlobal = true;
+      }
     }
   }
  
@@ -451,6 +464,14 @@ bool RecoverNames::runOnFunction(Function &F) {
   aa = &getAnalysis<AliasAnalysis>();
   se = &getAnalysis<ScalarEvolution>();
 
+  // The regions and the debug variables are indexed again for each function,
+  // since the regions of the last function don't exist anymore.
+  varsList.clear();
+  regionIndex.clear();
+  varIndex.clear();
+  debugVars.clear();
+  nameCache.clear();
+
   // If Global Variables isn't search at now (or not found), do the search:
   Module *M = F.getParent();
   searchGlobalVariables(M);
@@ -25,7 +25,11 @@
 //===----------------------------------------------------------------------===//
 #include <vector>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/ValueMap.h"
 
 // Start of llvm's namespace.
 namespace llvm {
@@ -89,8 +93,9 @@ class RecoverNames : public FunctionPass {
 
   explicit RecoverNames() : FunctionPass(ID) {};
 
-  // This method return the set of variables of the region R. If not found,
-  // return a empty Set, but the regionName attribute is a message.
+  // This method return the set of variables of the region R, including the
+  // variables of its parent regions. If not found, return a empty Set, but the
+  // regionName attribute is a message.
   RegionVars findRegionVariables(Region *R);
 
   // Return the varNames for instruction I, case was analyzed.
@@ -101,7 +106,8 @@ class RecoverNames : public FunctionPass {
 
   // Return the varNames for instruction I, independent of the pass run.
   // Implemented to facilitate for programmer that use this pass, in this
-  // case, if the programmer does not want to run the pass.
+  // case, if the programmer does not want to run the pass. The result is
+  // kept until the pass runs on the next function.
   VarNames getNameofValue(Value *V);
 
   // For Function F, run the pass.
@@ -128,14 +134,12 @@ class RecoverNames : public FunctionPass {
   void initializeRegionVars(RegionVars *list, Region *region,
   Region *regionParent,bool isTopRegion, bool hasParent, int id);
 
-  // Copy the list list of regionVars for "regionLocation" position in
-  // varsList.
-  // Used for example to know the parent variables that are lived in
-  // some region.
-  void copyList(RegionVars *list, int regionLocation);
+  // Add variable var in a list, return true if it's added. "names" holds the
+  // names of the variables already in the list.
+  bool addVarName(RegionVars *list, const VarNames &var, StringSet<> &names);
 
-  // Add variable var in a list, return true if it's added.
-  bool addVarName(RegionVars *list,VarNames var);
+  // Index var by its value, case the value has no names yet.
+  void addToIndex(const VarNames &var);
 
   // Return if some region was analyzed before by pass.
   // This method return true if one region is not Analyzed.  
@@ -157,7 +161,7 @@ class RecoverNames : public FunctionPass {
   // getPtrMetadata void is used to insert in the list of "regionVars"
   // the name of variables.
   void getPtrMetadata(RegionVars *list,Instruction *J,Instruction *I,
-                      Region *r);
+                      Region *r, StringSet<> &names);
 
   // Return the Function of the value v.
   const Function* findEnclosingFunc(const Value* V);
@@ -166,16 +170,58 @@ class RecoverNames : public FunctionPass {
   // value is equal to the value v.
   const DILocalVariable* findVar(const Value* V,const Function* F);
 
+  // Index the debug variables of function F, from its dbg.declare and
+  // dbg.value intrinsics, case it was not indexed before.
+  const DenseMap<const Value*, const DILocalVariable*> &
+  getDebugVars(const Function *F);
+
+  // Return the global variable with debug name "name", or null.
+  const GlobVars *findGlobalVar(StringRef name);
+
   // Return the name of the variable if it is interesting to analyze.  
   StringRef getOriginalName(const Value* V);
 
   // Search in the Module the Global Variables.
   void searchGlobalVariables(Module *M);
 
+  // Find the varNames of V, without the cache of getNameofValue.
+  VarNames findNameofValue(Value *V);
+
   // Global data structs used.
+  // Each region holds only the variables found in its own blocks, the
+  // variables of the parents are found by "regionParent".
   std::vector <RegionVars> varsList;
 
+  // Position of each region of the function in varsList.
+  DenseMap<const Region*, unsigned int> regionIndex;
+
+  // Names of each value accessed in the function, shared by all its regions.
+  DenseMap<const Value*, VarNames> varIndex;
+
+  // The names of a value are not moved to the value that replaces it.
+  struct NameCacheConfig : ValueMapConfig<const Value*> {
+    enum { FollowRAUW = false };
+  };
+
+  // Result of getNameofValue, and the block of the value when it was found.
+  typedef struct CachedName{
+    VarNames var;
+    const BasicBlock *block;
+  } CachedName;
+
+  // Results of getNameofValue. The entry of a value is dropped when the value
+  // is deleted, so a new value at the same address is not mistaken for it.
+  ValueMap<const Value*, CachedName, NameCacheConfig> nameCache;
+
   std::vector <GlobVars> listGlobalVars;
+
+  // Position of each global variable in listGlobalVars, by name.
+  StringMap<unsigned int> globalVarIndex;
+
+  // Debug variable of each value, per function. The first intrinsic that
+  // describes a value gives its variable.
+  DenseMap<const Function*,
+           DenseMap<const Value*, const DILocalVariable*> > debugVars;
   
   int regionGlobalIndex = 0;
 
@@ -33,6 +33,7 @@
 #include "llvm/ADT/Statistic.h"
 
 #include "PtrRangeAnalysis.h"
+#include "commentsCache.h"
 
 #include "restrictifier.h"
 
@@ -45,6 +46,15 @@ using namespace lge;
 static cl::opt<bool> ClEmitRest("Restrictifier",
     cl::Hidden, cl::desc("Use the infrastructure to clone loops."));
 
+static cl::opt<unsigned> ClSweepThreshold("Restrictifier-Sweep",
+    cl::Hidden, cl::desc("Minimum number of pointers tested by sorting their "
+                         "bounds, instead of pairwise (0 to disable)."),
+    cl::init(8));
+
+// Flags that change the comments, for the keys of the comments cache.
+static CacheFlag EmitRestFlag(ClEmitRest);
+static CacheFlag SweepThresholdFlag(ClSweepThreshold);
+
 bool Restrictifier::isOMP () {
   return omp;
 }
@@ -154,11 +164,15 @@ void Restrictifier::getBounds (std::map<std::string, std::string> & lowerB,
   }
 }
 
+std::string Restrictifier::getPointerRef (std::string var) {
+  return ((needRef[var]) ? ("&" + var) : (var));
+}
+
 std::string Restrictifier::generateRestrict (std::string varA, std::string varB) {
   if(hasNoAliasIn(varA, varB))
     return std::string();
-  std::string varAA = ((needRef[varA]) ? ("&" + varA) : (varA));
-  std::string varBB = ((needRef[varB]) ? ("&" + varB) : (varB));
+  std::string varAA = getPointerRef(varA);
+  std::string varBB = getPointerRef(varB);
   std::string str = std::string();
   str += NAME + " |= ";
   str += "!(((void*) (" + varAA + " + " + limits[varA].first + ") > ";
@@ -168,16 +182,164 @@ std::string Restrictifier::generateRestrict (std::string varA, std::string varB)
   return str;
 }
 
+std::string Restrictifier::generateSweep (const std::vector<std::string> & vars) {
+  std::string n = std::to_string(vars.size());
+  std::string lo = NAME + "_lo";
+  std::string up = NAME + "_up";
+  std::string id = NAME + "_id";
+  std::string na = NAME + "_na";
+  std::string a = NAME + "_a";
+  std::string i = NAME + "_i";
+  std::string c = NAME + "_c";
+  std::string e = NAME + "_e";
+  std::string t = NAME + "_t";
+  std::string lower = std::string();
+  std::string upper = std::string();
+  std::string ids = std::string();
+  for (unsigned int k = 0, ke = vars.size(); k != ke; k++) {
+    std::string var = getPointerRef(vars[k]);
+    lower += ((k == 0) ? "" : ", ");
+    lower += "(char*) (" + var + " + " + limits[vars[k]].first + ")";
+    upper += ((k == 0) ? "" : ", ");
+    upper += "(char*) (" + var + " + " + limits[vars[k]].second + ")";
+    ids += ((k == 0) ? "" : ", ") + std::to_string(k);
+  }
+
+  // Pairs of the group that alias analysis already proved disjoint, as in
+  // generateRestrict. Their overlaps must not fail the test.
+  std::string noAlias = std::string();
+  bool hasNoAlias = false;
+  for (unsigned int k = 0, ke = vars.size(); k != ke; k++)
+    for (unsigned int l = 0; l != ke; l++) {
+      bool known = (k != l) && hasNoAliasIn(vars[k], vars[l]);
+      noAlias += known ? "1" : "0";
+      hasNoAlias |= known;
+    }
+
+  std::string swap = "{ " + t + " = " + lo + "[" + i + "]; " + lo + "[" + i +
+                     "] = " + lo + "[" + c + "]; " + lo + "[" + c + "] = " +
+                     t + "; " + t + " = " + up + "[" + i + "]; " + up + "[" +
+                     i + "] = " + up + "[" + c + "]; " + up + "[" + c +
+                     "] = " + t + "; ";
+  if (hasNoAlias)
+    swap += a + " = " + id + "[" + i + "]; " + id + "[" + i + "] = " + id +
+            "[" + c + "]; " + id + "[" + c + "] = " + a + "; ";
+  swap += "}\n";
+
+  // Heap sort the intervals by their lower bounds, then sweep them. Two
+  // intervals overlap iff one of them starts before the largest upper bound
+  // of the intervals that start before it.
+  std::string str = std::string();
+  str += "{\n";
+  str += "char *" + lo + "[" + n + "] = {" + lower + "};\n";
+  str += "char *" + up + "[" + n + "] = {" + upper + "};\n";
+  str += "char *" + t + ";\n";
+  if (hasNoAlias) {
+    str += "static const char " + na + "[] = \"" + noAlias + "\";\n";
+    str += "int " + id + "[" + n + "] = {" + ids + "};\n";
+    str += "int " + a + ";\n";
+  }
+  str += "int " + NAME + "_s = " + n + " / 2, " + e + " = " + n + ", " + i +
+         ", " + c + ";\n";
+  str += "for (;;) {\n";
+  str += "if (" + NAME + "_s > 0) " + i + " = --" + NAME + "_s;\n";
+  str += "else if (--" + e + " > 0) { " + i + " = 0; " + c + " = " + e +
+         "; " + swap;
+  str += "}\n";
+  str += "else break;\n";
+  str += "for (; (" + c + " = 2 * " + i + " + 1) < " + e + "; " + i + " = " +
+         c + ") {\n";
+  str += "if (" + c + " + 1 < " + e + " && " + lo + "[" + c + " + 1] > " +
+         lo + "[" + c + "]) " + c + "++;\n";
+  str += "if (" + lo + "[" + i + "] >= " + lo + "[" + c + "]) break;\n";
+  str += swap;
+  str += "}\n";
+  str += "}\n";
+  if (!hasNoAlias) {
+    str += t + " = " + up + "[0];\n";
+    str += "for (" + i + " = 1; " + i + " < " + n + "; " + i + "++) {\n";
+    str += NAME + " |= (" + lo + "[" + i + "] <= " + t + ");\n";
+    str += "if (" + up + "[" + i + "] > " + t + ") " + t + " = " + up + "[" +
+           i + "];\n";
+    str += "}\n";
+    str += "}\n";
+    return str;
+  }
+
+  // With known disjoint pairs, each interval is compared with the earlier
+  // ones that still reach its lower bound, and only the overlaps of pairs
+  // that may alias fail the test. The sweep stops at the first of them.
+  std::string act = NAME + "_act";
+  std::string nact = NAME + "_n";
+  std::string k = NAME + "_k";
+  str += "int " + act + "[" + n + "], " + nact + " = 0, " + k + ";\n";
+  str += "for (" + i + " = 0; (" + i + " < " + n + ") && !" + NAME + "; " +
+         i + "++) {\n";
+  str += "for (" + k + " = 0, " + c + " = 0; " + k + " < " + nact + "; " +
+         k + "++) {\n";
+  str += "if (" + up + "[" + act + "[" + k + "]] < " + lo + "[" + i +
+         "]) continue;\n";
+  str += act + "[" + c + "++] = " + act + "[" + k + "];\n";
+  str += NAME + " |= (" + na + "[" + id + "[" + i + "] * " + n + " + " + id +
+         "[" + act + "[" + k + "]]] == '0');\n";
+  str += "}\n";
+  str += nact + " = " + c + ";\n";
+  str += act + "[" + nact + "++] = " + i + ";\n";
+  str += "}\n";
+  str += "}\n";
+  return str;
+}
+
+void Restrictifier::groupPointers (
+    std::vector<std::vector<std::string> > & groups) {
+  // Union-find over the pointers, joining the ones that may alias.
+  std::vector<std::string> vars;
+  for (auto I = limits.begin(), IE = limits.end(); I != IE; I++)
+    vars.push_back(I->first);
+
+  std::vector<unsigned int> leader(vars.size());
+  for (unsigned int i = 0, ie = vars.size(); i != ie; i++)
+    leader[i] = i;
+  auto find = [&](unsigned int i) {
+    while (leader[i] != i)
+      i = leader[i] = leader[leader[i]];
+    return i;
+  };
+
+  for (unsigned int i = 0, ie = vars.size(); i != ie; i++)
+    for (unsigned int j = i + 1; j != ie; j++)
+      if ((find(i) != find(j)) && !hasNoAliasIn(vars[i], vars[j]))
+        leader[find(j)] = find(i);
+
+  // Groups are kept in the order of their first pointer.
+  std::map<unsigned int, unsigned int> groupOf;
+  for (unsigned int i = 0, ie = vars.size(); i != ie; i++) {
+    unsigned int l = find(i);
+    if (!groupOf.count(l)) {
+      groupOf[l] = groups.size();
+      groups.push_back(std::vector<std::string>());
+    }
+    groups[groupOf[l]].push_back(vars[i]);
+  }
+}
+
 std::string Restrictifier::disambiguatePointers () {
   std::string desambiguateStr = std::string();
   desambiguateStr = "char " + NAME + " = 0;\n";
   
-  for (auto I = limits.begin(), IE = limits.end(); I != IE; I++)
-    for (auto J = I, JE = IE; J != JE; J++) {
-        
-      if (J != I)
-          desambiguateStr += generateRestrict(I->first, J->first);
-      }
+  // Pointers in different groups are known to be disjoint. Large groups are
+  // tested with a sort and a sweep, which grows as N log N instead of N^2.
+  std::vector<std::vector<std::string> > groups;
+  groupPointers(groups);
+  for (auto G = groups.begin(), GE = groups.end(); G != GE; G++) {
+    if ((ClSweepThreshold != 0) && (G->size() >= ClSweepThreshold)) {
+      desambiguateStr += generateSweep(*G);
+      continue;
+    }
+    for (unsigned int i = 0, ie = G->size(); i != ie; i++)
+      for (unsigned int j = i + 1; j != ie; j++)
+        desambiguateStr += generateRestrict((*G)[i], (*G)[j]);
+  }
   return desambiguateStr;
 }
 
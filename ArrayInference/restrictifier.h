@@ -63,6 +63,18 @@ class Restrictifier {
   // generate overlap tests between two pointers.
   std::string generateRestrict (std::string varA, std::string varB);
 
+  // Generate code that sorts the bounds of a group of pointers at runtime,
+  // and tests only adjacent intervals for overlaps. Overlaps of pairs known
+  // not to alias are ignored, like in generateRestrict.
+  std::string generateSweep (const std::vector<std::string> & vars);
+
+  // Split the pointers in groups, such that pointers in different groups
+  // never alias.
+  void groupPointers (std::vector<std::vector<std::string> > & groups);
+
+  // Return the address of the pointer, as used in the tests.
+  std::string getPointerRef (std::string var);
+
   public:
   // Manipulates the name of restrictfier computation.
   std::string getName();
@@ -0,0 +1,91 @@
+//===------------------------- sourceFile.cpp ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Indexed, memory mapped access to the lines of a source file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "sourceFile.h"
+
+#define CarriageReturn 13
+
+using namespace llvm;
+
+SourceFile::SourceFile(std::unique_ptr<MemoryBuffer> Buffer)
+  : Buffer(std::move(Buffer)) {
+  StringRef Data = this->Buffer->getBuffer();
+  LineOffsets.push_back(0);
+  for (size_t Pos = Data.find('\n'); Pos != StringRef::npos;
+       Pos = Data.find('\n', Pos + 1))
+    LineOffsets.push_back(Pos + 1);
+}
+
+std::unique_ptr<SourceFile> SourceFile::open(StringRef Path) {
+  // Large files are mapped instead of copied.
+  auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return nullptr;
+  return std::unique_ptr<SourceFile>(new SourceFile(std::move(*Buffer)));
+}
+
+StringRef SourceFile::getLine(unsigned Line) const {
+  if ((Line == 0) || (Line > LineOffsets.size()))
+    return StringRef();
+
+  StringRef Data = Buffer->getBuffer();
+  size_t Start = LineOffsets[Line - 1];
+  size_t End = (Line == LineOffsets.size()) ? Data.size()
+                                            : LineOffsets[Line] - 1;
+  return Data.slice(Start, End);
+}
+
+void SourceFile::writeWithComments(raw_ostream &OS,
+    const std::map<unsigned int, std::string> &Comments) const {
+  auto C = Comments.begin(), CE = Comments.end();
+  for (unsigned LineNo = 1, LE = getNumLines(); LineNo <= LE; ++LineNo) {
+    StringRef Line = getLine(LineNo);
+
+    while ((C != CE) && (C->first < LineNo))
+      ++C;
+
+    if ((C != CE) && (C->first == LineNo) && !C->second.empty()) {
+      // Gather all the blanks and tabs.
+      StringRef Start = Line.substr(0, Line.find_first_not_of(" \t"));
+
+      // Emit the comments, indenting each of their lines.
+      StringRef Comment = C->second;
+      OS << Start;
+      for (size_t Pos = Comment.find('\n'); Pos != StringRef::npos;
+           Pos = Comment.find('\n')) {
+        OS << Comment.substr(0, Pos + 1);
+        Comment = Comment.substr(Pos + 1);
+        if (Comment.empty())
+          break;
+        OS << Start;
+      }
+      OS << Comment;
+    }
+
+    // Try identify if console has add a Carriage Return character in the
+    // end of the string.
+    if (!Line.empty() && (Line.back() == CarriageReturn))
+      Line = Line.drop_back();
+
+    OS << Line << "\n";
+  }
+
+  // Comments of the line after the last one (e.g., the end of a construct
+  // that closes on the last line) go at the end of the file.
+  for (; C != CE; ++C)
+    if (C->first > getNumLines())
+      OS << C->second;
+}
+
+//===------------------------- sourceFile.cpp ----------------------------===//
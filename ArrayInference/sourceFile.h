@@ -0,0 +1,65 @@
+//===------------------------- sourceFile.h ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SourceFile gives access to the lines of a source file. The file is mapped
+// in memory once, and the offset of each line is indexed, so lines are
+// returned in constant time as slices of the buffer, without copies.
+//
+// It is used by WriteInFile to write the annotated source files: the output
+// is streamed as slices of the input, interleaved with the comments.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class SourceFile {
+  std::unique_ptr<MemoryBuffer> Buffer;
+
+  // Offset of the first character of each line.
+  std::vector<size_t> LineOffsets;
+
+  SourceFile(std::unique_ptr<MemoryBuffer> Buffer);
+
+public:
+  // Returns null if the file can't be read.
+  static std::unique_ptr<SourceFile> open(StringRef Path);
+
+  // Number of lines. A new line character at the end of the file starts a
+  // last, empty, line.
+  unsigned getNumLines() const { return LineOffsets.size(); }
+
+  // Line number "Line", starting from 1, without the new line character.
+  // Returns an empty string for lines out of the file.
+  StringRef getLine(unsigned Line) const;
+
+  // Write the file to OS. Before each line with comments, the comments are
+  // written with the indentation of the line. Comments of lines past the end
+  // are written after the last line.
+  void writeWithComments(raw_ostream &OS,
+                         const std::map<unsigned int, std::string> &Comments)
+                         const;
+};
+
+}
+
+#endif
+
+//===------------------------- sourceFile.h ----------------------------===//
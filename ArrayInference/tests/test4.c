@@ -0,0 +1,15 @@
+// Names of values used in subregions. getName of the accesses "v[j]" in the
+// inner loop gives "v", which is only declared in the top region of func:
+// before, only the variables of the inner loop's own region were searched.
+// The accesses "w[j]" get the names of the first access of w in func,
+// "w[0] = 0", outside the loops.
+void func(int n, int m){
+  int v[100];
+  int w[100];
+  w[0] = 0;
+  for(int i = 0; i < n; i++){
+    for(int j = 0; j < m; j++){
+  	  v[j] = w[j] + i;
+    }
+  }
+}
@@ -0,0 +1,8 @@
+// Loop-carried dependence between accesses that don't alias in one iteration.
+// "a[i]" and "a[i + 1]" are in different alias sets, but the loop is
+// sequential: it must not get a "#pragma omp parallel for".
+void func(int *a, int n){
+  for(int i = 0; i < n - 1; i++){
+  	  a[i+1] = a[i];
+  }
+}
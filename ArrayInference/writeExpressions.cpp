@@ -27,8 +27,11 @@
 // 
 //===----------------------------------------------------------------------===//
 
+#include <cctype>
 #include <fstream>
+#include <map>
 #include <queue>
+#include <set>
 
 #include "llvm/Analysis/RegionInfo.h"  
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -36,6 +39,7 @@
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/DIBuilder.h" 
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DataTypes.h"
@@ -45,6 +49,7 @@
 #include "llvm/ADT/Statistic.h"
 
 #include "PtrRangeAnalysis.h"
+#include "commentsCache.h"
 
 #include "writeExpressions.h"
 
@@ -78,6 +83,26 @@ static cl::opt<bool> ClDivergent("Discard-Divergent",
 static cl::opt<bool> ClCoalescing("Memory-Coalescing", 
     cl::desc("Annotate Pragmas using data coallesing."));
 
+static cl::opt<bool> ClResidency("Data-Residency",
+    cl::desc("Keep data on the device over sequential loops of parallel "
+             "kernels (with Memory-Coalescing)."));
+
+static cl::opt<bool> ClHoisting("Data-Hoisting",
+    cl::desc("Hoist data pragmas of functions to the loops that call them."));
+
+// Flags that change the comments, for the keys of the comments cache.
+static CacheFlag EmitParallelFlag(ClEmitParallel);
+static CacheFlag EmitOMPFlag(ClEmitOMP);
+static CacheFlag InputFlag(ClInput, true);
+static CacheFlag DivergentFlag(ClDivergent);
+static CacheFlag CoalescingFlag(ClCoalescing);
+static CacheFlag ResidencyFlag(ClResidency);
+static CacheFlag HoistingFlag(ClHoisting);
+
+bool WriteExpressions::isOpenMP () {
+  return (ClEmitOMP == OMP_GPU) || (ClEmitOMP == OMP_CPU);
+}
+
 void WriteExpressions::analyzeCalls (Loop *L) {
   if (!isLoopAnalyzable(L))
     return;
@@ -144,12 +169,10 @@ std::string WriteExpressions::getUniqueString () {
   return result;
 }
 
-void WriteExpressions::denotateLoopParallel (Loop *L, std::string condition, bool topLevelLoop) {
-  std::string pragma = "#pragma acc loop independent " + condition + "\n";
-  if ((ClEmitOMP == OMP_GPU) || (ClEmitOMP == OMP_CPU))
-    pragma = "#pragma omp parallel for " + condition + "\n";
-  if ((ClEmitOMP == OMP_GPU) && (topLevelLoop == true))
-    pragma = "#pragma omp target parallel for " + condition + "\n";
+void WriteExpressions::denotateLoopParallel (Loop *L, std::string condition,
+                                             bool topLevelLoop,
+                                             bool inKernels,
+                                             std::string offload) {
   BasicBlock *BB = L->getLoopLatch();
   MDNode *MD = nullptr;
   MDNode *MDDivergent = nullptr;
@@ -161,6 +184,31 @@ void WriteExpressions::denotateLoopParallel (Loop *L, std::string condition, boo
     return;
   if (!MD)
     return;
+  // Loops blocked by possible aliasing only run in parallel if the
+  // Restrictifier proves, at run time, that their pointers don't overlap.
+  if (!needsAliasCheck(L))
+    condition = std::string();
+  else if (condition.empty())
+    return;
+  std::string loopClauses = std::string();
+  if (!getReductionClauses(L, loopClauses) ||
+      !getPrivateClauses(L, loopClauses))
+    return;
+  std::string clauses = condition;
+  if (!offload.empty() && !clauses.empty())
+    clauses.insert(clauses.size() - 1, " && " + offload);
+  else if (!offload.empty())
+    clauses = "if(" + offload + ")";
+  if (!clauses.empty() && !loopClauses.empty())
+    clauses += " ";
+  clauses += loopClauses;
+  std::string pragma = "#pragma acc loop independent " + loopClauses + "\n";
+  if (!condition.empty() && !inKernels)
+    pragma = "#pragma acc kernels " + condition + "\n" + pragma;
+  if ((ClEmitOMP == OMP_GPU) || (ClEmitOMP == OMP_CPU))
+    pragma = "#pragma omp parallel for " + clauses + "\n";
+  if ((ClEmitOMP == OMP_GPU) && (topLevelLoop == true))
+    pragma = "#pragma omp target parallel for " + clauses + "\n";
   int line = L->getStartLoc()->getLine();
   numWL++;
   addCommentToLine(pragma, line);
@@ -183,11 +231,86 @@ bool WriteExpressions::isLoopParallel (Loop *L) {
   return true;
 }
 
+bool WriteExpressions::getReductionClauses (Loop *L, std::string & clauses) {
+  BasicBlock *BB = L->getLoopLatch();
+  if (BB == nullptr)
+    return false;
+  MDNode *MD = BB->getTerminator()->getMetadata("reductions");
+  if (!MD)
+    return true;
+
+  // Names of the variables carried by the loop.
+  std::set<std::string> names;
+  for (auto I = L->getHeader()->begin(); isa<PHINode>(I); ++I)
+    names.insert(rn->getNameofValue(I).nameInFile);
+
+  for (unsigned i = 0, ie = MD->getNumOperands(); (i + 1) < ie; i += 2) {
+    MDString *op = dyn_cast<MDString>(MD->getOperand(i));
+    MDString *var = dyn_cast<MDString>(MD->getOperand(i + 1));
+    if (!op || !var || !names.count(var->getString().str()))
+      return false;
+    if (!clauses.empty())
+      clauses += " ";
+    clauses += "reduction(" + op->getString().str() + ":" +
+               var->getString().str() + ")";
+  }
+  return true;
+}
+
+bool WriteExpressions::getPrivateClauses (Loop *L, std::string & clauses) {
+  BasicBlock *BB = L->getLoopLatch();
+  if (BB == nullptr)
+    return false;
+  MDNode *MD = BB->getTerminator()->getMetadata("privates");
+  if (!MD)
+    return true;
+
+  // Variables of each clause, in the order they are written.
+  std::map<std::string, std::string> vars;
+  for (unsigned i = 0, ie = MD->getNumOperands(); (i + 1) < ie; i += 2) {
+    MDString *clause = dyn_cast<MDString>(MD->getOperand(i));
+    MDString *var = dyn_cast<MDString>(MD->getOperand(i + 1));
+    if (!clause || !var)
+      return false;
+    std::string &list = vars[clause->getString().str()];
+    if (!list.empty())
+      list += ", ";
+    list += var->getString().str();
+  }
+
+  // OpenACC has no "lastprivate", and its compute constructs already copy the
+  // scalars they only read.
+  bool isACC = (ClEmitOMP != OMP_GPU) && (ClEmitOMP != OMP_CPU);
+  if (isACC && vars.count("lastprivate"))
+    return false;
+
+  const char *names[] = { "private", "firstprivate", "lastprivate" };
+  for (const char *name : names) {
+    if (!vars.count(name) || (isACC && (std::string(name) == "firstprivate")))
+      continue;
+    if (!clauses.empty())
+      clauses += " ";
+    clauses += std::string(name) + "(" + vars[name] + ")";
+  }
+  return true;
+}
+
+bool WriteExpressions::needsAliasCheck (Loop *L) {
+  BasicBlock *BB = L->getLoopLatch();
+  if (BB == nullptr)
+    return false;
+  return BB->getTerminator()->getMetadata("isParallelIfNoAlias") != nullptr;
+}
+
 bool WriteExpressions::hasLoopParallel (Region *R) {
   for (Region::block_iterator B = R->block_begin(), BE = R->block_end();
        B != BE; B++)
-    if (B->getTerminator()->getMetadata("isParallel"))
-      return true;
+    if (B->getTerminator()->getMetadata("isParallel")) {
+      // The metadata is in the latch, and divergent loops may be excluded.
+      Loop *L = li->getLoopFor(*B);
+      if (L && isLoopParallel(L))
+        return true;
+    }
   return false;
 }
 
@@ -297,7 +420,7 @@ void WriteExpressions::regionIdentify (Region *R) {
     for (auto BB = l->block_begin(), BE = l->block_end(); BB != BE; BB++) {
       for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
         if (CallInst *CI = dyn_cast<CallInst>(I)) {
-          if (routines.count(CI->getCalledFunction()->getName()) == 0) {
+          if (FunctionRoutines.count(CI->getCalledFunction()->getName()) == 0) {
              findACCroutines(CI->getCalledFunction());
           }
         }
@@ -307,12 +430,17 @@ void WriteExpressions::regionIdentify (Region *R) {
 
     copyComments(RC.Comments);
     clearExpression();
+    recordMappedArguments(RC, test + RC.offloadTest, line,
+                          std::vector<BasicBlock*>(l->block_begin(),
+                                                   l->block_end()));
 
+    // The data pragmas of RecoverCode already open the OpenACC "kernels"
+    // construct of the loop.
     if (ClEmitParallel) {
       if (ClEmitOMP == OMP_GPU)
-        denotateLoopParallel(l, test, true);
+        denotateLoopParallel(l, test, true, true, RC.offloadTest);
       else
-        denotateLoopParallel(l, test, false);
+        denotateLoopParallel(l, test, false, true, RC.offloadTest);
       return;
     }
     
@@ -334,18 +462,141 @@ bool WriteExpressions::isSafeMemoryCoalescing (Region *R) {
       for (Loop *subLoop : l->getSubLoops())
         loops[subLoop] = true;
     }
-    if (!isLoopParallel(l))
+    if (!isLoopParallel(l) && !isTimeStepLoop(l, R))
       return false;
     }
   return true;
 }
+
+bool WriteExpressions::getHostReads (Loop *L, Region *R,
+                                     std::map<int, std::set<Value*> > & reads) {
+  const DataLayout &DL = L->getHeader()->getParent()->getParent()->
+                                                         getDataLayout();
+  // Base pointers accessed and written by the kernels.
+  std::set<Value*> accessed;
+  std::set<Value*> written;
+  for (auto BB = L->block_begin(), BE = L->block_end(); BB != BE; BB++) {
+    if (li->getLoopFor(*BB) == L)
+      continue;
+    for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
+      Value *Base = nullptr;
+      if (LoadInst *LI = dyn_cast<LoadInst>(I))
+        Base = GetUnderlyingObject(LI->getPointerOperand(), DL, 0);
+      else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        Base = GetUnderlyingObject(SI->getPointerOperand(), DL, 0);
+        written.insert(Base);
+      }
+      if (!Base)
+        continue;
+      // Pointers changed by the loop (e.g., swapped buffers) aren't the ones
+      // copied before it.
+      if (Instruction *BI = dyn_cast<Instruction>(Base))
+        if (!isa<AllocaInst>(BI) && R->contains(BI))
+          return false;
+      accessed.insert(Base);
+    }
+  }
+
+  // The host code of the loop can read that data, but can't change it.
+  int headerLine = L->getStartLoc() ? (int) L->getStartLoc().getLine()
+                                    : ERROR_VALUE;
+  for (auto BB = L->block_begin(), BE = L->block_end(); BB != BE; BB++) {
+    if (li->getLoopFor(*BB) != L)
+      continue;
+    for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (accessed.count(GetUnderlyingObject(SI->getPointerOperand(), DL, 0)))
+          return false;
+      }
+      else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+        Value *Base = GetUnderlyingObject(LI->getPointerOperand(), DL, 0);
+        if (!written.count(Base))
+          continue;
+        // The update goes before the line of the read, which must be in the
+        // body of the loop.
+        int line = getLineNo(LI);
+        if ((line == ERROR_VALUE) || (line <= headerLine))
+          return false;
+        reads[line].insert(Base);
+      }
+      else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+        if (CI->doesNotAccessMemory())
+          continue;
+        for (unsigned int i = 0, ie = CI->getNumArgOperands(); i != ie; i++) {
+          Value *Arg = CI->getArgOperand(i);
+          if (Arg->getType()->isPointerTy() &&
+              accessed.count(GetUnderlyingObject(Arg, DL, 0)))
+            return false;
+        }
+        for (auto Base : accessed)
+          if (isa<GlobalValue>(Base))
+            return false;
+      }
+      else if (I->mayWriteToMemory())
+        return false;
+    }
+  }
+  return true;
+}
+
+bool WriteExpressions::isTimeStepLoop (Loop *L, Region *R) {
+  if (!ClResidency || !ClEmitParallel || isLoopParallel(L) || !R->contains(L))
+    return false;
+  Loop *Parent = L->getParentLoop();
+  if ((Parent && R->contains(Parent)) || L->getSubLoops().empty())
+    return false;
+  for (Loop *SubLoop : L->getSubLoops())
+    if (!isLoopParallel(SubLoop))
+      return false;
+  std::map<int, std::set<Value*> > reads;
+  return getHostReads(L, R, reads);
+}
+
+void WriteExpressions::writeHostUpdates (Loop *L, Region *R, std::string flag,
+                         std::map<Value*, RecoverCode::DataRange> & ranges) {
+  std::map<int, std::set<Value*> > reads;
+  if (!getHostReads(L, R, reads))
+    return;
+  for (auto I = reads.begin(), IE = reads.end(); I != IE; I++) {
+    // Sort by name, to write the same pragma in every run.
+    std::set<std::string> data;
+    for (auto Base : I->second)
+      if (ranges.count(Base))
+        data.insert(ranges[Base].getItem());
+    if (data.empty())
+      continue;
+    std::string pragma = "#pragma omp target update from(";
+    if (ClEmitOMP == ACC)
+      pragma = "#pragma acc update host(";
+    for (auto D = data.begin(), DE = data.end(); D != DE; D++) {
+      if (D != data.begin())
+        pragma += ", ";
+      pragma += *D;
+    }
+    pragma += ")" + flag + "\n";
+    addCommentToLine(pragma, I->first);
+  }
+}
+
+std::string WriteExpressions::getKernelsCondition (std::string NAME,
+                                                   bool restric,
+                                                   std::string offload) {
+  if (restric && !offload.empty())
+    return " if(!RST_" + NAME + " && " + offload + ")";
+  if (restric)
+    return " if(!RST_" + NAME + ")";
+  if (!offload.empty())
+    return " if(" + offload + ")";
+  return std::string();
+}
  
-void WriteExpressions::writeKernels (Loop *L, std::string NAME, bool restric) {
+void WriteExpressions::writeKernels (Loop *L, std::string NAME, bool restric,
+                                     std::string offload) {
   if (!L)
     return;
-  std::string flag = std::string();
-  if (restric)
-    flag = " if(!RST_" + NAME + ")";
+  std::string flag = getKernelsCondition(NAME, restric, offload);
 
   int line = L->getStartLoc()->getLine();
   std::string pragma = "#pragma acc kernels" + flag + "\n";
@@ -368,16 +619,20 @@ void WriteExpressions::writeKernels (Loop *L, std::string NAME, bool restric) {
   if (ClEmitOMP == ACC)
     addCommentToLine(pragma, line);
   if (ClEmitParallel) {
+    std::string test = std::string();
+    if (restric)
+      test = "if(!RST_" + NAME + ")";
     if (ClEmitOMP == OMP_GPU)
-      denotateLoopParallel(L, std::string(), true);
+      denotateLoopParallel(L, test, true, true, offload);
     else
-      denotateLoopParallel(L, std::string(), false);
+      denotateLoopParallel(L, test, false, true, offload);
     marknumWL(L);
   }
 }
 
 bool WriteExpressions::annotateAccKernels (Region *R, std::string NAME,
-                                           bool restric) {
+                                           bool restric, std::string offload,
+                         std::map<Value*, RecoverCode::DataRange> & ranges) {
   if (!isSafeMemoryCoalescing(R))
     return false;
   std::map<Loop*, bool> loops;
@@ -390,7 +645,16 @@ bool WriteExpressions::annotateAccKernels (Region *R, std::string NAME,
       continue;
     if (loops.count(l) == 0) {
       loops[l] = true;
-      writeKernels(l, NAME, restric);
+      // The data of a time-step loop stays on the device, and its kernels are
+      // annotated one by one.
+      if (isTimeStepLoop(l, R)) {
+        for (Loop *SubLoop : l->getSubLoops())
+          writeKernels(SubLoop, NAME, restric, offload);
+        writeHostUpdates(l, R, getKernelsCondition(NAME, restric, offload),
+                         ranges);
+      }
+      else
+        writeKernels(l, NAME, restric, offload);
     }
     std::queue<Loop*> q;
     q.push(l);
@@ -424,7 +688,7 @@ void WriteExpressions::writeComputation (int line, int lineEnd,
     for (auto BB = R->block_begin(), BE = R->block_end(); BB != BE; BB++) {
       for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
         if (CallInst *CI = dyn_cast<CallInst>(I)) {
-          if (routines.count(CI->getCalledFunction()->getName()) == 0) {
+          if (FunctionRoutines.count(CI->getCalledFunction()->getName()) == 0) {
              findACCroutines(CI->getCalledFunction());
           }
         }
@@ -433,7 +697,12 @@ void WriteExpressions::writeComputation (int line, int lineEnd,
 
     copyComments(RC.Comments);
     clearExpression();
-    annotateAccKernels(R, computationName, RC.restric);
+    std::vector<BasicBlock*> blocks;
+    for (auto BB = R->block_begin(), BE = R->block_end(); BB != BE; BB++)
+      blocks.push_back(*BB);
+    recordMappedArguments(RC, test + RC.offloadTest, line, blocks);
+    annotateAccKernels(R, computationName, RC.restric, RC.offloadTest,
+                       RC.DataRanges);
     std::string pragma = "}\n";
     addCommentToLine(pragma, lineEnd);
   }
@@ -444,6 +713,10 @@ void WriteExpressions::regionIdentifyCoalescing (Region *R) {
   // the data transference pragma.
   int line = st->getStartRegionLoops(R).first;
   int lineEnd = st->getEndRegionLoops(R).first + 1;
+  // Without parallel loops, neither R nor its subregions get a kernel, so their
+  // range data isn't computed.
+  if (ClEmitParallel && !hasLoopParallel(R))
+    return;
   if (!isSafeMemoryCoalescing(R) || !st->isSafetlyRegionLoops(R)) {
     for (auto SR = R->begin(), SRE = R->end(); SR != SRE; ++SR)
       regionIdentifyCoalescing(&(**SR));
@@ -477,6 +750,185 @@ void WriteExpressions::regionIdentifyCoalescing (Region *R) {
 }
 
 
+bool WriteExpressions::toArgumentExpression (std::string expression,
+                                             std::string & result) {
+  result = std::string();
+  for (unsigned int i = 0, ie = expression.size(); i != ie;) {
+    char c = expression[i];
+    if (isalpha(c) || (c == '_')) {
+      unsigned int begin = i;
+      while ((i != ie) && (isalnum(expression[i]) || (expression[i] == '_')))
+        i++;
+      std::string name = expression.substr(begin, i - begin);
+      if (!ArgumentNames.count(name))
+        return false;
+      result += "$" + std::to_string(ArgumentNames[name]);
+      continue;
+    }
+    // Numbers, with their suffixes.
+    if (isdigit(c)) {
+      while ((i != ie) && isalnum(expression[i]))
+        result += expression[i++];
+      continue;
+    }
+    result += c;
+    i++;
+  }
+  return !result.empty();
+}
+
+void WriteExpressions::recordMappedArguments (RecoverCode & RC,
+                                              std::string condition, int line,
+                                              std::vector<BasicBlock*> blocks) {
+  if (!ClHoisting || !condition.empty() || (line == ERROR_VALUE))
+    return;
+  for (auto I = RC.DataRanges.begin(), IE = RC.DataRanges.end(); I != IE;
+       I++) {
+    Argument *A = dyn_cast<Argument>(I->first);
+    if (!A)
+      continue;
+    MappedArgument MA;
+    std::string lower = RC.expandCommands(I->second.Lower);
+    std::string size = RC.expandCommands(I->second.Size);
+    if (!toArgumentExpression(lower, MA.Lower) ||
+        !toArgumentExpression(size, MA.Size))
+      continue;
+    MA.ArgNo = A->getArgNo();
+    MA.Access = I->second.Access;
+    MA.Line = line;
+    MA.Item = I->second.getItem();
+    MappedArguments.push_back(MA);
+    MappedBlocks[MA.ArgNo].insert(blocks.begin(), blocks.end());
+  }
+}
+
+Loop *WriteExpressions::getHoistLoop (CallInst *CI) {
+  const DataLayout &DL = CI->getParent()->getParent()->getParent()->
+                                                          getDataLayout();
+  std::set<Value*> bases;
+  for (unsigned int i = 0, ie = CI->getNumArgOperands(); i != ie; i++)
+    if (CI->getArgOperand(i)->getType()->isPointerTy())
+      bases.insert(GetUnderlyingObject(CI->getArgOperand(i), DL, 0));
+
+  Loop *best = nullptr;
+  for (Loop *L = li->getLoopFor(CI->getParent()); L; L = L->getParentLoop()) {
+    if (isLoopParallel(L))
+      return best;
+    for (unsigned int i = 0, ie = CI->getNumArgOperands(); i != ie; i++)
+      if (!L->isLoopInvariant(CI->getArgOperand(i)))
+        return best;
+
+    for (auto BB = L->block_begin(), BE = L->block_end(); BB != BE; BB++)
+      for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; I++) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          if (bases.count(GetUnderlyingObject(LI->getPointerOperand(), DL, 0)))
+            return best;
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+          if (bases.count(GetUnderlyingObject(SI->getPointerOperand(), DL, 0))
+              || bases.count(GetUnderlyingObject(SI->getValueOperand(), DL, 0)))
+            return best;
+        }
+        else if (CallInst *Call = dyn_cast<CallInst>(I)) {
+          if ((Call == CI) || isa<DbgInfoIntrinsic>(Call))
+            continue;
+          Function *Callee = Call->getCalledFunction();
+          if (Callee && !Callee->isDeclaration())
+            continue;
+          for (unsigned int i = 0, ie = Call->getNumArgOperands(); i != ie;
+               i++)
+            if (bases.count(GetUnderlyingObject(Call->getArgOperand(i), DL, 0)))
+              return best;
+          if (!Call->doesNotAccessMemory())
+            for (auto Base : bases)
+              if (isa<GlobalValue>(Base))
+                return best;
+        }
+      }
+    best = L;
+  }
+  return best;
+}
+
+void WriteExpressions::summarizeDataArguments (Function &F) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  // Arguments whose data is accessed out of the computations that copy it.
+  for (auto AI = F.arg_begin(), AE = F.arg_end(); AI != AE; AI++) {
+    Argument *A = &*AI;
+    if (!A->getType()->isPointerTy())
+      continue;
+    unsigned int k = A->getArgNo();
+    bool host = false;
+    for (auto BB = F.begin(), BE = F.end(); (BB != BE) && !host; BB++)
+      for (auto I = BB->begin(), IE = BB->end(); (I != IE) && !host; I++) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(I))
+          host = (GetUnderlyingObject(LI->getPointerOperand(), DL, 0) == A) &&
+                 !MappedBlocks[k].count(BB);
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I))
+          host = ((GetUnderlyingObject(SI->getPointerOperand(), DL, 0) == A) &&
+                  !MappedBlocks[k].count(BB)) ||
+                 (GetUnderlyingObject(SI->getValueOperand(), DL, 0) == A);
+        else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+          Function *Callee = CI->getCalledFunction();
+          if (isa<DbgInfoIntrinsic>(CI) || (Callee && !Callee->isDeclaration()))
+            continue;
+          for (unsigned int i = 0, ie = CI->getNumArgOperands(); i != ie; i++)
+            if (GetUnderlyingObject(CI->getArgOperand(i), DL, 0) == A)
+              host = true;
+        }
+      }
+    if (host)
+      HostArguments.insert(k);
+  }
+
+  std::vector<MappedArgument> mapped;
+  for (auto MA = MappedArguments.begin(), ME = MappedArguments.end();
+       MA != ME; MA++)
+    if (!HostArguments.count(MA->ArgNo))
+      mapped.push_back(*MA);
+  MappedArguments.swap(mapped);
+
+  // Calls to functions of the module.
+  for (auto BB = F.begin(), BE = F.end(); BB != BE; BB++)
+    for (auto I = BB->begin(), IE = BB->end(); I != IE; I++) {
+      CallInst *CI = dyn_cast<CallInst>(I);
+      if (!CI)
+        continue;
+      Function *Callee = CI->getCalledFunction();
+      int line = getLineNo(CI);
+      if (!Callee || Callee->isDeclaration() || (line == ERROR_VALUE))
+        continue;
+
+      CallSummary CS;
+      CS.Callee = Callee->getName();
+      CS.Line = line;
+      CS.HoistStart = CS.HoistEnd = 0;
+      for (unsigned int i = 0, ie = CI->getNumArgOperands(); i != ie; i++) {
+        Value *V = CI->getArgOperand(i);
+        std::string name = std::string();
+        int param = -1;
+        if (Argument *A = dyn_cast<Argument>(V))
+          param = A->getArgNo();
+        if (ConstantInt *C = dyn_cast<ConstantInt>(V))
+          name = std::to_string(C->getSExtValue());
+        else
+          name = rn->getNameofValue(V).nameInFile;
+        CS.Arguments.push_back(name);
+        CS.Parameters.push_back(param);
+      }
+
+      if (Loop *L = getHoistLoop(CI)) {
+        unsigned int start = 0, end = 0;
+        if (st->getLoopLines(L, start, end)) {
+          CS.HoistStart = start;
+          CS.HoistEnd = end;
+        }
+      }
+      CallSites.push_back(CS);
+    }
+}
+
 void WriteExpressions::functionIdentify (Function *F) {
   std::map<Loop*, bool> loops;
   // For top region in the function, call the void regionIdentify:
@@ -515,13 +967,12 @@ void WriteExpressions::findACCroutines (Function *F) {
       F->hasAvailableExternallyLinkage() || (ClEmitOMP != ACC)) {
     return;
   }
-  if (routines.count(F->getName()) == 0) {
-    routines[F->getName()] = true;
-  }
+  routines[F->getName()] = true;
+  FunctionRoutines[F->getName()] = true;
   for (auto BB = F->begin(), BE = F->end(); BB != BE; BB++) {
     for (auto I = BB->begin(), IE = BB->end(); I != IE; I++) {
       if (CallInst *CI = dyn_cast<CallInst>(I)) {
-        if (routines.count(CI->getCalledFunction()->getName()) == 0) {
+        if (FunctionRoutines.count(CI->getCalledFunction()->getName()) == 0) {
            findACCroutines(CI->getCalledFunction());
         }
       }
@@ -557,12 +1008,28 @@ bool WriteExpressions::runOnFunction(Function &F) {
   NewVars = 0;
   
   Comments.erase(Comments.begin(), Comments.end());
+  FunctionRoutines.erase(FunctionRoutines.begin(), FunctionRoutines.end());
   isknowedLoop.erase(isknowedLoop.begin(), isknowedLoop.end());
+  MappedArguments.clear();
+  HostArguments.clear();
+  CallSites.clear();
+  MappedBlocks.clear();
+  ArgumentNames.clear();
+  if (ClHoisting)
+    for (auto A = F.arg_begin(), AE = F.arg_end(); A != AE; A++)
+      if (A->getType()->isIntegerTy()) {
+        std::string name = rn->getNameofValue(&*A).nameInFile;
+        if (!name.empty())
+          ArgumentNames[name] = A->getArgNo();
+      }
 
   // In this step, the "functionIdentify" find the top level loop
   // to apply our techinic.
   functionIdentify(&F);
 
+  if (ClHoisting)
+    summarizeDataArguments(F);
+
   return true;
 }
 
@@ -37,6 +37,8 @@
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
 
+#include <set>
+
 #ifndef myutils
 #define myutils
 #include "recoverCode.h"
@@ -60,6 +62,38 @@ class LoopInfo;
 class ArrayInference;
 class ScopeTree;
 
+// A pointer argument of a function, whose data is copied to the device by a
+// data pragma of the function. Bounds are C expressions, where "$k" stands for
+// the k-th argument of the function.
+struct MappedArgument {
+  unsigned int ArgNo;
+  std::string Lower;
+  std::string Size;
+
+  // 1 to, 2 from, 3 tofrom.
+  char Access;
+
+  // Line of the data pragma, and the range as written there.
+  unsigned int Line;
+  std::string Item;
+};
+
+// A call to a function defined in the module.
+struct CallSummary {
+  std::string Callee;
+  unsigned int Line;
+
+  // Arguments as C expressions of the caller (empty if unknown), and the
+  // position of the argument of the caller passed in each of them, or -1.
+  std::vector<std::string> Arguments;
+  std::vector<int> Parameters;
+
+  // Lines of the outermost loop around the call where the data of the callee
+  // can stay on the device, or 0.
+  unsigned int HoistStart;
+  unsigned int HoistEnd;
+};
+
 class WriteExpressions : public FunctionPass {
 
   private:
@@ -115,11 +149,38 @@ class WriteExpressions : public FunctionPass {
   // Search for every sub region in region R.
   void regionIdentify(Region *R);
  
-  // Annotate pragma 'Kernels' in the region R
-  bool annotateAccKernels (Region *R, std::string NAME, bool restric);
+  // Annotate pragma 'Kernels' in the region R. The condition "offload" of the
+  // cost model, if any, goes on each 'Kernels' pragma. "ranges" are the data
+  // copied to the device, used to update the host in time-step loops.
+  bool annotateAccKernels (Region *R, std::string NAME, bool restric,
+                           std::string offload,
+                           std::map<Value*, RecoverCode::DataRange> & ranges);
+
+  // Find the reads, by the host, of data written on the device in the
+  // time-step loop "L" of region "R", by source line. Returns false if the
+  // host code of "L" may write that data, or if a read can't be located.
+  bool getHostReads (Loop *L, Region *R,
+                     std::map<int, std::set<Value*> > & reads);
+
+  // Return true if "L" is a sequential loop of region "R" whose subloops are
+  // all parallel, and the data of its kernels can stay on the device over
+  // its iterations (only with -Data-Residency). Kernels in called functions
+  // are left to -Data-Hoisting: a call that gets their data rejects "L".
+  bool isTimeStepLoop (Loop *L, Region *R);
+
+  // Write the pragmas that copy back to the host, before each of its reads,
+  // the data written on the device in the time-step loop "L".
+  void writeHostUpdates (Loop *L, Region *R, std::string flag,
+                         std::map<Value*, RecoverCode::DataRange> & ranges);
 
   // write the pragma 'Kernels' in association with loop L
-    void writeKernels (Loop *L, std::string NAME, bool restric);
+    void writeKernels (Loop *L, std::string NAME, bool restric,
+                       std::string offload);
+
+  // Return the "if" clause of the pragmas of computation NAME, from the test
+  // of the Restrictifier and the condition of the cost model.
+  std::string getKernelsCondition (std::string NAME, bool restric,
+                                   std::string offload);
 
   // Identify the region case it is safe to do memory coalescing.
   bool isSafeMemoryCoalescing (Region *R);
@@ -131,13 +192,35 @@ class WriteExpressions : public FunctionPass {
   // This void calls regionIdentify for the top level region in function F.
   void functionIdentify(Function *F);
 
-  // Use the metadata to validate insertion of "loop independent" pragmas
-  void denotateLoopParallel (Loop *L, std::string condition, bool topLevelLoop);
+  // Use the metadata to validate insertion of "loop independent" pragmas.
+  // The condition is the run-time test of the Restrictifier, used only by the
+  // loops that need it. With OpenACC, it goes on a "kernels" construct, unless
+  // the loop is already inside one that carries it ("inKernels"). The
+  // condition "offload" of the cost model goes on OpenMP pragmas; OpenACC
+  // loops get it from their "kernels" construct.
+  void denotateLoopParallel (Loop *L, std::string condition, bool topLevelLoop,
+                             bool inKernels = false,
+                             std::string offload = std::string());
 
   // Return true if the loop "L" has isParallel metadata, and false case not.
   bool isLoopParallel (Loop *L);
 
-  // Returns true if the region R has any loop annotated as parallel. 
+  // Return true if the loop "L" is only parallel when its pointers don't
+  // overlap (isParallelIfNoAlias metadata).
+  bool needsAliasCheck (Loop *L);
+
+  // Build the "reduction(op:var)" clauses of the loop "L", from its
+  // "reductions" metadata. Returns false if a reduction variable is not
+  // found in the loop, in which case "L" can't run in parallel.
+  bool getReductionClauses (Loop *L, std::string & clauses);
+
+  // Append the "private", "firstprivate" and "lastprivate" clauses of the loop
+  // "L", from its "privates" metadata. Returns false if a clause can't be
+  // written in the chosen standard.
+  bool getPrivateClauses (Loop *L, std::string & clauses);
+
+  // Returns true if the region R has any loop annotated as parallel, as
+  // isLoopParallel sees it.
   bool hasLoopParallel (Region *R);
 
   // Returns true if the loop L is Analyzable.
@@ -157,6 +240,31 @@ class WriteExpressions : public FunctionPass {
   void writeComputation (int line, int lineEnd, Region *R);
 
   void findACCroutines (Function *F);
+
+  // Blocks where the data of each argument is on the device.
+  std::map<unsigned int, std::set<BasicBlock*> > MappedBlocks;
+
+  // Integer arguments of the function, by name.
+  std::map<std::string, unsigned int> ArgumentNames;
+
+  // Write "expression" in terms of the arguments of F ("$k"). Returns false
+  // if it uses anything else.
+  bool toArgumentExpression (std::string expression, std::string & result);
+
+  // Add to MappedArguments the pointer arguments copied by the computation
+  // of RC, whose pragmas are in "line" and its code in "blocks". Computations
+  // guarded by a run-time "condition" are left out.
+  void recordMappedArguments (RecoverCode & RC, std::string condition,
+                              int line, std::vector<BasicBlock*> blocks);
+
+  // Return the outermost sequential loop around CI, whose other code doesn't
+  // touch the data of the pointers passed to CI, and where the other
+  // arguments of CI don't change. Calls to functions of the module may get
+  // those pointers, WriteInFile checks them. Return null if there is none.
+  Loop *getHoistLoop (CallInst *CI);
+
+  // Fill HostArguments and CallSites, once every computation of F is known.
+  void summarizeDataArguments (Function &F);
   
   public:
 
@@ -166,11 +274,25 @@ class WriteExpressions : public FunctionPass {
   std::map<unsigned int, std::string> Comments;
 
   std::map<std::string, bool> routines;
+
+  // Routines called from the code annotated in the last function analyzed.
+  std::map<std::string, bool> FunctionRoutines;
+
+  // Summary of the data of the last function analyzed, used by WriteInFile
+  // to hoist data pragmas to its callers (only with -Data-Hoisting): the
+  // arguments copied by its computations, the ones whose data the host
+  // reads or writes, and its calls to functions of the module.
+  std::vector<MappedArgument> MappedArguments;
+  std::set<unsigned int> HostArguments;
+  std::vector<CallSummary> CallSites;
   //===---------------------------------------------------------------------===
 
   static char ID;
 
   WriteExpressions() : FunctionPass(ID) {};
+
+  // Returns true if the pragmas are OpenMP ("-Emit-OMP" is 1 or 2).
+  static bool isOpenMP();
   
   // We need to insert the Instructions for each source file.
   virtual bool runOnFunction(Function &F) override;
@@ -29,21 +29,21 @@
 //      all functions.
 // 
 //===----------------------------------------------------------------------===//
-#include <fstream>
 
 #include "llvm/IR/Module.h"
 #include "llvm/IR/DIBuilder.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FileSystem.h"
+#include <cctype>
 #include <climits>
+#include <functional>
 
 #include "writeInFile.h" 
 
-#define CarriageReturn 13
-
 using namespace llvm;
 using namespace std;
 using namespace lge;
@@ -56,6 +56,17 @@ cl::Hidden, cl::desc("Analyse just 'GPU__' functions."));
 static cl::opt<bool> ClRun("Run-Mode",
 cl::Hidden, cl::desc("Annotate parallel loops or tasks"));
 
+// Flags that change the comments, for the keys of the comments cache.
+static CacheFlag EmitGPUFlag(ClEmitGPU);
+static CacheFlag RunFlag(ClRun);
+
+static cl::opt<std::string> ClCacheDir("Cache-Dir",
+cl::desc("Directory to cache the comments of each function between runs."),
+cl::init(""));
+
+STATISTIC(NumCacheHits, "Number of functions whose comments were cached");
+STATISTIC(NumCacheMisses, "Number of functions analyzed and cached");
+
 StringRef WriteInFile::getFileName(Instruction *I) {
   MDNode *Var = I->getMetadata("dbg");
   if (Var)
@@ -86,17 +97,15 @@ std::string WriteInFile::getLineForIns(Value *V) {
   if (Instruction *I = dyn_cast<Instruction>(V))
     if (MDNode *N = I->getMetadata("dbg"))
       if (DILocation *Loc = dyn_cast<DILocation>(N)) {
-        unsigned Line = Loc->getLine();
-        StringRef File = Loc->getFilename();
-        StringRef Dir = Loc->getDirectory();
-        //DIVariable Var(N);
-        std::fstream FileStream;
-        FileStream.open((Dir.str() + "/" + File.str()).c_str(), std::ios::in);
-        for (unsigned i = 0; i < Line - 1; ++i)
-           FileStream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        std::string line;
-        std::getline(FileStream, line);
-        return line;
+        std::string Path = Loc->getDirectory().str() + "/" +
+                           Loc->getFilename().str();
+        // Each source file is read and indexed once.
+        auto It = Sources.find(Path);
+        if (It == Sources.end())
+          It = Sources.insert(std::make_pair(Path,
+                                             SourceFile::open(Path))).first;
+        if (It->second)
+          return It->second->getLine(Loc->getLine());
       }
   return std::string();
 }
@@ -117,49 +126,17 @@ void WriteInFile::addCommentToLine(std::string Comment, unsigned int Line) {
 }
 
 void WriteInFile::printToFile(std::string Input, std::string Output) {
-fstream Infile(Input.c_str());
+std::unique_ptr<SourceFile> Infile = SourceFile::open(Input);
 if (!Infile){
   errs() << "\nError. File " << Input << " has not found.\n";
   return;
 }
-std::string Line = std::string();
 std::error_code EC; 
 sys::fs::OpenFlags Flags = sys::fs::F_RW;
 raw_fd_ostream File(Output.c_str(), EC, Flags);
 errs() << "\nWriting output to file " << Output << "\n";
 
-unsigned LineNo = 1;
-while (!Infile.eof()) {
-  Line = std::string();
-  std::getline(Infile, Line);
-  if (Comments.count(LineNo)) {
-    std::string Start;
-    // Gather all the blanks and tabs.
-    for (std::string::iterator It = Line.begin(), E = Line.end(); It != E;
-    ++It)
-      if (*It == ' ' || *It == '\t')
-        Start += *It;
-      else
-        break;
-
-    // Emit the comments.
-    if (Comments[LineNo].size() > 0)
-      File << Start << Comments[LineNo][0];
-    for (unsigned i = 1, ie = Comments[LineNo].size(); i != ie; ++i){
-      if (Comments[LineNo][i-1] == '\n')
-        File << Start;
-      File << Comments[LineNo][i];
-    }
-  }
-  // Try identify if console has add a Carriage Return character in the
-  // end of the string.
-  if (Line[Line.size() - 1] == CarriageReturn)
-    Line.erase(Line.end() - 1, Line.end());
-  
-  Line += "\n";
-  File << Line;
-  LineNo++;
-}
+Infile->writeWithComments(File, Comments);
 File.close();
 }
 
@@ -225,12 +202,27 @@ bool WriteInFile::findFunctionFileName (Function &F) {
 return false;
 }
 
-bool WriteInFile::runOnModule (Module &M) {
+void WriteInFile::collectComments (Module &M, ModuleComments &MC,
+                                   std::atomic<unsigned> *NextFunction) {
+MC.Functions.assign(M.size(), FunctionComments());
 if (!findModuleFileName(M))
-  return true;
+  return;
+
+MC.FirstFile = InputFile;
+MC.SmallerLine = getSmallerLineNo(&M);
+
+CommentsCache Cache(ClCacheDir);
+Cache.prepare(M);
+
+unsigned Claimed = NextFunction ? (*NextFunction)++ : 0;
+unsigned Idx = 0;
+for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F, ++Idx) {
+  if (NextFunction) {
+    if (Idx != Claimed)
+      continue;
+    Claimed = (*NextFunction)++;
+  }
 
-std::string lInputFile = InputFile;
-for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) { 
   if (ClEmitGPU) {
     std::string flag = F->getName();
     flag.erase(flag.begin() + 5, flag.end());
@@ -246,40 +238,430 @@ for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
   if (!findFunctionFileName(*F))
     continue;
 
-  // If has found a new file to input information in this module,
-  // write the last module available with information..
-  if (lInputFile != InputFile) {
-    printToFile(lInputFile, generateOutputName(lInputFile));
-    printPragToFile(generatePragOutputName(lInputFile));
-    lInputFile = InputFile;
-    Comments.erase(Comments.begin(), Comments.end());
+  FunctionComments &FC = MC.Functions[Idx];
+  FC.Valid = true;
+  FC.File = InputFile;
+  FC.Name = F->getName();
+
+  // On a hit, the analyses are not even scheduled for F.
+  std::string Key;
+  if (Cache.isEnabled()) {
+    Key = Cache.getKey(*F, FC.File);
+    if (Cache.load(Key, FC)) {
+      ++NumCacheHits;
+      continue;
+    }
+    ++NumCacheMisses;
   }
 
   if (ClRun == true) {
     this->re = &getAnalysis<RecoverExpressions>(*F);
-    copyComments(this->re->Comments);
+    FC.Comments = this->re->Comments;
   }
   else {
     this->we = &getAnalysis<WriteExpressions>(*F);
-    copyComments(this->we->Comments);
-    int line = getSmallerLineNo(&M);
-    for (auto I = this->we->routines.begin(), IE = this->we->routines.end();
-           I != IE; I++) {
-      if (line != INT_MAX) {
-      
-        std::string tmp = I->first;
-        if ((tmp != "llvm.dbg.value") && (tmp != "llvm.memcpy.p0i8.p0i8.i32") &&
-            (tmp != "llvm.memcpy.p0i8.p0i8.i64")) {  
-          tmp = "#pragma acc_routine(" + tmp + ")\n";
-          addCommentToLine(tmp, line);
+    FC.Comments = this->we->Comments;
+    for (auto I = this->we->FunctionRoutines.begin(),
+         IE = this->we->FunctionRoutines.end(); I != IE; I++)
+      FC.Routines.push_back(I->first);
+    FC.Mapped = this->we->MappedArguments;
+    FC.HostArguments = this->we->HostArguments;
+    FC.Calls = this->we->CallSites;
+  }
+
+  if (Cache.isEnabled())
+    Cache.store(Key, FC);
+}
+}
+
+// Replace "$k" in Expr by Values[k]. Returns false if a value is unknown.
+static bool substituteArguments(const std::string &Expr,
+                                const std::vector<std::string> &Values,
+                                std::string &Result) {
+  Result = std::string();
+  for (unsigned i = 0, ie = Expr.size(); i != ie;) {
+    if (Expr[i] != '$') {
+      Result += Expr[i++];
+      continue;
+    }
+    unsigned k = 0, Begin = ++i;
+    while ((i != ie) && isdigit(Expr[i]))
+      k = k * 10 + (Expr[i++] - '0');
+    if ((i == Begin) || (k >= Values.size()) || Values[k].empty())
+      return false;
+    // Values made of a single name or number need no parentheses.
+    bool Simple = true;
+    for (unsigned j = 0, je = Values[k].size(); j != je; ++j)
+      if (!isalnum(Values[k][j]) && (Values[k][j] != '_') &&
+          (Values[k][j] != '$') && (Values[k][j] != '-' || j != 0))
+        Simple = false;
+    Result += Simple ? Values[k] : "(" + Values[k] + ")";
+  }
+  return true;
+}
+
+// Move Item, in the "acc data" pragma of Comment, to a "present" clause.
+static std::string makePresent(std::string Comment, const std::string &Item) {
+  const std::string Data = "#pragma acc data ";
+  size_t Begin = Comment.find(Data);
+  while (Begin != std::string::npos) {
+    size_t End = Comment.find('\n', Begin);
+    if (End == std::string::npos)
+      End = Comment.size();
+    std::string Line = Comment.substr(Begin, End - Begin);
+    size_t Pos = Line.find(Item);
+    if (Pos == std::string::npos) {
+      Begin = Comment.find(Data, End);
+      continue;
+    }
+
+    size_t After = Pos + Item.size();
+    if ((Line[Pos - 1] == '(') && (After < Line.size()) &&
+        (Line[After] == ')')) {
+      // The only item of its clause: remove the whole clause.
+      size_t ClauseBegin = Line.rfind(' ', Pos - 1) + 1;
+      size_t ClauseEnd = After + 1;
+      if ((ClauseEnd < Line.size()) && (Line[ClauseEnd] == ' '))
+        ClauseEnd++;
+      Line.erase(ClauseBegin, ClauseEnd - ClauseBegin);
+    }
+    else if ((After < Line.size()) && (Line[After] == ','))
+      Line.erase(Pos, Item.size() + 1);
+    else if (Line[Pos - 1] == ',')
+      Line.erase(Pos - 1, Item.size() + 1);
+    else
+      return Comment;
+
+    Line.insert(Data.size(), "present(" + Item + ") ");
+    return Comment.substr(0, Begin) + Line + Comment.substr(End);
+  }
+  return Comment;
+}
+
+void WriteInFile::hoistDataRegions (ModuleComments &MC) {
+  bool OMP = WriteExpressions::isOpenMP();
+
+  unsigned N = MC.Functions.size();
+  std::map<std::string, unsigned> Index;
+  for (unsigned F = 0; F != N; ++F)
+    if (MC.Functions[F].Valid && !MC.Functions[F].Name.empty())
+      Index[MC.Functions[F].Name] = F;
+
+  // Data of the arguments of each function that its computations, or the
+  // ones of the functions it calls, copy to the device. Arguments copied with
+  // different bounds are left out.
+  struct Range {
+    std::string Lower, Size;
+    char Access;
+  };
+  std::vector<std::map<unsigned, Range> > Summary(N);
+  std::vector<std::set<unsigned> > Conflicts(N);
+  auto merge = [&](unsigned F, unsigned K, const Range &R) {
+    if (Conflicts[F].count(K))
+      return false;
+    auto It = Summary[F].find(K);
+    if (It == Summary[F].end()) {
+      Summary[F][K] = R;
+      return true;
+    }
+    if ((It->second.Lower != R.Lower) || (It->second.Size != R.Size)) {
+      Summary[F].erase(It);
+      Conflicts[F].insert(K);
+      return true;
+    }
+    if ((It->second.Access | R.Access) == It->second.Access)
+      return false;
+    It->second.Access |= R.Access;
+    return true;
+  };
+
+  // Returns true if every call of F between lines Start and End that gets
+  // the argument Param of F (or the variable Name, if Param is -1) goes to a
+  // function that copies it.
+  auto onlyMapped = [&](unsigned F, int Param, const std::string &Name,
+                        unsigned Start, unsigned End) {
+    const std::vector<CallSummary> &Calls = MC.Functions[F].Calls;
+    for (auto C = Calls.begin(), CE = Calls.end(); C != CE; ++C) {
+      if ((C->Line < Start) || (C->Line > End))
+        continue;
+      for (unsigned J = 0, JE = C->Arguments.size(); J != JE; ++J) {
+        if ((Param >= 0) ? (C->Parameters[J] != Param)
+                         : (C->Arguments[J] != Name))
+          continue;
+        auto G = Index.find(C->Callee);
+        if ((G == Index.end()) || !Summary[G->second].count(J))
+          return false;
+      }
+    }
+    return true;
+  };
+
+  for (unsigned F = 0; F != N; ++F)
+    for (auto M = MC.Functions[F].Mapped.begin(),
+         ME = MC.Functions[F].Mapped.end(); M != ME; ++M)
+      merge(F, M->ArgNo, Range{M->Lower, M->Size, M->Access});
+
+  // Propagate the arguments to the callers that pass their own arguments.
+  for (unsigned Round = 0; Round <= N; ++Round) {
+    bool Changed = false;
+    for (unsigned F = 0; F != N; ++F) {
+      const FunctionComments &FC = MC.Functions[F];
+      for (auto C = FC.Calls.begin(), CE = FC.Calls.end(); C != CE; ++C) {
+        auto G = Index.find(C->Callee);
+        if (G == Index.end())
+          continue;
+        std::vector<std::string> Values;
+        for (unsigned J = 0, JE = C->Arguments.size(); J != JE; ++J) {
+          long long Number;
+          if (C->Parameters[J] >= 0)
+            Values.push_back("$" + std::to_string(C->Parameters[J]));
+          else if (!StringRef(C->Arguments[J]).getAsInteger(10, Number))
+            Values.push_back(C->Arguments[J]);
+          else
+            Values.push_back(std::string());
+        }
+        std::map<unsigned, Range> Callee = Summary[G->second];
+        for (auto R = Callee.begin(), RE = Callee.end(); R != RE; ++R) {
+          if ((R->first >= Values.size()) || (C->Parameters[R->first] < 0) ||
+              FC.HostArguments.count(C->Parameters[R->first]))
+            continue;
+          Range Caller;
+          Caller.Access = R->second.Access;
+          if (substituteArguments(R->second.Lower, Values, Caller.Lower) &&
+              substituteArguments(R->second.Size, Values, Caller.Size))
+            Changed |= merge(F, C->Parameters[R->first], Caller);
         }
       }
     }
+    if (!Changed)
+      break;
+  }
+
+  // Arguments also passed to functions that don't copy them are used by the
+  // host, and can't stay on the device.
+  for (bool Removed = true; Removed;) {
+    Removed = false;
+    for (unsigned F = 0; F != N; ++F)
+      for (auto R = Summary[F].begin(); R != Summary[F].end();) {
+        if (onlyMapped(F, R->first, std::string(), 0, UINT_MAX)) {
+          ++R;
+          continue;
+        }
+        Summary[F].erase(R++);
+        Removed = true;
+      }
+  }
+
+  // Data to keep on the device around each loop: function -> first line of
+  // the loop -> variable -> range, access and argument of the function.
+  struct HoistedData {
+    std::string Item;
+    char Access;
+    int Param;
+  };
+  struct Hoist {
+    unsigned End;
+    std::map<std::string, HoistedData> Items;
+    std::set<std::string> Conflicts;
+  };
+  std::vector<std::map<unsigned, Hoist> > Plan(N);
+  std::vector<std::vector<std::pair<unsigned, unsigned> > > Callers(N);
+  for (unsigned F = 0; F != N; ++F) {
+    const FunctionComments &FC = MC.Functions[F];
+    for (unsigned I = 0, IE = FC.Calls.size(); I != IE; ++I) {
+      const CallSummary &C = FC.Calls[I];
+      auto G = Index.find(C.Callee);
+      if (G == Index.end())
+        continue;
+      Callers[G->second].push_back(std::make_pair(F, I));
+      if (!C.HoistStart)
+        continue;
+      for (auto R = Summary[G->second].begin(), RE = Summary[G->second].end();
+           R != RE; ++R) {
+        if (R->first >= C.Arguments.size())
+          continue;
+        const std::string &Name = C.Arguments[R->first];
+        std::string Lower, Size;
+        if (Name.empty() ||
+            !substituteArguments(R->second.Lower, C.Arguments, Lower) ||
+            !substituteArguments(R->second.Size, C.Arguments, Size) ||
+            !onlyMapped(F, -1, Name, C.HoistStart, C.HoistEnd))
+          continue;
+        Hoist &H = Plan[F][C.HoistStart];
+        H.End = C.HoistEnd;
+        if (H.Conflicts.count(Name))
+          continue;
+        std::string Item = Name + "[" + Lower + ":" + Size + "]";
+        auto It = H.Items.find(Name);
+        if (It == H.Items.end())
+          H.Items[Name] = HoistedData{Item, R->second.Access,
+                                      C.Parameters[R->first]};
+        else if (It->second.Item != Item) {
+          H.Items.erase(It);
+          H.Conflicts.insert(Name);
+        }
+        else
+          It->second.Access |= R->second.Access;
+      }
+    }
+  }
+
+  // An argument of a function is covered if, at every call, its data is
+  // already kept on the device, around the call or by the callers.
+  std::map<std::pair<unsigned, unsigned>, int> State;
+  std::function<bool(unsigned, unsigned)> isCovered =
+      [&](unsigned G, unsigned J) {
+    auto Key = std::make_pair(G, J);
+    auto It = State.find(Key);
+    if (It != State.end())
+      return It->second == 1;
+    // Recursive calls are not covered.
+    State[Key] = 0;
+    bool Covered = !Callers[G].empty();
+    for (auto P = Callers[G].begin(), PE = Callers[G].end();
+         Covered && (P != PE); ++P) {
+      const CallSummary &C = MC.Functions[P->first].Calls[P->second];
+      if (J >= C.Arguments.size()) {
+        Covered = false;
+        break;
+      }
+      if (C.HoistStart && Plan[P->first].count(C.HoistStart) &&
+          Plan[P->first][C.HoistStart].Items.count(C.Arguments[J]))
+        continue;
+      int Param = C.Parameters[J];
+      Covered = (Param >= 0) && Summary[P->first].count(Param) &&
+                isCovered(P->first, Param);
+    }
+    State[Key] = Covered ? 1 : 2;
+    return Covered;
+  };
+
+  for (unsigned F = 0; F != N; ++F)
+    for (auto H = Plan[F].begin(), HE = Plan[F].end(); H != HE; ++H) {
+      std::string In[2], Out[2];
+      for (auto I = H->second.Items.begin(), IE = H->second.Items.end();
+           I != IE; ++I) {
+        // Data already kept on the device by the callers of F.
+        int Param = I->second.Param;
+        if ((Param >= 0) && Summary[F].count(Param) && isCovered(F, Param))
+          continue;
+        std::string &Enter = In[(I->second.Access & 1) ? 0 : 1];
+        std::string &Exit = Out[(I->second.Access & 2) ? 0 : 1];
+        Enter += (Enter.empty() ? "" : ",") + I->second.Item;
+        Exit += (Exit.empty() ? "" : ",") + I->second.Item;
+      }
+      if (In[0].empty() && In[1].empty())
+        continue;
+
+      const char *InClauses[2] = { OMP ? " map(to: " : " copyin(",
+                                   OMP ? " map(alloc: " : " create(" };
+      const char *OutClauses[2] = { OMP ? " map(from: " : " copyout(",
+                                    OMP ? " map(release: " : " delete(" };
+      std::string EnterPragma = OMP ? "#pragma omp target enter data"
+                                    : "#pragma acc enter data";
+      std::string ExitPragma = OMP ? "#pragma omp target exit data"
+                                   : "#pragma acc exit data";
+      for (unsigned K = 0; K != 2; ++K) {
+        if (!In[K].empty())
+          EnterPragma += InClauses[K] + In[K] + ")";
+        if (!Out[K].empty())
+          ExitPragma += OutClauses[K] + Out[K] + ")";
+      }
+      std::map<unsigned int, std::string> &Comments =
+          MC.Functions[F].Comments;
+      Comments[H->first] = EnterPragma + "\n" + Comments[H->first];
+      Comments[H->second.End + 1] = ExitPragma + "\n" +
+                                    Comments[H->second.End + 1];
+    }
+
+  // OpenMP doesn't copy data that is already present, but OpenACC needs a
+  // "present" clause to check it.
+  if (OMP)
+    return;
+  for (unsigned G = 0; G != N; ++G) {
+    FunctionComments &FC = MC.Functions[G];
+    for (auto M = FC.Mapped.begin(), ME = FC.Mapped.end(); M != ME; ++M)
+      if (Summary[G].count(M->ArgNo) && isCovered(G, M->ArgNo) &&
+          FC.Comments.count(M->Line))
+        FC.Comments[M->Line] = makePresent(FC.Comments[M->Line], M->Item);
+  }
+}
+
+void WriteInFile::writeComments (const ModuleComments &Input) {
+if (Input.FirstFile.empty())
+  return;
+
+ModuleComments MC = Input;
+hoistDataRegions(MC);
+
+Comments.erase(Comments.begin(), Comments.end());
+std::string lInputFile = MC.FirstFile;
+std::set<std::string> Routines;
+
+for (auto FC = MC.Functions.begin(), FCE = MC.Functions.end(); FC != FCE;
+     ++FC) {
+  if (!FC->Valid)
+    continue;
+
+  // If has found a new file to input information in this module,
+  // write the last module available with information..
+  if (lInputFile != FC->File) {
+    printToFile(lInputFile, generateOutputName(lInputFile));
+    printPragToFile(generatePragOutputName(lInputFile));
+    lInputFile = FC->File;
+    Comments.erase(Comments.begin(), Comments.end());
+  }
+
+  copyComments(FC->Comments);
+
+  if (ClRun == true)
+    continue;
+
+  Routines.insert(FC->Routines.begin(), FC->Routines.end());
+  for (auto I = Routines.begin(), IE = Routines.end(); I != IE; I++) {
+    if (MC.SmallerLine != INT_MAX) {
+      std::string tmp = *I;
+      if ((tmp != "llvm.dbg.value") && (tmp != "llvm.memcpy.p0i8.p0i8.i32") &&
+          (tmp != "llvm.memcpy.p0i8.p0i8.i64")) {  
+        tmp = "#pragma acc_routine(" + tmp + ")\n";
+        addCommentToLine(tmp, MC.SmallerLine);
+      }
+    }
   }
 }   
 
-printToFile(InputFile, generateOutputName(InputFile));
+printToFile(lInputFile, generateOutputName(lInputFile));
 printPragToFile(generatePragOutputName(lInputFile));
+}
+
+ModuleComments WriteInFile::mergeComments (
+    const std::vector<ModuleComments> &Parts) {
+ModuleComments MC;
+for (auto P = Parts.begin(), PE = Parts.end(); P != PE; ++P) {
+  if (MC.FirstFile.empty()) {
+    MC.FirstFile = P->FirstFile;
+    MC.SmallerLine = P->SmallerLine;
+  }
+
+  if (MC.Functions.size() < P->Functions.size())
+    MC.Functions.resize(P->Functions.size());
+
+  for (unsigned i = 0, ie = P->Functions.size(); i != ie; ++i)
+    if (P->Functions[i].Valid)
+      MC.Functions[i] = P->Functions[i];
+}
+return MC;
+}
+
+bool WriteInFile::runOnModule (Module &M) {
+if (Result) {
+  collectComments(M, *Result, NextFunction);
+  return false;
+}
+
+ModuleComments MC;
+collectComments(M, MC, nullptr);
+writeComments(MC);
 return false;
 }
 
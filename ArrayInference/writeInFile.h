@@ -43,6 +43,13 @@
 
 #include "writeExpressions.h"
 #include "recoverExpressions.h"
+#include "commentsCache.h"
+#include "sourceFile.h"
+
+#include <atomic>
+#include <climits>
+#include <set>
+#include <vector>
 
 using namespace lge;
 
@@ -60,6 +67,41 @@ class Instruction;
 class LoopInfo;
 class ArrayInference;
 
+// Comments collected for a single function. They are kept apart from the
+// output files, so that functions can be analyzed independently and written
+// back later, in module order.
+struct FunctionComments {
+  // True if the function was analyzed.
+  bool Valid = false;
+
+  // Source file of the function.
+  std::string File;
+
+  // Comments to insert, by line.
+  std::map<unsigned int, std::string> Comments;
+
+  // Routines called from the code annotated in this function.
+  std::vector<std::string> Routines;
+
+  // Name of the function, and the summary of its data (see WriteExpressions).
+  std::string Name;
+  std::vector<MappedArgument> Mapped;
+  std::set<unsigned int> HostArguments;
+  std::vector<CallSummary> Calls;
+};
+
+// Comments collected for a whole module.
+struct ModuleComments {
+  // First source file referenced by the module.
+  std::string FirstFile;
+
+  // Smaller line with debug information in the module.
+  int SmallerLine = INT_MAX;
+
+  // Indexed by the position of the function in the module.
+  std::vector<FunctionComments> Functions;
+};
+
 class WriteInFile : public ModulePass {
 
   private:
@@ -70,6 +112,9 @@ class WriteInFile : public ModulePass {
   std::map<unsigned int, std::string > Comments;
 
   std::string InputFile;
+
+  // Source files read by getLineForIns.
+  std::map<std::string, std::unique_ptr<SourceFile> > Sources;
   //===---------------------------------------------------------------------===
 
   // getFilename
@@ -86,7 +131,7 @@ class WriteInFile : public ModulePass {
   // Return a string with name of Value for Instruction in Value Val.
   std::string getNameofFile(const Value* V);
 
-  // Return the number of the line for Instruction in Value V.
+  // Return the source line of Instruction in Value V.
   std::string getLineForIns(Value *V);
 
   // To add a comment (Or some change that we need add other line in source
@@ -117,15 +162,44 @@ class WriteInFile : public ModulePass {
 
   int getSmallerLineNo(Module *M);
 
+  // Collect the comments of the functions in M. If NextFunction is given, it
+  // is shared by several workers, and only the functions whose index is
+  // taken from it are analyzed.
+  void collectComments(Module &M, ModuleComments &MC,
+                       std::atomic<unsigned> *NextFunction);
+
+  // Move the data pragmas of functions called in loops to the outermost
+  // caller where their bounds can be written, as "enter data" and "exit data"
+  // pragmas around the loop. The data pragmas of the functions whose every
+  // call is covered this way then only check that the data is present.
+  static void hoistDataRegions(ModuleComments &MC);
+
+  // Worker mode: destination of the comments, and source of the functions to
+  // analyze.
+  ModuleComments *Result;
+  std::atomic<unsigned> *NextFunction;
+
   public:
 
   static char ID;
 
-  WriteInFile() : ModulePass(ID) {};
+  // By default, the pass writes the annotated source files. If Result is
+  // given, the comments of the functions taken from NextFunction are stored
+  // there instead, and must be written with writeComments.
+  WriteInFile(ModuleComments *Result = nullptr,
+              std::atomic<unsigned> *NextFunction = nullptr)
+    : ModulePass(ID), Result(Result), NextFunction(NextFunction) {};
   
   // We need Insert the Instructions for each source file.
   virtual bool runOnModule(Module &M);
 
+  // Write the annotated source files, visiting the functions in module order.
+  void writeComments(const ModuleComments &MC);
+
+  // Combine the results of several workers. Each function must have been
+  // analyzed by at most one of them.
+  static ModuleComments mergeComments(const std::vector<ModuleComments> &Parts);
+
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequired<WriteExpressions>();
     AU.addRequired<RecoverExpressions>();
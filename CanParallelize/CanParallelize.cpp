@@ -9,19 +9,23 @@
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
-#include <fstream>
 #include <vector>
 
 using namespace llvm;
 using namespace lge;
 
+static cl::opt<std::string> ParallelLoopsOut(
+    "parallel-loops-out",
+    cl::desc("Store the parallel loops found in the given sidecar file"),
+    cl::init(""));
+
 void CanParallelize::visit(Loop *L) {  
   LoopCounter++;
  
-  if (ParLoops->canParallelize(L)){
-    OutFile << std::to_string(L->getStartLoc().getLine()) << ";";
-    Parallel=true;
-  }
+  if (ParLoops->canParallelize(L))
+    Result->insert(L, *LI,
+                   ParLoops->needsAliasCheck(L) ? PL_NeedsAliasCheck : 0,
+                   ParLoops->getReductions(L), ParLoops->getPrivates(L));
 
   const std::vector<Loop *> &subLoops = L->getSubLoops();
 
@@ -34,27 +38,17 @@ bool CanParallelize::runOnFunction(llvm::Function &F) {
   LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
   
   LoopCounter=0;
-  Parallel=0;
-  
-  if(FirstFunction){
-    OutFile.open("out_pl.log", std::ios_base::out);
-    FirstFunction=false;
-  }
-  else{
-    OutFile.open("out_pl.log", std::ios_base::app);
-  }
-  
-  std::string name = F.getName();
-  OutFile << name <<";";
 
   for (auto I = LI->begin(), E = LI->end(); I != E; ++I) {
     visit(*I);
   }
-  if (!Parallel)
-    OutFile << "-1;";
-  
-  OutFile << "\n";
-  OutFile.close();
+
+  return false;
+}
+
+bool CanParallelize::doFinalization(Module &M) {
+  if (!ParallelLoopsOut.empty() && !Result->writeToFile(ParallelLoopsOut))
+    errs() << "Could not write parallel loops to " << ParallelLoopsOut << "\n";
 
   return false;
 }
@@ -9,8 +9,11 @@
 //
 //===--------------------------------------------------------------------------===//
 //
-// This pass identify what loop can be parallelized and inserts into a 
-// file which loop can parallelize. To do so, it uses ParallelLoopAnalysis.
+// This pass identify what loop can be parallelized and records it in a
+// ParallelLoopSet, that AnnotateParallel uses to mark the loops with metadata.
+// To do so, it uses ParallelLoopAnalysis. The set is shared in memory when
+// both passes run in the same process, or stored in the sidecar file given by
+// "-parallel-loops-out".
 //
 //===--------------------------------------------------------------------------===//
 
@@ -18,10 +21,10 @@
 #define CAN_PARALLELIZE_H
 
 #include "../DepBasedParallelLoopAnalysis/ParallelLoopAnalysis.h"
+#include "../DepBasedParallelLoopAnalysis/ParallelLoopSet.h"
 
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/IR/Metadata.h>
-#include <fstream>
 
 using namespace llvm;
 
@@ -32,21 +35,24 @@ class CanParallelize : public FunctionPass {
   ParallelLoopAnalysis *ParLoops;
   LoopInfo *LI;
   size_t LoopCounter;
-  bool FirstFunction=true;
-  bool Parallel=false;
-  std::ofstream OutFile;
-  //OutFile.open("/tmp/out_pl.log", std::ios_base::out);
-  //OutFile << "function;how many loops;parallelLoop1;parallelLoop2;end;\n";
-  //OutFile.close();  
+
+  // Parallel loops found so far. Points to OwnResult, unless the user of the
+  // pass provides a set to be shared with other passes.
+  ParallelLoopSet OwnResult;
+  ParallelLoopSet *Result;
 
   void visit(Loop *L);
 
 public:
   static char ID;
-  explicit CanParallelize() : FunctionPass(ID) {}
+  explicit CanParallelize(ParallelLoopSet *Result = nullptr)
+    : FunctionPass(ID), Result(Result ? Result : &OwnResult) {}
+
+  const ParallelLoopSet &getParallelLoops() const { return *Result; }
 
   // FunctionPass interface.
   virtual bool runOnFunction(Function &F);
+  virtual bool doFinalization(Module &M);
   virtual void getAnalysisUsage(AnalysisUsage &AU) const;
   void releaseMemory() {}
 };
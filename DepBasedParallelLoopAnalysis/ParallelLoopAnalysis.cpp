@@ -2,22 +2,279 @@
 
 #include "ParallelLoopAnalysis.h"
 
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/Local.h>
 #include <llvm/Transforms/Utils/LoopUtils.h>
 
 using namespace llvm;
 using namespace lge;
 
-bool ParallelLoopAnalysis::canParallelize(llvm::Loop* L) {
+#define DEBUG_TYPE "parallel-loop-analysis"
+
+STATISTIC(NumDAQueries, "Number of dependence queries issued");
+STATISTIC(NumSkippedPairs, "Number of memory pairs not queried");
+STATISTIC(NumReductions, "Number of scalar reductions recognized");
+STATISTIC(NumPrivateValues, "Number of loop-carried values of private "
+                            "variables ignored");
+STATISTIC(NumPrivateDeps, "Number of dependences on private arrays ignored");
+STATISTIC(NumAliasOnlyDeps, "Number of loop dependences that only exist if "
+                            "different base pointers alias");
+
+static cl::opt<bool> ParallelIfNoAlias(
+    "parallel-if-no-alias",
+    cl::desc("Keep loops blocked only by may-alias dependences as parallel, "
+             "guarded by a run-time overlap test"),
+    cl::init(false), cl::ZeroOrMore);
+
+static cl::opt<bool> ParallelFPReductions(
+    "parallel-fp-reductions",
+    cl::desc("Accept floating point reductions in parallel loops, although "
+             "reassociation changes the rounding of the result"),
+    cl::init(false), cl::ZeroOrMore);
+
+static cl::opt<std::string> PrivateFile(
+    "private-file",
+    cl::desc("Sidecar file with the private variables of each loop, written "
+             "by the private-detector Clang plugin"),
+    cl::init(""), cl::ZeroOrMore);
+
+std::string ParallelLoopAnalysis::getPrivateFile() {
+  return PrivateFile;
+}
+
+bool ParallelLoopAnalysis::canParallelize(const llvm::Loop *L) const {
   return (CantParallelize.count(L) == 0);
 }
 
+LoopReductions ParallelLoopAnalysis::getReductions(const Loop *L) const {
+  auto It = Reductions.find(L);
+  return (It != Reductions.end()) ? It->second : LoopReductions();
+}
+
+LoopPrivates ParallelLoopAnalysis::getPrivates(const Loop *L) const {
+  auto It = Privates.find(L);
+  return (It != Privates.end()) ? It->second : LoopPrivates();
+}
+
+bool ParallelLoopAnalysis::isPrivateVariable(const Loop *L, StringRef Var,
+                                             StringRef Clause) {
+  const LoopPrivates *LP = SourcePrivates.lookup(L);
+  return LP && !Var.empty() && LP->count(std::make_pair(Clause, Var));
+}
+
+std::string ParallelLoopAnalysis::getVariableName(PHINode *PN) {
+  // mem2reg describes the variable of a PHI with a llvm.dbg.value right after
+  // the PHIs of its block.
+  BasicBlock *BB = PN->getParent();
+  for (BasicBlock::iterator I = BB->getFirstNonPHI(), IE = BB->end(); I != IE;
+       ++I) {
+    DbgValueInst *DV = dyn_cast<DbgValueInst>(I);
+    if (!DV)
+      break;
+    if (DV->getValue() == PN)
+      return DV->getVariable()->getName();
+  }
+  return std::string();
+}
+
+bool ParallelLoopAnalysis::isReduction(PHINode *PN, Loop *L, std::string &Op,
+                                       std::string &Var, Instruction *&Exit) {
+  // A loop that can leave early doesn't know the iterations it will run, so
+  // the partial results of the threads can't be combined.
+  if (!L->getExitingBlock())
+    return false;
+
+  RecurrenceDescriptor RD;
+  if (!RecurrenceDescriptor::isReductionPHI(PN, L, RD))
+    return false;
+
+  switch (RD.getRecurrenceKind()) {
+  case RecurrenceDescriptor::RK_IntegerAdd:
+    Op = "+";
+    break;
+  case RecurrenceDescriptor::RK_IntegerMult:
+    Op = "*";
+    break;
+  case RecurrenceDescriptor::RK_IntegerOr:
+    Op = "|";
+    break;
+  case RecurrenceDescriptor::RK_IntegerAnd:
+    Op = "&";
+    break;
+  case RecurrenceDescriptor::RK_IntegerXor:
+    Op = "^";
+    break;
+  case RecurrenceDescriptor::RK_FloatAdd:
+    if (!ParallelFPReductions)
+      return false;
+    Op = "+";
+    break;
+  case RecurrenceDescriptor::RK_FloatMult:
+    if (!ParallelFPReductions)
+      return false;
+    Op = "*";
+    break;
+  case RecurrenceDescriptor::RK_IntegerMinMax:
+  case RecurrenceDescriptor::RK_FloatMinMax:
+    if ((RD.getRecurrenceKind() == RecurrenceDescriptor::RK_FloatMinMax) &&
+        !ParallelFPReductions)
+      return false;
+    switch (RD.getMinMaxRecurrenceKind()) {
+    case RecurrenceDescriptor::MRK_UIntMin:
+    case RecurrenceDescriptor::MRK_SIntMin:
+    case RecurrenceDescriptor::MRK_FloatMin:
+      Op = "min";
+      break;
+    case RecurrenceDescriptor::MRK_UIntMax:
+    case RecurrenceDescriptor::MRK_SIntMax:
+    case RecurrenceDescriptor::MRK_FloatMax:
+      Op = "max";
+      break;
+    default:
+      return false;
+    }
+    break;
+  default:
+    return false;
+  }
+
+  // The clause needs the name of the variable.
+  Var = getVariableName(PN);
+  if (Var.empty())
+    return false;
+
+  Exit = RD.getLoopExitInstr();
+  return true;
+}
+
+bool ParallelLoopAnalysis::needsAliasCheck(const llvm::Loop *L) const {
+  return canParallelize(L) && NeedsAliasCheck.count(L);
+}
+
+// Returns the address accessed by a load or store.
+static Value *getAccessPointer(Instruction &Inst) {
+  if (LoadInst *Load = dyn_cast<LoadInst>(&Inst))
+    return Load->getPointerOperand();
+  if (StoreInst *Store = dyn_cast<StoreInst>(&Inst))
+    return Store->getPointerOperand();
+  return nullptr;
+}
+
+namespace {
+// Checks that an address expression has bounds that can be computed before a
+// loop L: every value it uses is defined out of L, and every loop it iterates
+// over has a trip count that is invariant in L.
+struct ComputableBoundsChecker {
+  ScalarEvolution *SE;
+  const Loop *L;
+  bool Computable;
+
+  ComputableBoundsChecker(ScalarEvolution *SE, const Loop *L)
+      : SE(SE), L(L), Computable(true) {}
+
+  bool follow(const SCEV *S) {
+    if (isa<SCEVCouldNotCompute>(S))
+      Computable = false;
+    else if (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(S)) {
+      const Loop *AddRecLoop = AddRec->getLoop();
+
+      if (L->contains(AddRecLoop) &&
+          (!SE->hasLoopInvariantBackedgeTakenCount(AddRecLoop) ||
+           !SE->isLoopInvariant(SE->getBackedgeTakenCount(AddRecLoop), L)))
+        Computable = false;
+    } else if (const SCEVUnknown *Unknown = dyn_cast<SCEVUnknown>(S)) {
+      if (Instruction *Inst = dyn_cast<Instruction>(Unknown->getValue()))
+        if (L->contains(Inst))
+          Computable = false;
+    }
+
+    return Computable;
+  }
+
+  bool isDone() const { return !Computable; }
+};
+} // end anonymous namespace
+
+bool ParallelLoopAnalysis::hasComputableBounds(Value *Ptr, const Loop *L) {
+  if (!SE->isSCEVable(Ptr->getType()))
+    return false;
+
+  ComputableBoundsChecker Checker(SE, L);
+  visitAll(SE->getSCEV(Ptr), Checker);
+  return Checker.Computable;
+}
+
+bool ParallelLoopAnalysis::isAliasOnlyDependence(Instruction &Src,
+                                                 Instruction &Dst,
+                                                 const Loop *L) {
+  if (!ParallelIfNoAlias)
+    return false;
+
+  Value *SrcPtr = getAccessPointer(Src);
+  Value *DstPtr = getAccessPointer(Dst);
+  if (!SrcPtr || !DstPtr)
+    return false;
+
+  // Accesses to the same base pointer may truly depend on each other.
+  const SCEV *SrcBase = SE->getPointerBase(SE->getSCEV(SrcPtr));
+  const SCEV *DstBase = SE->getPointerBase(SE->getSCEV(DstPtr));
+  if (!isa<SCEVUnknown>(SrcBase) || !isa<SCEVUnknown>(DstBase) ||
+      (SrcBase == DstBase))
+    return false;
+
+  return hasComputableBounds(SrcPtr, L) && hasComputableBounds(DstPtr, L);
+}
+
+bool ParallelLoopAnalysis::isPrivateAccess(Instruction &Src, Instruction &Dst,
+                                            const Loop *L) {
+  Value *SrcPtr = getAccessPointer(Src);
+  Value *DstPtr = getAccessPointer(Dst);
+  if (!SrcPtr || !DstPtr)
+    return false;
+
+  const DataLayout &DL = Src.getParent()->getParent()->getParent()
+                           ->getDataLayout();
+  Value *Base = GetUnderlyingObject(SrcPtr, DL, 0);
+  if (!isa<AllocaInst>(Base) || (GetUnderlyingObject(DstPtr, DL, 0) != Base))
+    return false;
+
+  DbgDeclareInst *DD = FindAllocaDbgDeclare(Base);
+  if (!DD)
+    return false;
+
+  StringRef Var = DD->getVariable()->getName();
+  return isPrivateVariable(L, Var, "private") ||
+         isPrivateVariable(L, Var, "lastprivate");
+}
+
+void ParallelLoopAnalysis::registerDependence(Instruction &Src,
+                                              Instruction &Dst,
+                                              const Loop *L) {
+  // Each iteration works on its own copy of a private array.
+  if (isPrivateAccess(Src, Dst, L)) {
+    NumPrivateDeps++;
+    return;
+  }
+
+  if (isAliasOnlyDependence(Src, Dst, L)) {
+    NumAliasOnlyDeps++;
+    NeedsAliasCheck.insert(L);
+    return;
+  }
+
+  CantParallelize.insert(L);
+}
+
 void ParallelLoopAnalysis::inspectMemoryDependence(Dependence &D,
   Instruction &Src, Instruction &Dst) {
 
@@ -51,7 +308,7 @@ void ParallelLoopAnalysis::inspectMemoryDependence(Dependence &D,
 
     // Register all common loops as not parallelizable.
     while (CommonDepth > 0) {
-      CantParallelize.insert(CommonLoop);
+      registerDependence(Src, Dst, CommonLoop);
       CommonLoop = CommonLoop->getParentLoop();
       --CommonDepth;
     }
@@ -77,7 +334,7 @@ void ParallelLoopAnalysis::inspectMemoryDependence(Dependence &D,
       (cast<SCEVConstant>(Distance)->getValue()->isZero());
 
     if (!DependenceFree)
-      CantParallelize.insert(LoopIt);
+      registerDependence(Src, Dst, LoopIt);
 
     LoopIt = LoopIt->getParentLoop();
     --Level;
@@ -97,32 +354,85 @@ void ParallelLoopAnalysis::checkRegisterDependencies(Loop *L) {
   BasicBlock *Header = L->getHeader();
   ConstantInt *Step = nullptr;
   bool hasBadPHI = false;
+  LoopReductions LoopRed;
+  std::set<Value *> ReductionValues;
+
+  // Source names of the values of the loop, used to find the values of its
+  // private variables.
+  std::map<Value *, std::string> ValueNames;
+  if (const LoopPrivates *LP = SourcePrivates.lookup(L)) {
+    Privates[L] = *LP;
+    for (auto BB = L->block_begin(), BE = L->block_end(); BB != BE; ++BB)
+      for (auto I = (*BB)->begin(), IE = (*BB)->end(); I != IE; ++I)
+        if (DbgValueInst *DV = dyn_cast<DbgValueInst>(I))
+          if (DV->getValue())
+            ValueNames[DV->getValue()] = DV->getVariable()->getName();
+  }
 
   // Check for loop-carried dependencies. The assumption is that constant-stride
-  // (induction) PHIs can always be rewritten as a function of threadId.
+  // (induction) PHIs can always be rewritten as a function of threadId, and
+  // that reductions can be computed by each thread and combined at the end.
   for (BasicBlock::iterator I = Header->begin(); isa<PHINode>(I); ++I) {
     PHINode *PN = cast<PHINode>(I);
+    std::string Op, Var;
+    Instruction *Exit = nullptr;
 
-    if (!isInductionPHI(PN, SE, Step)) {
-      CantParallelize.insert(L);
-      hasBadPHI = true;
-      break;
+    if (isInductionPHI(PN, SE, Step))
+      continue;
+
+    if (isReduction(PN, L, Op, Var, Exit)) {
+      LoopRed.insert(std::make_pair(Op, Var));
+      ReductionValues.insert(PN);
+      if (Exit)
+        ReductionValues.insert(Exit);
+      continue;
+    }
+
+    // Each iteration writes a private variable before reading it, so the
+    // value carried from the previous iteration is never used.
+    Var = ValueNames[PN];
+    if (isPrivateVariable(L, Var, "private") ||
+        isPrivateVariable(L, Var, "lastprivate")) {
+      NumPrivateValues++;
+      continue;
     }
+
+    CantParallelize.insert(L);
+    hasBadPHI = true;
+    break;
   }
 
   // Check that no values produced within the loop are used outside of it. If
-  // so, iteration order must be preserved.
+  // so, iteration order must be preserved. The final values of reductions and
+  // of "lastprivate" variables are the only exceptions.
   if (!hasBadPHI) {
      SmallVector<BasicBlock *, 4> exitBlocks;
      L->getExitBlocks(exitBlocks);
 
-     for (BasicBlock* exit : exitBlocks)
-       // As we are on LCSSA form, a PHI in an exit block means that a value
-       // scapes the loop.
-       if (isa<PHINode>(exit->begin())) {
+     // As we are on LCSSA form, a PHI in an exit block means that a value
+     // scapes the loop.
+     for (BasicBlock* exit : exitBlocks) {
+       for (BasicBlock::iterator I = exit->begin(); isa<PHINode>(I); ++I) {
+         PHINode *PN = cast<PHINode>(I);
+
+         for (unsigned i = 0, ie = PN->getNumIncomingValues(); i != ie; ++i)
+           if (L->contains(PN->getIncomingBlock(i)) &&
+               !ReductionValues.count(PN->getIncomingValue(i)) &&
+               !isPrivateVariable(L, ValueNames[PN->getIncomingValue(i)],
+                                  "lastprivate"))
+             hasBadPHI = true;
+       }
+
+       if (hasBadPHI) {
          CantParallelize.insert(L);
          break;
        }
+     }
+  }
+
+  if (!hasBadPHI && !LoopRed.empty()) {
+    NumReductions += LoopRed.size();
+    Reductions[L] = LoopRed;
   }
 
   const std::vector<Loop *> &subLoops = L->getSubLoops();
@@ -187,30 +497,194 @@ bool ParallelLoopAnalysis::isLoopSafetly(Loop *L) {
    return true;
 }
 
+bool ParallelLoopAnalysis::doInitialization(Module &M) {
+  if (!PrivateFile.empty() && !SourcePrivates.readFromFile(PrivateFile))
+    errs() << "Could not read private variables from " << PrivateFile << "\n";
+
+  return false;
+}
+
 bool ParallelLoopAnalysis::runOnFunction(llvm::Function &F) {
   DA = &getAnalysis<DependenceAnalysis>();
   LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
   SE = &getAnalysis<ScalarEvolution>();
 
-  CantParallelize.clear();
+  AA = &getAnalysis<AliasAnalysis>();
 
-  // Check for memory dependecies among every pair of instructions in this function.
-  for (auto Src = inst_begin(F), SrcE = inst_end(F); Src != SrcE; ++Src)
-    if (Src->mayWriteToMemory() || Src->mayReadFromMemory())
-      for (auto Dst = Src, DstE = inst_end(F); Dst != DstE; ++Dst)
-        if (Dst->mayWriteToMemory() || Dst->mayReadFromMemory())
-          if (auto D = DA->depends(&*Src, &*Dst, true))
-            inspectMemoryDependence(*D, *Src, *Dst);
+  CantParallelize.clear();
+  NeedsAliasCheck.clear();
+  Reductions.clear();
+  Privates.clear();
 
-  // Check for register dependencies on each loop.
+  // Check for register dependencies on each loop. This is done first, so the
+  // loops rejected here don't need any dependence query.
   for (auto L = LI->begin(), E = LI->end(); L != E; ++L) {
     checkRegisterDependencies(*L);
   }
 
+  // Check for memory dependecies among the instructions in this function.
+  checkMemoryDependencies(F);
+
   return false;
 }
 
+const Loop *ParallelLoopAnalysis::getCommonLoop(BasicBlock *A, BasicBlock *B) {
+  const Loop *LA = LI->getLoopFor(A);
+  const Loop *LB = LI->getLoopFor(B);
+
+  while (LA && LB && LA != LB) {
+    unsigned DepthA = LA->getLoopDepth();
+    unsigned DepthB = LB->getLoopDepth();
+
+    if (DepthA >= DepthB)
+      LA = LA->getParentLoop();
+    if (DepthB >= DepthA)
+      LB = LB->getParentLoop();
+  }
+
+  return (LA == LB) ? LA : nullptr;
+}
+
+bool ParallelLoopAnalysis::isNestRejected(const Loop *L) {
+  for (; L; L = L->getParentLoop())
+    if (!CantParallelize.count(L))
+      return false;
+  return true;
+}
+
+void ParallelLoopAnalysis::rejectNest(const Loop *L) {
+  for (; L; L = L->getParentLoop())
+    CantParallelize.insert(L);
+}
+
+// First object of the bucket of object O.
+static unsigned findLeader(std::vector<unsigned> &Leader, unsigned O) {
+  while (Leader[O] != O)
+    O = Leader[O] = Leader[Leader[O]];
+  return O;
+}
+
+void ParallelLoopAnalysis::checkMemoryDependencies(Function &F) {
+  // Only instructions inside loops can make a loop sequential. Loads and
+  // stores are bucketed by underlying object. The dependence analysis only
+  // drops a pair when the underlying objects of both pointers don't alias
+  // (alias sets are not enough: "a[i]" and "a[i + 1]" never alias in one
+  // iteration, but depend across iterations), so objects that may alias,
+  // including every unknown or escaped one, share a bucket.
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  std::vector<Instruction *> Accesses;
+  std::vector<const Value *> Objects;
+  std::map<const Value *, unsigned> ObjectIndex;
+  std::vector<unsigned> AccessObject;
+
+  for (auto BB = F.begin(), BE = F.end(); BB != BE; ++BB) {
+    const Loop *L = LI->getLoopFor(BB);
+    if (!L)
+      continue;
+
+    for (auto I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+      if (!I->mayReadOrWriteMemory())
+        continue;
+
+      // The dependence analysis only understands unordered loads and stores,
+      // and gives a confused dependence for any other instruction, even when
+      // paired with itself. That makes every loop around it sequential.
+      bool IsUnordered = false;
+      if (LoadInst *LD = dyn_cast<LoadInst>(I))
+        IsUnordered = LD->isUnordered();
+      else if (StoreInst *ST = dyn_cast<StoreInst>(I))
+        IsUnordered = ST->isUnordered();
+
+      if (!IsUnordered) {
+        rejectNest(L);
+        continue;
+      }
+
+      const Value *Obj = GetUnderlyingObject(MemoryLocation::get(I).Ptr, DL);
+      auto It = ObjectIndex.find(Obj);
+      if (It == ObjectIndex.end()) {
+        It = ObjectIndex.insert(std::make_pair(Obj, Objects.size())).first;
+        Objects.push_back(Obj);
+      }
+
+      Accesses.push_back(I);
+      AccessObject.push_back(It->second);
+    }
+  }
+
+  // Merge the objects that may alias, as the dependence analysis asks it (with
+  // unknown sizes, which is never less conservative). Buckets are the
+  // connected components of that relation.
+  std::vector<unsigned> Leader(Objects.size());
+  for (unsigned O = 0, OE = Objects.size(); O != OE; ++O) {
+    Leader[O] = O;
+    for (unsigned P = 0; P != O; ++P) {
+      unsigned LO = findLeader(Leader, O), LP = findLeader(Leader, P);
+      if ((LO != LP) && (AA->alias(Objects[P], Objects[O]) != NoAlias))
+        Leader[LO] = LP;
+    }
+  }
+
+  // Group the accesses by bucket, keeping program order in each group.
+  std::map<unsigned, unsigned> BucketIndex;
+  std::vector<std::vector<Instruction *> > Buckets;
+  std::vector<bool> BucketHasStore;
+
+  for (unsigned A = 0, AE = Accesses.size(); A != AE; ++A) {
+    Instruction *I = Accesses[A];
+    unsigned Bucket = findLeader(Leader, AccessObject[A]);
+
+    auto It = BucketIndex.find(Bucket);
+    if (It == BucketIndex.end()) {
+      It = BucketIndex.insert(std::make_pair(Bucket, Buckets.size())).first;
+      Buckets.push_back(std::vector<Instruction *>());
+      BucketHasStore.push_back(false);
+    }
+
+    Buckets[It->second].push_back(I);
+    if (isa<StoreInst>(I))
+      BucketHasStore[It->second] = true;
+  }
+
+  for (unsigned B = 0, BE = Buckets.size(); B != BE; ++B) {
+    std::vector<Instruction *> &Bucket = Buckets[B];
+
+    // Dependences between loads don't matter.
+    if (!BucketHasStore[B]) {
+      NumSkippedPairs += (Bucket.size() * (Bucket.size() + 1)) / 2;
+      continue;
+    }
+
+    for (unsigned S = 0, E = Bucket.size(); S != E; ++S) {
+      Instruction *Src = Bucket[S];
+
+      for (unsigned D = S; D != E; ++D) {
+        Instruction *Dst = Bucket[D];
+
+        if (isa<LoadInst>(Src) && isa<LoadInst>(Dst)) {
+          ++NumSkippedPairs;
+          continue;
+        }
+
+        // A dependence can only affect the loops around both instructions.
+        // Once all of them are known to be sequential, there is nothing left
+        // to find for this pair.
+        const Loop *Common = getCommonLoop(Src->getParent(), Dst->getParent());
+        if (!Common || isNestRejected(Common)) {
+          ++NumSkippedPairs;
+          continue;
+        }
+
+        ++NumDAQueries;
+        if (auto Dep = DA->depends(Src, Dst, true))
+          inspectMemoryDependence(*Dep, *Src, *Dst);
+      }
+    }
+  }
+}
+
 void ParallelLoopAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<AliasAnalysis>();
   AU.addRequiredTransitive<DependenceAnalysis>();
   AU.addRequiredTransitive<LoopInfoWrapperPass>();
   AU.addRequired<ScalarEvolution>();
@@ -242,6 +716,7 @@ static RegisterStandardPasses
 // Flag to be used from Opt.
 INITIALIZE_PASS_BEGIN(ParallelLoopAnalysis, "parallel-loop-analysis",
     "Run detection of parallel loops", true, true);
+INITIALIZE_AG_DEPENDENCY(AliasAnalysis);
 INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis);
 INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass);
 INITIALIZE_PASS_DEPENDENCY(ScalarEvolution);
@@ -8,6 +8,20 @@
 //   for (int i = 0; i < N; ++i)
 //     for (int j = 1; j < M; ++j)
 //       a[i][j] += a[i][j-1];
+//
+// With "-parallel-if-no-alias", loops whose only dependences are between
+// accesses to different base pointers with computable bounds are kept as
+// parallel, provided the pointers are shown not to overlap at run time.
+//
+// Loops whose only loop-carried scalars are associative reductions (add, mul,
+// min, max, and, or, xor) are also parallel. Floating point reductions change
+// the rounding of the result, so they are only accepted with
+// "-parallel-fp-reductions".
+//
+// The private variables found in the source code by the private-detector
+// plugin can be given with "-private-file". The loop-carried values and the
+// memory accesses of those variables don't prevent a loop from running in
+// parallel, and the last value of a "lastprivate" variable may leave the loop.
 
 #ifndef PARALLEL_LOOP_ANALYSIS_H
 #define PARALLEL_LOOP_ANALYSIS_H
@@ -15,9 +29,15 @@
 #include <llvm/Analysis/DependenceAnalysis.h>
 #include <llvm/Analysis/ScalarEvolution.h>
 #include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <map>
 #include <set>
+#include <string>
+
+#include "ParallelLoopSet.h"
+#include "PrivateVariableSet.h"
 
 namespace llvm {
+class AliasAnalysis;
 class Loop;
 }
 
@@ -25,16 +45,70 @@ namespace lge {
 
 class ParallelLoopAnalysis : public llvm::FunctionPass {
   // Analyses used.
+  llvm::AliasAnalysis *AA;
   llvm::DependenceAnalysis *DA;
   llvm::LoopInfo *LI;
   llvm::ScalarEvolution *SE;
   std::set<const llvm::Loop*> CantParallelize;
+  std::set<const llvm::Loop*> NeedsAliasCheck;
+  std::map<const llvm::Loop*, LoopReductions> Reductions;
+  std::map<const llvm::Loop*, LoopPrivates> Privates;
+
+  // Private variables read from the "-private-file" sidecar.
+  PrivateVariableSet SourcePrivates;
+
+  // Returns true if VAR is listed for L with the given clause.
+  bool isPrivateVariable(const llvm::Loop *L, llvm::StringRef Var,
+                         llvm::StringRef Clause);
+
+  // Returns true if SRC and DST both access an array that each iteration of
+  // L keeps a private copy of.
+  bool isPrivateAccess(llvm::Instruction &Src, llvm::Instruction &Dst,
+                       const llvm::Loop *L);
+
+  // Checks if PN is a reduction of L that can be written as a "reduction"
+  // clause. On success, returns the operator and the variable name in
+  // OP and VAR, and the value that leaves the loop in EXIT.
+  bool isReduction(llvm::PHINode *PN, llvm::Loop *L, std::string &Op,
+                   std::string &Var, llvm::Instruction *&Exit);
+
+  // Returns the source name of a value, from its debug information.
+  std::string getVariableName(llvm::PHINode *PN);
+
+  // Returns true if a dependence between SRC and DST can only exist if two
+  // different base pointers alias, and the bounds of both accesses can be
+  // computed before L.
+  bool isAliasOnlyDependence(llvm::Instruction &Src, llvm::Instruction &Dst,
+                             const llvm::Loop *L);
+
+  // Checks if the addresses accessed through PTR in L have bounds that can be
+  // computed before L starts.
+  bool hasComputableBounds(llvm::Value *Ptr, const llvm::Loop *L);
+
+  // Registers that a dependence between SRC and DST prevents the iterations
+  // of L from running in parallel.
+  void registerDependence(llvm::Instruction &Src, llvm::Instruction &Dst,
+                          const llvm::Loop *L);
 
   // Registers a dependence between two instructions.
   void inspectMemoryDependence(llvm::Dependence &D, llvm::Instruction &Src,
     llvm::Instruction &Dst);
   void checkRegisterDependencies(llvm::Loop *);
 
+  // Queries the dependence analysis only for pairs of memory instructions that
+  // may still change the result: pairs sharing a loop that is not known to be
+  // sequential yet, with at least one store, and whose pointers may alias.
+  void checkMemoryDependencies(llvm::Function &F);
+
+  // Returns the innermost loop containing both blocks, if any.
+  const llvm::Loop *getCommonLoop(llvm::BasicBlock *A, llvm::BasicBlock *B);
+
+  // Returns true if L and every loop around it are known to be sequential.
+  bool isNestRejected(const llvm::Loop *L);
+
+  // Registers L and every loop around it as sequential.
+  void rejectNest(const llvm::Loop *L);
+
   // Find all PHINode Instructions used to index a loop.
   void getPHIMAPS(llvm::Function *F, std::map<llvm::PHINode*,bool> & PHIS);
 
@@ -49,11 +123,30 @@ public:
   explicit ParallelLoopAnalysis() : FunctionPass(ID) {}
 
   // FunctionPass interface.
+  virtual bool doInitialization(llvm::Module &M);
   virtual bool runOnFunction(llvm::Function &F);
   virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
-  void releaseMemory() { CantParallelize.clear(); }
+  void releaseMemory() {
+    CantParallelize.clear();
+    NeedsAliasCheck.clear();
+    Reductions.clear();
+    Privates.clear();
+  }
+
+  // Per-loop verdict, valid until the pass runs on another function.
+  bool canParallelize(const llvm::Loop *L) const;
+
+  // Returns true if L is only parallel when its base pointers don't overlap.
+  bool needsAliasCheck(const llvm::Loop *L) const;
+
+  // Returns the reductions that must be declared to run L in parallel.
+  LoopReductions getReductions(const llvm::Loop *L) const;
+
+  // Returns the private variables that must be declared to run L in parallel.
+  LoopPrivates getPrivates(const llvm::Loop *L) const;
 
-  bool canParallelize(llvm::Loop* L);
+  // Returns the file given by "-private-file", or an empty string.
+  static std::string getPrivateFile();
 };
 
 } // end lge namespace
@@ -0,0 +1,266 @@
+// Verdicts of ParallelLoopAnalysis, as consumed by the passes that mark loops
+// with "isParallel" metadata. Loops are identified by their function, by the
+// source line of their start location, and by their position among the loops
+// of the function that start on that line, ordered by start column. So the
+// result can be carried from the module where parallel loops are detected
+// (which may be a copy with versioned regions) to the module that gets
+// annotated. The columns themselves are not compared, since they change with
+// the optimizations that only the first module gets (e.g., -loop-rotate
+// changes the preheader, whose terminator gives the start location), but their
+// order does not.
+//
+// Loops with the same start location get the same position, and share an
+// entry. This is intended for the versions of a region built by
+// AliasInstrumentation: the entry keeps the flags, the reductions and the
+// private variables of every version, and the annotated module, which has a
+// single version, gets all of them. Two distinct loops only share an entry if
+// the debug info has no columns and they start on the same line.
+//
+// CanParallelize fills a ParallelLoopSet and AnnotateParallel queries it. When
+// both passes run in the same process, the set is shared in memory. Otherwise,
+// it can be stored in a binary sidecar file, with the following layout (all
+// integers are 32 bits, little endian):
+//
+//   "DPLS" NumFunctions
+//   { NameSize Name NumLoops
+//     { Line Position Flags NumReductions { OpSize Op VarSize Var }*
+//       NumPrivates { ClauseSize Clause VarSize Var }* }* }*
+
+#ifndef PARALLEL_LOOP_SET_H
+#define PARALLEL_LOOP_SET_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+
+namespace lge {
+
+// Flags of a parallel loop.
+enum ParallelLoopFlags {
+  // The loop is only parallel if its base pointers don't overlap at run time.
+  PL_NeedsAliasCheck = 1 << 0
+};
+
+// Scalar reductions of a loop: the operator, as written in a "reduction"
+// clause ("+", "*", "min", "max", "&", "|" or "^"), and the name of the
+// variable in the source code.
+typedef std::set<std::pair<std::string, std::string> > LoopReductions;
+
+// Variables that each iteration keeps a copy of: the clause ("private",
+// "firstprivate" or "lastprivate") and the name of the variable in the source
+// code.
+typedef std::set<std::pair<std::string, std::string> > LoopPrivates;
+
+struct ParallelLoop {
+  unsigned Flags;
+  LoopReductions Reductions;
+  LoopPrivates Privates;
+
+  ParallelLoop() : Flags(0) {}
+};
+
+class ParallelLoopSet {
+  // Line of a loop and its position among the loops starting on that line.
+  typedef std::pair<unsigned, unsigned> LoopKey;
+
+  // Function name -> loops found parallel in it.
+  std::map<std::string, std::map<LoopKey, ParallelLoop> > Loops;
+
+  // Collects the start columns of the loops in L and its subloops that start
+  // on LINE.
+  static void collectColumns(const llvm::Loop *L, unsigned Line,
+                             std::set<unsigned> &Columns) {
+    llvm::DebugLoc Loc = L->getStartLoc();
+    if (Loc && (Loc.getLine() == Line))
+      Columns.insert(Loc.getCol());
+    for (const llvm::Loop *SubLoop : L->getSubLoops())
+      collectColumns(SubLoop, Line, Columns);
+  }
+
+  // Computes the key of L, the loops of its function being in LI. Returns
+  // false if L has no start location.
+  static bool getKey(const llvm::Loop *L, const llvm::LoopInfo &LI,
+                     LoopKey &Key) {
+    llvm::DebugLoc Loc = L->getStartLoc();
+    if (!Loc)
+      return false;
+
+    std::set<unsigned> Columns;
+    for (const llvm::Loop *TopLoop : LI)
+      collectColumns(TopLoop, Loc.getLine(), Columns);
+
+    Key.first = Loc.getLine();
+    Key.second = std::distance(Columns.begin(), Columns.find(Loc.getCol()));
+    return true;
+  }
+
+public:
+  // Loops sharing an entry (versions of a region) keep the flags, the
+  // reductions and the private variables of all of them.
+  void insert(const llvm::Loop *L, const llvm::LoopInfo &LI,
+              unsigned Flags = 0,
+              const LoopReductions &Reductions = LoopReductions(),
+              const LoopPrivates &Privates = LoopPrivates()) {
+    LoopKey Key;
+    if (!getKey(L, LI, Key))
+      return;
+
+    ParallelLoop &PL = Loops[L->getHeader()->getParent()->getName()][Key];
+    PL.Flags |= Flags;
+    PL.Reductions.insert(Reductions.begin(), Reductions.end());
+    PL.Privates.insert(Privates.begin(), Privates.end());
+  }
+
+  bool hasFunction(llvm::StringRef Fn) const { return Loops.count(Fn); }
+
+  bool contains(const llvm::Loop *L, const llvm::LoopInfo &LI) const {
+    return lookup(L, LI) != nullptr;
+  }
+
+  // Returns the entry of a loop, or null if it isn't in the set.
+  const ParallelLoop *lookup(const llvm::Loop *L,
+                             const llvm::LoopInfo &LI) const {
+    auto It = Loops.find(L->getHeader()->getParent()->getName());
+    if (It == Loops.end())
+      return nullptr;
+
+    LoopKey Key;
+    if (!getKey(L, LI, Key))
+      return nullptr;
+
+    auto LoopIt = It->second.find(Key);
+    return (LoopIt != It->second.end()) ? &LoopIt->second : nullptr;
+  }
+
+  bool empty() const { return Loops.empty(); }
+  void clear() { Loops.clear(); }
+
+  // Store the set in a sidecar file. Returns false on failure.
+  bool writeToFile(llvm::StringRef Path) const {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+    if (EC)
+      return false;
+
+    llvm::support::endian::Writer<llvm::support::little> W(OS);
+    auto writeString = [&](const std::string &Str) {
+      W.write<uint32_t>(Str.size());
+      OS << Str;
+    };
+
+    OS << "DPLS";
+    W.write<uint32_t>(Loops.size());
+    for (auto &Fn : Loops) {
+      writeString(Fn.first);
+      W.write<uint32_t>(Fn.second.size());
+      for (auto &Entry : Fn.second) {
+        W.write<uint32_t>(Entry.first.first);
+        W.write<uint32_t>(Entry.first.second);
+        W.write<uint32_t>(Entry.second.Flags);
+        W.write<uint32_t>(Entry.second.Reductions.size());
+        for (auto &Reduction : Entry.second.Reductions) {
+          writeString(Reduction.first);
+          writeString(Reduction.second);
+        }
+        W.write<uint32_t>(Entry.second.Privates.size());
+        for (auto &Private : Entry.second.Privates) {
+          writeString(Private.first);
+          writeString(Private.second);
+        }
+      }
+    }
+    return true;
+  }
+
+  // Load a set stored by writeToFile. Returns false if the file can't be read
+  // or is malformed, in which case the set is left empty.
+  bool readFromFile(llvm::StringRef Path) {
+    clear();
+    auto Buffer = llvm::MemoryBuffer::getFile(Path);
+    if (!Buffer)
+      return false;
+
+    const char *Ptr = (*Buffer)->getBufferStart();
+    const char *End = (*Buffer)->getBufferEnd();
+    auto readWord = [&](uint32_t &V) {
+      if (End - Ptr < 4)
+        return false;
+      V = llvm::support::endian::read32le(Ptr);
+      Ptr += 4;
+      return true;
+    };
+    auto readString = [&](std::string &Str) {
+      uint32_t Size;
+      if (!readWord(Size) || (uint32_t)(End - Ptr) < Size)
+        return false;
+      Str.assign(Ptr, Size);
+      Ptr += Size;
+      return true;
+    };
+
+    if ((End - Ptr < 4) || (llvm::StringRef(Ptr, 4) != "DPLS"))
+      return false;
+    Ptr += 4;
+
+    uint32_t NumFunctions;
+    if (!readWord(NumFunctions))
+      return false;
+
+    for (uint32_t I = 0; I != NumFunctions; ++I) {
+      std::string Name;
+      uint32_t NumLoops;
+      if (!readString(Name) || !readWord(NumLoops)) {
+        clear();
+        return false;
+      }
+      std::map<LoopKey, ParallelLoop> &FnLoops = Loops[Name];
+
+      for (uint32_t J = 0; J != NumLoops; ++J) {
+        uint32_t Line, Position, Flags, NumReductions;
+        if (!readWord(Line) || !readWord(Position) || !readWord(Flags) ||
+            !readWord(NumReductions)) {
+          clear();
+          return false;
+        }
+        ParallelLoop &PL = FnLoops[LoopKey(Line, Position)];
+        PL.Flags |= Flags;
+
+        for (uint32_t K = 0; K != NumReductions; ++K) {
+          std::string Op, Var;
+          if (!readString(Op) || !readString(Var)) {
+            clear();
+            return false;
+          }
+          PL.Reductions.insert(std::make_pair(Op, Var));
+        }
+
+        uint32_t NumPrivates;
+        if (!readWord(NumPrivates)) {
+          clear();
+          return false;
+        }
+        for (uint32_t K = 0; K != NumPrivates; ++K) {
+          std::string Clause, Var;
+          if (!readString(Clause) || !readString(Var)) {
+            clear();
+            return false;
+          }
+          PL.Privates.insert(std::make_pair(Clause, Var));
+        }
+      }
+    }
+    return true;
+  }
+};
+
+} // end lge namespace
+
+#endif
@@ -0,0 +1,78 @@
+// Variables that each iteration of a loop can keep a private copy of, as found
+// in the source code by the private-detector Clang plugin (PrivateDetector).
+// Loops are identified by their function and by the source line of their start
+// location. Unlike in ParallelLoopSet, loops starting on the same line share
+// their variables, since the plugin only writes lines.
+//
+// The plugin writes a text sidecar file, "file_private.txt", with one line per
+// variable after the header:
+//
+//   "DAWNCC-PRIVATE 1"
+//   { Function Line Clause Variable }*
+//
+// Clause is "private", "firstprivate" or "lastprivate".
+
+#ifndef PRIVATE_VARIABLE_SET_H
+#define PRIVATE_VARIABLE_SET_H
+
+#include "ParallelLoopSet.h"
+
+#include <llvm/ADT/SmallVector.h>
+
+namespace lge {
+
+class PrivateVariableSet {
+  // Function name -> line of a loop -> its private variables.
+  std::map<std::string, std::map<unsigned, LoopPrivates> > Lines;
+
+public:
+  // Returns the private variables of a loop, or null if it has none.
+  const LoopPrivates *lookup(const llvm::Loop *L) const {
+    llvm::DebugLoc Loc = L->getStartLoc();
+    if (!Loc)
+      return nullptr;
+
+    auto It = Lines.find(L->getHeader()->getParent()->getName());
+    if (It == Lines.end())
+      return nullptr;
+
+    auto LineIt = It->second.find(Loc.getLine());
+    return (LineIt != It->second.end()) ? &LineIt->second : nullptr;
+  }
+
+  bool empty() const { return Lines.empty(); }
+  void clear() { Lines.clear(); }
+
+  // Load a file written by the plugin. Returns false if the file can't be read
+  // or is malformed, in which case the set is left empty.
+  bool readFromFile(llvm::StringRef Path) {
+    clear();
+    auto Buffer = llvm::MemoryBuffer::getFile(Path);
+    if (!Buffer)
+      return false;
+
+    llvm::SmallVector<llvm::StringRef, 64> Entries;
+    (*Buffer)->getBuffer().split(Entries, "\n", -1, false);
+    if (Entries.empty() || (Entries[0].rtrim() != "DAWNCC-PRIVATE 1"))
+      return false;
+
+    for (unsigned I = 1, IE = Entries.size(); I != IE; ++I) {
+      llvm::SmallVector<llvm::StringRef, 4> Fields;
+      Entries[I].rtrim().split(Fields, " ", -1, false);
+
+      unsigned Line;
+      if ((Fields.size() != 4) || Fields[1].getAsInteger(10, Line) ||
+          ((Fields[2] != "private") && (Fields[2] != "firstprivate") &&
+           (Fields[2] != "lastprivate"))) {
+        clear();
+        return false;
+      }
+      Lines[Fields[0]][Line].insert(std::make_pair(Fields[2], Fields[3]));
+    }
+    return true;
+  }
+};
+
+} // end lge namespace
+
+#endif
@@ -0,0 +1,530 @@
+//===--------------------------- dawncc-batch.cpp -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Batch driver for DawnCC. It annotates every source file of a project, given
+// either by a compile_commands.json file or by a directory (all the .c and
+// .cpp files under it, like run.sh -src).
+//
+// Each file goes through the same steps as in run.sh, which are scheduled as
+// a chain of tasks:
+//   format -> scope tree -> IR -> analysis and write-back -> format output
+// Files don't depend on each other, so the chains run concurrently on a
+// work-stealing pool: every worker takes tasks from the front of its own
+// queue, pushing the next step of a file there, and steals from the back of
+// the other queues when its own is empty. At the end, a summary with the
+// latency percentiles of the files is printed.
+//
+// Example:
+//
+// dawncc-batch -scope-finder=${LLVM_BUILD}/lib/scope-finder.so \
+//   -Xdawncc=-Emit-OMP=1 -Xdawncc=-Restrictifier=true \
+//   build/compile_commands.json
+//
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/YAMLParser.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> InputPath(cl::Positional,
+cl::desc("<compile_commands.json or source directory>"), cl::Required);
+
+static cl::opt<unsigned> ClJobs("j",
+cl::desc("Number of worker threads (default: number of cores)."),
+cl::init(0));
+
+static cl::opt<std::string> ClClang("clang",
+cl::desc("Path to clang."), cl::init(""));
+
+static cl::opt<std::string> ClClangFormat("clang-format",
+cl::desc("Path to clang-format."), cl::init(""));
+
+static cl::opt<std::string> ClScopeFinder("scope-finder",
+cl::desc("Path to the scope-finder plugin."), cl::Required);
+
+static cl::opt<std::string> ClDawnCC("dawncc",
+cl::desc("Path to dawncc (default: next to dawncc-batch)."), cl::init(""));
+
+static cl::list<std::string> ClDawnCCArgs("Xdawncc",
+cl::desc("Pass an argument to dawncc."), cl::ZeroOrMore);
+
+static cl::opt<bool> ClKeep("Keep-Intermediary-Files",
+cl::desc("Keep the scope tree and IR of each file."), cl::init(false));
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// A source file to annotate, and the state of its chain of tasks.
+struct SourceFile {
+  // Working directory of the commands, and the file relative to it.
+  std::string Directory;
+  std::string File;
+
+  // Compilation flags, without the input and output files.
+  std::vector<std::string> Flags;
+
+  std::string Bitcode;
+  Clock::time_point Start;
+  double Latency = 0;
+  bool Failed = false;
+};
+
+// Thread pool where each worker owns a queue of tasks, and steals from the
+// other queues when its own one is empty.
+class WorkStealingPool {
+public:
+  typedef std::function<void(unsigned)> Task;
+
+  explicit WorkStealingPool(unsigned NumWorkers)
+    : Queues(NumWorkers), Pending(0) {}
+
+  // Adds a task to the queue of worker W. It runs before the tasks already
+  // there, so a worker keeps on the file it is working on.
+  void push(unsigned W, Task T) {
+    // Counted before it is visible, so Pending never drops to zero while the
+    // task can still be taken.
+    ++Pending;
+    {
+      std::lock_guard<std::mutex> Lock(Queues[W].Mutex);
+      Queues[W].Tasks.push_front(std::move(T));
+    }
+    Idle.notify_one();
+  }
+
+  // Runs the workers until every task, including the ones they push, is done.
+  void run() {
+    std::vector<std::thread> Workers;
+    for (unsigned W = 0, WE = Queues.size(); W != WE; ++W)
+      Workers.emplace_back([this, W]() { work(W); });
+    for (auto &Worker : Workers)
+      Worker.join();
+  }
+
+private:
+  struct Queue {
+    std::mutex Mutex;
+    std::deque<Task> Tasks;
+  };
+
+  std::vector<Queue> Queues;
+
+  // Tasks queued or running.
+  std::atomic<unsigned> Pending;
+
+  std::mutex IdleMutex;
+  std::condition_variable Idle;
+
+  bool take(unsigned W, Task &T) {
+    // Own queue first, from the front.
+    {
+      std::lock_guard<std::mutex> Lock(Queues[W].Mutex);
+      if (!Queues[W].Tasks.empty()) {
+        T = std::move(Queues[W].Tasks.front());
+        Queues[W].Tasks.pop_front();
+        return true;
+      }
+    }
+
+    // Then steal from the back of the others.
+    for (unsigned I = 1, E = Queues.size(); I != E; ++I) {
+      Queue &Victim = Queues[(W + I) % E];
+      std::lock_guard<std::mutex> Lock(Victim.Mutex);
+      if (!Victim.Tasks.empty()) {
+        T = std::move(Victim.Tasks.back());
+        Victim.Tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(unsigned W) {
+    while (true) {
+      Task T;
+      if (take(W, T)) {
+        T(W);
+        if (--Pending == 0)
+          Idle.notify_all();
+        continue;
+      }
+
+      if (Pending == 0)
+        return;
+
+      // Some task is still running and may push more work.
+      std::unique_lock<std::mutex> Lock(IdleMutex);
+      Idle.wait_for(Lock, std::chrono::milliseconds(10));
+    }
+  }
+};
+
+} // end of anonymous namespace.
+
+static std::string quote(StringRef S) {
+  std::string Quoted = "'";
+  for (char C : S) {
+    if (C == '\'')
+      Quoted += "'\\''";
+    else
+      Quoted += C;
+  }
+  return Quoted + "'";
+}
+
+// Runs Command in the directory of SF. Returns false if it fails.
+static bool runCommand(const SourceFile &SF, const std::string &Command) {
+  std::string Line = "cd " + quote(SF.Directory) + " && " + Command;
+  const char *Args[] = {"sh", "-c", Line.c_str(), nullptr};
+  std::string ErrMsg;
+
+  int Result = sys::ExecuteAndWait("/bin/sh", Args, nullptr, nullptr, 0, 0,
+                                   &ErrMsg);
+  if (Result != 0) {
+    errs() << "Failed on " << SF.File << ": " << Command << "\n";
+    if (!ErrMsg.empty())
+      errs() << ErrMsg << "\n";
+    return false;
+  }
+  return true;
+}
+
+static std::string joinFlags(const SourceFile &SF) {
+  std::string Flags;
+  for (auto &Flag : SF.Flags)
+    Flags += " " + quote(Flag);
+  return Flags;
+}
+
+// Name of the annotated file written by WriteInFile.
+static std::string getOutputName(std::string FileName) {
+  std::size_t Found = FileName.rfind(".");
+  if (Found != std::string::npos)
+    FileName.replace(Found, 1, "_AI.");
+  return FileName;
+}
+
+static std::string Format;
+
+// Steps of the chain of a file, as in run.sh.
+static bool formatInput(SourceFile &SF) {
+  return runCommand(SF, Format + " -i " + quote(SF.File));
+}
+
+static bool buildScopeTree(SourceFile &SF) {
+  return runCommand(SF, quote(ClClang) + " -Xclang -load -Xclang " +
+                        quote(ClScopeFinder) + " -Xclang -add-plugin" +
+                        " -Xclang -find-scope" +
+                        " -Xclang -plugin-arg-find-scope -Xclang format=bin" +
+                        " -g -O0 -c -fsyntax-only" +
+                        joinFlags(SF) + " " + quote(SF.File));
+}
+
+static bool emitIR(SourceFile &SF) {
+  SmallString<128> Path;
+  if (sys::fs::createTemporaryFile("dawncc", "bc", Path)) {
+    errs() << "Failed on " << SF.File << ": could not create a temporary file\n";
+    return false;
+  }
+  SF.Bitcode = Path.str();
+
+  return runCommand(SF, quote(ClClang) + " -g -O0 -c -emit-llvm" +
+                        joinFlags(SF) + " " + quote(SF.File) + " -o " +
+                        quote(SF.Bitcode));
+}
+
+static bool annotate(SourceFile &SF) {
+  std::string Command = quote(ClDawnCC) + " -Stage-Times=false";
+  for (auto &Arg : ClDawnCCArgs)
+    Command += " " + quote(Arg);
+  return runCommand(SF, Command + " " + quote(SF.Bitcode));
+}
+
+static bool formatOutput(SourceFile &SF) {
+  return runCommand(SF, Format + " -i " + quote(getOutputName(SF.File)));
+}
+
+static void cleanUp(SourceFile &SF) {
+  if (ClKeep)
+    return;
+
+  if (!SF.Bitcode.empty())
+    sys::fs::remove(SF.Bitcode);
+
+  SmallString<128> ScopeFile(SF.File);
+  if (!sys::path::is_absolute(ScopeFile)) {
+    ScopeFile = SF.Directory;
+    sys::path::append(ScopeFile, SF.File);
+  }
+  sys::fs::remove(Twine(ScopeFile) + "_scope.bin");
+  sys::fs::remove(Twine(ScopeFile) + "_scope.dot");
+}
+
+typedef bool (*Step)(SourceFile &);
+static const Step Steps[] = {formatInput, buildScopeTree, emitIR, annotate,
+                             formatOutput};
+
+// Runs step S of the file, and schedules the next one on the same worker.
+static void runStep(WorkStealingPool &Pool, SourceFile &SF, unsigned S,
+                    unsigned W) {
+  if (S == 0)
+    SF.Start = Clock::now();
+
+  if (!Steps[S](SF))
+    SF.Failed = true;
+
+  if (SF.Failed || S + 1 == array_lengthof(Steps)) {
+    SF.Latency =
+        std::chrono::duration<double>(Clock::now() - SF.Start).count();
+    cleanUp(SF);
+    return;
+  }
+
+  Pool.push(W, [&Pool, &SF, S](unsigned Worker) {
+    runStep(Pool, SF, S + 1, Worker);
+  });
+}
+
+static std::string getScalar(yaml::Node *N) {
+  SmallString<128> Storage;
+  if (yaml::ScalarNode *Scalar = dyn_cast_or_null<yaml::ScalarNode>(N))
+    return Scalar->getValue(Storage).str();
+  return std::string();
+}
+
+// Returns true for the optimization levels and the debug info options of
+// clang ("-O2", "-Os", "-g0", "-gline-tables-only", ...).
+static bool isDebugOrOptFlag(StringRef Arg) {
+  if (Arg.startswith("-O"))
+    return true;
+  return (Arg == "-g") || Arg.startswith("-g0") || Arg.startswith("-g1") ||
+         Arg.startswith("-g2") || Arg.startswith("-g3") ||
+         Arg.startswith("-ggdb") || Arg.startswith("-gline-") ||
+         Arg.startswith("-gdwarf") || (Arg == "-gmlt") ||
+         Arg.startswith("-gno-");
+}
+
+// Keeps the compilation flags of a command line, dropping the compiler, the
+// input file and the output options.
+static void addFlags(SourceFile &SF, ArrayRef<std::string> Args) {
+  for (unsigned I = 1, E = Args.size(); I < E; ++I) {
+    StringRef Arg = Args[I];
+    if (Arg == "-o") {
+      ++I;
+      continue;
+    }
+    if (Arg == "-c" || Arg == SF.File || Arg.startswith("-o"))
+      continue;
+    // The pipeline needs the debug locations of "-O0 -g": the annotations
+    // and the parallel loops are keyed on source locations.
+    if (isDebugOrOptFlag(Arg))
+      continue;
+    SF.Flags.push_back(Args[I]);
+  }
+}
+
+static bool readCompileCommands(StringRef Path,
+                                std::vector<SourceFile> &Files) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    errs() << "Could not read " << Path << "\n";
+    return false;
+  }
+
+  SourceMgr SM;
+  yaml::Stream Stream((*Buffer)->getBuffer(), SM);
+  yaml::document_iterator Doc = Stream.begin();
+  if (Doc == Stream.end())
+    return false;
+
+  yaml::SequenceNode *Entries = dyn_cast_or_null<yaml::SequenceNode>(
+      Doc->getRoot());
+  if (!Entries) {
+    errs() << Path << " is not a list of compile commands\n";
+    return false;
+  }
+
+  for (auto &Entry : *Entries) {
+    yaml::MappingNode *Object = dyn_cast<yaml::MappingNode>(&Entry);
+    if (!Object)
+      continue;
+
+    SourceFile SF;
+    std::vector<std::string> Args;
+    std::string Command;
+
+    for (auto &KV : *Object) {
+      std::string Key = getScalar(KV.getKey());
+      if (Key == "directory")
+        SF.Directory = getScalar(KV.getValue());
+      else if (Key == "file")
+        SF.File = getScalar(KV.getValue());
+      else if (Key == "command")
+        Command = getScalar(KV.getValue());
+      else if (Key == "arguments")
+        if (auto *List = dyn_cast_or_null<yaml::SequenceNode>(KV.getValue()))
+          for (auto &Arg : *List)
+            Args.push_back(getScalar(&Arg));
+    }
+
+    if (Args.empty() && !Command.empty()) {
+      BumpPtrAllocator Alloc;
+      StringSaver Saver(Alloc);
+      SmallVector<const char *, 32> Tokens;
+      cl::TokenizeGNUCommandLine(Command, Saver, Tokens);
+      for (auto Token : Tokens)
+        if (Token)
+          Args.push_back(Token);
+    }
+
+    if (SF.File.empty())
+      continue;
+
+    addFlags(SF, Args);
+    Files.push_back(std::move(SF));
+  }
+  return true;
+}
+
+static void readDirectory(StringRef Path, std::vector<SourceFile> &Files) {
+  // The commands run in the directory, so the paths of the files found must
+  // not be relative to the current one.
+  SmallString<128> Root(Path);
+  sys::fs::make_absolute(Root);
+
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator I(Root, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    StringRef Ext = sys::path::extension(I->path());
+    if (Ext != ".c" && Ext != ".cpp")
+      continue;
+
+    SourceFile SF;
+    SF.Directory = Root.str();
+    SF.File = I->path();
+    Files.push_back(std::move(SF));
+  }
+}
+
+static bool findTool(cl::opt<std::string> &Opt, StringRef Name) {
+  if (!Opt.empty())
+    return true;
+
+  auto Path = sys::findProgramByName(Name);
+  if (!Path) {
+    errs() << "Could not find " << Name << ", use -" << Opt.ArgStr << "\n";
+    return false;
+  }
+  Opt = *Path;
+  return true;
+}
+
+static double getPercentile(const std::vector<double> &Sorted, double P) {
+  if (Sorted.empty())
+    return 0;
+  unsigned Rank = (unsigned)(P * (Sorted.size() - 1) + 0.5);
+  return Sorted[Rank];
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+
+  cl::ParseCommandLineOptions(argc, argv, "DawnCC batch driver\n");
+
+  if (!findTool(ClClang, "clang") || !findTool(ClClangFormat, "clang-format"))
+    return 1;
+
+  if (ClDawnCC.empty()) {
+    std::string Self = sys::fs::getMainExecutable(argv[0],
+                                                  (void *)(intptr_t)&main);
+    SmallString<128> Path(sys::path::parent_path(Self));
+    sys::path::append(Path, "dawncc");
+    ClDawnCC = Path.str();
+  }
+
+  Format = quote(ClClangFormat) +
+           " -style=\"{BasedOnStyle: llvm, IndentWidth: 2}\"";
+
+  std::vector<SourceFile> Files;
+  if (sys::fs::is_directory(InputPath))
+    readDirectory(InputPath, Files);
+  else if (!readCompileCommands(InputPath, Files))
+    return 1;
+
+  unsigned NumWorkers = ClJobs ? ClJobs : std::thread::hardware_concurrency();
+  NumWorkers = std::max(1u, NumWorkers);
+
+  WorkStealingPool Pool(NumWorkers);
+  for (unsigned I = 0, E = Files.size(); I != E; ++I) {
+    SourceFile &SF = Files[I];
+    Pool.push(I % NumWorkers, [&Pool, &SF](unsigned W) {
+      runStep(Pool, SF, 0, W);
+    });
+  }
+
+  Clock::time_point Start = Clock::now();
+  Pool.run();
+  double Total = std::chrono::duration<double>(Clock::now() - Start).count();
+
+  std::vector<double> Latencies;
+  unsigned NumFailed = 0;
+  for (auto &SF : Files) {
+    Latencies.push_back(SF.Latency);
+    if (SF.Failed)
+      ++NumFailed;
+  }
+  std::sort(Latencies.begin(), Latencies.end());
+
+  errs() << "\n===-------------------------------------------------------===\n"
+         << "  DawnCC batch summary\n"
+         << "===-------------------------------------------------------===\n"
+         << "  Files:      " << Files.size() << " (" << NumFailed
+         << " failed)\n"
+         << "  Workers:    " << NumWorkers << "\n"
+         << "  Wall time:  " << format("%.3f", Total) << "s\n"
+         << "  Latency p50: " << format("%.3f", getPercentile(Latencies, 0.5))
+         << "s\n"
+         << "  Latency p90: " << format("%.3f", getPercentile(Latencies, 0.9))
+         << "s\n"
+         << "  Latency p99: " << format("%.3f", getPercentile(Latencies, 0.99))
+         << "s\n"
+         << "  Latency max: "
+         << format("%.3f", Latencies.empty() ? 0.0 : Latencies.back())
+         << "s\n";
+
+  return NumFailed ? 1 : 0;
+}
+
+//===--------------------------- dawncc-batch.cpp -------------------------===//
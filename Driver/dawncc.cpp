@@ -0,0 +1,229 @@
+//===------------------------------ dawncc.cpp ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Single process driver for the DawnCC annotation pipeline. It replaces the
+// three "opt" invocations of run.sh: the module is parsed once and every
+// stage runs in memory, so the canonicalization passes and the analyses are
+// not recomputed after a bitcode round trip.
+//
+// The pipeline has two stages:
+//   -- Parallel loop detection: PtrRangeAnalysis, AliasInstrumentation and
+//      CanParallelize (ParallelLoopAnalysis) run over a copy of the module,
+//      because the versioned regions must not reach the annotated output
+//      (run.sh throws this IR away as well).
+//   -- Annotation: AnnotateParallel marks the parallel loops, then
+//      WriteInFile writes the annotated source file.
+//
+// The parallel loops found in the first stage are handed to the second one
+// in memory, through a ParallelLoopSet.
+//
+// With "-Jobs=N", the annotation stage runs in N worker threads. Each worker
+// parses its own copy of the module in a private LLVMContext and analyzes the
+// functions it takes from a shared counter. The comments of all workers are
+// then merged and written back in module order, so the output doesn't depend
+// on the number of workers.
+//
+// Example:
+//
+// dawncc -Emit-GPU=false -Emit-Parallel=true -Emit-OMP=1 \
+//   -Restrictifier=true -Memory-Coalescing=true -Ptr-licm=true \
+//   -Ptr-region=true -Run-Mode=false result.bc
+//
+// Every flag accepted by the passes in the pipeline (including "-stats" and
+// "-time-passes") is accepted by dawncc as well. The time spent in each stage
+// is reported at the end of the run, unless "-Stage-Times=false" is given.
+//
+//===----------------------------------------------------------------------===//
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "../AliasInstrumentation/AliasInstrumentation.h"
+#include "../CanParallelize/CanParallelize.h"
+#include "../ArrayInference/annotateLoopParallel.h"
+#include "../ArrayInference/writeInFile.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace lge;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+cl::desc("<input bitcode file>"), cl::init("-"),
+cl::value_desc("filename"));
+
+static cl::opt<bool> ClStageTimes("Stage-Times",
+cl::desc("Report the time spent in each stage of the pipeline."),
+cl::init(true));
+
+static cl::opt<unsigned> ClJobs("Jobs",
+cl::desc("Number of threads used to annotate the functions of the module."),
+cl::init(1));
+
+// The private variables change the comments, but their flag is defined out of
+// ArrayInference.
+static CacheFlag PrivateFileFlag("private-file",
+                                 &ParallelLoopAnalysis::getPrivateFile, true);
+
+// Canonicalization used by the parallel loop detection stage. It matches the
+// FLAGS variable of run.sh.
+static void addDetectionPasses(legacy::PassManager &PM,
+                               ParallelLoopSet &ParLoops) {
+  PM.add(createPromoteMemoryToRegisterPass());
+  PM.add(createTypeBasedAliasAnalysisPass());
+  PM.add(createScopedNoAliasAAPass());
+  PM.add(createBasicAliasAnalysisPass());
+  PM.add(createFunctionAttrsPass());
+  PM.add(createGVNPass());
+  PM.add(createLoopRotatePass());
+  PM.add(createInstructionCombiningPass());
+  PM.add(createLICMPass());
+
+  // The PtrRangeAnalysis of AliasInstrumentation, not the one of
+  // ArrayInference: "-Ptr-licm" and "-Ptr-region" don't change this stage,
+  // as in run.sh.
+  PM.add(new pra::PtrRangeAnalysis());
+  PM.add(new AliasInstrumentation());
+  PM.add(new CanParallelize(&ParLoops));
+}
+
+// Annotation stage. AnnotateParallel runs on the IR emitted by clang, then the
+// FLAGSAI canonicalization of run.sh is applied before writing the source.
+static void addAnnotationPasses(legacy::PassManager &PM,
+                                const ParallelLoopSet &ParLoops,
+                                ModuleComments *Result = nullptr,
+                                std::atomic<unsigned> *NextFunction = nullptr) {
+  PM.add(new AnnotateParallel(&ParLoops));
+
+  PM.add(createPromoteMemoryToRegisterPass());
+  PM.add(createInstructionNamerPass());
+  PM.add(createLoopRotatePass());
+
+  PM.add(new WriteInFile(Result, NextFunction));
+}
+
+// Annotation stage in worker mode. Bitcode holds the module as it was parsed,
+// which every worker loads in its own context.
+static void runAnnotationWorkers(StringRef Bitcode,
+                                 const ParallelLoopSet &ParLoops) {
+  std::atomic<unsigned> NextFunction(0);
+  std::vector<ModuleComments> Parts(ClJobs);
+  std::vector<std::thread> Workers;
+
+  for (unsigned W = 0; W != ClJobs; ++W) {
+    Workers.emplace_back([&, W]() {
+      LLVMContext Context;
+      ErrorOr<std::unique_ptr<Module>> M =
+          parseBitcodeFile(MemoryBufferRef(Bitcode, InputFilename), Context);
+      if (!M) {
+        errs() << "Worker " << W << " could not load the module: "
+               << M.getError().message() << "\n";
+        return;
+      }
+
+      legacy::PassManager PM;
+      addAnnotationPasses(PM, ParLoops, &Parts[W], &NextFunction);
+      PM.run(**M);
+    });
+  }
+
+  for (auto &Worker : Workers)
+    Worker.join();
+
+  WriteInFile Writer;
+  Writer.writeComments(WriteInFile::mergeComments(Parts));
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+
+  LLVMContext &Context = getGlobalContext();
+
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeScalarOpts(Registry);
+  initializeIPO(Registry);
+  initializeAnalysis(Registry);
+  initializeIPA(Registry);
+  initializeTransformUtils(Registry);
+  initializeInstCombine(Registry);
+
+  // Region scoped alias checks are always used to find parallel loops, like
+  // in run.sh. The flag accepts repeated occurrences, so the user can still
+  // pass it explicitly.
+  std::vector<const char *> Args(argv, argv + argc);
+  Args.insert(Args.begin() + 1, "-region-alias-checks");
+
+  cl::ParseCommandLineOptions(Args.size(), Args.data(),
+                              "DawnCC annotation pipeline\n");
+
+  // The stage timers are reported when they go out of scope.
+  TimerGroup StageTimers("DawnCC pipeline stages");
+  Timer ParseTimer("Parse module", StageTimers);
+  Timer DetectionTimer("Parallel loop detection", StageTimers);
+  Timer AnnotationTimer("Annotation and source write-back", StageTimers);
+
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M;
+  {
+    TimeRegion Region(ClStageTimes ? &ParseTimer : nullptr);
+    M = parseIRFile(InputFilename, Err, Context);
+  }
+
+  if (!M) {
+    Err.print(argv[0], errs());
+    return 1;
+  }
+
+  ParallelLoopSet ParLoops;
+  {
+    TimeRegion Region(ClStageTimes ? &DetectionTimer : nullptr);
+    std::unique_ptr<Module> Instrumented = CloneModule(M.get());
+    legacy::PassManager PM;
+    addDetectionPasses(PM, ParLoops);
+    PM.run(*Instrumented);
+  }
+
+  {
+    TimeRegion Region(ClStageTimes ? &AnnotationTimer : nullptr);
+    if (ClJobs > 1) {
+      SmallString<0> Bitcode;
+      raw_svector_ostream OS(Bitcode);
+      WriteBitcodeToFile(M.get(), OS);
+      OS.flush();
+      runAnnotationWorkers(Bitcode, ParLoops);
+    } else {
+      legacy::PassManager PM;
+      addAnnotationPasses(PM, ParLoops);
+      PM.run(*M);
+    }
+  }
+
+  return 0;
+}
+
+//===------------------------------ dawncc.cpp ----------------------------===//
@@ -13,6 +13,11 @@
 using namespace llvm;
 using namespace lge;
 
+static cl::opt<std::string> ParallelLoopsIn(
+    "parloops-md-in",
+    cl::desc("Sidecar file with the parallel loops found by CanParallelize"),
+    cl::init(""));
+
 void ParallelLoopMetadata::setMetadataParallelLoop (Loop *L, bool ParAnalysis) {
   BasicBlock *BB = L->getHeader();
   if (BB == nullptr)
@@ -31,13 +36,9 @@ void ParallelLoopMetadata::setMetadataParallelLoop (Loop *L, bool ParAnalysis) {
 void ParallelLoopMetadata::visit(Loop *L, bool Par, bool Div) {
   LoopCounter++;
   
-  if (Par) {
-    int LoopPar = LoopsFunction[FunctionCounter][(CountPar - 1)];
-    if(LoopCounter == LoopPar) {
-      setMetadataParallelLoop(L,1);
-      CountPar++;
-    }
-  }
+  if (Par && ParLoops.contains(L, *LI))
+    setMetadataParallelLoop(L,1);
+
   if (Div){
     int LoopDiv = DivLoops[FunctionCounter][CountDiv];
   
@@ -52,7 +53,7 @@ void ParallelLoopMetadata::visit(Loop *L, bool Par, bool Div) {
     visit(SL,Par,Div);
 }
 
-void ParallelLoopMetadata::readFile(bool ParAnalysis, std::ifstream &InFile) {
+void ParallelLoopMetadata::readFile(std::ifstream &InFile) {
  
   std::string Line;
   int i=0;
@@ -72,10 +73,7 @@ void ParallelLoopMetadata::readFile(bool ParAnalysis, std::ifstream &InFile) {
       Words = std::strtok (NULL, ";");
       j++;      
     }
-    if (ParAnalysis)
-      LoopsFunction.push_back(NumLoop);
-    else
-      DivLoops.push_back(NumLoop);
+    DivLoops.push_back(NumLoop);
     i++;
   }
 }  
@@ -83,47 +81,36 @@ void ParallelLoopMetadata::readFile(bool ParAnalysis, std::ifstream &InFile) {
 bool ParallelLoopMetadata::runOnFunction(llvm::Function &F) {
   LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
   LoopCounter = 0;
-  CountPar = 0,CountDiv = 0;
+  CountDiv = 0;
   bool Par = 0, Div = 0; 
   
   if (!FunctionCounter) {
-    std::ifstream PlFile, DaFile;
-    
-    PlFile.open("out_pl.log", std::ios_base::in);
-    if (PlFile.is_open()) {
-      readFile(1, PlFile);
-      Par = 1;
-    } else
-      Par = 0;
-    PlFile.close();
+    std::ifstream DaFile;
+
+    if (!ParallelLoopsIn.empty() && !ParLoops.readFromFile(ParallelLoopsIn))
+      errs() << "Could not read parallel loops from " << ParallelLoopsIn
+             << "\n";
     
     DaFile.open("out_da.log", std::ios_base::in);
-    if (DaFile.is_open()) {
-      readFile(0, DaFile);
-      Div = 1;
-    } else
-      Div = 0;
+    if (DaFile.is_open())
+      readFile(DaFile);
     DaFile.close();
   }
 
-  if (F.getName() == Functions[FunctionCounter]) {
-    
-    if (Par) {    
-      if (LoopsFunction[FunctionCounter][CountPar] != 0) 
-        CountPar++;
-      else 
-        Par = 0;
-    }
-    if (Div) {
-      if(DivLoops[FunctionCounter][CountDiv] != 0)  
-        CountDiv++;
-      else
-        Div = 0;
+  Par = ParLoops.hasFunction(F.getName());
+
+  if (((size_t)FunctionCounter < Functions.size()) &&
+      (F.getName() == Functions[FunctionCounter])) {
+    if(!DivLoops[FunctionCounter].empty() &&
+       DivLoops[FunctionCounter][CountDiv] != 0) {
+      CountDiv++;
+      Div = 1;
     }
-    if(Par || Div){   
-      for (auto I = LI->begin(), E = LI->end(); I != E; ++I) {
-        visit(*I,Par,Div);
-      }
+  }
+
+  if(Par || Div){   
+    for (auto I = LI->begin(), E = LI->end(); I != E; ++I) {
+      visit(*I,Par,Div);
     }
   }
   
@@ -11,7 +11,8 @@
 //
 // This pass identify what loop can be parallelized and inserts into the 
 // source code a metadata which indicates the loop is parallel. To do so, 
-// it uses ParallelLoopAnalysis.
+// it uses the parallel loops stored by CanParallelize with
+// "-parallel-loops-out", given to this pass by "-parloops-md-in".
 //
 //===--------------------------------------------------------------------------===//
 
@@ -22,6 +23,8 @@
 #include <llvm/IR/Metadata.h>
 #include <vector>
 
+#include "../DepBasedParallelLoopAnalysis/ParallelLoopSet.h"
+
 using namespace llvm;
 
 namespace lge {
@@ -30,16 +33,15 @@ class ParallelLoopMetadata : public FunctionPass {
   // Analyses used.
   LoopInfo *LI;
   size_t LoopCounter;
-  size_t CountPar;
   size_t CountDiv;
   int FunctionCounter=0;
+  ParallelLoopSet ParLoops;
   std::vector <std::string> Functions;
-  std::vector <std::vector <int>> LoopsFunction;
   std::vector <std::vector <int>> DivLoops;
 
   void visit(Loop *L,bool Par,bool Div);
 
-  void readFile(bool ParAnalysis, std::ifstream &InFile);
+  void readFile(std::ifstream &InFile);
   void setMetadataParallelLoop (Loop *L, bool ParAnalysis);
 
 public:
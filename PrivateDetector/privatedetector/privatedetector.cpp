@@ -1,4 +1,4 @@
-//===----------------------------ompwriterr.cpp-----------------------------===
+//===-------------------------privatedetector.cpp---------------------------===
 //
 //
 //Author: Gleison Souza Diniz Mendonca
@@ -6,33 +6,52 @@
 //
 //===-----------------------------------------------------------------------===
 //
-//OMP Extractor is a small plugin developed for the Clang C compiler front-end.
-//Its goal is to provide auxiliary source-code information extracting information
-//of Openmp pragmas, to permits people to understand and compare different openmp
-//pragmas for the same benchamrk.
+//Private Detector is a small plugin developed for the Clang C compiler front-
+//end. Its goal is to find, for each "for" loop of a C/C++ source-code file,
+//the variables that every iteration can keep a copy of, so that our LLVM
+//passes can run the loop in parallel and write the matching OpenMP/OpenACC
+//clauses.
 //
-//More specifically, it collects information about the synctatical pragma
-//constructions and pragmas that exist within a C/C++ source-code file. It then
-//builds a Json file, which is a representation of those pragma blocks in the source
-//file, where each loop is a node block with information about parallelization using
-//OpenMP syntax.
+//More specifically, for each loop it computes three sets of variables,
+//declared out of the loop, with local storage, whose address is never taken:
 //
-//For each input file, its reference nodes are outputted as a JSON format file, that
-//represents the loops inside the source code.
+//  private      -> scalars (and small arrays of constant size) that each
+//                  iteration writes before reading them.
+//  lastprivate  -> private variables that are read after the loop ends, and
+//                  that the last iteration always writes.
+//  firstprivate -> arithmetic scalars that the loop body only reads. Pointers
+//                  are left out, since a private copy of a pointer doesn't
+//                  follow the data mapped to an accelerator.
+//
+//The induction variables of the loop, and the variables declared inside it,
+//are private by definition, and are not listed. An access only defines a
+//variable when it runs in every iteration: writes nested in conditionals,
+//inner loops, or after a jump out of the iteration don't count.
+//
+//For each input file, the sets are written to the sidecar "file_private.txt",
+//read by ParallelLoopAnalysis with "-private-file". Each line after the header
+//"DAWNCC-PRIVATE 1" describes one variable of one loop:
+//
+//  function line clause variable
+//
+//where "function" is the name of the function in the LLVM IR, and "line" is
+//the line where the loop starts. The largest array that can be privatized
+//(in elements, default 256) can be changed with the plugin argument
+//"max-array=N":
+//
+//  clang ... -Xclang -plugin-arg-private-detector -Xclang max-array=64
 //
 //Since it is a small self-contained plugin (not meant to be included by other
 //applications), all the code is kept within its own source file, for simplici-
 //ty's sake.
 //
-//By default, the plugin is built alongside an LLVM+Clang build, and its shared
-//library file (ompextractor.so) can be found its build.
-//
 //The plugin can be set to run during any Clang compilation command, using the
 //following syntax:
 //
-//  clang -Xclang -load -Xclang $SCOPE -Xclang -add-plugin -Xclang -private-detector
+//  clang -Xclang -load -Xclang $PRIVATE -Xclang -add-plugin -Xclang -private-detector
 //
-//  Where $SCOPE -> points to the ompextractor.so shared library file location 
+//  Where $PRIVATE -> points to the CLANGPrivateDetector.so shared library file
+//  location
 //===-----------------------------------------------------------------------===
 
 #include "clang/Driver/Options.h"
@@ -45,10 +64,11 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
-#include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Basic/SourceLocation.h"
-#include <stack>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <set>
 #include <vector>
 #include <fstream>
 
@@ -59,219 +79,609 @@ using namespace llvm;
   //---------------------------------------------------------------------------
   //                       DATA SCTRUCTURES
   //---------------------------------------------------------------------------
-  /*we can use this little baby to alter the original source code, if we ever feel
-  like it*/
-  Rewriter rewriter;
+/*largest array, in elements, that can be privatized*/
+uint64_t MaxArrayElements = 256;
+
+/*state of a variable in one iteration of the loop being analyzed*/
+struct VarState {
+  bool defined;   //written, as a whole, in every iteration
+  bool exposed;   //may be read before it is written in the iteration
+  bool written;   //written somewhere in the loop
+  bool read;      //read somewhere in the loop body
+  set<uint64_t> definedElems; //constant positions written in every iteration
+
+  VarState() : defined(false), exposed(false), written(false), read(false) {}
+};
+
+/*private variables of a loop, by clause*/
+struct LoopPrivates {
+  string function;
+  unsigned int line;
+  set<string> privates;
+  set<string> firstPrivates;
+  set<string> lastPrivates;
+};
 
 /*visitor class, inherits clang's ASTVisitor to traverse specific node types in
  the program's AST and retrieve useful information*/
-class PragmaVisitor : public RecursiveASTVisitor<PragmaVisitor> {
+class PrivateVisitor : public RecursiveASTVisitor<PrivateVisitor> {
 private:
     ASTContext *astContext; //provides AST context info
-    MangleContext *mangleContext;
-    map<ValueDecl, bool> inductionVars; //map of all variables to a boolean value indicating if this variable is used as induction at some point
+    unique_ptr<MangleContext> mangleContext;
+
+    /*references to each variable of the current function, and the loops of
+    the current function*/
+    map<const VarDecl*, vector<SourceLocation> > references;
+    vector<Stmt*> loops;
+
+    /*variables of the current function whose address is taken anywhere in
+    it, by "&", an array decaying to a pointer, a reference or inline
+    assembly. A pointer may reach them from inside any loop*/
+    set<const VarDecl*> escaped;
+
+    /*state of the loop being analyzed*/
+    map<const VarDecl*, VarState> vars;
+    set<const VarDecl*> inductionVars;
+    SourceRange loopRange;
+    bool jumped; //a jump may have left the current iteration
+    bool inBody; //the body is being visited, not the loop header
 
 public:
-    
-    explicit PragmaVisitor(CompilerInstance *CI) 
-      : astContext(&(CI->getASTContext())) { // initialize private members
-        rewriter.setSourceMgr(astContext->getSourceManager(),
-        astContext->getLangOpts());
-    }
+    vector<LoopPrivates> results;
 
-    /*Recover C code */
-    std::string getSourceSnippet(SourceRange sourceRange, bool allTokens, bool jsonForm) {
-      if (!sourceRange.isValid())
-	return std::string();
+    explicit PrivateVisitor(CompilerInstance *CI)
+      : astContext(&(CI->getASTContext())),
+        mangleContext(astContext->createMangleContext()) { }
 
-      SourceLocation bLoc(sourceRange.getBegin());
-      SourceLocation eLoc(sourceRange.getEnd());
-	   
+    /*returns true if the location L lies within the range R*/
+    bool contains(SourceRange R, SourceLocation L) {
       const SourceManager& mng = astContext->getSourceManager();
-      std::pair<FileID, unsigned> bLocInfo = mng.getDecomposedLoc(bLoc);
-      std::pair<FileID, unsigned> eLocInfo = mng.getDecomposedLoc(eLoc);
-      FileID FID = bLocInfo.first;
-      unsigned bFileOffset = bLocInfo.second;
-      unsigned eFileOffset = eLocInfo.second;
-      int length = eFileOffset - bFileOffset;
-
-      if (length <= 0)
-	return std::string();
-
-      bool Invalid = false;
-      const char *BufStart = mng.getBufferData(FID, &Invalid).data();
-      if (Invalid)
-        return std::string();
-
-      if (allTokens == true) {
-	while (true) {
-	  if (BufStart[(bFileOffset + length)] == ';')
-            break;
-	  if (BufStart[(bFileOffset + length)] == '}')
-	    break;
-	  if (length == eFileOffset)
-            break;
-          length++;
-	}
-      }
+      SourceLocation B = mng.getExpansionLoc(R.getBegin());
+      SourceLocation E = mng.getExpansionLoc(R.getEnd());
+      L = mng.getExpansionLoc(L);
+      return !mng.isBeforeInTranslationUnit(L, B) &&
+             !mng.isBeforeInTranslationUnit(E, L);
+    }
+
+    /*returns the name of a function in the LLVM IR*/
+    string getFunctionName(FunctionDecl *FD) {
+      if (!mangleContext->shouldMangleDeclName(FD))
+        return FD->getNameAsString();
+      string name;
+      raw_string_ostream OS(name);
+      mangleContext->mangleName(FD, OS);
+      return OS.str();
+    }
+
+    /*returns the variable referenced by E, if any*/
+    const VarDecl *getVar(Expr *E) {
+      if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(E->IgnoreParenImpCasts()))
+        return dyn_cast<VarDecl>(DRE->getDecl());
+      return nullptr;
+    }
+
+    /*returns the number of elements of V if it is an array that can be
+    privatized, or 0 otherwise*/
+    uint64_t getArraySize(const VarDecl *V) {
+      const ConstantArrayType *CAT =
+        astContext->getAsConstantArrayType(V->getType());
+      if (!CAT || !CAT->getElementType()->isScalarType())
+        return 0;
+      uint64_t size = CAT->getSize().getZExtValue();
+      return (size <= MaxArrayElements) ? size : 0;
+    }
+
+    /*returns true if V is a variable that the loop may privatize*/
+    bool isCandidate(const VarDecl *V) {
+      if (!V || !V->hasLocalStorage() || inductionVars.count(V) ||
+          escaped.count(V))
+        return false;
+      if (V->getType().isVolatileQualified())
+        return false;
+      if (contains(loopRange, V->getLocation()))
+        return false;
+      return V->getType()->isScalarType() || getArraySize(V);
+    }
+
+    /*returns the constant index of an array access, if any*/
+    bool getConstantIndex(Expr *E, uint64_t &index) {
+      APSInt value;
+      if (!E->EvaluateAsInt(value, *astContext) || value.isNegative())
+        return false;
+      index = value.getZExtValue();
+      return true;
+    }
 
-      if (length != eFileOffset)
-        length++;
+    void read(const VarDecl *V) {
+      if (!isCandidate(V))
+        return;
+      VarState &S = vars[V];
+      S.read |= inBody;
+      if (!S.defined)
+        S.exposed = true;
+    }
 
-      std::string snippet = StringRef(BufStart + bFileOffset, length).trim().str();
-      snippet = replace_all(snippet, "\\", "\\\\");
-      snippet = replace_all(snippet, "\"", "\\\"");
+    void readElement(const VarDecl *V, uint64_t index) {
+      if (!isCandidate(V))
+        return;
+      VarState &S = vars[V];
+      S.read |= inBody;
+      if (!S.defined && !S.definedElems.count(index))
+        S.exposed = true;
+    }
 
-      if (jsonForm == true)
-	snippet = "\"" + replace_all(snippet, "\n", "\",\n\"") + "\"";
+    /*a write defines the variable if it runs in every iteration*/
+    void write(const VarDecl *V, bool conditional) {
+      if (!isCandidate(V))
+        return;
+      VarState &S = vars[V];
+      S.written = true;
+      if (!conditional && !jumped && !getArraySize(V))
+        S.defined = true;
+    }
 
-      return snippet;
+    void writeElement(const VarDecl *V, uint64_t index, bool conditional) {
+      if (!isCandidate(V))
+        return;
+      VarState &S = vars[V];
+      S.written = true;
+      if (conditional || jumped)
+        return;
+      S.definedElems.insert(index);
+      if (S.definedElems.size() == getArraySize(V))
+        S.defined = true;
     }
 
-    /*Replace all  occurrences in the target string*/
-    std::string replace_all(std::string str, std::string from, std::string to) {
-      int pos = 0;
-      while((pos = str.find(from, pos)) != std::string::npos) {
-	str.replace(pos, from.length(), to);
-	pos = pos + to.length();
+    /*marks the variable of the lvalue E as escaped, through subscripts and
+    fields*/
+    void escape(Expr *E) {
+      E = E->IgnoreParenImpCasts();
+      while (isa<ArraySubscriptExpr>(E) || isa<MemberExpr>(E)) {
+        if (ArraySubscriptExpr *AS = dyn_cast<ArraySubscriptExpr>(E))
+          E = AS->getBase()->IgnoreParenImpCasts();
+        else
+          E = cast<MemberExpr>(E)->getBase()->IgnoreParenImpCasts();
       }
-      return str;
+      if (const VarDecl *V = getVar(E))
+        escaped.insert(V);
     }
 
-    /*visit each node walking in the sub-ast and provide a list stored as "nodes_list"*/
-    void visitNodes(Stmt *st, vector<Stmt*> & nodes_list) {
-      if (!st)
-	return;
-      nodes_list.push_back(st);
-      if (CapturedStmt *CPTSt = dyn_cast<CapturedStmt>(st)) {
-        visitNodes(CPTSt->getCapturedStmt(), nodes_list);
-	return;
+    /*finds the variables whose address escapes in the statement S*/
+    void findEscapes(Stmt *S) {
+      if (!S)
+        return;
+
+      /*indexing an array doesn't let its address out*/
+      if (ArraySubscriptExpr *AS = dyn_cast<ArraySubscriptExpr>(S)) {
+        Expr *Base = AS->getBase()->IgnoreParens();
+        ImplicitCastExpr *IC = dyn_cast<ImplicitCastExpr>(Base);
+        if (IC && (IC->getCastKind() == CK_ArrayToPointerDecay)) {
+          findEscapes(IC->getSubExpr());
+          findEscapes(AS->getIdx());
+          return;
+        }
+      }
+
+      if (UnaryOperator *UO = dyn_cast<UnaryOperator>(S)) {
+        if (UO->getOpcode() == UO_AddrOf)
+          escape(UO->getSubExpr());
+      }
+      else if (ImplicitCastExpr *IC = dyn_cast<ImplicitCastExpr>(S)) {
+        if (IC->getCastKind() == CK_ArrayToPointerDecay)
+          escape(IC->getSubExpr());
+      }
+      else if (DeclStmt *DS = dyn_cast<DeclStmt>(S)) {
+        /*references bound to a variable*/
+        for (auto I = DS->decl_begin(), IE = DS->decl_end(); I != IE; ++I)
+          if (VarDecl *VD = dyn_cast<VarDecl>(*I))
+            if (VD->getType()->isReferenceType() && VD->getInit())
+              escape(VD->getInit());
       }
-      for (auto I = st->child_begin(), IE = st->child_end(); I != IE; I++) {
-       visitNodes((*I)->IgnoreContainers(true), nodes_list);
+      else if (CallExpr *CE = dyn_cast<CallExpr>(S)) {
+        /*arguments bound to reference parameters*/
+        if (FunctionDecl *Callee = CE->getDirectCallee())
+          for (unsigned int i = 0, ie = std::min(CE->getNumArgs(),
+                                                 Callee->getNumParams());
+               i != ie; i++)
+            if (Callee->getParamDecl(i)->getType()->isReferenceType())
+              escape(CE->getArg(i));
       }
+      else if (isa<AsmStmt>(S)) {
+        /*inline assembly may read or write any variable it names*/
+        vector<Stmt*> nodes;
+        collectNodes(S, nodes);
+        for (Stmt *N : nodes)
+          if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(N))
+            if (VarDecl *VD = dyn_cast<VarDecl>(DRE->getDecl()))
+              escaped.insert(VD);
+        return;
+      }
+
+      for (auto I = S->child_begin(), IE = S->child_end(); I != IE; I++)
+        findEscapes(*I);
     }
 
-    /*recursively visits the children of a node and returns a vector containing all found*/
-    virtual void RecVisitChildren(Stmt *S, vector<ValueDecl> &recVars){
-	for (Stmt::child_iterator i = S->child_begin(), e = S->child_end(); i!=e; ++i) {
-     		Stmt *child = *i;
-                if (child!=nullptr) {
-			if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(child)) {
-				string varName = DRE->getDecl()->getNameAsString();
-				recVars.push_back(*DRE->getDecl());
-				//errs() <<varName <<"\n";
-				return;
-			}
-		}
-		RecVisitChildren(child->IgnoreContainers(true), recVars);
-	}
+    /*visits the target of an assignment, after its value*/
+    void visitStore(Expr *E, bool conditional, bool partial) {
+      E = E->IgnoreParenImpCasts();
+      if (const VarDecl *V = getVar(E)) {
+        if (partial)
+          read(V);
+        write(V, conditional || partial);
+        return;
+      }
+
+      if (ArraySubscriptExpr *AS = dyn_cast<ArraySubscriptExpr>(E)) {
+        const VarDecl *V = getVar(AS->getBase());
+        uint64_t index;
+        if (V && getArraySize(V)) {
+          visitExpr(AS->getIdx(), conditional);
+          if (getConstantIndex(AS->getIdx(), index)) {
+            if (partial)
+              readElement(V, index);
+            writeElement(V, index, conditional || partial);
+          }
+          else {
+            read(V);
+            write(V, true);
+          }
+          return;
+        }
+      }
+
+      /*any other target (pointers, fields, ...) is only read*/
+      visitExpr(E, conditional);
     }
 
-    /*visits all nodes of type decl*/
-    virtual bool VisitDecl(Decl *D) {
-	if (FunctionDecl *FD = dyn_cast<FunctionDecl>(D)) {
-      	  if (FD->doesThisDeclarationHaveABody()) {
-	    const SourceManager& mng = astContext->getSourceManager();
-            if (astContext->getSourceManager().isInSystemHeader(D->getLocation())) {
-              return true;
+    /*visits an expression in evaluation order*/
+    void visitExpr(Expr *E, bool conditional) {
+      if (!E)
+        return;
+      E = E->IgnoreParens();
+
+      if (BinaryOperator *BO = dyn_cast<BinaryOperator>(E)) {
+        if (BO->getOpcode() == BO_Assign) {
+          visitExpr(BO->getRHS(), conditional);
+          visitStore(BO->getLHS(), conditional, false);
+          return;
+        }
+        if (BO->isCompoundAssignmentOp()) {
+          visitExpr(BO->getRHS(), conditional);
+          visitStore(BO->getLHS(), conditional, true);
+          return;
+        }
+        if (BO->isLogicalOp()) {
+          visitExpr(BO->getLHS(), conditional);
+          visitExpr(BO->getRHS(), true);
+          return;
+        }
+      }
+
+      if (UnaryOperator *UO = dyn_cast<UnaryOperator>(E)) {
+        if (UO->isIncrementDecrementOp()) {
+          visitStore(UO->getSubExpr(), conditional, true);
+          return;
+        }
+        if (UO->getOpcode() == UO_AddrOf) {
+          Expr *Sub = UO->getSubExpr()->IgnoreParenImpCasts();
+          while (isa<ArraySubscriptExpr>(Sub) || isa<MemberExpr>(Sub)) {
+            if (ArraySubscriptExpr *AS = dyn_cast<ArraySubscriptExpr>(Sub)) {
+              visitExpr(AS->getIdx(), conditional);
+              Sub = AS->getBase()->IgnoreParenImpCasts();
             }
+            else
+              Sub = cast<MemberExpr>(Sub)->getBase()->IgnoreParenImpCasts();
+          }
+          visitExpr(UO->getSubExpr(), conditional);
+          return;
+        }
+      }
 
-	  }
-	}
-	else if (VarDecl *VD = dyn_cast<VarDecl>(D)) {
-		string varName = VD->getNameAsString();
-		SourceLocation SL = VD->getLocStart();
-                FullSourceLoc FSL = astContext->getFullLoc(SL);
-                if(FSL.isValid()){
-	                errs() <<"Variable declaration " << varName << " at line:" << FSL.getSpellingLineNumber() <<"\n";
-                }
-	}
-	// Add an else here, to find other declarations.
-      return true;
+      if (AbstractConditionalOperator *CO =
+            dyn_cast<AbstractConditionalOperator>(E)) {
+        visitExpr(CO->getCond(), conditional);
+        visitExpr(CO->getTrueExpr(), true);
+        visitExpr(CO->getFalseExpr(), true);
+        return;
+      }
+
+      if (ArraySubscriptExpr *AS = dyn_cast<ArraySubscriptExpr>(E)) {
+        const VarDecl *V = getVar(AS->getBase());
+        uint64_t index;
+        if (V && getArraySize(V)) {
+          visitExpr(AS->getIdx(), conditional);
+          if (getConstantIndex(AS->getIdx(), index))
+            readElement(V, index);
+          else
+            read(V);
+          return;
+        }
+      }
+
+      if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(E)) {
+        if (const VarDecl *V = dyn_cast<VarDecl>(DRE->getDecl()))
+          read(V);
+        return;
+      }
+
+      visitChildren(E, conditional);
     }
 
+    void visitChildren(Stmt *S, bool conditional) {
+      for (Stmt::child_iterator I = S->child_begin(), IE = S->child_end();
+           I != IE; ++I) {
+        if (Expr *E = dyn_cast_or_null<Expr>(*I))
+          visitExpr(E, conditional);
+        else
+          visitStmt(*I, conditional, true);
+      }
+    }
 
-    /* receives a loop statement and find its induction variables */
-    void setInductionVars(Stmt *S){
-	  vector<ValueDecl> *indVars = new vector<ValueDecl>;
-	  if (ForStmt *FS = dyn_cast<ForStmt>(S)) {
-		  errs() <<" induction variable: ";
-		  RecVisitChildren(FS->getInc()->IgnoreContainers(true), *indVars);
-		  for (auto& it:*indVars){
-			  errs() <<it.getNameAsString() <<" ";
-		  }
-		  errs() <<"\n";
+    /*visits a statement of the loop body. "nested" is true within inner loops
+    and switches, where "break" and "continue" don't leave the iteration*/
+    void visitStmt(Stmt *S, bool conditional, bool nested) {
+      if (!S)
+        return;
 
-	  }
+      if (Expr *E = dyn_cast<Expr>(S)) {
+        visitExpr(E, conditional);
+        return;
+      }
+
+      if (CompoundStmt *CS = dyn_cast<CompoundStmt>(S)) {
+        for (auto I = CS->body_begin(), IE = CS->body_end(); I != IE; ++I)
+          visitStmt(*I, conditional, nested);
+        return;
+      }
+
+      if (DeclStmt *DS = dyn_cast<DeclStmt>(S)) {
+        for (auto I = DS->decl_begin(), IE = DS->decl_end(); I != IE; ++I)
+          if (VarDecl *VD = dyn_cast<VarDecl>(*I))
+            visitExpr(VD->getInit(), conditional);
+        return;
+      }
+
+      if (IfStmt *IS = dyn_cast<IfStmt>(S)) {
+        visitExpr(IS->getCond(), conditional);
+        visitStmt(IS->getThen(), true, nested);
+        visitStmt(IS->getElse(), true, nested);
+        return;
+      }
+
+      if (ForStmt *FS = dyn_cast<ForStmt>(S)) {
+        visitStmt(FS->getInit(), conditional, nested);
+        visitExpr(FS->getCond(), conditional);
+        visitStmt(FS->getBody(), true, true);
+        visitExpr(FS->getInc(), true);
+        return;
+      }
+
+      if (WhileStmt *WS = dyn_cast<WhileStmt>(S)) {
+        visitExpr(WS->getCond(), conditional);
+        visitStmt(WS->getBody(), true, true);
+        return;
+      }
+
+      if (DoStmt *DS = dyn_cast<DoStmt>(S)) {
+        visitStmt(DS->getBody(), true, true);
+        visitExpr(DS->getCond(), true);
+        return;
+      }
+
+      if (SwitchStmt *SS = dyn_cast<SwitchStmt>(S)) {
+        visitExpr(SS->getCond(), conditional);
+        visitStmt(SS->getBody(), true, true);
+        return;
+      }
+
+      /*code after a label may be reached without running what precedes it*/
+      if (LabelStmt *LS = dyn_cast<LabelStmt>(S)) {
+        jumped = true;
+        visitStmt(LS->getSubStmt(), conditional, nested);
+        return;
+      }
+
+      if (isa<ReturnStmt>(S) || isa<GotoStmt>(S) || isa<IndirectGotoStmt>(S) ||
+          (!nested && (isa<BreakStmt>(S) || isa<ContinueStmt>(S)))) {
+        visitChildren(S, conditional);
+        jumped = true;
+        return;
+      }
 
+      /*the variables named by inline assembly are escaped*/
+      if (isa<AsmStmt>(S))
+        return;
+
+      visitChildren(S, true);
+    }
+
+    /*visit each node walking in the sub-ast and provide a list stored as "nodes_list"*/
+    void collectNodes(Stmt *st, vector<Stmt*> & nodes_list) {
+      if (!st)
+	return;
+      nodes_list.push_back(st);
+      for (auto I = st->child_begin(), IE = st->child_end(); I != IE; I++)
+        collectNodes(*I, nodes_list);
+    }
+
+    /*returns true if V may be read after the loop. A reference inside a loop
+    that encloses the analyzed one may run after it*/
+    bool isReadAfterLoop(const VarDecl *V, ForStmt *FS) {
+      const SourceManager& mng = astContext->getSourceManager();
+      SourceLocation end = mng.getExpansionLoc(FS->getLocEnd());
+      for (SourceLocation L : references[V]) {
+        if (contains(loopRange, L))
+          continue;
+        if (mng.isBeforeInTranslationUnit(end, mng.getExpansionLoc(L)))
+          return true;
+        for (Stmt *Outer : loops)
+          if ((Outer != FS) && contains(Outer->getSourceRange(), L) &&
+              contains(Outer->getSourceRange(), FS->getLocStart()))
+            return true;
+      }
+      return false;
     }
 
-    /*visits all nodes of type stmt*/
-    virtual bool VisitStmt(Stmt *S){
-	    vector<ValueDecl> *loopVars = new vector<ValueDecl>;
-	    if (ForStmt *FS = dyn_cast<ForStmt>(S)) {
-		    SourceLocation SL = S->getLocStart();
-		    FullSourceLoc FSL = astContext->getFullLoc(SL);
-		    if (FSL.isValid()) {
-			    errs() <<"For statement found at line: " << FSL.getSpellingLineNumber() <<"\n";
-		    }
-		    setInductionVars(S);
-		    for (Stmt::child_iterator i = FS->child_begin(), e = FS->child_end(); i!=e; ++i) {
-			    Stmt *child = *i;
-			    if (child!=nullptr) {
-				if (BinaryOperator *BO = dyn_cast<BinaryOperator>(child)) {
-                                    if (BO->isAssignmentOp()) {
-					    RecVisitChildren(BO->IgnoreContainers(true), *loopVars);
-				    }
-                            	}
-			    }
-		    }
-
-	    }
-	    return true;
+    /*computes the private variables of a loop*/
+    void analyzeLoop(ForStmt *FS, const string &function) {
+      vars.clear();
+      inductionVars.clear();
+      loopRange = FS->getSourceRange();
+      jumped = false;
+      inBody = false;
+
+      /*variables updated by the increment are induction variables*/
+      vector<Stmt*> nodes;
+      collectNodes(FS->getInc(), nodes);
+      for (Stmt *N : nodes)
+        if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(N))
+          if (VarDecl *VD = dyn_cast<VarDecl>(DRE->getDecl()))
+            inductionVars.insert(VD);
+
+      /*the condition runs before the body, and the increment after it*/
+      visitExpr(FS->getCond(), false);
+      inBody = true;
+      visitStmt(FS->getBody(), false, false);
+      inBody = false;
+      visitExpr(FS->getInc(), false);
+
+      LoopPrivates LP;
+      LP.function = function;
+      LP.line = astContext->getFullLoc(FS->getLocStart()).getExpansionLineNumber();
+
+      for (auto &It : vars) {
+        const VarDecl *V = It.first;
+        const VarState &S = It.second;
+        string name = V->getNameAsString();
+        if (name.empty())
+          continue;
+
+        if (S.written && !S.exposed) {
+          if (!isReadAfterLoop(V, FS))
+            LP.privates.insert(name);
+          else if (S.defined)
+            LP.lastPrivates.insert(name);
+        }
+        else if (!S.written && S.read && V->getType()->isArithmeticType())
+          LP.firstPrivates.insert(name);
+      }
+
+      if (!LP.privates.empty() || !LP.firstPrivates.empty() ||
+          !LP.lastPrivates.empty())
+        results.push_back(LP);
     }
 
+    /*visits all nodes of type FunctionDecl*/
+    bool VisitFunctionDecl(FunctionDecl *FD) {
+      const SourceManager& mng = astContext->getSourceManager();
+      if (!FD->doesThisDeclarationHaveABody() ||
+          !mng.isInMainFile(mng.getExpansionLoc(FD->getLocation())))
+        return true;
+
+      /*constructors and destructors have many names in the LLVM IR, and
+      templates have none*/
+      if (isa<CXXConstructorDecl>(FD) || isa<CXXDestructorDecl>(FD) ||
+          FD->isDependentContext())
+        return true;
+
+      references.clear();
+      loops.clear();
+      escaped.clear();
+      vector<Stmt*> nodes;
+      collectNodes(FD->getBody(), nodes);
+      for (Stmt *N : nodes) {
+        if (DeclRefExpr *DRE = dyn_cast<DeclRefExpr>(N)) {
+          if (VarDecl *VD = dyn_cast<VarDecl>(DRE->getDecl()))
+            references[VD].push_back(DRE->getLocation());
+        }
+        else if (isa<ForStmt>(N) || isa<WhileStmt>(N) || isa<DoStmt>(N))
+          loops.push_back(N);
+      }
+
+      /*the address of a variable may be taken before the loops that use it,
+      so the whole function is scanned before any loop is analyzed*/
+      findEscapes(FD->getBody());
+
+      string function = getFunctionName(FD);
+      for (Stmt *N : loops)
+        if (ForStmt *FS = dyn_cast<ForStmt>(N))
+          analyzeLoop(FS, function);
+      return true;
+    }
 };
 
-class PragmaASTConsumer : public ASTConsumer {
+class PrivateASTConsumer : public ASTConsumer {
 private:
-    PragmaVisitor *visitor; // doesn't have to be private
+    CompilerInstance *CI;
 
 public:
     /*override the constructor in order to pass CI*/
-    explicit PragmaASTConsumer(CompilerInstance *CI)
-        : visitor(new PragmaVisitor(CI)) // initialize the visitor
-    { }
+    explicit PrivateASTConsumer(CompilerInstance *CI) : CI(CI) { }
+
+    /*writes the private variables of each loop as output*/
+    bool writeToFile(const string &filename, const vector<LoopPrivates> &loops) {
+      ofstream outfile(filename + "_private.txt");
+      if (!outfile.is_open())
+        return false;
+
+      outfile << "DAWNCC-PRIVATE 1\n";
+      for (const LoopPrivates &LP : loops) {
+        for (const string &V : LP.privates)
+          outfile << LP.function << " " << LP.line << " private " << V << "\n";
+        for (const string &V : LP.firstPrivates)
+          outfile << LP.function << " " << LP.line << " firstprivate " << V
+                  << "\n";
+        for (const string &V : LP.lastPrivates)
+          outfile << LP.function << " " << LP.line << " lastprivate " << V
+                  << "\n";
+      }
+      return true;
+    }
 
     /*we override HandleTranslationUnit so it calls our visitor
     after parsing each entire input file*/
     virtual void HandleTranslationUnit(ASTContext &Context) {
+        PrivateVisitor visitor(CI);
+
         /*traverse the AST*/
-        visitor->TraverseDecl(Context.getTranslationUnitDecl());
+        visitor.TraverseDecl(Context.getTranslationUnitDecl());
+
+        const SourceManager& mng = Context.getSourceManager();
+        const FileEntry *FE = mng.getFileEntryForID(mng.getMainFileID());
+        if (!FE)
+          return;
 
+        if (!writeToFile(FE->getName(), visitor.results)) {
+          errs() << "Failed to write private variables for input file: ";
+          errs() << FE->getName() << "\n";
+        }
     }
 };
 
-class PragmaPluginAction : public PluginASTAction {
+class PrivatePluginAction : public PluginASTAction {
 protected:
     /*This gets called by Clang when it invokes our Plugin.
     Has to be unique pointer (this bit was a bitch to figure out*/
-    unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI, 
+    unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
                                               StringRef file) {
-        return make_unique<PragmaASTConsumer>(&CI);
+        return make_unique<PrivateASTConsumer>(&CI);
     }
 
-    /*leaving this here as a placeholder for now, we can implement a function
-    here to evaluate and handle input arguments, if ever necessary*/
+    /*handles "max-array=N", the largest array that can be privatized*/
     bool ParseArgs(const CompilerInstance &CI, const vector<string> &args) {
-      for (unsigned i = 0, e = args.size(); i != e; ++i) {
-        // Add code to process parameters
+      for (const string& arg : args) {
+        StringRef value(arg);
+        if (value.startswith("max-array=") &&
+            !value.substr(strlen("max-array=")).getAsInteger(10,
+                                                             MaxArrayElements))
+          continue;
+        errs() << "private-detector: unknown argument " << arg << "\n";
+        return false;
       }
       return true;
     }
 };
 
 /*register the plugin and its invocation command in the compilation pipeline*/
-static FrontendPluginRegistry::Add<PragmaPluginAction> X
+static FrontendPluginRegistry::Add<PrivatePluginAction> X
                                                ("-private-detector", "Private Variables Detector");
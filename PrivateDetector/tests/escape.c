@@ -0,0 +1,31 @@
+// Variables whose address is taken before a loop are never private.
+// Running the plugin on this file must write escape.c_private.txt:
+//
+//   clang -Xclang -load -Xclang $PRIVATE -Xclang -add-plugin \
+//     -Xclang -private-detector -g -O0 -c -fsyntax-only escape.c
+
+void address_before(int n, float *a) {
+  float x;
+  float *p = &x;
+  for (int i = 0; i < n; i++) {
+    x = a[i];
+    a[i] = *p * 2;
+  }
+}
+
+void decay_before(int n, float *a) {
+  float buf[4];
+  float *q = buf;
+  for (int i = 0; i < n; i++) {
+    buf[0] = a[i];
+    a[i] = q[0] * 2;
+  }
+}
+
+void not_escaped(int n, float *a) {
+  float t;
+  for (int i = 0; i < n; i++) {
+    t = a[i];
+    a[i] = t * 2;
+  }
+}
@@ -5,13 +5,12 @@
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Module.h>
-#include <llvm/Support/CommandLine.h>
-#include <llvm/Transforms/Scalar.h>
 
 using namespace llvm;
 using namespace lge;
+using namespace lge::pra;
 
-Value *lge::getPointerOperand(Instruction *Inst) {
+Value *lge::pra::getPointerOperand(Instruction *Inst) {
   if (LoadInst *Load = dyn_cast<LoadInst>(Inst))
     return Load->getPointerOperand();
   else if (StoreInst *Store = dyn_cast<StoreInst>(Inst))
@@ -22,8 +21,8 @@ Value *lge::getPointerOperand(Instruction *Inst) {
   return 0;
 }
 
-bool lge::isInvariant(const Value *Val, const Region *R, LoopInfo *LI,
-                      AliasAnalysis *AA) {
+bool lge::pra::isInvariant(const Value *Val, const Region *R, LoopInfo *LI,
+                           AliasAnalysis *AA) {
   // A reference to function argument or constant value is invariant.
   if (isa<Argument>(Val) || isa<Constant>(Val))
     return true;
@@ -64,7 +63,7 @@ bool lge::isInvariant(const Value *Val, const Region *R, LoopInfo *LI,
   return true;
 }
 
-bool lge::hasKnownElementSize(Value *BasePtr) {
+bool lge::pra::hasKnownElementSize(Value *BasePtr) {
   Type *BaseTy = BasePtr->getType();
 
   // Only sequential types have elements.
@@ -80,8 +79,9 @@ bool lge::hasKnownElementSize(Value *BasePtr) {
   return ElemTy->isSized();
 }
 
-Value *lge::getBasePtrValue(Instruction *Inst, const Region *R, LoopInfo *LI,
-                            AliasAnalysis *AA, ScalarEvolution *SE) {
+Value *lge::pra::getBasePtrValue(Instruction *Inst, const Region *R,
+                                 LoopInfo *LI, AliasAnalysis *AA,
+                                 ScalarEvolution *SE) {
   Value *Ptr = getPointerOperand(Inst);
   Loop *L = LI->getLoopFor(Inst->getParent());
   const SCEV *AccessFunction = SE->getSCEVAtScope(Ptr, L);
@@ -214,37 +214,14 @@ void PtrRangeAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.setPreservesAll();
 }
 
-// Flag to be used from Clang.
-static cl::opt<bool>
-    RunPtrRangeAnalysis("ptr-ra",
-                        cl::desc("Run symbolic pointer range analysis"),
-                        cl::init(false), cl::ZeroOrMore);
-
 char PtrRangeAnalysis::ID = 0;
 
-static void registerPtrRangeAnalysis(const PassManagerBuilder &Builder,
-                                     legacy::PassManagerBase &PM) {
-  if (!RunPtrRangeAnalysis)
-    return;
-
-  // Run canonicalization passes before instrumenting, to make the IR simpler.
-  // These will only run when invoking directly from Clang.
-  PM.add(llvm::createPromoteMemoryToRegisterPass());
-  PM.add(llvm::createInstructionCombiningPass());
-  PM.add(llvm::createCFGSimplificationPass());
-  PM.add(llvm::createReassociatePass());
-  PM.add(llvm::createLoopRotatePass());
-  PM.add(llvm::createInstructionCombiningPass());
-
-  PM.add(new PtrRangeAnalysis());
-}
-
-static RegisterStandardPasses
-    RegisterPtrRangeAnalysis(PassManagerBuilder::EP_EarlyAsPossible,
-                             registerPtrRangeAnalysis);
+// Registered as "PraPtrRangeAnalysis", see PtrRangeAnalysis.h. The hook used
+// from Clang is in RegisterPtrRangeAnalysis.cpp, which dawncc doesn't link.
+typedef PtrRangeAnalysis PraPtrRangeAnalysis;
 
 // Flag to be used from Opt.
-INITIALIZE_PASS_BEGIN(PtrRangeAnalysis, "ptr-range-analysis",
+INITIALIZE_PASS_BEGIN(PraPtrRangeAnalysis, "ptr-range-analysis",
                       "Run symbolic pointer range analysis", true, true);
 INITIALIZE_AG_DEPENDENCY(AliasAnalysis);
 INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass);
@@ -253,5 +230,5 @@ INITIALIZE_PASS_DEPENDENCY(LoopSimplify);
 INITIALIZE_PASS_DEPENDENCY(LCSSA);
 INITIALIZE_PASS_DEPENDENCY(RegionInfoPass);
 INITIALIZE_PASS_DEPENDENCY(ScalarEvolution);
-INITIALIZE_PASS_END(PtrRangeAnalysis, "ptr-range-analysis",
+INITIALIZE_PASS_END(PraPtrRangeAnalysis, "ptr-range-analysis",
                     "Run symbolic pointer range analysis", true, true)
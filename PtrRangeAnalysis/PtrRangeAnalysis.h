@@ -41,8 +41,8 @@
 //                                          std::make_pair(low, up)));
 //    }
 
-#ifndef PTR_RANGE_ANALYSIS_H
-#define PTR_RANGE_ANALYSIS_H
+#ifndef PRA_PTR_RANGE_ANALYSIS_H
+#define PRA_PTR_RANGE_ANALYSIS_H
 
 #include "SCEVRangeBuilder.h"
 
@@ -55,6 +55,11 @@ using namespace llvm;
 
 namespace lge {
 
+// ArrayInference has an extended copy of this pass, also named
+// PtrRangeAnalysis. This one is in lge::pra, and is registered as
+// "PraPtrRangeAnalysis", so that both can be linked in dawncc.
+namespace pra {
+
 class PtrRangeAnalysis : public FunctionPass {
   /**
    * Holds range data for the memory operations in a region.
@@ -145,24 +150,25 @@ Value *getPointerOperand(Instruction *Inst);
 bool isInvariant(const Value *Val, const Region *Reg, LoopInfo *LI,
                  AliasAnalysis *AA);
 
+} // end pra namespace
 } // end lge namespace
 
 namespace llvm {
 class PassRegistry;
-void initializePtrRangeAnalysisPass(llvm::PassRegistry &);
+void initializePraPtrRangeAnalysisPass(llvm::PassRegistry &);
 }
 
 namespace {
 // Workaround to make the pass available from Clang. Initialize the pass as soon
 // as the library is loaded.
-class PtrRAStaticInitializer {
+class PraStaticInitializer {
 public:
-  PtrRAStaticInitializer() {
+  PraStaticInitializer() {
     llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
-    llvm::initializePtrRangeAnalysisPass(Registry);
+    llvm::initializePraPtrRangeAnalysisPass(Registry);
   }
 };
-static PtrRAStaticInitializer PtrRAInit;
+static PraStaticInitializer PraInit;
 } // end of anonymous namespace.
 
 #endif
@@ -0,0 +1,38 @@
+// Hook that runs PtrRangeAnalysis from Clang. It is apart from the pass so
+// that dawncc, which links the pass with the ArrayInference copy of it, doesn't
+// register the "ptr-ra" flag twice.
+
+#include "PtrRangeAnalysis.h"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Scalar.h>
+
+using namespace llvm;
+using namespace lge::pra;
+
+// Flag to be used from Clang.
+static cl::opt<bool>
+    RunPtrRangeAnalysis("ptr-ra",
+                        cl::desc("Run symbolic pointer range analysis"),
+                        cl::init(false), cl::ZeroOrMore);
+
+static void registerPtrRangeAnalysis(const PassManagerBuilder &Builder,
+                                     legacy::PassManagerBase &PM) {
+  if (!RunPtrRangeAnalysis)
+    return;
+
+  // Run canonicalization passes before instrumenting, to make the IR simpler.
+  // These will only run when invoking directly from Clang.
+  PM.add(llvm::createPromoteMemoryToRegisterPass());
+  PM.add(llvm::createInstructionCombiningPass());
+  PM.add(llvm::createCFGSimplificationPass());
+  PM.add(llvm::createReassociatePass());
+  PM.add(llvm::createLoopRotatePass());
+  PM.add(llvm::createInstructionCombiningPass());
+
+  PM.add(new PtrRangeAnalysis());
+}
+
+static RegisterStandardPasses
+    RegisterPtrRangeAnalysis(PassManagerBuilder::EP_EarlyAsPossible,
+                             registerPtrRangeAnalysis);
@@ -5,6 +5,7 @@
 
 using namespace llvm;
 using namespace lge;
+using namespace lge::pra;
 
 Value *SCEVRangeBuilder::getSavedExpression(const SCEV *S,
                                             Instruction *InsertPt, bool Upper) {
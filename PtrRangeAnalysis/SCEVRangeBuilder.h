@@ -20,8 +20,8 @@
 // program point, but don't actually insert range computation instructions in
 // the CFG.
 
-#ifndef SCEV_RANGE_BUILDER_H
-#define SCEV_RANGE_BUILDER_H 1
+#ifndef PRA_SCEV_RANGE_BUILDER_H
+#define PRA_SCEV_RANGE_BUILDER_H 1
 
 #define DUMMY_VAL ((Value *)0x1)
 
@@ -38,9 +38,14 @@ class Region;
 }
 
 namespace lge {
+class AliasInstrumentation;
+
+// The ArrayInference copy of this utility is also in namespace lge, so this
+// one is in lge::pra, and both can be linked in the same executable (dawncc).
+namespace pra {
 
 class SCEVRangeBuilder : private SCEVExpander {
-  friend class AliasInstrumentation;
+  friend class lge::AliasInstrumentation;
 
   ScalarEvolution *SE;
   AliasAnalysis *AA;
@@ -172,6 +177,7 @@ public:
   // bound will be the first byte after the pointed memory region.
   Value *stretchPtrUpperBound(Value *BasePtr, Value *UpperBound);
 };
+} // end pra namespace
 } // end lge namespace
 
-#endif // SCEV_RANGE_BUILDER_H
+#endif // PRA_SCEV_RANGE_BUILDER_H
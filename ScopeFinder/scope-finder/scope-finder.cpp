@@ -20,6 +20,13 @@
 //represents the tree. If the user so chooses, the DOT files can be printed to
 //PNG/PDF using tools such as Graphviz.
 //
+//The tree is also outputted in a compact binary format, that the ScopeTree
+//pass maps in memory instead of parsing the DOT file. The formats written can
+//be chosen with the plugin argument "format=dot", "format=bin" or
+//"format=both" (the default):
+//
+//  clang ... -Xclang -plugin-arg-find-scope -Xclang format=bin
+//
 //Since it is a small self-contained plugin (not meant to be included by other
 //applications), all the code is kept within its own source file, for simplici-
 //ty's sake.
@@ -47,8 +54,11 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
 #include <stack>
 #include <fstream>
+#include <vector>
 
 using namespace std;
 using namespace clang;
@@ -58,6 +68,18 @@ using namespace llvm;
 like it*/
 Rewriter rewriter;
 
+/*layout of the binary scope tree files. It must match the one read by the
+ScopeTree pass (ScopeTree/ScopeTreeFile.h): a header with the magic "DSTB",
+the version, the number of nodes and the size of the string table, followed
+by one record of 9 words per node and by the string table. All words are 32
+bits, little endian*/
+enum { BinVersion = 1, BinNoNode = ~0U };
+enum { BinTopLevel = 1 << 0, BinLoop = 1 << 1, BinFunction = 1 << 2 };
+
+/*formats of the scope files that are written*/
+bool EmitDot = true;
+bool EmitBin = true;
+
 /*POD struct that represents a meaningful node in the AST, with its unique name
 identifier and source location numbers*/
 struct Node {
@@ -65,6 +87,10 @@ struct Node {
   unsigned int id;
   unsigned int sline, scol;
   unsigned int eline, ecol;
+  /*position of the node and of its parent in the file's node list, and the
+  Bin* flags of the node*/
+  unsigned int index, parent;
+  unsigned int flags;
 };
 
 /*POD struct that represents an input file in a Translation Unit (a single
@@ -75,6 +101,7 @@ struct InputFile {
 	string edges;
 	string labels;
 	stack <struct Node> NodeStack;
+	vector <struct Node> Nodes;
 };
 
 /*we need a stack of active input files, to know which constructs belong to
@@ -134,6 +161,10 @@ public:
       currFile.edges += 
         to_string(currFile.NodeStack.top().id)+" -- "+to_string(N.id)+"\n";
 
+      N.index = currFile.Nodes.size();
+      N.parent = currFile.NodeStack.top().index;
+      currFile.Nodes.push_back(N);
+
       /*push node to top of stack, making it our current "parent candidate"*/
       currFile.NodeStack.push(N);
     }
@@ -157,6 +188,10 @@ public:
         N.eline = EndLocation.getSpellingLineNumber();
         N.ecol = EndLocation.getSpellingColumnNumber();
         N.name = st->getStmtClassName() + to_string(N.id);
+        N.flags = 0;
+        if (isa<ForStmt>(st) || isa<WhileStmt>(st) || isa<DoStmt>(st)) {
+          N.flags = BinLoop;
+        }
 
         currFile.labels += to_string(N.id) + " [label=\"" + N.name + "\\n";
         currFile.labels += "[" + to_string(N.sline) + ":" + to_string(N.scol);
@@ -211,6 +246,7 @@ public:
         N.eline = EndLocation.getSpellingLineNumber();
         N.ecol = EndLocation.getSpellingColumnNumber();
         N.name = FuncName;
+        N.flags = BinFunction;
 
         currFile.labels += to_string(N.id) + " [shape=\"box\" ";
         currFile.labels += "label=\"" + N.name + "\\n" + "[";
@@ -234,8 +270,12 @@ public:
       root.scol = 0;
       root.eline = ~0;
       root.ecol = ~0;
+      root.index = 0;
+      root.parent = 0;
+      root.flags = BinTopLevel;
 
       /*create parent node for the new file's scope tree*/
+      FileStack.top().Nodes.push_back(root);
       FileStack.top().NodeStack.push(root);
       FileStack.top().labels += to_string(root.id) + " [label=\"File: ";
       FileStack.top().labels += filename + "\"" + " shape=\"triangle\"];\n";
@@ -351,21 +391,76 @@ public:
       return true;
     }
 
+    /*writes scope tree in the binary format as output*/
+    bool writeBinToFile() {
+      struct InputFile& currFile = FileStack.top(); 
+      const vector<struct Node>& Nodes = currFile.Nodes;
+
+      if (currFile.filename.empty()) {
+        return false;
+      }
+
+      /*link the children of each node, in source order*/
+      vector<unsigned int> FirstChild(Nodes.size(), BinNoNode);
+      vector<unsigned int> NextSibling(Nodes.size(), BinNoNode);
+      for (unsigned int i = Nodes.size(); i-- > 1;) {
+        NextSibling[i] = FirstChild[Nodes[i].parent];
+        FirstChild[Nodes[i].parent] = i;
+      }
+
+      string Strings;
+      vector<unsigned int> NameOffset;
+      for (const struct Node& N : Nodes) {
+        NameOffset.push_back(Strings.size());
+        Strings += N.name;
+        Strings += '\0';
+      }
+
+      std::error_code EC;
+      raw_fd_ostream outfile(currFile.filename + "_scope.bin", EC,
+                             sys::fs::F_None);
+      if (EC) {
+        return false;
+      }
+
+      support::endian::Writer<support::little> W(outfile);
+      outfile << "DSTB";
+      W.write<uint32_t>(BinVersion);
+      W.write<uint32_t>(Nodes.size());
+      W.write<uint32_t>(Strings.size());
+
+      for (unsigned int i = 0, ie = Nodes.size(); i != ie; i++) {
+        W.write<uint32_t>(Nodes[i].parent);
+        W.write<uint32_t>(FirstChild[i]);
+        W.write<uint32_t>(NextSibling[i]);
+        W.write<uint32_t>(Nodes[i].sline);
+        W.write<uint32_t>(Nodes[i].scol);
+        W.write<uint32_t>(Nodes[i].eline);
+        W.write<uint32_t>(Nodes[i].ecol);
+        W.write<uint32_t>(NameOffset[i]);
+        W.write<uint32_t>(Nodes[i].flags);
+      }
+      outfile << Strings;
+
+      return true;
+    }
+
     /*we override HandleTranslationUnit so it calls our visitor
     after parsing each entire input file*/
     virtual void HandleTranslationUnit(ASTContext &Context) {
         /*traverse the AST*/
         visitor->TraverseDecl(Context.getTranslationUnitDecl());
 
-        /*write output DOT file*/
+        /*write output DOT and binary files*/
         while (!FileStack.empty()) {
-          if (writeDotToFile()) {
+          if ((!EmitDot || writeDotToFile()) &&
+              (!EmitBin || writeBinToFile())) {
             errs() << "Scope info for file " << FileStack.top().filename;
             errs() << " written successfully!\n";
           }
 
           else {
-            errs() << "Failed to write dot file for input file: ";
+            errs() << "Failed to write scope file for input file: ";
             errs() << FileStack.top().filename << "\n";
           }
 
@@ -383,9 +478,27 @@ protected:
         return make_unique<ScopeASTConsumer>(&CI);
     }
 
-    /*leaving this here as a placeholder for now, we can implement a function
-    here to evaluate and handle input arguments, if ever necessary*/
+    /*handles "format=dot", "format=bin" and "format=both", which select the
+    scope files written*/
     bool ParseArgs(const CompilerInstance &CI, const vector<string> &args) {
+        for (const string& arg : args) {
+          if (arg == "format=dot") {
+            EmitDot = true;
+            EmitBin = false;
+          }
+          else if (arg == "format=bin") {
+            EmitDot = false;
+            EmitBin = true;
+          }
+          else if (arg == "format=both") {
+            EmitDot = true;
+            EmitBin = true;
+          }
+          else {
+            errs() << "scope-finder: unknown argument " << arg << "\n";
+            return false;
+          }
+        }
         return true;
     }
 };
@@ -75,6 +75,19 @@ ScopeTree::STnode ScopeTree::initSTnode () {
   return node;
 }
 
+ScopeTree::STnode ScopeTree::getSTnode (const Graph *gph, unsigned int id) {
+  const ScopeFileNode &data = gph->data->getNode(id);
+  STnode node = initSTnode();
+  node.id = id;
+  node.startLine = data.StartLine;
+  node.startColumn = data.StartColumn;
+  node.endLine = data.EndLine;
+  node.endColumn = data.EndColumn;
+  node.name = gph->data->getName(id);
+  node.isTopLevel = gph->data->hasFlag(id, SN_TopLevel);
+  return node;
+}
+
 bool ScopeTree::isFileName (std::string str) {
   std::string subStr = "File: ";
   for (unsigned int i = 0, ie = 6; i != ie; i++)
@@ -144,9 +157,22 @@ ScopeTree::STnode ScopeTree::generateSTNode (std::string str) {
   return node; 
 }
 
-void ScopeTree::insertNodeInList (Graph *gph, STnode node) {
-  if (!gph->list.count(node.id))
-    gph->list[node.id] = node;
+void ScopeTree::insertNodeInList (Graph *gph, STnode node,
+                                  std::map<unsigned int, unsigned int> & ids) {
+  if (ids.count(node.id))
+    return;
+
+  unsigned int flags = 0;
+  if (node.isTopLevel)
+    flags |= SN_TopLevel;
+  if ((node.name.find("WhileStmt") != string::npos) ||
+      (node.name.find("DoStmt") != string::npos) ||
+      (node.name.find("ForStmt") != string::npos))
+    flags |= SN_Loop;
+
+  ids[node.id] = gph->data->addNode(node.name, node.startLine,
+                                    node.startColumn, node.endLine,
+                                    node.endColumn, flags);
 }
 
 std::pair<unsigned int, unsigned int> ScopeTree::buildEdge (std::string str) {
@@ -164,11 +190,27 @@ std::pair<unsigned int, unsigned int> ScopeTree::buildEdge (std::string str) {
   return edge;
 }
 
-void ScopeTree::insertEdge (Graph *gph, unsigned int p1, unsigned int p2) {
-  gph->nodes[p1].push_back(p2);
+void ScopeTree::insertEdge (Graph *gph, unsigned int p1, unsigned int p2,
+                            std::map<unsigned int, unsigned int> & ids) {
+  if (ids.count(p1) && ids.count(p2))
+    gph->data->addEdge(ids[p1], ids[p2]);
 }
 
 bool ScopeTree::readFile (std::string name, Function *F) {
+  std::unique_ptr<ScopeTreeFile> data =
+    ScopeTreeFile::readBinary(name + "_scope.bin");
+  if (!data)
+    return readDotFile(name, F);
+
+  Graph gph;
+  gph.file = name + "_scope.bin";
+  gph.data = std::move(data);
+  gph.nesting.build(*gph.data);
+  info[F->getParent()].push_back(std::move(gph));
+  return true;
+}
+
+bool ScopeTree::readDotFile (std::string name, Function *F) {
   name = name + "_scope.dot";
   std::fstream Infile;
   Infile.open(name.c_str(), std::ios::in);
@@ -189,119 +231,72 @@ bool ScopeTree::readFile (std::string name, Function *F) {
     if (graphE) {
       Graph gph;
       gph.file = name;
+      gph.data.reset(new ScopeTreeFile());
+      std::map<unsigned int, unsigned int> ids;
       std::getline(Infile, Line);
       std::getline(Infile, Line);
  
       // For each line, generate a node in the with target data.
       do {
         STnode node = generateSTNode(Line);
-        insertNodeInList(&gph, node);
+        insertNodeInList(&gph, node, ids);
         std::getline(Infile, Line);
       } while (Line != "");
 
       std::getline(Infile, Line);
       std::getline(Infile, Line);
-      gph.n_nodes = 0;
-      // Starts to build a graph.
-      for (auto I = gph.list.begin(), IE = gph.list.end(); I != IE; I++) {
-        if (gph.n_nodes < I->second.id)
-          gph.n_nodes = I->second.id;
-      }
-
-      gph.n_nodes++;
-      std::vector<unsigned int> vct;
-      // Generates a vector for vertex edge in the graph.
-      for (unsigned int i = 0, ie = gph.n_nodes; i != ie; i++)
-        gph.nodes.push_back(vct);
 
+      // Starts to build a graph. The first edge to a node defines its
+      // parent.
       do {
         std::pair<unsigned int, unsigned int> edge;
         edge = buildEdge(Line);
-        insertEdge (&gph, edge.first, edge.second);
+        insertEdge (&gph, edge.first, edge.second, ids);
         std::getline(Infile, Line);
       } while (Line != "");
       
-      Module *M = F->getParent();
-      if (!info.count(M)) {
-        std::vector<Graph> vctGph;
-        info[M] = vctGph;
-      }
-      // Identify the parent of each node in the graph.
-      identifyParents(&gph);
-      info[M].push_back(gph);
+      gph.nesting.build(*gph.data);
+      info[F->getParent()].push_back(std::move(gph));
     }
   }
   Infile.close();
   return true;
 }
 
-void ScopeTree::identifyParents (Graph *gph) {
-  unsigned int id = INT_MAX;
-
-  for (auto I = gph->list.begin(), IE = gph->list.end(); I != IE; I++) {
-    if (I->second.id < id)
-      id = I->second.id;
-  }
-
-  for (auto I = gph->list.begin(), IE = gph->list.end(); I != IE; I++) {
-    if (I->second.isTopLevel) {
-      id = I->second.id;
-      break;
-    }
-  }
-
-  std::queue<unsigned int> toIterate;
-  std::vector<bool> nodeFound(gph->n_nodes, false);
-  toIterate.push(id);
-  nodeFound[id] = true;
-
-  while(!toIterate.empty()) {
-    id = toIterate.front();
-    toIterate.pop();
-    for (unsigned int i = 0, ie = gph->nodes[id].size(); i != ie; i++) {
-      if (!nodeFound[gph->nodes[id][i]]) {
-        toIterate.push(gph->nodes[id][i]);
-        gph->parents[gph->nodes[id][i]] = id;
-        nodeFound[gph->nodes[id][i]] = true;
-      }
-    }
-  }
-}
-
-bool ScopeTree::isValidLoopStatement (STnode node, int line, int column) {
-  return ((node.startLine == line) && (node.startColumn == column) &&
-          ((node.name.find("WhileStmt") != string::npos) ||
-           (node.name.find("DoStmt") != string::npos) ||
-           (node.name.find("ForStmt") != string::npos)));
+void ScopeTree::buildIndex (Module *M) {
+  std::vector<const ScopeTreeFile*> graphs;
+  for (auto I = info[M].begin(), IE = info[M].end(); I != IE; I++)
+    graphs.push_back(I->data.get());
+  index[M].build(graphs);
 }
 
 void ScopeTree::associateLoop (Loop *L) {
-  unsigned int line = L->getStartLoc()->getLine();
-  unsigned int column = L->getStartLoc()->getColumn();
+  int line = L->getStartLoc()->getLine();
+  int column = L->getStartLoc()->getColumn();
   Module *M = L->getHeader()->getParent()->getParent();
 
   if (!info.count(M))
     return;
 
-  for (auto I = info[M].begin(), IE = info[M].end(); I != IE; I++)
-    for (auto J = I->list.begin(), JE = I->list.end(); J != JE; J++) {
-      if (isValidLoopStatement(J->second, line, column)) {
-        J->second.isLoop = true;
-        loopNodes[L] = J->second;
-        return;
-      }
-      MDNode* MD = L->getHeader()->getTerminator()->getMetadata("dbg");
-      if (!MD)
-        continue;
-      if (DILocation *DL = dyn_cast<DILocation>(MD))
-        column = DL->getColumn();
-      if (isValidLoopStatement(J->second, line, column)) {
-        J->second.isLoop = true;
-        loopNodes[L] = J->second;
-        return;
-      }
-      column = L->getStartLoc()->getColumn();
-    }
+  // The loop may also start at the column of its header's terminator.
+  int termColumn = column;
+  if (MDNode* MD = L->getHeader()->getTerminator()->getMetadata("dbg"))
+    if (DILocation *DL = dyn_cast<DILocation>(MD))
+      termColumn = DL->getColumn();
+
+  // Among the statements at both positions, use the first one in the module.
+  const ScopeTreeIndex::LoopEntry *entry = index[M].findLoop(line, column);
+  const ScopeTreeIndex::LoopEntry *termEntry =
+    index[M].findLoop(line, termColumn);
+  if (!entry || (termEntry && ((termEntry->Graph < entry->Graph) ||
+                               ((termEntry->Graph == entry->Graph) &&
+                                (termEntry->Id < entry->Id)))))
+    entry = termEntry;
+  if (!entry)
+    return;
+
+  loopNodes[L] = getSTnode(&info[M][entry->Graph], entry->Id);
+  loopNodes[L].isLoop = true;
 }
 
 void ScopeTree::associateFunction (Function *F) {
@@ -313,13 +308,9 @@ void ScopeTree::associateFunction (Function *F) {
   std::string name = F->getName();
   
   //std::string name = (F->getSubprogram())->getName();
-  for (auto I = info[M].begin(), IE = info[M].end(); I != IE; I++)
-    for (auto J = I->list.begin(), JE = I->list.end(); J != JE; J++) {
-      if (name == J->second.name) {
-        funcNodes[F] = J->second;
-        return;
-      }
-    }
+  unsigned int graph, id;
+  if (index[M].findName(name, graph, id))
+    funcNodes[F] = getSTnode(&info[M][graph], id);
 }
 
 void ScopeTree::associateIRSource (Function *F) {
@@ -341,23 +332,26 @@ void ScopeTree::printData () {
   for (auto MI = info.begin(), ME = info.end(); MI != ME; MI++) {
     for (auto GI = MI->second.begin(), GE = MI->second.end(); GI != GE;
               GI++) {
-      errs() << "Number of Nodes: " << GI->n_nodes << "\n";
+      const ScopeTreeFile *data = GI->data.get();
+      errs() << "Number of Nodes: " << data->size() << "\n";
       errs() << "Files: " << GI->file << "\n";
-      for (unsigned int i = 0, ie = GI->n_nodes; i != ie; i++) {
-        for (unsigned int j = 0, je = GI->nodes[i].size();j != je; j++) {
-          errs() << "EDGE : " <<  i << " - " << GI->nodes[i][j] << "\n";
+      for (unsigned int i = 0, ie = data->size(); i != ie; i++) {
+        for (unsigned int j = data->getNode(i).FirstChild; j != ScopeNoNode;
+             j = data->getNode(j).NextSibling) {
+          errs() << "EDGE : " <<  i << " - " << j << "\n";
         }
       }
-      for (auto LI = GI->list.begin(), LE = GI->list.end(); LI != LE; LI++) {
-        errs() << "--------------- NODE " << LI->first << " ----------------\n";
-        errs() << "ID : " << LI->second.id << "\n";
-        errs() << "Line Start : " << LI->second.startLine << "\n";
-        errs() << "Column Start : " << LI->second.startColumn << "\n";
-        errs() << "Line End : " << LI->second.endLine << "\n";
-        errs() << "Column End : " << LI->second.endColumn << "\n";
-        errs() << "Name : " << LI->second.name << "\n";
-        errs() << "Is Top Level : " << LI->second.isTopLevel << "\n";
-        errs() << "--------------- NODE " << LI->first << " END ------------\n";
+      for (unsigned int i = 0, ie = data->size(); i != ie; i++) {
+        STnode node = getSTnode(&*GI, i);
+        errs() << "--------------- NODE " << i << " ----------------\n";
+        errs() << "ID : " << node.id << "\n";
+        errs() << "Line Start : " << node.startLine << "\n";
+        errs() << "Column Start : " << node.startColumn << "\n";
+        errs() << "Line End : " << node.endLine << "\n";
+        errs() << "Column End : " << node.endColumn << "\n";
+        errs() << "Name : " << node.name << "\n";
+        errs() << "Is Top Level : " << node.isTopLevel << "\n";
+        errs() << "--------------- NODE " << i << " END ------------\n";
       }
     }
   }
@@ -397,27 +391,15 @@ void ScopeTree::associateLoopstoRegion (std::map<Loop*, STnode> & Loops,
   }
 }
 
-ScopeTree::Graph ScopeTree::findGraph (Region *R) {
+ScopeTree::Graph *ScopeTree::findGraph (Region *R) {
   Function *F = R->getEntry()->getParent();
   Module *M = F->getParent();
 
-  // Find the Top region node to start the search, and the respective graph.
-  STnode node;
-  Graph gph;
-  gph.n_nodes = -1;
-  for (auto I = info[M].begin(), IE = info[M].end(); I != IE; I++) {
-    for (auto J = I->list.begin(), JE = I->list.end(); J != JE; J++) {
-      if (J->second.name != F->getName())
-        continue;
-      node = J->second;
-      break;
-    }
-    if (node.name == F->getName()) {
-      gph = *I;
-      break;
-    }
-  }
-  return gph;
+  // Find the graph with the Top region node of the function.
+  unsigned int graph, id;
+  if (!index[M].findName(F->getName(), graph, id))
+    return nullptr;
+  return &info[M][graph];
 }
 
 std::pair<unsigned int, unsigned int> ScopeTree::getStartRegionLoops (
@@ -457,38 +439,43 @@ std::pair<unsigned int, unsigned int> ScopeTree::getEndRegionLoops (Region *R) {
   return std::make_pair(maxLine, maxColumn);
 }
   
+bool ScopeTree::getLoopLines (Loop *L, unsigned int &start,
+                              unsigned int &end) {
+  auto I = loopNodes.find(L);
+  if ((I == loopNodes.end()) || (I->second.startLine <= 0) ||
+      (I->second.endLine < I->second.startLine))
+    return false;
+  start = I->second.startLine;
+  end = I->second.endLine;
+  return true;
+}
+
 bool ScopeTree::isSafetlyRegionLoops (Region *R) {
   std::map<Loop*, STnode> Loops;
   associateLoopstoRegion (Loops, R);
   Function *F = R->getEntry()->getParent();
-  Module *M = F->getParent();
   
   // Find the Top region node to start the search, and the respective graph.
   if (!funcNodes.count(F)) {   
     return false;
   }
   STnode node = funcNodes[F];
-  Graph gph = findGraph(R);
-  if (gph.n_nodes == -1)
+  Graph *gph = findGraph(R);
+  if (!gph || (node.id >= gph->data->size()))
     return false;
-  std::queue<unsigned int> toIterate;
-  toIterate.push(node.id);
-  std::vector<unsigned int> nodeLevel(gph.n_nodes, DEFVAL);
-  nodeLevel[node.id] = 0; 
- 
-  // Classify each STnode in a level, with a BFS search.
-  while (!toIterate.empty()) {
-    unsigned int id = toIterate.front();
-    toIterate.pop();
-    
-    for (unsigned int i = 0, ie = gph.nodes[id].size(); i != ie; i++) {
-      if ((nodeLevel[gph.nodes[id][i]] == DEFVAL) ||
-           nodeLevel[gph.nodes[id][i]] > (nodeLevel[id] + 1)) {
-        nodeLevel[gph.nodes[id][i]] = nodeLevel[id] + 1;
-        toIterate.push(gph.nodes[id][i]);
-      }
-    }
-  }
+  const ScopeTreeFile *data = gph->data.get();
+
+  // The level of each STnode is its depth below the function's node. Loops
+  // associated with nodes out of the function are never at a known level.
+  auto getLevel = [&](unsigned int id) {
+    if ((id >= data->size()) || !gph->nesting.isNestedIn(id, node.id))
+      return (unsigned int)DEFVAL;
+    return gph->nesting.getDepth(id) - gph->nesting.getDepth(node.id);
+  };
+  auto getParent = [&](unsigned int id) {
+    return (id < data->size()) ? (unsigned int)data->getNode(id).Parent
+                               : DEFVAL;
+  };
  
   // Find each loop's node present in this region. Compare the level, we can
   // mark as safe in two cases:
@@ -498,22 +485,19 @@ bool ScopeTree::isSafetlyRegionLoops (Region *R) {
   unsigned int topLevel = DEFVAL;
   unsigned int topLevelNode = DEFVAL;
   for (auto I = Loops.begin(), IE = Loops.end(); I != IE; I++) {
-    if ((I->second.isLoop) && (nodeLevel[I->second.id] < topLevel)) {
-      topLevel = nodeLevel[I->second.id];
+    if ((I->second.isLoop) && (getLevel(I->second.id) < topLevel)) {
+      topLevel = getLevel(I->second.id);
       topLevelNode = I->second.id;
     }
   }
 
-  // Find a parent to be used as the reference.
-  unsigned int parent = gph.parents[topLevel];
-
   bool valid = true;
   bool needCase2 = false;
   std::vector<Loop*> safety;
   for (auto I = Loops.begin(), IE = Loops.end(); I != IE; I++) {
     // Case 1
-    if ((I->second.isLoop) && (nodeLevel[I->second.id] == topLevel) &&
-        (gph.parents[topLevelNode] == gph.parents[I->second.id])) {
+    if ((I->second.isLoop) && (getLevel(I->second.id) == topLevel) &&
+        (getParent(topLevelNode) == getParent(I->second.id))) {
       safety.push_back(I->first);
       continue;
     }
@@ -566,10 +550,15 @@ bool ScopeTree::runOnFunction(Function &F) {
   std::string fName = getFileName(F.begin()->getTerminator());
   if ((fName != std::string()) && !isFileRead.count(fName)) {
     isFileRead[fName] = readFile(fName, &F);
+    // New graphs may have been added to the module.
+    index.erase(F.getParent());
   }
   
-  if (isFileRead[fName])
+  if (isFileRead[fName]) {
+    if (!index.count(F.getParent()))
+      buildIndex(F.getParent());
     associateIRSource(&F);
+  }
   
   return true;
 }
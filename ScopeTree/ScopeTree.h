@@ -23,6 +23,11 @@
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
 
+#include "ScopeTreeFile.h"
+#include "ScopeTreeIndex.h"
+
+#include <memory>
+
 namespace llvm {
 class ScalarEvolution;
 class AliasAnalysis;
@@ -57,25 +62,25 @@ class ScopeTree : public FunctionPass {
  
   typedef struct Graph {
     
-    // Provides a graph to possible search.
-    std::vector<std::vector<unsigned int> > nodes;
-    // get the parent for each node. If is a top level region,
-    // uses the same node.
-    // The information is present in a tuple < child, parent >.
-    std::map<unsigned int, unsigned int> parents;
-    int n_nodes;
+    // Nodes of the scope tree, indexed by id. They are mapped from a binary
+    // scope file, or built from a DOT file.
+    std::unique_ptr<ScopeTreeFile> data;
     
     // Store the name of the file, such as an id of this graph.
     std::string file;
 
-    // Provides information to each node.
-    std::map<unsigned int, STnode> list;
+    // Nested intervals of the tree, for scope containment and levels.
+    ScopeNesting nesting;
 
   } Graph;
-  
+
   // Provides information to the Module.
   std::map<Module*, std::vector<Graph> > info;
 
+  // Index of the graphs of each module, so that loops and functions are
+  // associated without scanning every node.
+  std::map<Module*, ScopeTreeIndex> index;
+
   // Used to map functions to STnodes.
   std::map<Function*, STnode> funcNodes;
 
@@ -95,29 +100,36 @@ class ScopeTree : public FunctionPass {
   // Initialize a STnode with default values.
   STnode initSTnode ();
 
+  // Generate a STnode object with the information of node "id" in gph.
+  STnode getSTnode (const Graph *gph, unsigned int id);
+
   // Define if the string contains a file name.
   bool isFileName (std::string str);
 
   // Generate a STNode object, with the target information.
   STnode generateSTNode (std::string str);
 
-  // Insert a node in the object "list".
-  void insertNodeInList (Graph *gph, STnode node);
+  // Insert a node in the graph. The ids of the nodes in a DOT file are
+  // mapped to the ids of the graph by "ids".
+  void insertNodeInList (Graph *gph, STnode node,
+                         std::map<unsigned int, unsigned int> & ids);
 
   // Create a new edge, using string str.
   std::pair<unsigned int, unsigned int> buildEdge (std::string str);
 
   // Insert an edge in a graph object.
-  void insertEdge (Graph *gph, unsigned int p1, unsigned int p2);
+  void insertEdge (Graph *gph, unsigned int p1, unsigned int p2,
+                   std::map<unsigned int, unsigned int> & ids);
 
   // Read an extern file, and use the information to built the graph.
+  // The binary scope file is used if available, otherwise the DOT file.
   bool readFile (std::string name, Function *F);
 
-  // Identify the parent for each node.
-  void identifyParents (Graph *gph);
+  // Read a scope file in the DOT format.
+  bool readDotFile (std::string name, Function *F);
 
-  // Validade if the statement is valid.
-  bool isValidLoopStatement (STnode node, int line, int column);
+  // Build the lookup tables over the graphs of module M.
+  void buildIndex (Module *M);
 
   // Associate a loop with available information, case possible.
   void associateLoop (Loop *L);
@@ -137,8 +149,8 @@ class ScopeTree : public FunctionPass {
   // Returns the loops present in a region R.
   void associateLoopstoRegion (std::map<Loop*, STnode> & Loops, Region *R);
 
-  // Find a graph for region R.
-  Graph findGraph (Region *R);
+  // Find a graph for region R. Returns null if there is none.
+  Graph *findGraph (Region *R);
 
   public:
 
@@ -165,6 +177,10 @@ class ScopeTree : public FunctionPass {
   // of the loops in this region (in essence, if is a unique region or not.)
   bool isSafetlyRegionLoops (Region *R);
 
+  // Uses loop's debug information to find the first and the last line of the
+  // statement of loop L. Return false if the loop is not in the scope tree.
+  bool getLoopLines (Loop *L, unsigned int &start, unsigned int &end);
+
   virtual bool runOnFunction(Function &F) override;
 
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
@@ -0,0 +1,121 @@
+//===------------------------ ScopeTreeFile.cpp ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Storage of the scope tree of a source file. See ScopeTreeFile.h for the
+// layout of the binary files.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstring>
+
+#include "ScopeTreeFile.h"
+
+using namespace llvm;
+
+std::unique_ptr<ScopeTreeFile> ScopeTreeFile::readBinary(StringRef Path) {
+  // Large files are mapped instead of copied.
+  auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return nullptr;
+
+  const char *Start = (*Buffer)->getBufferStart();
+  uint64_t Size = (*Buffer)->getBufferSize();
+  if (Size < sizeof(ScopeFileHeader))
+    return nullptr;
+
+  const ScopeFileHeader *Header =
+    reinterpret_cast<const ScopeFileHeader *>(Start);
+  if (memcmp(Header->Magic, "DSTB", 4) || Header->Version != ScopeFileVersion)
+    return nullptr;
+
+  uint64_t NodesSize = uint64_t(Header->NumNodes) * sizeof(ScopeFileNode);
+  if (Size != sizeof(ScopeFileHeader) + NodesSize + Header->StringTableSize)
+    return nullptr;
+
+  std::unique_ptr<ScopeTreeFile> File(new ScopeTreeFile());
+  File->Nodes = reinterpret_cast<const ScopeFileNode *>(
+    Start + sizeof(ScopeFileHeader));
+  File->NumNodes = Header->NumNodes;
+  File->Strings = Start + sizeof(ScopeFileHeader) + NodesSize;
+  File->StringsSize = Header->StringTableSize;
+  File->Buffer = std::move(*Buffer);
+
+  if (!File->validate())
+    return nullptr;
+  return File;
+}
+
+bool ScopeTreeFile::validate() const {
+  // Every name ends inside the table.
+  if (StringsSize == 0 || Strings[StringsSize - 1] != '\0')
+    return false;
+
+  for (uint32_t I = 0; I != NumNodes; I++) {
+    const ScopeFileNode &N = Nodes[I];
+    if (N.Parent >= NumNodes || N.Name >= StringsSize)
+      return false;
+    if (N.FirstChild != ScopeNoNode && N.FirstChild >= NumNodes)
+      return false;
+    if (N.NextSibling != ScopeNoNode && N.NextSibling >= NumNodes)
+      return false;
+  }
+  return true;
+}
+
+uint32_t ScopeTreeFile::addNode(StringRef Name, uint32_t StartLine,
+                                uint32_t StartColumn, uint32_t EndLine,
+                                uint32_t EndColumn, uint32_t Flags) {
+  uint32_t Id = OwnedNodes.size();
+  ScopeFileNode N;
+  N.Parent = Id;
+  N.FirstChild = ScopeNoNode;
+  N.NextSibling = ScopeNoNode;
+  N.StartLine = StartLine;
+  N.StartColumn = StartColumn;
+  N.EndLine = EndLine;
+  N.EndColumn = EndColumn;
+  N.Name = OwnedStrings.size();
+  N.Flags = Flags;
+
+  OwnedStrings.insert(OwnedStrings.end(), Name.begin(), Name.end());
+  OwnedStrings.push_back('\0');
+  OwnedNodes.push_back(N);
+  LastChild.push_back(ScopeNoNode);
+
+  Nodes = OwnedNodes.data();
+  NumNodes = OwnedNodes.size();
+  Strings = OwnedStrings.data();
+  StringsSize = OwnedStrings.size();
+  return Id;
+}
+
+void ScopeTreeFile::addEdge(uint32_t Parent, uint32_t Child) {
+  // Keep only the first parent of a node, like a breadth-first search from
+  // the root would.
+  if ((Parent >= NumNodes) || (Child >= NumNodes) ||
+      (OwnedNodes[Child].Parent != Child))
+    return;
+
+  OwnedNodes[Child].Parent = Parent;
+  if (LastChild[Parent] == ScopeNoNode)
+    OwnedNodes[Parent].FirstChild = Child;
+  else
+    OwnedNodes[LastChild[Parent]].NextSibling = Child;
+  LastChild[Parent] = Child;
+}
+
+uint32_t ScopeTreeFile::getRoot() const {
+  for (uint32_t I = 0; I != NumNodes; I++)
+    if (hasFlag(I, SN_TopLevel))
+      return I;
+  return 0;
+}
+
+//===------------------------ ScopeTreeFile.cpp ---------------------------===//
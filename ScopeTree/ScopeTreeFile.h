@@ -0,0 +1,126 @@
+//===------------------------- ScopeTreeFile.h ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Storage of the scope tree of a source file, as emitted by scope-finder.
+//
+// scope-finder writes the tree of "<file>" to "<file>_scope.bin", a binary
+// file that is mapped in memory and used without any parsing. All integers are
+// 32 bits, little endian:
+//
+//   Header: "DSTB" Version NumNodes StringTableSize
+//   Nodes:  NumNodes fixed size records (ScopeFileNode).
+//   Names:  StringTableSize bytes of null terminated strings.
+//
+// Nodes are identified by their index. The parent of the root node (the
+// source file itself) is the root. Children are linked through FirstChild and
+// NextSibling, in source order.
+//
+// The Graphviz file "<file>_scope.dot" of older versions of scope-finder is
+// still supported: ScopeTree parses it and builds the same records in memory
+// with addNode and addEdge.
+//
+// The layout is duplicated in scope-finder.cpp, which is built as part of the
+// Clang tree. Both must be changed together, bumping the version.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SCOPE_TREE_FILE_H
+#define SCOPE_TREE_FILE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+// Flags of a scope node.
+enum ScopeNodeFlags {
+  SN_TopLevel = 1 << 0, // The source file.
+  SN_Loop     = 1 << 1, // A for, while or do-while statement.
+  SN_Function = 1 << 2  // A function definition.
+};
+
+// Index used for missing children and siblings.
+const uint32_t ScopeNoNode = ~0U;
+
+const uint32_t ScopeFileVersion = 1;
+
+struct ScopeFileHeader {
+  char Magic[4];
+  support::ulittle32_t Version;
+  support::ulittle32_t NumNodes;
+  support::ulittle32_t StringTableSize;
+};
+
+struct ScopeFileNode {
+  support::ulittle32_t Parent;
+  support::ulittle32_t FirstChild;
+  support::ulittle32_t NextSibling;
+  support::ulittle32_t StartLine;
+  support::ulittle32_t StartColumn;
+  support::ulittle32_t EndLine;
+  support::ulittle32_t EndColumn;
+  // Offset of the name in the string table.
+  support::ulittle32_t Name;
+  support::ulittle32_t Flags;
+};
+
+class ScopeTreeFile {
+  // Mapped binary file, if the tree was read from one.
+  std::unique_ptr<MemoryBuffer> Buffer;
+
+  // Storage of trees built in memory.
+  std::vector<ScopeFileNode> OwnedNodes;
+  std::vector<char> OwnedStrings;
+  std::vector<uint32_t> LastChild;
+
+  const ScopeFileNode *Nodes;
+  uint32_t NumNodes;
+  const char *Strings;
+  uint32_t StringsSize;
+
+  // Checks that every index and name in the mapped file is in range.
+  bool validate() const;
+
+public:
+  ScopeTreeFile()
+    : Nodes(nullptr), NumNodes(0), Strings(nullptr), StringsSize(0) {}
+
+  // Maps a binary scope file. Returns null if it can't be read or is
+  // malformed.
+  static std::unique_ptr<ScopeTreeFile> readBinary(StringRef Path);
+
+  // Builds a tree in memory. Nodes must be added before their edges.
+  uint32_t addNode(StringRef Name, uint32_t StartLine, uint32_t StartColumn,
+                   uint32_t EndLine, uint32_t EndColumn, uint32_t Flags);
+  void addEdge(uint32_t Parent, uint32_t Child);
+
+  uint32_t size() const { return NumNodes; }
+
+  const ScopeFileNode &getNode(uint32_t Id) const { return Nodes[Id]; }
+
+  StringRef getName(uint32_t Id) const { return Strings + Nodes[Id].Name; }
+
+  bool hasFlag(uint32_t Id, uint32_t Flag) const {
+    return Nodes[Id].Flags & Flag;
+  }
+
+  // Returns the node of the source file, or the first node if there is none.
+  uint32_t getRoot() const;
+};
+
+}
+
+#endif
+
+//===------------------------- ScopeTreeFile.h ----------------------------===//
@@ -0,0 +1,97 @@
+//===------------------------ ScopeTreeIndex.cpp --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Lookup tables over the scope trees of a module. See ScopeTreeIndex.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+
+#include "ScopeTreeIndex.h"
+
+using namespace llvm;
+
+void ScopeNesting::build(const ScopeTreeFile &Data) {
+  uint32_t N = Data.size();
+  Enter.assign(N, ScopeNoNode);
+  Exit.assign(N, ScopeNoNode);
+  Depth.assign(N, ScopeNoNode);
+  if (N == 0)
+    return;
+
+  // Iterative depth-first search. Each entry holds a node and the next child
+  // to visit.
+  uint32_t Counter = 0;
+  uint32_t Root = Data.getRoot();
+  std::vector<std::pair<uint32_t, uint32_t> > Stack;
+  Enter[Root] = Counter++;
+  Depth[Root] = 0;
+  Stack.push_back(std::make_pair(Root, Data.getNode(Root).FirstChild));
+
+  while (!Stack.empty()) {
+    uint32_t Id = Stack.back().first;
+    uint32_t Child = Stack.back().second;
+    if (Child == ScopeNoNode) {
+      Exit[Id] = Counter++;
+      Stack.pop_back();
+      continue;
+    }
+
+    // A node seen twice means a malformed file. Stop at the first repeated
+    // child, so a cycle can't make the search loop forever.
+    if (Enter[Child] != ScopeNoNode) {
+      Stack.back().second = ScopeNoNode;
+      continue;
+    }
+
+    Stack.back().second = Data.getNode(Child).NextSibling;
+    Enter[Child] = Counter++;
+    Depth[Child] = Depth[Id] + 1;
+    Stack.push_back(std::make_pair(Child, Data.getNode(Child).FirstChild));
+  }
+}
+
+void ScopeTreeIndex::build(ArrayRef<const ScopeTreeFile *> Graphs) {
+  Loops.clear();
+  Names.clear();
+
+  for (unsigned G = 0, GE = Graphs.size(); G != GE; ++G) {
+    const ScopeTreeFile *Data = Graphs[G];
+    for (uint32_t Id = 0, IE = Data->size(); Id != IE; ++Id) {
+      if (Data->hasFlag(Id, SN_Loop)) {
+        const ScopeFileNode &Node = Data->getNode(Id);
+        LoopEntry Entry = {(int)Node.StartLine, (int)Node.StartColumn, G, Id};
+        Loops.push_back(Entry);
+      }
+      Names.insert(std::make_pair(Data->getName(Id), std::make_pair(G, Id)));
+    }
+  }
+  std::sort(Loops.begin(), Loops.end());
+}
+
+const ScopeTreeIndex::LoopEntry *ScopeTreeIndex::findLoop(int Line,
+                                                          int Column) const {
+  LoopEntry Key = {Line, Column, 0, 0};
+  auto I = std::lower_bound(Loops.begin(), Loops.end(), Key);
+  if ((I == Loops.end()) || (I->Line != Line) || (I->Column != Column))
+    return nullptr;
+  return &*I;
+}
+
+bool ScopeTreeIndex::findName(StringRef Name, unsigned &Graph,
+                              unsigned &Id) const {
+  auto I = Names.find(Name);
+  if (I == Names.end())
+    return false;
+  Graph = I->second.first;
+  Id = I->second.second;
+  return true;
+}
+
+//===------------------------ ScopeTreeIndex.cpp --------------------------===//
@@ -0,0 +1,104 @@
+//===------------------------- ScopeTreeIndex.h ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Lookup tables over the scope trees of a module, so that loops, functions and
+// scopes are found without scanning every node:
+//
+//   ScopeNesting   -> nested intervals of the nodes of one tree, numbered in a
+//                     depth-first search from the root. Containment of two
+//                     nodes and the depth of a node are O(1).
+//   ScopeTreeIndex -> loop statements of all trees, sorted by start position
+//                     and searched in O(log n), and the first node with each
+//                     name.
+//
+// They only depend on ScopeTreeFile, so they can be built and timed out of
+// the ScopeTree pass (see benchmarks/scope-lookups.cpp).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SCOPE_TREE_INDEX_H
+#define SCOPE_TREE_INDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "ScopeTreeFile.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+class ScopeNesting {
+  // Node "a" contains node "b" if Enter[a] <= Enter[b] and Exit[b] <= Exit[a].
+  // Nodes not reachable from the root are not numbered.
+  std::vector<uint32_t> Enter;
+  std::vector<uint32_t> Exit;
+  std::vector<uint32_t> Depth;
+
+public:
+  // Number the nodes of Data.
+  void build(const ScopeTreeFile &Data);
+
+  // Return true if node Id is in the scope of node Scope.
+  bool isNestedIn(uint32_t Id, uint32_t Scope) const {
+    return (Enter[Scope] != ScopeNoNode) && (Enter[Id] != ScopeNoNode) &&
+           (Enter[Scope] <= Enter[Id]) && (Exit[Id] <= Exit[Scope]);
+  }
+
+  // Depth of node Id below the root.
+  uint32_t getDepth(uint32_t Id) const { return Depth[Id]; }
+};
+
+class ScopeTreeIndex {
+public:
+  // A loop statement, identified by the position of its tree in the list
+  // given to build, and by its id.
+  struct LoopEntry {
+    int Line;
+    int Column;
+    unsigned Graph;
+    unsigned Id;
+
+    bool operator<(const LoopEntry &E) const {
+      if (Line != E.Line)
+        return Line < E.Line;
+      if (Column != E.Column)
+        return Column < E.Column;
+      if (Graph != E.Graph)
+        return Graph < E.Graph;
+      return Id < E.Id;
+    }
+  };
+
+private:
+  // Loop statements, sorted by start position.
+  std::vector<LoopEntry> Loops;
+
+  // First <graph, id> with each name. The names point into the trees.
+  std::map<StringRef, std::pair<unsigned, unsigned> > Names;
+
+public:
+  // Index the trees of a module.
+  void build(ArrayRef<const ScopeTreeFile *> Graphs);
+
+  // Find the first loop statement, in module order, at <Line, Column>.
+  // Returns null if there is none.
+  const LoopEntry *findLoop(int Line, int Column) const;
+
+  // Find the first node named Name. Returns false if there is none.
+  bool findName(StringRef Name, unsigned &Graph, unsigned &Id) const;
+};
+
+}
+
+#endif
+
+//===------------------------- ScopeTreeIndex.h ---------------------------===//
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+#Functions shared by the benchmark scripts of this folder
+#Set DEFAULT_ROOT_DIR (folder containing DawnCC and llvm-build) before sourcing this file
+
+LLVM_PATH="${DEFAULT_ROOT_DIR}/llvm-build"
+CLANG="${LLVM_PATH}/bin/clang"
+SCOPEFIND="${LLVM_PATH}/lib/scope-finder.so"
+DAWNCC="${DEFAULT_ROOT_DIR}/DawnCC/lib/Driver/dawncc"
+TIME="/usr/bin/time"
+
+#Copy the source file $1 into the folder $2 and write its scope tree and IR (result.bc)
+#dawncc writes the annotations into the copy, so each run needs a folder of its own
+prepare_input() {
+    local src="$1"
+    local dir="$2"
+    local f=`basename "${src}"`
+
+    rm -rf "${dir}"
+    mkdir -p "${dir}"
+    cp "${src}" "${dir}/${f}"
+
+    cd "${dir}"
+    $CLANG -Xclang -load -Xclang $SCOPEFIND -Xclang -add-plugin -Xclang -find-scope -g -O0 -c -fsyntax-only ${f}
+    $CLANG -g -S -emit-llvm ${f} -o result.bc
+    cd - > /dev/null
+}
+
+#Run the dawncc binary $1 on the input prepared in the folder $2, passing the remaining arguments
+#Prints the elapsed seconds and the peak resident set size in KB
+measure() {
+    local bin="$1"
+    local dir="$2"
+    shift 2
+
+    cd "${dir}"
+    $TIME -f "%e %M" -o time.txt "${bin}" "$@" -Stage-Times=false -Run-Mode=false result.bc > dawncc.log 2>&1
+    cat time.txt
+    cd - > /dev/null
+}
@@ -0,0 +1,80 @@
+// Sample input of the benchmark scripts: small kernels with the loop nests
+// and array accesses DawnCC usually finds.
+
+void gemm(int n, float alpha, float beta, float *A, float *B, float *C) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      C[i * n + j] *= beta;
+      for (int k = 0; k < n; k++)
+        C[i * n + j] += alpha * A[i * n + k] * B[k * n + j];
+    }
+}
+
+void mm2(int n, float *A, float *B, float *C, float *D, float *T) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      T[i * n + j] = 0;
+      for (int k = 0; k < n; k++)
+        T[i * n + j] += A[i * n + k] * B[k * n + j];
+    }
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      D[i * n + j] = 0;
+      for (int k = 0; k < n; k++)
+        D[i * n + j] += T[i * n + k] * C[k * n + j];
+    }
+}
+
+void jacobi(int steps, int n, float *A, float *B) {
+  for (int t = 0; t < steps; t++) {
+    for (int i = 1; i < n - 1; i++)
+      B[i] = (A[i - 1] + A[i] + A[i + 1]) / 3;
+    for (int i = 1; i < n - 1; i++)
+      A[i] = (B[i - 1] + B[i] + B[i + 1]) / 3;
+  }
+}
+
+void stencil(int n, int m, float *in, float *out) {
+  for (int i = 1; i < n - 1; i++)
+    for (int j = 1; j < m - 1; j++)
+      out[i * m + j] = 0.2f * (in[i * m + j] + in[(i - 1) * m + j] +
+                               in[(i + 1) * m + j] + in[i * m + j - 1] +
+                               in[i * m + j + 1]);
+}
+
+void conv(int n, int k, float *in, float *w, float *out) {
+  for (int i = 0; i < n - k; i++) {
+    float s = 0;
+    for (int j = 0; j < k; j++)
+      s += in[i + j] * w[j];
+    out[i] = s;
+  }
+}
+
+void transpose(int n, int m, double *a, double *b) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < m; j++)
+      b[j * n + i] = a[i * m + j];
+}
+
+void shrink(int n, char *src, char *dst) {
+  for (int i = 0; i < n / 2; i++)
+    dst[i] = (char)((src[2 * i] + src[2 * i + 1]) / 2);
+}
+
+void histogram(int n, int bins, int *data, int *hist) {
+  for (int i = 0; i < bins; i++)
+    hist[i] = 0;
+  for (int i = 0; i < n; i++)
+    hist[data[i] % bins]++;
+}
+
+void scale(int n, long off, float *v, float *r) {
+  for (long i = off; i < off + n; i++)
+    r[i - off] = v[i] * 2;
+}
+
+void truncated(long n, float *a, float *b) {
+  for (long i = 0; i < n; i++)
+    b[(int)i] = a[(int)i] + 1;
+}
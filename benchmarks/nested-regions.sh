@@ -0,0 +1,147 @@
+#!/bin/bash
+
+#Micro-benchmark of the name recovery (RecoverNames) on deeply nested regions
+#It writes a C function with loops nested -depth levels deep, each level accessing -vars arrays of its own
+#and the arrays of the level above it, and reports the best time of two builds of dawncc over -r runs
+#With -check 1, each build runs once on that function and on the files of -src, and the script exits with 1
+#if the annotated files differ, e.g. if the names written in the pragmas changed
+#./benchmarks/nested-regions.sh -d (DawnCC root dir) -old (dawncc before a change) -new (dawncc after it) \
+#   -depth (levels, default 12) -vars (arrays per level, default 8) -r (runs, default 5) \
+#   -check (1 to only compare the annotated files, default 0) -src (folders with *.c files, default ArrayInference/tests)
+
+SCRIPT_DIR=`cd $(dirname $0) && pwd`
+DEFAULT_ROOT_DIR=`pwd`
+OLD_BIN=""
+NEW_BIN=""
+DEPTH=12
+VARS=8
+RUNS=5
+CHECK=0
+FILES_FOLDER="${SCRIPT_DIR}/../ArrayInference/tests"
+DAWNCC_ARGS="-Emit-OMP=1 -Restrictifier=true -Memory-Coalescing=true"
+WORK_DIR="/tmp/dawncc-nested-regions"
+
+while [ $# -gt 1 ]
+do
+    key="$1"
+
+    case $key in
+        -d|--DawnCCRoot)
+            DEFAULT_ROOT_DIR="$2"
+            shift
+        ;;
+        -old)
+            OLD_BIN="$2"
+            shift
+        ;;
+        -new)
+            NEW_BIN="$2"
+            shift
+        ;;
+        -depth)
+            DEPTH="$2"
+            shift
+        ;;
+        -vars)
+            VARS="$2"
+            shift
+        ;;
+        -r|--Runs)
+            RUNS="$2"
+            shift
+        ;;
+        -check)
+            CHECK="$2"
+            shift
+        ;;
+        -src|--SourceFolder)
+            FILES_FOLDER="$2"
+            shift
+        ;;
+        -a|--Args)
+            DAWNCC_ARGS="$2"
+            shift
+        ;;
+        *)
+            # unknown option
+        ;;
+    esac
+    shift
+done
+
+source "${SCRIPT_DIR}/common.sh"
+
+if [ -z "${NEW_BIN}" ]; then
+    NEW_BIN="${DAWNCC}"
+fi
+
+#Write the input: level l declares the arrays a<l>_<v> and loops over i<l>
+mkdir -p "${WORK_DIR}"
+INPUT="${WORK_DIR}/nested.c"
+{
+    echo "void nested(int n) {"
+    for l in $(seq 1 ${DEPTH}); do
+        for v in $(seq 1 ${VARS}); do
+            echo "  float a${l}_${v}[64];"
+        done
+        echo "  for (int i${l} = 0; i${l} < n; i${l}++) {"
+        for v in $(seq 1 ${VARS}); do
+            echo "    a${l}_${v}[i${l}] = a$(( l > 1 ? l - 1 : 1 ))_${v}[i${l}] + ${v};"
+        done
+    done
+    for l in $(seq 1 ${DEPTH}); do
+        echo "  }"
+    done
+    echo "}"
+} > "${INPUT}"
+
+#Best elapsed time of dawncc ($1) over the runs
+best_time() {
+    local bin=`realpath "$1"`
+    local best=""
+    for r in $(seq 1 ${RUNS}); do
+        prepare_input "${INPUT}" "${WORK_DIR}/run"
+        local t=`measure "${bin}" "${WORK_DIR}/run" ${DAWNCC_ARGS} | cut -d' ' -f1`
+        if [ -z "${best}" ] || [ `awk "BEGIN { print (${t} < ${best}) }"` == "1" ]; then
+            best=${t}
+        fi
+    done
+    echo ${best}
+}
+
+#Compare the files annotated by the two builds
+if [ "${CHECK}" == "1" ]; then
+    if [ -z "${OLD_BIN}" ]; then
+        echo "ERROR : -check 1 needs -old."
+        exit 1
+    fi
+    OLD_BIN=`realpath "${OLD_BIN}"`
+    NEW_BIN=`realpath "${NEW_BIN}"`
+    DIFFER=0
+    for f in ${INPUT} $(find ${FILES_FOLDER} -name '*.c' -or -name '*.cpp' | sort); do
+        name=`basename ${f}`
+        prepare_input "${f}" "${WORK_DIR}/old"
+        measure "${OLD_BIN}" "${WORK_DIR}/old" ${DAWNCC_ARGS} > /dev/null
+        prepare_input "${f}" "${WORK_DIR}/new"
+        measure "${NEW_BIN}" "${WORK_DIR}/new" ${DAWNCC_ARGS} > /dev/null
+        if ! diff -q "${WORK_DIR}/old/${name}" "${WORK_DIR}/new/${name}" > /dev/null; then
+            DIFFER=1
+            echo "  ${name} differs (< old, > new):"
+            diff "${WORK_DIR}/old/${name}" "${WORK_DIR}/new/${name}" | grep '^[<>]' | sed 's/^/    /'
+        fi
+    done
+    rm -rf "${WORK_DIR}"
+    if [ "${DIFFER}" == "1" ]; then
+        echo "The two builds write different files"
+        exit 1
+    fi
+    exit 0
+fi
+
+echo "depth ${DEPTH}, ${VARS} arrays per level, best of ${RUNS} runs"
+if [ ! -z "${OLD_BIN}" ]; then
+    echo "old: `best_time ${OLD_BIN}` s"
+fi
+echo "new: `best_time ${NEW_BIN}` s"
+
+rm -rf "${WORK_DIR}"
@@ -0,0 +1,80 @@
+#!/bin/bash
+
+#Compare the peak memory (maximum resident set size) of two builds of dawncc on the same inputs
+#./benchmarks/peak-rss.sh -d (DawnCC root dir) -old (dawncc before the change) -new (dawncc after the change) \
+#   -src (folder with *.c files, default benchmarks/inputs) -a (extra dawncc flags)
+#e.g., build dawncc before and after a change and run
+#./benchmarks/peak-rss.sh -old old/dawncc -new lib/Driver/dawncc -a "-Emit-OMP=1 -Restrictifier=true -Memory-Coalescing=true"
+
+SCRIPT_DIR=`cd $(dirname $0) && pwd`
+DEFAULT_ROOT_DIR=`pwd`
+FILES_FOLDER="${SCRIPT_DIR}/inputs"
+OLD_BIN=""
+NEW_BIN=""
+DAWNCC_ARGS="-Emit-OMP=1 -Restrictifier=true -Memory-Coalescing=true"
+WORK_DIR="/tmp/dawncc-peak-rss"
+
+while [ $# -gt 1 ]
+do
+    key="$1"
+
+    case $key in
+        -d|--DawnCCRoot)
+            DEFAULT_ROOT_DIR="$2"
+            shift
+        ;;
+        -old)
+            OLD_BIN="$2"
+            shift
+        ;;
+        -new)
+            NEW_BIN="$2"
+            shift
+        ;;
+        -src|--SourceFolder)
+            FILES_FOLDER="$2"
+            shift
+        ;;
+        -a|--Args)
+            DAWNCC_ARGS="$2"
+            shift
+        ;;
+        *)
+            # unknown option
+        ;;
+    esac
+    shift
+done
+
+source "${SCRIPT_DIR}/common.sh"
+
+if [ -z "${OLD_BIN}" ]; then
+    echo "ERROR : -old is empty. Give the dawncc built before the change."
+    exit 1
+fi
+
+if [ -z "${NEW_BIN}" ]; then
+    NEW_BIN="${DAWNCC}"
+fi
+
+OLD_BIN=`realpath "${OLD_BIN}"`
+NEW_BIN=`realpath "${NEW_BIN}"`
+
+printf "%-30s %12s %12s %8s\n" "file" "old (KB)" "new (KB)" "change"
+for f in $(find ${FILES_FOLDER} -name '*.c' -or -name '*.cpp' | sort); do
+    prepare_input "${f}" "${WORK_DIR}/old"
+    prepare_input "${f}" "${WORK_DIR}/new"
+
+    OLD_KB=`measure "${OLD_BIN}" "${WORK_DIR}/old" ${DAWNCC_ARGS} | cut -d' ' -f2`
+    NEW_KB=`measure "${NEW_BIN}" "${WORK_DIR}/new" ${DAWNCC_ARGS} | cut -d' ' -f2`
+
+    #Both builds must write the same annotations
+    if ! cmp -s "${WORK_DIR}/old/`basename ${f}`" "${WORK_DIR}/new/`basename ${f}`"; then
+        echo "NOTE : the annotations of ${f} differ, e.g. in the order of the pointers"
+    fi
+
+    printf "%-30s %12s %12s %7s%%\n" `basename ${f}` ${OLD_KB} ${NEW_KB} \
+        `awk "BEGIN { printf \"%.1f\", (${NEW_KB} - ${OLD_KB}) * 100 / ${OLD_KB} }"`
+done
+
+rm -rf "${WORK_DIR}"
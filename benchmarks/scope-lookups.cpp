@@ -0,0 +1,246 @@
+//===-------------------------- scope-lookups.cpp -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the Universidade Federal de Minas Gerais -
+// UFMG Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Micro-benchmark of the scope tree lookups of ScopeTree. It builds, in
+// memory, the scope tree of a file with -funcs functions of -loops nests of
+// two loops each (about 100k scopes by default), and times only the lookups
+// that ScopeTree does for each loop and region:
+//
+//   loop     -> the loop statement at a <line, column> (associateLoop).
+//   function -> the node of a function, by name (associateFunction and
+//               findGraph).
+//   level    -> the depth of a loop below the node of its function
+//               (isSafetlyRegionLoops).
+//
+// "old" are the scans that ScopeTree did before ScopeTreeIndex, reproduced
+// here; "new" are the lookups of ScopeTreeIndex and ScopeNesting.
+//
+// Example:
+//
+// scope-lookups -funcs=1000 -loops=25 -queries=2000
+//
+//===----------------------------------------------------------------------===//
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "../ScopeTree/ScopeTreeFile.h"
+#include "../ScopeTree/ScopeTreeIndex.h"
+
+#include <chrono>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> ClFuncs("funcs",
+cl::desc("Number of functions (default 1000)."), cl::init(1000));
+
+static cl::opt<unsigned> ClLoops("loops",
+cl::desc("Number of loop nests per function (default 25)."), cl::init(25));
+
+static cl::opt<unsigned> ClQueries("queries",
+cl::desc("Number of lookups of each kind (default 2000)."), cl::init(2000));
+
+static cl::opt<unsigned> ClRuns("r",
+cl::desc("Number of runs, the best one is reported (default 5)."),
+cl::init(5));
+
+typedef std::chrono::steady_clock Clock;
+
+// A loop to look up: its position, and the name of its function.
+struct Query {
+  int Line;
+  int Column;
+  std::string Function;
+};
+
+// Build the tree of the file. Each function "f<i>" holds, in its body, the
+// nests "for { for { } }" of -loops.
+static void buildTree(ScopeTreeFile &Data, std::vector<Query> &Queries) {
+  uint32_t Root = Data.addNode("scopes.c", 0, 0, 0, 0, SN_TopLevel);
+  unsigned Line = 1;
+  for (unsigned F = 0; F != ClFuncs; ++F) {
+    std::string Name = "f" + std::to_string(F);
+    unsigned End = Line + 4 * ClLoops + 1;
+    uint32_t Func = Data.addNode(Name, Line, 1, End, 1, SN_Function);
+    uint32_t Body = Data.addNode("CompoundStmt", Line, 40, End, 1, 0);
+    Data.addEdge(Root, Func);
+    Data.addEdge(Func, Body);
+    for (unsigned L = 0; L != ClLoops; ++L) {
+      unsigned Start = Line + 1 + 4 * L;
+      uint32_t Outer = Data.addNode("ForStmt", Start, 3, Start + 3, 3,
+                                    SN_Loop);
+      uint32_t OuterBody = Data.addNode("CompoundStmt", Start, 35, Start + 3,
+                                        3, 0);
+      uint32_t Inner = Data.addNode("ForStmt", Start + 1, 5, Start + 2, 5,
+                                    SN_Loop);
+      uint32_t InnerBody = Data.addNode("CompoundStmt", Start + 1, 37,
+                                        Start + 2, 5, 0);
+      Data.addEdge(Body, Outer);
+      Data.addEdge(Outer, OuterBody);
+      Data.addEdge(OuterBody, Inner);
+      Data.addEdge(Inner, InnerBody);
+      Queries.push_back(Query{(int)Start, 3, Name});
+      Queries.push_back(Query{(int)Start + 1, 5, Name});
+    }
+    Line = End + 1;
+  }
+}
+
+// Lookups before ScopeTreeIndex: scans of every node of the tree, and a
+// breadth-first search from the function for the levels.
+static uint32_t oldFindLoop(const ScopeTreeFile &Data, int Line, int Column) {
+  for (uint32_t Id = 0, IE = Data.size(); Id != IE; ++Id) {
+    const ScopeFileNode &Node = Data.getNode(Id);
+    if (Data.hasFlag(Id, SN_Loop) && ((int)Node.StartLine == Line) &&
+        ((int)Node.StartColumn == Column))
+      return Id;
+  }
+  return ScopeNoNode;
+}
+
+static uint32_t oldFindName(const ScopeTreeFile &Data, StringRef Name) {
+  for (uint32_t Id = 0, IE = Data.size(); Id != IE; ++Id)
+    if (Data.getName(Id) == Name)
+      return Id;
+  return ScopeNoNode;
+}
+
+static uint32_t oldLevel(const ScopeTreeFile &Data, uint32_t Func,
+                         uint32_t Id) {
+  std::queue<uint32_t> ToIterate;
+  ToIterate.push(Func);
+  std::vector<uint32_t> NodeLevel(Data.size(), ScopeNoNode);
+  NodeLevel[Func] = 0;
+  while (!ToIterate.empty()) {
+    uint32_t N = ToIterate.front();
+    ToIterate.pop();
+    for (uint32_t I = Data.getNode(N).FirstChild; I != ScopeNoNode;
+         I = Data.getNode(I).NextSibling) {
+      if ((NodeLevel[I] == ScopeNoNode) || (NodeLevel[I] > NodeLevel[N] + 1)) {
+        NodeLevel[I] = NodeLevel[N] + 1;
+        ToIterate.push(I);
+      }
+    }
+  }
+  return NodeLevel[Id];
+}
+
+static uint32_t newLevel(const ScopeNesting &Nesting, uint32_t Func,
+                         uint32_t Id) {
+  if (!Nesting.isNestedIn(Id, Func))
+    return ScopeNoNode;
+  return Nesting.getDepth(Id) - Nesting.getDepth(Func);
+}
+
+// Best time of Run over the runs, in microseconds per lookup. The results are
+// added to Check, so that the old and new lookups can be compared.
+template <typename Fn>
+static double timeLookups(Fn Run, uint64_t &Check) {
+  double Best = 0;
+  for (unsigned R = 0; R != ClRuns; ++R) {
+    uint64_t Sum = 0;
+    Clock::time_point Start = Clock::now();
+    Run(Sum);
+    double Time =
+        std::chrono::duration<double>(Clock::now() - Start).count();
+    if ((R == 0) || (Time < Best))
+      Best = Time;
+    Check = Sum;
+  }
+  return Best * 1e6 / ClQueries;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "DawnCC scope tree lookups\n");
+
+  ScopeTreeFile Data;
+  std::vector<Query> Loops;
+  buildTree(Data, Loops);
+
+  Clock::time_point Start = Clock::now();
+  ScopeNesting Nesting;
+  Nesting.build(Data);
+  ScopeTreeIndex Index;
+  const ScopeTreeFile *Graphs[] = { &Data };
+  Index.build(Graphs);
+  double Build = std::chrono::duration<double>(Clock::now() - Start).count();
+
+  // The same random loops for every kind of lookup.
+  std::mt19937 Random(42);
+  std::vector<Query> Queries;
+  for (unsigned Q = 0; Q != ClQueries; ++Q)
+    Queries.push_back(Loops[Random() % Loops.size()]);
+
+  outs() << Data.size() << " scopes, " << Loops.size() << " loops, "
+         << ClQueries << " lookups of each kind, best of " << ClRuns
+         << " runs\n";
+  outs() << "index built in " << format("%.2f", Build * 1e3) << " ms\n";
+
+  bool Same = true;
+  auto report = [&](const char *Kind, double Old, double New,
+                    uint64_t OldCheck, uint64_t NewCheck) {
+    Same &= (OldCheck == NewCheck);
+    outs() << format("%-9s old %10.3f us  new %8.3f us  speedup %8.1fx\n",
+                     Kind, Old, New, Old / New);
+  };
+
+  uint64_t OldCheck = 0, NewCheck = 0;
+  double Old = timeLookups([&](uint64_t &Sum) {
+    for (const Query &Q : Queries)
+      Sum += oldFindLoop(Data, Q.Line, Q.Column);
+  }, OldCheck);
+  double New = timeLookups([&](uint64_t &Sum) {
+    for (const Query &Q : Queries)
+      Sum += Index.findLoop(Q.Line, Q.Column)->Id;
+  }, NewCheck);
+  report("loop", Old, New, OldCheck, NewCheck);
+
+  Old = timeLookups([&](uint64_t &Sum) {
+    for (const Query &Q : Queries)
+      Sum += oldFindName(Data, Q.Function);
+  }, OldCheck);
+  New = timeLookups([&](uint64_t &Sum) {
+    unsigned Graph, Id;
+    for (const Query &Q : Queries)
+      if (Index.findName(Q.Function, Graph, Id))
+        Sum += Id;
+  }, NewCheck);
+  report("function", Old, New, OldCheck, NewCheck);
+
+  // The nodes of the loops and functions are known, as after associateLoop
+  // and associateFunction.
+  std::vector<std::pair<uint32_t, uint32_t> > Nodes;
+  for (const Query &Q : Queries) {
+    unsigned Graph, Func;
+    Index.findName(Q.Function, Graph, Func);
+    Nodes.push_back(
+        std::make_pair(Func, Index.findLoop(Q.Line, Q.Column)->Id));
+  }
+  Old = timeLookups([&](uint64_t &Sum) {
+    for (auto &N : Nodes)
+      Sum += oldLevel(Data, N.first, N.second);
+  }, OldCheck);
+  New = timeLookups([&](uint64_t &Sum) {
+    for (auto &N : Nodes)
+      Sum += newLevel(Nesting, N.first, N.second);
+  }, NewCheck);
+  report("level", Old, New, OldCheck, NewCheck);
+
+  if (!Same) {
+    errs() << "The old and new lookups found different nodes\n";
+    return 1;
+  }
+  return 0;
+}
+
+//===-------------------------- scope-lookups.cpp -------------------------===//
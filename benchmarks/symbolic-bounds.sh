@@ -0,0 +1,102 @@
+#!/bin/bash
+
+#Compare the two ways dawncc writes the bounds of pointers: from the instructions it inserts in the module
+#(-Symbolic-Bounds=false) and straight from the scalar evolution expressions (-Symbolic-Bounds=true)
+#For each input, it reports the best time of each mode over -r runs and prints the annotations that differ
+#With -check 1, each mode runs once and the script exits with 1 if the bounds of any input differ
+#./benchmarks/symbolic-bounds.sh -d (DawnCC root dir) -dawncc (dawncc binary, default DawnCC/lib/Driver/dawncc) \
+#   -src (folders with *.c files, default benchmarks/inputs and ArrayInference/tests) -r (runs, default 5) -a (extra dawncc flags) \
+#   -check (1 to only check the bounds, default 0)
+
+SCRIPT_DIR=`cd $(dirname $0) && pwd`
+DEFAULT_ROOT_DIR=`pwd`
+FILES_FOLDER="${SCRIPT_DIR}/inputs ${SCRIPT_DIR}/../ArrayInference/tests"
+BIN=""
+RUNS=5
+CHECK=0
+DAWNCC_ARGS="-Emit-OMP=1 -Restrictifier=true -Memory-Coalescing=true"
+WORK_DIR="/tmp/dawncc-symbolic-bounds"
+
+while [ $# -gt 1 ]
+do
+    key="$1"
+
+    case $key in
+        -d|--DawnCCRoot)
+            DEFAULT_ROOT_DIR="$2"
+            shift
+        ;;
+        -dawncc)
+            BIN="$2"
+            shift
+        ;;
+        -src|--SourceFolder)
+            FILES_FOLDER="$2"
+            shift
+        ;;
+        -r|--Runs)
+            RUNS="$2"
+            shift
+        ;;
+        -check)
+            CHECK="$2"
+            shift
+        ;;
+        -a|--Args)
+            DAWNCC_ARGS="$2"
+            shift
+        ;;
+        *)
+            # unknown option
+        ;;
+    esac
+    shift
+done
+
+source "${SCRIPT_DIR}/common.sh"
+
+if [ -z "${BIN}" ]; then
+    BIN="${DAWNCC}"
+fi
+BIN=`realpath "${BIN}"`
+
+if [ "${CHECK}" == "1" ]; then
+    RUNS=1
+fi
+DIFFER=0
+
+#Best elapsed time of dawncc on the file $1 with -Symbolic-Bounds=$2
+#The annotated file of the last run is left in ${WORK_DIR}/$2
+best_time() {
+    local best=""
+    for r in $(seq 1 ${RUNS}); do
+        prepare_input "$1" "${WORK_DIR}/$2"
+        local t=`measure "${BIN}" "${WORK_DIR}/$2" ${DAWNCC_ARGS} -Symbolic-Bounds=$2 | cut -d' ' -f1`
+        if [ -z "${best}" ] || [ `awk "BEGIN { print (${t} < ${best}) }"` == "1" ]; then
+            best=${t}
+        fi
+    done
+    echo ${best}
+}
+
+printf "%-30s %14s %14s\n" "file" "insts (s)" "symbolic (s)"
+for f in $(find ${FILES_FOLDER} -name '*.c' -or -name '*.cpp' | sort); do
+    name=`basename ${f}`
+    INSTS=`best_time "${f}" false`
+    SYMBOLIC=`best_time "${f}" true`
+    printf "%-30s %14s %14s\n" ${name} ${INSTS} ${SYMBOLIC}
+
+    #The bounds are in the pragmas, so the annotated files are compared line by line
+    if ! diff -q "${WORK_DIR}/false/${name}" "${WORK_DIR}/true/${name}" > /dev/null; then
+        DIFFER=1
+        echo "  bounds of ${name} differ (< instructions, > symbolic):"
+        diff "${WORK_DIR}/false/${name}" "${WORK_DIR}/true/${name}" | grep '^[<>]' | sed 's/^/    /'
+    fi
+done
+
+rm -rf "${WORK_DIR}"
+
+if [ "${CHECK}" == "1" ] && [ "${DIFFER}" == "1" ]; then
+    echo "The two modes write different bounds"
+    exit 1
+fi
@@ -15,6 +15,7 @@ POINTER_DESAMBIGUATION_BOOL="true"
 MEMORY_COALESCING_BOOL="true"
 MINIMIZE_ALIASING_BOOL="true"
 CODE_CHANGE_BOOL="true"
+PRIVATE_VARIABLES_BOOL="false"
 FILES_FOLDER=""
 FILE=""
 
@@ -56,6 +57,10 @@ do
             CODE_CHANGE_BOOL="$2" #true - allow modification to program regions; false - only modify what allowed in LLVM IR
             shift # past argument
         ;;
+        -pv|--PrivateVariables)
+            PRIVATE_VARIABLES_BOOL="$2" #true - find private variables with the private-detector plugin; false - don't
+            shift # past argument
+        ;;
         -src|--SourceFolder)
             FILES_FOLDER="$2" # path to be scanned and have files processed
             shift
@@ -82,6 +87,7 @@ export CLANG="${LLVM_PATH}/bin/clang"
 export CLANGFORM="${LLVM_PATH}/bin/clang-format"
 export OPT="${LLVM_PATH}/bin/opt"
 export SCOPEFIND="${LLVM_PATH}/lib/scope-finder.so"
+export PRIVDET="${DEFAULT_ROOT_DIR}/libPrivate/privatedetector/libCLANGPrivateDetector.so"
 
 #Export path to DawnCC libraries
 export BUILD="${DEFAULT_ROOT_DIR}/DawnCC/lib"
@@ -103,8 +109,10 @@ export FLAGSAI="-mem2reg -instnamer -loop-rotate"
 TEMP_FILE1="result.bc"
 TEMP_FILE2="result2.bc"
 TEMP_FILE3="result3.bc"
-LOG_FILE="out_pl.log"
+LOOPS_FILE="parallel_loops.bin"
 SCOPE_FILE_SUFFIX="_scope.dot"
+SCOPE_BIN_FILE_SUFFIX="_scope.bin"
+PRIVATE_FILE_SUFFIX="_private.txt"
 
 if [ ! -z $FILES_FOLDER ]; then
 
@@ -116,12 +124,21 @@ for f in $(find . -name '*.c' -or -name '*.cpp'); do
 
     $CLANG -Xclang -load -Xclang $SCOPEFIND -Xclang -add-plugin -Xclang -find-scope -g -O0 -c -fsyntax-only ${f}
 
+    #Find the private variables of each loop, if asked and the plugin was built
+    PRIVATE_FLAGS=""
+    if [ "${PRIVATE_VARIABLES_BOOL}" == "true" ] && [ -f "${PRIVDET}" ]; then
+        $CLANG -Xclang -load -Xclang $PRIVDET -Xclang -add-plugin -Xclang -private-detector -g -O0 -c -fsyntax-only ${f}
+        PRIVATE_FLAGS="-private-file=${f}${PRIVATE_FILE_SUFFIX}"
+    fi
+
     $CLANG -g -S -emit-llvm ${f} -o ${TEMP_FILE1} 
 
     $OPT -load $PRA -load $AI -load $DPLA -load $CP $FLAGS -ptr-ra -basicaa \
-     -scoped-noalias -alias-instrumentation -region-alias-checks -can-parallelize -S ${TEMP_FILE1}
+     -scoped-noalias -alias-instrumentation -region-alias-checks -can-parallelize \
+     ${PRIVATE_FLAGS} -parallel-loops-out=${LOOPS_FILE} -S ${TEMP_FILE1}
 
-    $OPT -load $ST -load $WAI -annotateParallel -S ${TEMP_FILE1} -o ${TEMP_FILE2}
+    $OPT -load $ST -load $WAI -annotateParallel -parallel-loops-in=${LOOPS_FILE} \
+      -S ${TEMP_FILE1} -o ${TEMP_FILE2}
 
     $OPT -S $FLAGSAI -load $ST -load $WAI -writeInFile -stats -Emit-GPU=${GPUONLY_BOOL} \
       -Emit-Parallel=${PARALELLIZE_LOOPS_BOOL} -Emit-OMP=${PRAGMA_STANDARD_INT} -Restrictifier=${POINTER_DESAMBIGUATION_BOOL} \
@@ -137,6 +154,16 @@ for f in $(find . -name '*.c' -or -name '*.cpp'); do
         if [ -f "${f}${SCOPE_FILE_SUFFIX}" ]; then
             rm "${f}${SCOPE_FILE_SUFFIX}"
         fi
+
+        #Delete file.ext_scope.bin if exists
+        if [ -f "${f}${SCOPE_BIN_FILE_SUFFIX}" ]; then
+            rm "${f}${SCOPE_BIN_FILE_SUFFIX}"
+        fi
+
+        #Delete file.ext_private.txt if exists
+        if [ -f "${f}${PRIVATE_FILE_SUFFIX}" ]; then
+            rm "${f}${PRIVATE_FILE_SUFFIX}"
+        fi
     fi
 done
 fi
@@ -149,12 +176,21 @@ if [ ! -z $FILE ]; then
 
     $CLANG -Xclang -load -Xclang $SCOPEFIND -Xclang -add-plugin -Xclang -find-scope -g -O0 -c -fsyntax-only ${f}
 
+    #Find the private variables of each loop, if asked and the plugin was built
+    PRIVATE_FLAGS=""
+    if [ "${PRIVATE_VARIABLES_BOOL}" == "true" ] && [ -f "${PRIVDET}" ]; then
+        $CLANG -Xclang -load -Xclang $PRIVDET -Xclang -add-plugin -Xclang -private-detector -g -O0 -c -fsyntax-only ${f}
+        PRIVATE_FLAGS="-private-file=${f}${PRIVATE_FILE_SUFFIX}"
+    fi
+
     $CLANG -g -S -emit-llvm ${f} -o ${TEMP_FILE1} 
 
     $OPT -load $PRA -load $AI -load $DPLA -load $CP $FLAGS -ptr-ra -basicaa \
-     -scoped-noalias -alias-instrumentation -region-alias-checks -can-parallelize -S ${TEMP_FILE1}
+     -scoped-noalias -alias-instrumentation -region-alias-checks -can-parallelize \
+     ${PRIVATE_FLAGS} -parallel-loops-out=${LOOPS_FILE} -S ${TEMP_FILE1}
 
-    $OPT -load $ST -load $WAI -annotateParallel -S ${TEMP_FILE1} -o ${TEMP_FILE2}
+    $OPT -load $ST -load $WAI -annotateParallel -parallel-loops-in=${LOOPS_FILE} \
+      -S ${TEMP_FILE1} -o ${TEMP_FILE2}
 
     $OPT -S $FLAGSAI -load $ST -load $WAI -writeInFile -stats -Emit-GPU=${GPUONLY_BOOL} \
       -Emit-Parallel=${PARALELLIZE_LOOPS_BOOL} -Emit-OMP=${PRAGMA_STANDARD_INT} -Restrictifier=${POINTER_DESAMBIGUATION_BOOL} \
@@ -170,6 +206,16 @@ if [ ! -z $FILE ]; then
         if [ -f "${f}${SCOPE_FILE_SUFFIX}" ]; then
             rm "${f}${SCOPE_FILE_SUFFIX}"
         fi
+
+        #Delete file.ext_scope.bin if exists
+        if [ -f "${f}${SCOPE_BIN_FILE_SUFFIX}" ]; then
+            rm "${f}${SCOPE_BIN_FILE_SUFFIX}"
+        fi
+
+        #Delete file.ext_private.txt if exists
+        if [ -f "${f}${PRIVATE_FILE_SUFFIX}" ]; then
+            rm "${f}${PRIVATE_FILE_SUFFIX}"
+        fi
     fi
 fi 
 
@@ -197,9 +243,9 @@ if [ "${KEEP_INTERMEDIARY_FILES_BOOL}" == "false" ]; then
         rm ${TEMP_FILE3}
     fi
 
-    #Delete out_pl.log
-    if [ -f "${LOG_FILE}" ]; then
-        rm ${LOG_FILE}
+    #Delete parallel_loops.bin
+    if [ -f "${LOOPS_FILE}" ]; then
+        rm ${LOOPS_FILE}
     fi
 fi
 